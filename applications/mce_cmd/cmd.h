@@ -16,6 +16,8 @@
 
 #define FS_DIGITS 3 /* Number of digits in file sequencing file name */
 
+#define MAX_DECIMATE 8 /* ACQ_OPTION DIRFILE DECIMATE rules per dirfile */
+
 enum {
     ERR_MEM=-1,
     ERR_OPT=-2,
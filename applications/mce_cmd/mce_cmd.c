@@ -47,6 +47,9 @@ enum {
     SPECIAL_ACQ_CONFIG_FS,
     SPECIAL_ACQ_CONFIG_DIRFILE,
     SPECIAL_ACQ_CONFIG_DIRFILESEQ,
+    SPECIAL_ACQ_CONFIG_ARCHIVE,
+    SPECIAL_ACQ_CONFIG_SHM,
+    SPECIAL_ACQ_CONFIG_NET,
     SPECIAL_ACQ_OPTION,
     SPECIAL_ACQ_FLUSH,
     SPECIAL_ACQ_MULTI_BEGIN,
@@ -74,6 +77,13 @@ enum {
     SPECIAL_DIROPT_INCLUDE,
     SPECIAL_DIROPT_SPF,
     SPECIAL_DIROPT_VERSION,
+    SPECIAL_DIROPT_BLOCK,
+    SPECIAL_DIROPT_WORKERS,
+    SPECIAL_DIROPT_DECIMATE,
+    SPECIAL_DIROPT_EXTRACT,
+    SPECIAL_OPTION_MULTISYNC,
+    SPECIAL_SYNCOPT_DEPTH,
+    SPECIAL_SYNCOPT_POLICY,
     ENUM_SPECIAL_HIGH,
 };
 
@@ -101,15 +111,51 @@ mascmdtree_opt_t command_placeholder_opts[] = {
     { MASCMDTREE_TERMINATOR, "", 0, 0, 0, NULL},
 };
 
+mascmdtree_opt_t decimate_output_opts[] = {
+    { SEL_NO, "SAMPLE", 0, -1, MCEDATA_DECIMATE_SAMPLE, decimate_output_opts },
+    { SEL_NO, "MEAN",   0, -1, MCEDATA_DECIMATE_MEAN,   decimate_output_opts },
+    { SEL_NO, "MIN",    0, -1, MCEDATA_DECIMATE_MIN,    decimate_output_opts },
+    { SEL_NO, "MAX",    0, -1, MCEDATA_DECIMATE_MAX,    decimate_output_opts },
+    { MASCMDTREE_TERMINATOR, "", 0, 0, 0, NULL }
+};
+
+mascmdtree_opt_t decimate_factor_opts[] = {
+    { MASCMDTREE_INTEGER   , "", 0, -1, 0, decimate_output_opts },
+    { MASCMDTREE_TERMINATOR, "", 0, 0, 0, NULL},
+};
+
+mascmdtree_opt_t decimate_opts[] = {
+    { MASCMDTREE_STRING    , "", 1, -1, 0, decimate_factor_opts },
+    { MASCMDTREE_TERMINATOR, "", 0, 0, 0, NULL},
+};
+
 mascmdtree_opt_t dirfile_opt_opts[] = {
     { SEL_NO, "INCLUDE", 1, 1, SPECIAL_DIROPT_INCLUDE, string_opts },
     { SEL_NO, "SPF",     1, 1, SPECIAL_DIROPT_SPF,     integer_opts },
     { SEL_NO, "VERSION", 1, 1, SPECIAL_DIROPT_VERSION, integer_opts },
+    { SEL_NO, "BLOCK",   1, 1, SPECIAL_DIROPT_BLOCK,   integer_opts },
+    { SEL_NO, "WORKERS", 1, 1, SPECIAL_DIROPT_WORKERS, integer_opts },
+    { SEL_NO, "DECIMATE", 2, -1, SPECIAL_DIROPT_DECIMATE, decimate_opts },
+    { SEL_NO, "EXTRACT", 1, 1, SPECIAL_DIROPT_EXTRACT, integer_opts },
+    { MASCMDTREE_TERMINATOR, "", 0, 0, 0, NULL }
+};
+
+mascmdtree_opt_t sync_policy_opts[] = {
+    { SEL_NO, "BLOCK", 0, 0, MCEDATA_MULTISYNC_BLOCK, NULL },
+    { SEL_NO, "DROP",  0, 0, MCEDATA_MULTISYNC_DROP,  NULL },
+    { SEL_NO, "STOP",  0, 0, MCEDATA_MULTISYNC_STOP,  NULL },
+    { MASCMDTREE_TERMINATOR, "", 0, 0, 0, NULL }
+};
+
+mascmdtree_opt_t multisync_opt_opts[] = {
+    { SEL_NO, "DEPTH",  1, 1, SPECIAL_SYNCOPT_DEPTH,  integer_opts },
+    { SEL_NO, "POLICY", 1, 1, SPECIAL_SYNCOPT_POLICY, sync_policy_opts },
     { MASCMDTREE_TERMINATOR, "", 0, 0, 0, NULL }
 };
 
 mascmdtree_opt_t option_opts[] = {
     { SEL_NO, "DIRFILE", 2, -1, SPECIAL_OPTION_DIRFILE, dirfile_opt_opts },
+    { SEL_NO, "MULTISYNC", 2, 2, SPECIAL_OPTION_MULTISYNC, multisync_opt_opts },
     /* more acq types go here */
     { MASCMDTREE_TERMINATOR, "", 0, 0, 0, NULL },
 };
@@ -156,6 +202,10 @@ mascmdtree_opt_t root_opts[] = {
         flat_args},
     { SEL_NO, "ACQ_CONFIG_DIRFILE_FS", 3, 3, SPECIAL_ACQ_CONFIG_DIRFILESEQ,
         fs_args},
+    { SEL_NO, "ACQ_CONFIG_ARCHIVE", 2, 2, SPECIAL_ACQ_CONFIG_ARCHIVE,
+        flat_args},
+    { SEL_NO, "ACQ_CONFIG_SHM", 2, 2, SPECIAL_ACQ_CONFIG_SHM, flat_args},
+    { SEL_NO, "ACQ_CONFIG_NET", 2, 2, SPECIAL_ACQ_CONFIG_NET, flat_args},
     { SEL_NO, "ACQ_FLUSH", 0, 0, SPECIAL_ACQ_FLUSH, NULL},
     { SEL_NO, "ACQ_LINK",  0, 1, SPECIAL_ACQ_LINK, string_opts},
     { SEL_NO, "ACQ_GO"  , 1, 1, SPECIAL_ACQ     , integer_opts},
@@ -533,6 +583,20 @@ int bit_count(int k)
     return count;
 }
 
+/* Apply (and forget) the ACQ_OPTION DIRFILE DECIMATE rules. */
+int set_decimation(mcedata_storage_t *storage)
+{
+    int i, err = 0;
+    for (i=0; i<options.dirfile_n_decimate; i++)
+        if (mcedata_dirfile_decimate(storage,
+                    options.dirfile_decimate[i].fields,
+                    options.dirfile_decimate[i].factor,
+                    options.dirfile_decimate[i].outputs))
+            err = -1;
+    options.dirfile_n_decimate = 0;
+    return err;
+}
+
 int prepare_outfile(char *errmsg, int storage_option)
 {
     int error;
@@ -589,33 +653,82 @@ int prepare_outfile(char *errmsg, int storage_option)
             }
             break;
 
+        case SPECIAL_ACQ_CONFIG_ARCHIVE:
+            storage = mcedata_archive_create(options.acq_filename,
+                    options.symlink, 0);
+            if (storage == NULL) {
+                sprintf(errmsg, "Could not create archive");
+                return -1;
+            }
+            break;
+
+        case SPECIAL_ACQ_CONFIG_SHM:
+            storage = mcedata_shmring_create(options.acq_filename, 0);
+            if (storage == NULL) {
+                sprintf(errmsg, "Could not create shared memory ring");
+                return -1;
+            }
+            break;
+
+        case SPECIAL_ACQ_CONFIG_NET:
+            storage = mcedata_netserve_create(options.acq_filename, 0);
+            if (storage == NULL) {
+                sprintf(errmsg, "Could not create network server");
+                return -1;
+            }
+            break;
+
         case SPECIAL_ACQ_CONFIG_DIRFILE:
-            storage = mcedata_dirfile_create(options.acq_filename, 0,
+            storage = mcedata_dirfile_create(options.acq_filename,
+                    options.dirfile_extract ? MCEDATA_DIRFILE_EXTRACT : 0,
                     options.dirfile_include, options.dirfile_spf,
                     options.dirfile_version, options.symlink);
             if (storage == NULL) {
                 sprintf(errmsg, "Could not create dirfile");
                 return -1;
             }
+            mcedata_dirfile_set_block(storage, options.dirfile_block);
+            mcedata_dirfile_set_workers(storage, options.dirfile_workers);
+            error = set_decimation(storage);
             /* reset options */
             options.dirfile_include[0] = 0;
             options.dirfile_spf = 1;
             options.dirfile_version = -1;
+            options.dirfile_block = 0;
+            options.dirfile_workers = 0;
+            options.dirfile_extract = 0;
+            if (error) {
+                mcedata_storage_destroy(storage);
+                sprintf(errmsg, "Invalid DECIMATE option");
+                return -1;
+            }
             break;
 
         case SPECIAL_ACQ_CONFIG_DIRFILESEQ:
             storage = mcedata_dirfileseq_create(options.acq_filename,
-                    options.acq_interval, FS_DIGITS, 0,
+                    options.acq_interval, FS_DIGITS,
+                    options.dirfile_extract ? MCEDATA_DIRFILE_EXTRACT : 0,
                     options.dirfile_include, options.dirfile_spf,
                     options.dirfile_version, options.symlink);
             if (storage == NULL) {
                 sprintf(errmsg, "Could not create dirfile sequencer");
                 return -1;
             }
+            mcedata_dirfile_set_block(storage, options.dirfile_block);
+            mcedata_dirfile_set_workers(storage, options.dirfile_workers);
+            error = set_decimation(storage);
             /* reset options */
             options.dirfile_include[0] = 0;
             options.dirfile_spf = 1;
             options.dirfile_version = -1;
+            options.dirfile_block = 0;
+            options.dirfile_workers = 0;
+            options.dirfile_extract = 0;
+            if (error) {
+                mcedata_storage_destroy(storage);
+                sprintf(errmsg, "Invalid DECIMATE option");
+                return -1;
+            }
             break;
 
         default:
@@ -624,8 +737,12 @@ int prepare_outfile(char *errmsg, int storage_option)
     }
 
     if (acq_multisync) {
-        // In multisync, just add that storage to the container
-        error = mcedata_multisync_add(acq, storage);
+        // In multisync, just add that storage to the container; the
+        // ACQ_OPTION MULTISYNC settings apply to this one only.
+        error = mcedata_multisync_add_queue(acq, storage,
+                options.multisync_depth, options.multisync_policy);
+        options.multisync_depth = 0;
+        options.multisync_policy = MCEDATA_MULTISYNC_BLOCK;
         if (error != 0) {
             sprintf(errmsg, "Could not append acquisition to multisync.");
             return -1;
@@ -663,6 +780,8 @@ int data_string(char* dest, const uint32_t *buf, int count,
 }
 
 int process_dirfile_option(mascmdtree_token_t *tokens, char *errmsg) {
+    int i, n;
+
     switch (tokens[0].value) {
         case SPECIAL_DIROPT_INCLUDE:
             /* this doesn't get run through pathify_filename because it's
@@ -675,6 +794,31 @@ int process_dirfile_option(mascmdtree_token_t *tokens, char *errmsg) {
         case SPECIAL_DIROPT_VERSION:
             options.dirfile_version = tokens[1].value;
             break;
+        case SPECIAL_DIROPT_BLOCK:
+            options.dirfile_block = tokens[1].value;
+            break;
+        case SPECIAL_DIROPT_WORKERS:
+            options.dirfile_workers = tokens[1].value;
+            break;
+        case SPECIAL_DIROPT_EXTRACT:
+            options.dirfile_extract = tokens[1].value;
+            break;
+        case SPECIAL_DIROPT_DECIMATE:
+            /* DECIMATE <fields> <factor> [SAMPLE|MEAN|MIN|MAX ...] */
+            n = options.dirfile_n_decimate;
+            if (n >= MAX_DECIMATE) {
+                sprintf(errmsg, "Too many DECIMATE options (max %i)",
+                        MAX_DECIMATE);
+                return -1;
+            }
+            mascmdtree_token_word(options.dirfile_decimate[n].fields,
+                    tokens + 1);
+            options.dirfile_decimate[n].factor = tokens[2].value;
+            options.dirfile_decimate[n].outputs = 0;
+            for (i=3; i<tokens[0].n; i++)
+                options.dirfile_decimate[n].outputs |= tokens[i].value;
+            options.dirfile_n_decimate++;
+            break;
         default:
             sprintf(errmsg, "Unhandled ACQ_OPTION DIRFILE parameter: %i\n",
                     tokens[0].value);
@@ -684,10 +828,29 @@ int process_dirfile_option(mascmdtree_token_t *tokens, char *errmsg) {
     return 0;
 }
 
+int process_multisync_option(mascmdtree_token_t *tokens, char *errmsg) {
+    switch (tokens[0].value) {
+        case SPECIAL_SYNCOPT_DEPTH:
+            options.multisync_depth = tokens[1].value;
+            break;
+        case SPECIAL_SYNCOPT_POLICY:
+            options.multisync_policy = tokens[1].value;
+            break;
+        default:
+            sprintf(errmsg, "Unhandled ACQ_OPTION MULTISYNC parameter: %i\n",
+                    tokens[0].value);
+            return -1;
+    }
+
+    return 0;
+}
+
 int process_acq_option(mascmdtree_token_t *tokens, char *errmsg) {
     switch (tokens[0].value) {
         case SPECIAL_OPTION_DIRFILE:
             return process_dirfile_option(tokens + 1, errmsg);
+        case SPECIAL_OPTION_MULTISYNC:
+            return process_multisync_option(tokens + 1, errmsg);
         default:
             sprintf(errmsg, "Unhandled ACQ_OPTION class: %i\n",
                     tokens[0].value);
@@ -873,6 +1036,7 @@ int process_command(mascmdtree_opt_t *opts, mascmdtree_token_t *tokens,
                 break;
 
             case SPECIAL_ACQ_CONFIG:
+            case SPECIAL_ACQ_CONFIG_ARCHIVE:
                 /* Args: filename, card */
 
                 /* Assemble file name using any path override */
@@ -887,7 +1051,37 @@ int process_command(mascmdtree_opt_t *opts, mascmdtree_token_t *tokens,
                     break;
                 }
 
-                ret_val = prepare_outfile(errmsg, SPECIAL_ACQ_CONFIG);
+                ret_val = prepare_outfile(errmsg, tokens[0].value);
+                break;
+
+            case SPECIAL_ACQ_CONFIG_SHM:
+                /* Args: shared memory name (not a path), card */
+                mascmdtree_token_word( options.acq_filename, tokens+1 );
+
+                /* Decode card name */
+                mascmdtree_token_word( s, tokens+2 );
+                options.acq_cards = translate_card_string(s, errmsg);
+                if (options.acq_cards < 0) {
+                    ret_val = -1;
+                    break;
+                }
+
+                ret_val = prepare_outfile(errmsg, SPECIAL_ACQ_CONFIG_SHM);
+                break;
+
+            case SPECIAL_ACQ_CONFIG_NET:
+                /* Args: listening address (host:port), card */
+                mascmdtree_token_word( options.acq_filename, tokens+1 );
+
+                /* Decode card name */
+                mascmdtree_token_word( s, tokens+2 );
+                options.acq_cards = translate_card_string(s, errmsg);
+                if (options.acq_cards < 0) {
+                    ret_val = -1;
+                    break;
+                }
+
+                ret_val = prepare_outfile(errmsg, SPECIAL_ACQ_CONFIG_NET);
                 break;
 
             case SPECIAL_ACQ_CONFIG_FS:
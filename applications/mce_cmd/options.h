@@ -42,6 +42,17 @@ typedef struct {
     char dirfile_include[LINE_LEN];
     int dirfile_spf;
     int dirfile_version;
+    int dirfile_block;
+    int dirfile_workers;
+    int dirfile_extract;
+    struct {
+        char fields[LINE_LEN];
+        int factor;
+        int outputs;
+    } dirfile_decimate[MAX_DECIMATE];
+    int dirfile_n_decimate;
+    int multisync_depth;
+    int multisync_policy;
 
     maslog_t *logger;
 
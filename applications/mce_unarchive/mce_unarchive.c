@@ -0,0 +1,112 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* mce_unarchive: decompress an MCE frame archive (see
+ * mcedata_archive_create) to a flat file, as mcedata_flatfile_create
+ * would have written it. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <mce_library.h>
+
+#define CHUNK_FRAMES 1024
+
+void __attribute__((noreturn)) Usage(int ret)
+{
+    printf("Usage:\n"
+            "  mce_unarchive [ -f FIRST ] [ -n COUNT ] ARCHIVE FLATFILE\n"
+            "  mce_unarchive -i ARCHIVE\n\n"
+            "Write frames FIRST (default 0) to FIRST+COUNT-1 (default: to "
+            "the end) of\nARCHIVE to FLATFILE (\"-\" for standard output)."
+            "  With -i, just report the\nframe size, frame count and "
+            "readout geometry.\n");
+    exit(ret);
+}
+
+int main(int argc, char **argv)
+{
+    long first = 0, count = -1, done = 0;
+    mcedata_archive_t *a;
+    uint32_t *frames;
+    int frame_size;
+    int info = 0;
+    FILE *fout;
+    int option;
+
+    while ((option = getopt(argc, argv, "f:hin:")) >= 0) {
+        if (option == 'f')
+            first = atol(optarg);
+        else if (option == 'n')
+            count = atol(optarg);
+        else if (option == 'i')
+            info = 1;
+        else if (option == 'h')
+            Usage(0);
+        else
+            Usage(1);
+    }
+    if (argc - optind != (info ? 1 : 2) || first < 0)
+        Usage(1);
+
+    a = mcedata_archive_open(argv[optind]);
+    if (a == NULL) {
+        fprintf(stderr, "Could not open archive '%s'.\n", argv[optind]);
+        return 1;
+    }
+    frame_size = mcedata_archive_frame_size(a);
+
+    if (info) {
+        const mce_archive_header_t *h = mcedata_archive_header(a);
+        int i;
+        printf("frame_size %i\nframes %li\n", frame_size,
+                mcedata_archive_frame_count(a));
+        printf("cards 0x%x\nrows %u\ncols %u\n", h->cards, h->rows, h->cols);
+        for (i=0; i<MCEDATA_CARDS; i++)
+            if (h->cards & (1 << i))
+                printf("rc%i row0 %i col0 %i\n", i+1, h->row0[i],
+                        h->col0[i]);
+        mcedata_archive_close(a);
+        return 0;
+    }
+
+    if (strcmp(argv[optind+1], "-") == 0)
+        fout = stdout;
+    else
+        fout = fopen(argv[optind+1], "w");
+    frames = malloc((size_t)CHUNK_FRAMES * frame_size * sizeof(*frames));
+    if (fout == NULL || frames == NULL) {
+        perror(argv[optind+1]);
+        return 1;
+    }
+
+    while (count < 0 || done < count) {
+        long n = CHUNK_FRAMES;
+        if (count >= 0 && n > count - done)
+            n = count - done;
+        n = mcedata_archive_read(a, first + done, n, frames);
+        if (n < 0) {
+            fprintf(stderr, "Archive '%s' is damaged at frame %li.\n",
+                    argv[optind], first + done);
+            return 1;
+        }
+        if (n == 0)
+            break;
+        if (fwrite(frames, frame_size * sizeof(*frames), n, fout) != n) {
+            perror(argv[optind+1]);
+            return 1;
+        }
+        done += n;
+    }
+
+    if (fout != stdout && fclose(fout) != 0) {
+        perror(argv[optind+1]);
+        return 1;
+    }
+    free(frames);
+    mcedata_archive_close(a);
+    return 0;
+}
@@ -21,6 +21,7 @@
 #include <linux/sched.h>
 #include <linux/pci.h>
 #include <linux/delay.h>
+#include <linux/poll.h>
 
 #include "autoversion.h"
 #include "mce_options.h"
@@ -144,6 +145,9 @@ typedef struct {
     frame_buffer_t dframes;
     void* data_lock;
 
+    // Page shared read-only with user-space (see struct dsp_ctrl_page)
+    struct dsp_ctrl_page *ctrl;
+
     int reply_buffer_size;
     volatile void* reply_buffer_dma_virt;
     dma_addr_t reply_buffer_dma_handle;
@@ -314,6 +318,53 @@ void data_free(mcedsp_t *dsp)
 }
 
 
+/* Control page - user-visible mirror of dframes ring state.
+ *
+ * ctrl_sync copies the ring indices; call it with DSP_LOCK held after
+ * changing head_index, tail_index or force_exit.  ctrl_layout also
+ * copies the buffer layout, bracketed by generation increments so
+ * readers can detect a torn read.
+ */
+
+static void ctrl_sync(mcedsp_t *dsp)
+{
+    struct dsp_ctrl_page *ctrl = dsp->ctrl;
+    if (ctrl == NULL)
+        return;
+    // Frame data must be visible before the head index that covers it.
+    smp_wmb();
+    ctrl->head_index = dsp->dframes.head_index;
+    ctrl->tail_index = dsp->dframes.tail_index;
+    ctrl->force_exit = dsp->dframes.force_exit;
+}
+
+static void ctrl_layout(mcedsp_t *dsp)
+{
+    struct dsp_ctrl_page *ctrl = dsp->ctrl;
+    frame_buffer_t *dframes = &dsp->dframes;
+    int i, offset = 0;
+    if (ctrl == NULL)
+        return;
+
+    ctrl->generation++;
+    smp_wmb();
+    ctrl->n_frames = dframes->n_frames;
+    ctrl->frame_size = dframes->frame_size;
+    ctrl->data_size = dframes->data_size;
+    ctrl->total_size = dframes->total_size;
+    ctrl->n_blocks = dframes->n_blocks;
+    for (i=0; i<dframes->n_blocks; i++) {
+        ctrl->blocks[i].offset = offset;
+        ctrl->blocks[i].start_frame = dframes->blocks[i].start_frame;
+        ctrl->blocks[i].end_frame = dframes->blocks[i].end_frame;
+        offset += dframes->blocks[i].size;
+    }
+    ctrl_sync(dsp);
+    smp_wmb();
+    ctrl->generation++;
+}
+
+
 /* set_transfer_params_multi
  *
  * Update data transfer parameters internally, and write them to the
@@ -363,6 +414,7 @@ static int set_transfer_params_multi(mcedsp_t *dsp, int enable, int data_size)
     dframes->n_frames = start_frame;
     dframes->data_size = data_size;
     dframes->frame_size = frame_size;
+    ctrl_layout(dsp);
     DSP_UNLOCK;
 
     /* Create the command for DSP */
@@ -601,9 +653,12 @@ irqreturn_t mcedsp_int_handler(int irq, void *dev_id, struct pt_regs *regs)
                     (gram.buffer[0] < dsp->dframes.n_frames)) {
                 DSP_LOCK;
                 dsp->dframes.head_index = gram.buffer[0];
+                ctrl_sync(dsp);
                 k = (dsp->dframes.head_index - dsp->dframes.last_grant +
                         dsp->dframes.n_frames) % dsp->dframes.n_frames;
                 DSP_UNLOCK;
+                /* Wake anyone sleeping in poll() for new frames. */
+                wake_up_interruptible(&dsp->dframes.queue);
                 /* PRINT_INFO(dsp->minor, "scheduling update!\n"); */
                 /* Limits updates to "rare".  The biggest reason to do
                    this is to not bother in the case when only single
@@ -762,6 +817,7 @@ int mcedsp_probe(struct pci_dev *pci, const struct pci_device_id *id)
 
     // Kernel structures...
     init_waitqueue_head(&dsp->queue);
+    init_waitqueue_head(&dsp->dframes.queue);
     tasklet_init(&dsp->grantlet, grant_task, (unsigned long)dsp);
 
 #ifdef NEW_TIMER
@@ -785,6 +841,17 @@ int mcedsp_probe(struct pci_dev *pci, const struct pci_device_id *id)
         goto fail;
     }
 
+    // And the control page that describes it.
+    dsp->ctrl = (struct dsp_ctrl_page*)get_zeroed_page(GFP_KERNEL);
+    if (dsp->ctrl == NULL) {
+        PRINT_ERR(card, "control page allocation failed.\n");
+        err = -1;
+        goto fail;
+    }
+    SetPageReserved(virt_to_page(dsp->ctrl));
+    dsp->ctrl->magic = DSP_CTRL_MAGIC;
+    ctrl_layout(dsp);
+
     // Allocate DMA-ready reply buffer.
     dsp->reply_buffer_size = 2048;
     dsp->reply_buffer_dma_virt =
@@ -930,6 +997,12 @@ void mcedsp_remove(struct pci_dev *pci)
 
     data_free(dsp);
 
+    if (dsp->ctrl != NULL) {
+        ClearPageReserved(virt_to_page(dsp->ctrl));
+        free_page((unsigned long)dsp->ctrl);
+        dsp->ctrl = NULL;
+    }
+
     //Unmap i/o...
     if (dsp->reg != NULL)
         iounmap(dsp->reg);
@@ -1183,6 +1256,23 @@ static int data_lock_operation(mcedsp_t *dsp, int operation, void *filp)
 }
 
 
+/* frame_offset - byte offset into the mmap of frame index x, which
+ * lies in one of the (consecutively mapped) DMA blocks. */
+
+static int frame_offset(frame_buffer_t *dframes, int x)
+{
+    int offset = 0;
+    int block_i = 0;
+    while (x < dframes->blocks[block_i].start_frame ||
+            x >= dframes->blocks[block_i].end_frame) {
+        offset += dframes->blocks[block_i].size;
+        block_i++;
+    }
+    return offset + dframes->frame_size *
+        (x - dframes->blocks[block_i].start_frame);
+}
+
+
 long mcedsp_ioctl(struct file *filp, unsigned int iocmd, unsigned long arg)
 {
     mcedsp_t *dsp = (mcedsp_t*)filp->private_data;
@@ -1190,6 +1280,7 @@ long mcedsp_ioctl(struct file *filp, unsigned int iocmd, unsigned long arg)
 
     struct dsp_command *cmd;
     struct dsp_datagram *gram;
+    struct dsp_frame_batch batch;
     __u32* mce_cmd;
     int x, err;
 
@@ -1288,6 +1379,14 @@ long mcedsp_ioctl(struct file *filp, unsigned int iocmd, unsigned long arg)
                     return dsp->dframes.frame_size;
                 case QUERY_BUFSIZE:
                     return dsp->dframes.total_size;
+                case QUERY_POLL:
+                    return 1;
+                case QUERY_BATCH:
+                    return DSP_FRAME_BATCH_MAX;
+                case QUERY_CTRL_OFFSET:
+                    if (dsp->ctrl == NULL)
+                        return -1;
+                    return PAGE_ALIGN(dsp->dframes.total_size);
                 default:
                     return -1;
             }
@@ -1308,13 +1407,16 @@ long mcedsp_ioctl(struct file *filp, unsigned int iocmd, unsigned long arg)
             PRINT_ERR(card, "fake_stopframe initiated!\n");
             DSP_LOCK;
             dsp->dframes.force_exit = 1;
+            ctrl_sync(dsp);
             DSP_UNLOCK;
+            wake_up_interruptible(&dsp->dframes.queue);
             return 0;
 
         case DSPIOCT_EMPTY:
             DSP_LOCK;
             dsp->dframes.head_index = 0;
             dsp->dframes.tail_index = 0;
+            ctrl_sync(dsp);
             DSP_UNLOCK;
             return 0;
 
@@ -1328,23 +1430,47 @@ long mcedsp_ioctl(struct file *filp, unsigned int iocmd, unsigned long arg)
             x = dsp->dframes.tail_index;
             if (dsp->dframes.force_exit) {
                 dsp->dframes.force_exit = 0;
+                ctrl_sync(dsp);
                 x = -ENODATA;
             } else if (x == dsp->dframes.head_index)
                 x = -EAGAIN;
-            else {
-                int offset = 0;
-                int block_i = 0;
-                while (x < dsp->dframes.blocks[block_i].start_frame ||
-                        x >= dsp->dframes.blocks[block_i].end_frame) {
-                    offset += dsp->dframes.blocks[block_i].size;
-                    block_i++;
+            else
+                x = frame_offset(&dsp->dframes, x);
+            DSP_UNLOCK;
+            return x;
+
+        case DSPIOCT_FRAME_POLL_BATCH:
+            /* Like FRAME_POLL, but return the offsets of all frames
+               between tail and head (up to batch.max).  Return value is
+               the number of frames, or -EAGAIN / -ENODATA. */
+            if (copy_from_user(&batch, (void __user *)arg,
+                        2*sizeof(__s32)) != 0)
+                return -EFAULT;
+            if (batch.max > DSP_FRAME_BATCH_MAX)
+                batch.max = DSP_FRAME_BATCH_MAX;
+            batch.count = 0;
+            DSP_LOCK;
+            x = dsp->dframes.tail_index;
+            if (dsp->dframes.force_exit) {
+                dsp->dframes.force_exit = 0;
+                ctrl_sync(dsp);
+                err = -ENODATA;
+            } else {
+                while (x != dsp->dframes.head_index &&
+                        batch.count < batch.max) {
+                    batch.offsets[batch.count++] =
+                        frame_offset(&dsp->dframes, x);
+                    x = (x + 1) % dsp->dframes.n_frames;
                 }
-                offset += dsp->dframes.frame_size *
-                    (x - dsp->dframes.blocks[block_i].start_frame);
-                x = offset;
+                err = (batch.count > 0) ? batch.count : -EAGAIN;
             }
             DSP_UNLOCK;
-            return x;
+            if (err < 0)
+                return err;
+            if (copy_to_user((void __user *)arg, &batch,
+                        (2 + batch.count) * sizeof(__s32)) != 0)
+                return -EFAULT;
+            return err;
 
         case DSPIOCT_FRAME_CONSUME:
             DSP_LOCK;
@@ -1353,10 +1479,29 @@ long mcedsp_ioctl(struct file *filp, unsigned int iocmd, unsigned long arg)
                 dsp->dframes.tail_index =
                     (dsp->dframes.tail_index + 1) %
                     dsp->dframes.n_frames;
+                ctrl_sync(dsp);
             }
             DSP_UNLOCK;
             return 0;
 
+        case DSPIOCT_FRAME_CONSUME_N:
+            /* Consume up to arg frames; return the number consumed. */
+            DSP_LOCK;
+            x = 0;
+            if (dsp->dframes.n_frames > 0) {
+                x = (dsp->dframes.head_index - dsp->dframes.tail_index +
+                        dsp->dframes.n_frames) % dsp->dframes.n_frames;
+                if ((long)arg < x)
+                    x = (long)arg;
+                if (x < 0)
+                    x = 0;
+                dsp->dframes.tail_index =
+                    (dsp->dframes.tail_index + x) % dsp->dframes.n_frames;
+                ctrl_sync(dsp);
+            }
+            DSP_UNLOCK;
+            return x;
+
         case DSPIOCT_DATA_LOCK:
             return data_lock_operation(dsp, arg, filp);
 
@@ -1382,6 +1527,21 @@ int mcedsp_mmap(struct file *filp, struct vm_area_struct *vma)
     vma->vm_flags |= VM_IO | VM_RESERVED;
 #endif
 
+    // The control page sits just past the frame buffer, read-only.
+    if (dsp->ctrl != NULL && vma->vm_pgoff ==
+            PAGE_ALIGN(dsp->dframes.total_size) >> PAGE_SHIFT) {
+        if (vma->vm_end - vma->vm_start > PAGE_SIZE ||
+                (vma->vm_flags & VM_WRITE)) {
+            PRINT_ERR(dsp->minor, "control page must be mapped "
+                    "read-only, one page\n");
+            return -EINVAL;
+        }
+        vma->vm_flags &= ~VM_MAYWRITE;
+        return remap_pfn_range(vma, vma->vm_start,
+                virt_to_phys(dsp->ctrl) >> PAGE_SHIFT,
+                PAGE_SIZE, vma->vm_page_prot);
+    }
+
     // Do args checking on vma... start, end, prot.
     PRINT_INFO(dsp->minor, "mapping %#lx bytes to user address %#lx\n",
             vma->vm_end - vma->vm_start, vma->vm_start);
@@ -1404,6 +1564,28 @@ int mcedsp_mmap(struct file *filp, struct vm_area_struct *vma)
 }
 
 
+/* mcedsp_poll - readable when a frame is waiting at the tail of the
+ * data buffer, or when a fake stop frame has been requested (so the
+ * reader wakes up and collects the ENODATA from FRAME_POLL). */
+
+unsigned int mcedsp_poll(struct file *filp, poll_table *wait)
+{
+    mcedsp_t *dsp = (mcedsp_t*)filp->private_data;
+    unsigned int mask = 0;
+    DSP_LOCK_DECLARE_FLAGS;
+
+    poll_wait(filp, &dsp->dframes.queue, wait);
+
+    DSP_LOCK;
+    if (dsp->dframes.force_exit ||
+            dsp->dframes.tail_index != dsp->dframes.head_index)
+        mask |= POLLIN | POLLRDNORM;
+    DSP_UNLOCK;
+
+    return mask;
+}
+
+
 int mcedsp_open(struct inode *inode, struct file *filp)
 {
     /* struct filp_pdata *fpdata; */
@@ -1437,6 +1619,7 @@ struct file_operations mcedsp_fops =
     .open=    mcedsp_open,
     .release= mcedsp_release,
     .mmap=    mcedsp_mmap,
+    .poll=    mcedsp_poll,
     .unlocked_ioctl= mcedsp_ioctl,
 };
 
@@ -42,6 +42,10 @@ typedef struct {
 /* This is a DSP firmware max; do not increase beyond 20. */
 #define DSP_MAX_MEM_BLOCKS 20
 
+#if DSP_MAX_MEM_BLOCKS > DSP_CTRL_MAX_BLOCKS
+#  error "dsp_ctrl_page cannot describe all memory blocks"
+#endif
+
 typedef struct {
 #if 0
     volatile void *base; 
@@ -12,6 +12,18 @@
 #define MCEDATA_INCREMENT         (1 <<  1) /* keep ret_data_s up to date */
 #define MCEDATA_FILESEQUENCE      (1 <<  2) /* switch output files regularly */
 #define MCEDATA_THREAD            (1 <<  3) /* use non-blocking data thread */
+#define MCEDATA_PIPELINE          (1 <<  4) /* queue frames for worker threads */
+
+/* Checksum failures are counted in acq->stats; only the first few in
+   each go are reported individually. */
+#define MCEDATA_CHECKSUM_WARNINGS 10
+
+/* Likewise frame_counter and sync_number discontinuities. */
+#define MCEDATA_GAP_WARNINGS      10
+
+/* Pipeline defaults, for MCEDATA_PIPELINE */
+#define MCEDATA_PIPELINE_DEPTH    1024      /* frames */
+#define MCEDATA_PIPELINE_WORKERS  1
 
 
 /* MCE card bits - fix this! */
@@ -43,6 +55,76 @@ typedef struct mce_acq_struct mce_acq_t;
 struct mcedata_storage;
 typedef struct mcedata_storage mcedata_storage_t;
 
+struct mce_frame_view;
+struct mcedata_pipeline;
+struct frame_reorder;
+struct gapcheck;
+struct data_thread_struct;
+
+/* Continuous streaming state (mcedata_acq_stream).  The MCE is run
+   in chunks of "chunk" frames; at each chunk's LAST frame the GO is
+   re-issued without reconfiguring the MCE or the driver.  The default
+   chunk spans the whole ret_dat_s range, so that a re-GO comes only
+   every 2^31 frames (more than a day at 20 kHz).  Frame numbers keep
+   counting across chunks; storage gets them as ints, so past INT_MAX
+   they start again from 0, while "frames" has the full count. */
+
+#define MCEDATA_STREAM_CHUNK      0x7fffffff
+
+typedef struct mcedata_stream {
+    int chunk;                  // frames per GO; 0 when not streaming
+    volatile int stop;          // end streaming at the next STOP or LAST
+    int restarts;               // GOs re-issued at chunk boundaries
+    int chunk_frames;           // frames received since the last GO
+    long long frames;           // frames received
+    long long gaps;             // frames missing, by header frame_counter
+    int gap_events;             // number of discontinuities seen
+} mcedata_stream_t;
+
+/* Acquisition statistics (mcedata_acq_stats); these are reset at the
+   start of each go.  Times are in microseconds.  Latency bin 0 counts
+   frames handled in under 1 us, bin i those taking [2^(i-1), 2^i) us;
+   the last bin is open-ended. */
+
+#define MCEDATA_LATENCY_BINS      20
+#define MCEDATA_STATS_SYNCS       10
+
+typedef struct mce_acq_stats {
+    long long frames;               // frames received
+    int checksum_errors;            // frames that failed checksum
+    int last_checksum_error;        // index of the latest such frame, or -1
+    long long gaps;                 // frames missing, by header frame_counter
+    int gap_events;                 // discontinuities in frame_counter
+    int repeats;                    // ... that went backwards
+    int sync_events;                // sync_number steps not matching
+    long long polls;                // polls of the driver buffer
+    long long empty_polls;          // ... that found no frames ready
+    int ring_size;                  // driver buffer size, in frames
+    int ring_high_water;            // most frames waiting in the buffer
+    long long latency[MCEDATA_LATENCY_BINS];  // per-frame handling time
+    double latency_max;
+    double storage_time;            // total time storing (and reordering)
+    int n_syncs;                    // multisync only: syncs timed, and
+    double sync_time[MCEDATA_STATS_SYNCS];    // time in each of the first
+    double sync_time_rest;          // total for the syncs beyond those
+} mce_acq_stats_t;
+
+/* Host arrival time of a frame: CLOCK_MONOTONIC and CLOCK_REALTIME, in
+   ns, taken when the acquisition loop found the frame in the driver
+   buffer.  Frames found by the same poll share a time.  The realtime
+   value is derived from the monotonic one, through an offset that is
+   re-measured every second.  Storage actions find the time of the
+   frame they are given in acq->frame_time. */
+
+typedef struct mce_host_time {
+    int64_t mono_ns;
+    int64_t real_ns;
+} mce_host_time_t;
+
+/* Called from the data thread when an mcedata_acq_start acquisition
+   finishes. */
+typedef void (*mcedata_acq_callback_t)(mce_acq_t *acq, void *user_data);
+
 
 struct mcedata_storage {
 
@@ -50,6 +132,7 @@ struct mcedata_storage {
     int (*pre_frame)(mce_acq_t *);
     int (*flush)(mce_acq_t *);
     int (*post_frame)(mce_acq_t *, int, u32 *);
+    int (*post_view)(mce_acq_t *, int, const struct mce_frame_view *);
     int (*cleanup)(mce_acq_t *);
     int (*destroy)(mcedata_storage_t *);
 
@@ -86,9 +169,25 @@ struct mce_acq_struct {
 
     int last_n_frames;
 
+    mce_acq_stats_t stats;
+    mce_host_time_t frame_time;     // Arrival of the frame being stored
+
     frame_header_abstraction_t *header_description;
 
     int ready;
+
+    struct frame_reorder *reorder;     // Card-major to row-major plan
+    uint32_t *frame_buf;               // Reordered frame, for storage
+    struct mce_frame_view *view;       // Unordered frame, for storage
+    struct gapcheck *gapcheck;         // frame_counter / sync_number checks
+
+    struct mcedata_pipeline *pipeline; // Non-NULL in pipelined mode
+
+    struct data_thread_struct *thread; // Running mcedata_acq_start
+    mcedata_acq_callback_t callback;
+    void *callback_data;
+
+    mcedata_stream_t stream;
 };
 
 #endif
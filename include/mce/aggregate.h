@@ -0,0 +1,64 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#ifndef __AGGREGATE_H__
+#define __AGGREGATE_H__
+
+#include "mce/acq.h"
+
+/* Aggregated acquisition from several MCEs (one per fibre card).
+
+Frames are taken from a set of frame sources, matched up by header
+sync_number, and passed to a single storage chain as "super-frames":
+the matched frames of all sources, complete and in source order, one
+after the other.
+
+Frames that can't be matched are dropped and counted.  A frame is
+unmatched if another source has already moved on to a later
+sync_number, or if it has waited for more than max_skew frames while
+some other source has nothing to offer.
+
+Super-frames go to the storage's pre_frame and post_frame actions;
+post_view is not called, since a super-frame is not one MCE's frame.
+
+Sources hand out frames in place (e.g. in the driver's buffer) and get
+them back, oldest first, once they have been stored or dropped. */
+
+#define MCEDATA_AGG_SOURCES       8     /* most sources per aggregate */
+#define MCEDATA_AGG_MAX_SKEW      63    /* most frames held per source */
+
+struct mcedata_source;
+typedef struct mcedata_source mcedata_source_t;
+
+struct mcedata_source {
+
+    int frame_size;                 // dwords
+    int fd;                         // poll()able for new frames, or -1
+
+    /* Start producing n_frames frames; may be NULL. */
+    int (*start)(mcedata_source_t *, int n_frames);
+
+    /* Get the frame after the last one returned.  Returns 1 and sets
+       *frame, 0 if nothing is ready yet, or a negative number if there
+       will be no more frames. */
+    int (*next)(mcedata_source_t *, const uint32_t **frame);
+
+    /* Return the n oldest frames got with next. */
+    int (*release)(mcedata_source_t *, int n);
+
+    int (*destroy)(mcedata_source_t *);
+
+    void *source_data;
+};
+
+typedef struct mcedata_aggregate_stats {
+    long long frames;                           // super-frames stored
+    long long unmatched[MCEDATA_AGG_SOURCES];   // frames dropped, by source
+    int max_held;                   // most frames held by one source
+    uint32_t last_sync;             // sync_number of the latest super-frame
+} mcedata_aggregate_stats_t;
+
+struct mcedata_aggregate;
+typedef struct mcedata_aggregate mcedata_aggregate_t;
+
+#endif
@@ -0,0 +1,122 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#ifndef _MCE_ARCHIVE_H_
+#define _MCE_ARCHIVE_H_
+
+#include <stdint.h>
+#include "mce/acq.h"
+
+/* Compressed frame archives (mcedata_archive_create).
+ *
+ * An archive holds whole frames, losslessly compressed, in blocks of up
+ * to block_frames frames (a fixed span of time, unless a flush cut the
+ * block short).  Within a block the frames are stored column by
+ * column: each word of the frame (a "channel"; header words included)
+ * is stored as its first value and then its differences from one frame
+ * to the next, zigzag-coded (0, -1, 1, -2, ... as 0, 1, 2, 3, ...) and
+ * packed with just as many bits as the largest of them in that block
+ * needs.  So a few channels over a long span can be read without
+ * touching the rest.
+ *
+ * Layout, all in host byte order:
+ *
+ *   file header    mce_archive_header_t
+ *   blocks         mce_archive_block_t, then size bytes:
+ *                    frame_size bit widths, one byte each
+ *                    each channel in turn: its first value (one word),
+ *                      then its packed differences, from the least
+ *                      significant bit of each byte, in
+ *                      ceil((n_frames-1) * width / 8) bytes
+ *   index          one mce_archive_index_t per block, then the bit
+ *                    widths of each block again (frame_size bytes each)
+ *   trailer        mce_archive_trailer_t
+ *
+ * Channel i of a block thus starts at byte
+ *
+ *   frame_size + sum over j < i of (4 + ceil((n_frames-1) * width_j / 8))
+ *
+ * of the block data, which the index gives without reading the block.
+ * The index is written when the archive is closed; without it (say the
+ * writer crashed) a reader finds the blocks by walking the headers.
+ *
+ * The header also records the readout geometry of the acquisition (as
+ * in mce_frame_view_t), so that channels can be found by MCE row and
+ * column; cards is 0 if that is unknown. */
+
+#define MCE_ARCHIVE_MAGIC    0x4145434d /* "MCEA" */
+#define MCE_ARCHIVE_BLOCK    0x4245434d /* "MCEB" */
+#define MCE_ARCHIVE_INDEX    0x4945434d /* "MCEI" */
+#define MCE_ARCHIVE_VERSION  2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t frame_size;       // words per frame
+    uint32_t header_size;      // words before the data block
+    uint32_t block_frames;     // most frames in a block
+    uint32_t cards;            // bit mask of reporting RCs
+    uint32_t rows;             // rows reported, per card
+    uint32_t cols;             // columns reported, per card
+    int32_t row0[MCEDATA_CARDS];    // readout rectangle, by RC
+    int32_t col0[MCEDATA_CARDS];
+    uint32_t reserved[4];
+} mce_archive_header_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t n_frames;
+    uint64_t frame0;           // archive index of the first frame
+    uint32_t size;             // bytes that follow
+    uint32_t reserved;
+} mce_archive_block_t;
+
+typedef struct {
+    uint64_t offset;           // of the block header
+    uint64_t frame0;
+    uint32_t n_frames;
+    uint32_t size;
+} mce_archive_index_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t n_blocks;
+    uint64_t index_offset;
+} mce_archive_trailer_t;
+
+
+/* Reading */
+
+typedef struct mcedata_archive mcedata_archive_t;
+
+/* Open an archive for reading; NULL on failure. */
+mcedata_archive_t *mcedata_archive_open(const char *filename);
+
+void mcedata_archive_close(mcedata_archive_t *archive);
+
+/* The file header, with the frame size and readout geometry. */
+const mce_archive_header_t *mcedata_archive_header(
+        const mcedata_archive_t *archive);
+
+/* Words per frame, and frames in the archive. */
+int mcedata_archive_frame_size(const mcedata_archive_t *archive);
+long mcedata_archive_frame_count(const mcedata_archive_t *archive);
+
+/* The channel (offset in the frame) of MCE row and column (0-31), or -1
+   if it was not read out. */
+int mcedata_archive_channel(const mcedata_archive_t *archive,
+        int mce_row, int mce_col);
+
+/* Read up to count whole frames, starting with frame first, into
+   frames; returns the number read, or -1 on error. */
+long mcedata_archive_read(mcedata_archive_t *archive, long first, long count,
+        uint32_t *frames);
+
+/* Read up to count frames of just n_channels channels (offsets in the
+   frame; a negative one reads as 0), starting with frame first, into
+   out, n_channels words per frame.  Only those channels are decoded.
+   Returns the number of frames read, or -1 on error. */
+long mcedata_archive_read_channels(mcedata_archive_t *archive, long first,
+        long count, const int *channels, int n_channels, uint32_t *out);
+
+#endif
@@ -4,6 +4,8 @@
 #ifndef _DATA_MODE_H_
 #define _DATA_MODE_H_
 
+#include <stdint.h>
+
 enum mce_data_type { DATA_MODE_RAW, DATA_MODE_SCALE, DATA_MODE_EXTRACT,
     DATA_MODE_EXTRACT_SCALE };
 
@@ -15,8 +17,20 @@ struct mce_data_field {
     int bit_count;
     double scalar;
     int has_sign;
+
+    /* For DATA_MODE_EXTRACT(_SCALE): unpack n packed words into out,
+       which holds n values of MCE_DATA_EXTRACT_SIZE(field) bytes:
+       integers (signed if has_sign) of the smallest size that holds
+       bit_count bits, or, with a scale, float. */
+    void (*extract)(const uint32_t *in, void *out, int n);
 };
 
+#define MCE_DATA_EXTRACT_INT_SIZE(bits) \
+    (((bits) <= 8) ? 1 : ((bits) <= 16) ? 2 : 4)
+#define MCE_DATA_EXTRACT_SIZE(f) \
+    (((f)->type == DATA_MODE_EXTRACT_SCALE) ? (int)sizeof(float) : \
+     MCE_DATA_EXTRACT_INT_SIZE((f)->bit_count))
+
 
 #define MCE_DATA_ERROR   "error"
 #define MCE_DATA_FB      "fb"
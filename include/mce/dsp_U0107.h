@@ -53,6 +53,50 @@ struct mce_reply {
   __s32 data[DSP_COMMAND_SIZE];
 };
 
+/* Argument to DSPIOCT_FRAME_POLL_BATCH.  Caller sets max; driver
+   fills in count and the mmap offsets of up to max frames, starting
+   at the tail. */
+#define DSP_FRAME_BATCH_MAX 64
+
+struct dsp_frame_batch {
+  __s32 max;
+  __s32 count;
+  __s32 offsets[DSP_FRAME_BATCH_MAX];
+};
+
+/* Read-only control page, exported through mmap of the data device
+   at byte offset DSPIOCT_QUERY(QUERY_CTRL_OFFSET).  It mirrors the
+   ring indices and buffer layout so that consumers can find ready
+   frames without an ioctl.  generation is odd while the layout is
+   being rewritten (i.e. on DSPIOCT_SET_DATASIZE). */
+#define DSP_CTRL_MAGIC      0x4d434543
+#define DSP_CTRL_MAX_BLOCKS 20
+
+struct dsp_ctrl_block {
+  __s32 offset;           // byte offset of block in the data mmap
+  __s32 start_frame;
+  __s32 end_frame;
+  __s32 unused;
+};
+
+struct dsp_ctrl_page {
+  __u32 magic;
+  __u32 generation;
+  // Ring state; DMA writes at head, consumer reads at tail.
+  __s32 head_index;
+  __s32 tail_index;
+  __s32 force_exit;
+  __s32 unused1;
+  // Buffer layout
+  __s32 n_frames;
+  __s32 frame_size;
+  __s32 data_size;
+  __s32 total_size;
+  __s32 n_blocks;
+  __s32 unused2;
+  struct dsp_ctrl_block blocks[DSP_CTRL_MAX_BLOCKS];
+};
+
 #pragma pack(pop)
 
 #define DSP_REPLY(datagramp) ((struct dsp_reply*)(&((datagramp)->buffer)))
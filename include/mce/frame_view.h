@@ -0,0 +1,137 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#ifndef __FRAME_VIEW_H__
+#define __FRAME_VIEW_H__
+
+#include <stddef.h>
+#include "mce/acq.h"
+
+/* Frame views
+
+A frame view describes a frame as the MCE sent it: after the header, the
+data block is card-major (all rows of the first reporting card, then all
+rows of the next, ...).  Consumers that only need a few channels can
+read them in place, through the view, rather than having the whole frame
+reordered first.
+
+Element (row, col) of the view is the same element as (row, col) of the
+row-major data block that post_frame storage receives: rows run from 0
+to rows-1 and columns from 0 to n_cards*cols-1, with the reporting
+cards side by side.  For MCE coordinates (absolute row and column
+number, 0-31) use mce_frame_view_find, which also accounts for the
+readout rectangle origin (row0, col0) of each card.
+
+The geometry is fixed for an acquisition (see mcedata_frame_view_init);
+only the data pointer changes from frame to frame.
+*/
+
+typedef struct mce_frame_view {
+
+    const uint32_t *data;           // Frame, starting at the header
+
+    int frame_size;                 // dwords
+    int header_size;
+    int rows;                       // Rows reported, per card
+    int cols;                       // Columns reported, per card
+    int n_cards;                    // Reporting cards
+    int cards;                      // Bit mask of reporting cards
+    int slot[MCEDATA_CARDS];        // Position of each card in the frame;
+                                    //   -1 if not reporting
+    int row0[MCEDATA_CARDS];        // Readout rectangle, by RC
+    int col0[MCEDATA_CARDS];
+
+} mce_frame_view_t;
+
+
+/* Strided iterator, over one row or one column of a view.  Use:
+
+     mce_frame_iter_t it;
+     uint32_t x;
+     mce_frame_view_row(view, r, &it);
+     while (mce_frame_iter_next(&it, &x))
+         ...
+*/
+
+typedef struct mce_frame_iter {
+    const uint32_t *p;              // Next element
+    int stride;                     // Step within a run
+    int left;                       // Elements left in this run
+    int run_len;                    // Elements per run
+    int jump;                       // Step from the end of a run to the next
+    int runs;                       // Runs left after this one
+} mce_frame_iter_t;
+
+
+/* Offset of element (row, col) in the frame. */
+static inline int mce_frame_view_offset(const mce_frame_view_t *v,
+        int row, int col)
+{
+    int k = col / v->cols;
+    return v->header_size + (k*v->rows + row)*v->cols + col - k*v->cols;
+}
+
+/* Element (row, col); no bounds checking. */
+static inline uint32_t mce_frame_view_get(const mce_frame_view_t *v,
+        int row, int col)
+{
+    return v->data[mce_frame_view_offset(v, row, col)];
+}
+
+/* Address of the element at MCE row and column (0-31), or NULL if that
+   channel is not in the frame. */
+static inline const uint32_t *mce_frame_view_find(const mce_frame_view_t *v,
+        int mce_row, int mce_col)
+{
+    int card = mce_col / MCEDATA_COLUMNS;
+    int r, c;
+    if (card < 0 || card >= MCEDATA_CARDS || v->slot[card] < 0)
+        return NULL;
+    r = mce_row - v->row0[card];
+    c = mce_col - card*MCEDATA_COLUMNS - v->col0[card];
+    if (r < 0 || r >= v->rows || c < 0 || c >= v->cols)
+        return NULL;
+    return v->data + v->header_size +
+        (v->slot[card]*v->rows + r)*v->cols + c;
+}
+
+/* Iterate over row "row", across all reporting cards. */
+static inline void mce_frame_view_row(const mce_frame_view_t *v, int row,
+        mce_frame_iter_t *it)
+{
+    it->p = v->data + v->header_size + row*v->cols;
+    it->stride = 1;
+    it->left = it->run_len = v->cols;
+    it->jump = (v->rows - 1) * v->cols;
+    it->runs = v->n_cards - 1;
+}
+
+/* Iterate over column "col", all rows. */
+static inline void mce_frame_view_column(const mce_frame_view_t *v, int col,
+        mce_frame_iter_t *it)
+{
+    it->p = v->data + mce_frame_view_offset(v, 0, col);
+    it->stride = v->cols;
+    it->left = it->run_len = v->rows;
+    it->jump = 0;
+    it->runs = 0;
+}
+
+/* Store the next element in *value and return 1, or return 0 at the
+   end. */
+static inline int mce_frame_iter_next(mce_frame_iter_t *it, uint32_t *value)
+{
+    if (it->left == 0) {
+        if (it->runs == 0)
+            return 0;
+        it->runs--;
+        it->left = it->run_len;
+        it->p += it->jump;
+    }
+    *value = *it->p;
+    it->p += it->stride;
+    it->left--;
+    return 1;
+}
+
+#endif
@@ -33,6 +33,9 @@
 /* #define      QUERY_LTAIL     7 */
 /* #define      QUERY_LPARTIAL  8 */
 /* #define      QUERY_LVALID    9 */
+#define      QUERY_POLL      10 /* non-zero if poll() reports new frames */
+#define      QUERY_BATCH     11 /* non-zero if FRAME_POLL_BATCH supported */
+#define      QUERY_CTRL_OFFSET 12 /* mmap offset of struct dsp_ctrl_page */
 #define DSPIOCT_SET_DATASIZE    _IO(DSPIOCT_MAGIC, 41)
 #define DSPIOCT_FAKE_STOPFRAME  _IO(DSPIOCT_MAGIC, 42)
 #define DSPIOCT_EMPTY           _IO(DSPIOCT_MAGIC, 43)
@@ -44,6 +47,8 @@
 #define      LOCK_DOWN       1
 #define      LOCK_UP         2
 #define      LOCK_RESET      3
+#define DSPIOCT_FRAME_POLL_BATCH _IOWR(DSPIOCT_MAGIC, 49, int)
+#define DSPIOCT_FRAME_CONSUME_N  _IO(DSPIOCT_MAGIC, 50)
 
 
 /* Low level read / write of DSP PCI registers */
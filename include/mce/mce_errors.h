@@ -49,6 +49,7 @@
 #define MCE_ERR_FRAME_ROWS      (MCE_ERR_BASE + 0x0039)
 #define MCE_ERR_FRAME_COLS      (MCE_ERR_BASE + 0x003a)
 #define MCE_ERR_FRAME_KILL      (MCE_ERR_BASE + 0x003b)
+#define MCE_ERR_FRAME_OVERRUN   (MCE_ERR_BASE + 0x003c)
 
 /* #define MCE_ERR_                MCE_ERR_BASE + 0x0001 */
 
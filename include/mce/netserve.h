@@ -0,0 +1,82 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#ifndef _MCE_NETSERVE_H_
+#define _MCE_NETSERVE_H_
+
+#include <stdint.h>
+#include "mce/acq.h"
+
+/* Network frame streaming (mcedata_netserve_create).
+ *
+ * The server listens on a TCP port (see massock_listen) and streams
+ * live frames to any number of subscribers.  A subscriber sends one
+ * line of text, and may send another at any time to change it:
+ *
+ *   SUBSCRIBE [DECIMATE n] [ALL | HEADER | CHANNELS w w ...]
+ *
+ * to get every nth frame (default 1) of: the whole frame (the
+ * default), just the frame header, or just the listed words (offsets
+ * in the frame as stored by post_frame, i.e. row-major, as in a flat
+ * file; ones past the end read as 0).  The server answers with an
+ * MCE_NETSERVE_INFO message, then an MCE_NETSERVE_FRAME message per
+ * frame; a bad request gets an MCE_NETSERVE_ERROR message, whose data
+ * is text.
+ *
+ * Every message is an mce_netserve_msg_t followed by n_words words,
+ * all in host byte order.  Frames are handed from the acquisition to
+ * a server thread through a queue; if that is full, frames are
+ * skipped, which shows as a gap in seq.  Each subscriber has a send
+ * buffer; one that can't take the next message (the subscriber isn't
+ * keeping up) is disconnected.  The acquisition never waits for the
+ * network. */
+
+#define MCE_NETSERVE_MAGIC    0x4e45434d /* "MCEN" */
+
+#define MCE_NETSERVE_INFO     1
+#define MCE_NETSERVE_FRAME    2
+#define MCE_NETSERVE_ERROR    3
+
+typedef struct {
+    uint32_t magic;
+    uint32_t type;
+    uint32_t n_words;          // words that follow
+    int32_t frame_index;       // as passed to post_frame
+    uint64_t seq;              // frames since the server started
+    int64_t mono_ns;           // frame arrival (mce_host_time_t)
+    int64_t real_ns;
+} mce_netserve_msg_t;
+
+/* Data of an MCE_NETSERVE_INFO message: the frame geometry (as in
+   mce_frame_view_t) and the subscription. */
+typedef struct {
+    uint32_t frame_size;       // words per frame
+    uint32_t header_size;      // words before the data block
+    uint32_t cards;            // bit mask of reporting RCs
+    uint32_t rows;             // rows reported, per card
+    uint32_t cols;             // columns reported, per card
+    int32_t row0[MCEDATA_CARDS];    // readout rectangle, by RC
+    int32_t col0[MCEDATA_CARDS];
+    uint32_t decimate;
+    uint32_t n_words;          // words in each frame message
+} mce_netserve_info_t;
+
+
+/* Subscribing */
+
+typedef struct mcedata_netclient mcedata_netclient_t;
+
+/* Connect to a server at addr ("host:port") and send the request (a
+   SUBSCRIBE line, without the newline).  NULL on failure. */
+mcedata_netclient_t *mcedata_netclient_open(const char *addr,
+        const char *request);
+
+void mcedata_netclient_close(mcedata_netclient_t *client);
+
+/* Wait for the next message; store its header in msg and up to
+   max_words of its data in data (the rest is discarded).  Returns the
+   message type, or -1 if the connection is gone. */
+int mcedata_netclient_read(mcedata_netclient_t *client,
+        mce_netserve_msg_t *msg, uint32_t *data, int max_words);
+
+#endif
@@ -0,0 +1,101 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#ifndef _MCE_SHMRING_H_
+#define _MCE_SHMRING_H_
+
+#include <stdint.h>
+#include "mce/acq.h"
+
+/* Shared-memory frame rings (mcedata_shmring_create).
+ *
+ * The writer (a storage module, so usually one sync of a multisync)
+ * publishes each frame into a ring of "depth" slots in a POSIX shared
+ * memory object, from which any number of processes can read without
+ * locks, and without the writer knowing about them.  Frame s (counting
+ * from 0) goes in slot s % depth; each slot is a seqlock:
+ *
+ *   writer:  seq = 2s+1, write the frame, seq = 2s+2, then head = s+1
+ *   reader:  check seq == 2s+2, copy the frame, check seq again
+ *
+ * A reader that falls more than depth-1 frames behind the head has
+ * been overrun: it skips ahead to the oldest frame that is still safe
+ * to read and counts the frames it missed.
+ *
+ * Layout, in host byte order: mce_shmring_header_t, padded to
+ * MCE_SHMRING_DATA bytes, then depth slots of slot_size bytes, each an
+ * mce_shmring_slot_t followed by the frame (as stored by post_frame,
+ * i.e. row-major, as in a flat file).
+ *
+ * The object lives as long as the acquisition that writes it.  When it
+ * is done (or a new writer takes over the name) the writer sets
+ * "closed" and unlinks it; readers then look for a new object under
+ * the same name and carry on with that. */
+
+#define MCE_SHMRING_MAGIC    0x5245434d /* "MCER" */
+#define MCE_SHMRING_VERSION  1
+#define MCE_SHMRING_DATA     4096       /* offset of the first slot */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t frame_size;       // words per frame
+    uint32_t header_size;      // words before the data block
+    uint32_t depth;            // slots
+    uint32_t slot_size;        // bytes per slot
+    uint32_t cards;            // bit mask of reporting RCs
+    uint32_t rows;             // rows reported, per card
+    uint32_t cols;             // columns reported, per card
+    int32_t row0[MCEDATA_CARDS];    // readout rectangle, by RC
+    int32_t col0[MCEDATA_CARDS];
+    uint32_t closed;           // the writer is done with this object
+    uint64_t head;             // frames published so far
+    uint32_t reserved[8];
+} mce_shmring_header_t;
+
+typedef struct {
+    uint64_t seq;              // 2s+1 while frame s is written, then 2s+2
+    int64_t mono_ns;           // frame arrival (mce_host_time_t)
+    int64_t real_ns;
+    int32_t frame_index;       // as passed to post_frame
+    uint32_t reserved;
+} mce_shmring_slot_t;
+
+
+/* Reading */
+
+typedef struct mcedata_shmring mcedata_shmring_t;
+
+typedef struct {
+    uint64_t seq;              // position of the frame in the stream
+    int frame_index;
+    mce_host_time_t frame_time;
+} mce_shmring_frame_t;
+
+/* Open the ring called name (as given to mcedata_shmring_create) for
+   reading, from its newest frame on; NULL if there is no such ring. */
+mcedata_shmring_t *mcedata_shmring_open(const char *name);
+
+void mcedata_shmring_close(mcedata_shmring_t *ring);
+
+/* The header of the ring being followed.  It changes when the writer
+   is replaced (at a read that returns 0), so check the frame size
+   again after that, and don't keep the pointer across reads. */
+const mce_shmring_header_t *mcedata_shmring_header(
+        const mcedata_shmring_t *ring);
+
+/* Copy the next frame, if there is one, into data (room for max_words
+   words) and fill in info (if not NULL).  Returns the frame size, 0 if
+   there is no new frame yet, or -1 if the frame won't fit. */
+int mcedata_shmring_read(mcedata_shmring_t *ring, uint32_t *data,
+        int max_words, mce_shmring_frame_t *info);
+
+/* Frames missed so far by being overrun. */
+long long mcedata_shmring_lost(const mcedata_shmring_t *ring);
+
+/* The offset in the frame of MCE row and column (0-31), or -1 if it
+   is not read out. */
+int mcedata_shmring_channel(const mcedata_shmring_t *ring,
+        int mce_row, int mce_col);
+
+#endif
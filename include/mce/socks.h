@@ -82,6 +82,10 @@ int massock_listener_close( listener_t *list );
 int massock_listener_listen( listener_t *list, const char *addr );
 massock_listen_flags massock_listener_select( listener_t *list );
 
+/* Accept a pending connection (the listening socket is readable) and
+   add it to the client list and rfd_master; NULL on failure. */
+massock_client_t *massock_listener_accept( listener_t *list );
+
 massock_client_t *massock_client_add( listener_t *list, int fd );
 int massock_client_delete( massock_client_t *client );
 
@@ -89,4 +93,11 @@ massock_listen_flags massock_client_recv( massock_client_t *client );
 massock_listen_flags massock_client_send( massock_client_t *client, char *buf,
         int count );
 
+/* Buffered sending: queue appends count bytes to the client's
+   send_buf (-1 if they don't fit); flush sends as much of send_buf as
+   the socket takes without blocking, and keeps the rest. */
+int massock_client_queue( massock_client_t *client, const char *buf,
+        int count );
+massock_listen_flags massock_client_flush( massock_client_t *client );
+
 #endif
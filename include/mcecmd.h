@@ -108,6 +108,7 @@ int mcecmd_load_command(mce_command *cmd, uint32_t command,
 /* Packet examination */
 
 uint32_t mcecmd_checksum( const uint32_t *data, int count );
+uint32_t mcecmd_copy_checksum( uint32_t *dest, const uint32_t *src, int count );
 uint32_t mcecmd_cmd_checksum( const mce_command *cmd );
 int mcecmd_cmd_match_rep( const mce_command *cmd, const mce_reply *rep );
 
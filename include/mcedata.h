@@ -26,7 +26,12 @@
 #include <sys/types.h>
 #include <mce/frame.h>
 #include <mce/acq.h>
+#include <mce/frame_view.h>
+#include <mce/aggregate.h>
 #include <mce/data_mode.h>
+#include <mce/archive.h>
+#include <mce/shmring.h>
+#include <mce/netserve.h>
 
 /* Data connection */
 
@@ -43,8 +48,13 @@ int mcedata_empty_data(mce_context_t* context);
 int mcedata_fake_stopframe(mce_context_t* context);
 void mcedata_buffer_query(mce_context_t* context, int *head, int *tail,
         int *count);
+
+int mcedata_buffer_occupancy(mce_context_t* context, int *size);
 int mcedata_poll_offset(mce_context_t* context, int *offset);
 int mcedata_consume_frame(mce_context_t* context);
+int mcedata_poll_batch(mce_context_t* context, int *offsets, int max);
+int mcedata_consume_frames(mce_context_t* context, int n);
+int mcedata_wait_frame(mce_context_t* context, int timeout_ms);
 int mcedata_lock_query(mce_context_t* context);
 int mcedata_lock_reset(mce_context_t* context);
 int mcedata_lock_down(mce_context_t* context);
@@ -63,6 +73,22 @@ mcedata_storage_t* mcedata_rambuff_create(rambuff_callback_t callback,
 
 //void mcedata_rambuff_destroy(mce_acq_t *acq);
 
+/* rambuff_view: as rambuff, but the callback gets a view of the frame
+   in the driver's (card-major) order, and the frame is not reordered
+   unless something else needs it.  The view is only valid during the
+   callback. */
+
+typedef int (*rambuff_view_callback_t)(unsigned long user_data,
+        const mce_frame_view_t *view);
+
+mcedata_storage_t* mcedata_rambuff_view_create(rambuff_view_callback_t callback,
+        unsigned long user_data);
+
+/* Set up "view" with the frame geometry of acq; fill in view->data
+   before use. */
+
+void mcedata_frame_view_init(mce_frame_view_t *view, const mce_acq_t *acq);
+
 
 /* flatfile: frames are stored in a single data file */
 
@@ -71,12 +97,70 @@ mcedata_storage_t* mcedata_flatfile_create(const char *filename,
 
 //void mcedata_flatfile_destroy(mce_acq_t *acq);
 
+/* flatfile_buffered: as flatfile, but frames are gathered into two
+   large page-aligned buffers (buffer_size bytes each; 0 for 8 MB), one
+   of which is written out by a separate thread while the other fills.
+   With MCEDATA_FLATFILE_DIRECT the file is opened O_DIRECT, if the
+   filesystem allows it. */
+
+#define MCEDATA_FLATFILE_DIRECT   (1 << 0)
+
+mcedata_storage_t* mcedata_flatfile_buffered_create(const char *filename,
+        const char *symlink, int buffer_size, int options);
+
+
+/* archive: frames are stored losslessly compressed, in blocks of
+   block_frames (0 for the default, 256), channel by channel, so that a
+   reader can pick out a few channels cheaply; see mce/archive.h for the
+   format and the reader.  A flush writes out a short block.  The file
+   is overwritten, not appended to. */
+
+mcedata_storage_t* mcedata_archive_create(const char *filename,
+        const char *symlink, int block_frames);
+
+
+/* shmring: frames are published in a ring of depth (0 for the default,
+   1024) frames in the POSIX shared memory object "name" (e.g.
+   "/mce_frames"), for any number of other processes to follow; see
+   mce/shmring.h for the layout and the reader.  The object is replaced
+   by each acquisition and removed at cleanup. */
+
+mcedata_storage_t* mcedata_shmring_create(const char *name, int depth);
+
+
+/* netserve: frames are streamed over TCP to subscribers connecting to
+   addr ("host:port"; port 0 picks a free one), each getting the
+   channels and rate it asked for; see mce/netserve.h for the protocol
+   and the client.  Each subscriber gets a send buffer of send_max bytes
+   (0 for the default, 4 MB).  The server runs from init to cleanup. */
+
+mcedata_storage_t* mcedata_netserve_create(const char *addr, int send_max);
+
+/* The port being listened on, or -1. */
+int mcedata_netserve_port(mcedata_storage_t *storage);
+
+/* Frames skipped because the server thread fell behind, and subscribers
+   disconnected for not keeping up. */
+long long mcedata_netserve_skipped(mcedata_storage_t *storage);
+long long mcedata_netserve_dropped(mcedata_storage_t *storage);
+
 
 /* fileseq: frames are stored in a set of files, numbered sequentially */
 
 mcedata_storage_t* mcedata_fileseq_create(const char *basename, int interval,
                                           int digits, const char *symlink);
 
+/* Each file is opened ahead of time, and closed afterwards, by a helper
+   thread, so changing files costs post_frame no more than any other
+   frame.  With MCEDATA_SEQ_PREALLOCATE the helper also reserves disk
+   space for a whole file (fallocate); the excess is released when the
+   file is closed.  dirfileseq takes the same option. */
+
+#define MCEDATA_SEQ_PREALLOCATE   (1 << 1)
+
+mcedata_storage_t* mcedata_fileseq_create_options(const char *basename,
+        int interval, int digits, const char *symlink, int options);
+
 //void mcedata_fileseq_destroy(mce_acq_t *acq);
 
 /* generic destructor for mcedata_storage_t; it will be called automatically by mcedata_acq_destroy. */
@@ -93,11 +177,83 @@ mcedata_storage_t* mcedata_dirfileseq_create(const char *basename, int interval,
     int digits, int options, const char *include, int spf, int vers,
     const char *symlink);
 
-
-/* multisync storage class -- container for multiple storage objects */
+/* dirfile fields are written in blocks: block_frames samples per field
+   (0 for the default, 1024), gathered and written with one write per
+   field.  Data are also written out by the storage flush method, and
+   when the dirfile is closed.  With the MCEDATA_DIRFILE_SYNC option
+   each field is also fdatasync()ed after every block.  Call before the
+   acquisition is configured; works for dirfileseq too. */
+
+#define MCEDATA_DIRFILE_SYNC      (1 << 2)
+
+int mcedata_dirfile_set_block(mcedata_storage_t *storage, int block_frames);
+
+/* Write dirfile fields from n_workers threads, each with its own share
+   of the fields (0, the default, writes them from the acquisition
+   thread).  The output is the same either way.  Call before the
+   acquisition is configured; works for dirfileseq too. */
+
+int mcedata_dirfile_set_workers(mcedata_storage_t *storage, int n_workers);
+
+/* With the MCEDATA_DIRFILE_EXTRACT option, detector fields in packed
+   data modes (those with bit fields, e.g. 4, 5, 9, 10) are also stored
+   unpacked, each bit field as a raw field of its own: e.g. fb_r00c00
+   as FLOAT32 and fj_r00c00 as INT8 in mode 10, in place of the format
+   file's BIT/SBIT and LINCOM definitions.  Needs dirfile version 5 or
+   later; works for dirfileseq too. */
+
+#define MCEDATA_DIRFILE_EXTRACT   (1 << 3)
+
+/* Store the fields matching "fields" (an fnmatch pattern on the raw
+   field name, e.g. "tesdatar0?c*", or "header" for the frame header
+   fields) at 1/factor of the frame rate.  outputs says what to store
+   for each group of factor samples: its first sample, under the
+   field's own name; and/or its mean, minimum and maximum, as the
+   fields <name>_mean (FLOAT64), <name>_min and <name>_max.  0 means
+   the first sample.  Rules apply in the order given; the last one to
+   match a field wins, and a factor of 1 restores the full rate.  The
+   format file declares each field's spf accordingly, so the fastest
+   fields get spf times the largest ratio of rates.  A trailing partial
+   group is stored when the dirfile is closed.  Call before the
+   acquisition is configured; works for dirfileseq too. */
+
+#define MCEDATA_DECIMATE_SAMPLE   (1 << 0)
+#define MCEDATA_DECIMATE_MEAN     (1 << 1)
+#define MCEDATA_DECIMATE_MIN      (1 << 2)
+#define MCEDATA_DECIMATE_MAX      (1 << 3)
+
+int mcedata_dirfile_decimate(mcedata_storage_t *storage, const char *fields,
+        int factor, int outputs);
+
+
+/* multisync storage class -- container for multiple storage objects.
+   Each sync stores frames from its own queue, in its own thread, so a
+   slow one doesn't hold up the rest.  When a sync's queue (of depth
+   frames) is full, its policy decides: wait for room (BLOCK), drop
+   its oldest frame (DROP), or stop using that sync, reporting
+   -MCE_ERR_FRAME_OVERRUN (STOP).
+
+   The frame is copied once, into a buffer that all the queues share;
+   when any sync takes views, the frame as the MCE sent it is copied
+   into that buffer as well.
+
+   The error callback returns non-zero to stop using the sync.  It is
+   called from the acquisition's thread for init, flush and cleanup
+   errors and for overruns, but from the sync's own thread for
+   pre_frame, post_view and post_frame errors; so with several syncs
+   it may run in several threads at once, and must be thread-safe.
+   The latest of those frame errors is also returned by the next
+   multisync post_frame (or flush), in the acquisition's thread. */
+
+#define MCEDATA_MULTISYNC_DEPTH   256
+
+#define MCEDATA_MULTISYNC_BLOCK   0
+#define MCEDATA_MULTISYNC_DROP    1
+#define MCEDATA_MULTISYNC_STOP    2
 
 enum mcedata_stage {mcedata_acq_init, mcedata_acq_cleanup,
-    mcedata_acq_pre_frame, mcedata_acq_flush, mcedata_acq_post_frame};
+    mcedata_acq_pre_frame, mcedata_acq_flush, mcedata_acq_post_frame,
+    mcedata_acq_post_view};
 typedef enum mcedata_stage mcedata_stage_t;
 
 typedef int (*multisync_err_callback_t)(void *user_data, int sync_num, int err,
@@ -108,6 +264,18 @@ mcedata_storage_t* mcedata_multisync_create(int options);
 int mcedata_multisync_add(mce_acq_t *multisync_acq,
                           mcedata_storage_t *sync);
 
+/* As mcedata_multisync_add, with a queue of depth frames (0 for the
+   default) and an overflow policy. */
+int mcedata_multisync_add_queue(mce_acq_t *multisync_acq,
+        mcedata_storage_t *sync, int depth, int policy);
+
+/* Wait until every sync has stored everything queued so far; does
+   nothing if acq's storage isn't a multisync. */
+void mcedata_multisync_drain(mce_acq_t *acq);
+
+/* Frames dropped so far by sync sync_num (under MCEDATA_MULTISYNC_DROP). */
+long long mcedata_multisync_dropped(mce_acq_t *multisync_acq, int sync_num);
+
 void mcedata_multisync_errcallback(mce_acq_t *multisync_acq,
         multisync_err_callback_t callback, void *user_data);
 
@@ -121,4 +289,98 @@ mce_acq_t *mcedata_acq_duplicate(mce_acq_t *acq);
 
 int mcedata_acq_go(mce_acq_t *acq, int n_frames);
 
+/* Asynchronous acquisition: mcedata_acq_start issues the GO and returns
+   at once, while a thread collects the frames.  mcedata_acq_wait
+   returns acq->status once that thread is done (0 if the acquisition
+   completed; acq->n_frames_complete says how far it got), or
+   -MCE_ERR_TIMEOUT.  mcedata_acq_stop asks the MCE to stop early and
+   waits; the STOP frame it asked for is not an error.  The callback,
+   if set, is run from the data thread as the acquisition finishes.
+   Called from the data thread (the callback, or storage handlers),
+   mcedata_acq_wait and _stop return -MCE_ERR_ACTIVE rather than wait
+   for themselves. */
+
+int mcedata_acq_start(mce_acq_t *acq, int n_frames);
+int mcedata_acq_wait(mce_acq_t *acq, int timeout_ms);
+int mcedata_acq_stop(mce_acq_t *acq);
+void mcedata_acq_set_callback(mce_acq_t *acq,
+        mcedata_acq_callback_t callback, void *user_data);
+
+/* Open-ended acquisition: like mcedata_acq_start, but the data thread
+   re-issues the GO each time the MCE reaches the end of a chunk of
+   chunk_frames frames (MCEDATA_STREAM_CHUNK if <= 0), and keeps going
+   until mcedata_acq_stop.  Continuity (acq->stream.gaps) is checked
+   using the frame header's frame_counter. */
+
+int mcedata_acq_stream(mce_acq_t *acq, int chunk_frames);
+
+
+/* Pipelined acquisition: frames are copied out of the driver buffer
+   into a queue of "depth" frames; n_workers threads reorder them, in
+   parallel, and pass them to storage one at a time, in order.  More
+   than one worker only helps when reordering, not storage, is the
+   bottleneck.  depth=0 returns to in-line processing. */
+
+typedef struct mcedata_pipeline_stats {
+    int depth;              /* queue size, in frames */
+    int n_workers;
+    int queued;             /* frames currently queued */
+    int high_water;         /* most frames queued at once */
+    long long frames;       /* frames passed through the queue */
+    long long full_waits;   /* times the reader waited on a full queue */
+} mcedata_pipeline_stats_t;
+
+int mcedata_acq_set_pipeline(mce_acq_t *acq, int depth, int n_workers);
+
+int mcedata_acq_pipeline_stats(mce_acq_t *acq,
+        mcedata_pipeline_stats_t *stats, int reset);
+
+
+/* Statistics for the latest (or current) go; see mce_acq_stats_t in
+   mce/acq.h.  mcedata_acq_stats_summary formats the one-line summary
+   that is also sent to maslog at the end of each go. */
+
+int mcedata_acq_stats(mce_acq_t *acq, mce_acq_stats_t *stats);
+
+/* Log each frame_counter gap or sync_number error to a text file (one
+   line per event, appended); filename=NULL stops logging. */
+
+int mcedata_acq_set_gap_log(mce_acq_t *acq, const char *filename);
+
+int mcedata_acq_stats_summary(const mce_acq_stats_t *stats, char *buf,
+        int size);
+
+
+/* Aggregated acquisition (see mce/aggregate.h) */
+
+/* Frame sources.  An acq source reads frames from the acq's MCE (which
+   is started by mcedata_aggregate_go); the acq's own storage is not
+   used.  A memory source hands out n_frames frames from the array,
+   which must outlive it.  A flatfile source reads a recording made by
+   the flatfile storage. */
+
+mcedata_source_t *mcedata_source_acq_create(mce_acq_t *acq);
+mcedata_source_t *mcedata_source_memory_create(const uint32_t *frames,
+        int frame_size, int n_frames);
+mcedata_source_t *mcedata_source_flatfile_create(const char *filename,
+        int frame_size);
+
+/* The aggregate takes ownership of the sources and the storage.
+   context, which may be NULL, is used only for error reporting.
+   max_skew <= 0 means MCEDATA_AGG_MAX_SKEW. */
+
+mcedata_aggregate_t *mcedata_aggregate_create(mce_context_t *context,
+        mcedata_source_t **sources, int n_sources, int max_skew,
+        mcedata_storage_t *storage);
+
+/* Store up to n_frames super-frames; stops early, returning 0, if a
+   source runs out of frames.  Returns -MCE_ERR_FRAME_TIMEOUT if no
+   source produces a frame for timeout_ms (<= 0 to wait forever). */
+
+int mcedata_aggregate_go(mcedata_aggregate_t *agg, int n_frames,
+        int timeout_ms);
+int mcedata_aggregate_stats(mcedata_aggregate_t *agg,
+        mcedata_aggregate_stats_t *stats);
+int mcedata_aggregate_destroy(mcedata_aggregate_t *agg);
+
 #endif
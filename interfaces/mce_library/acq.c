@@ -5,10 +5,12 @@
 
 #include <stdlib.h>
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 #include <ctype.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/ioctl.h>
 
 #include <mce_library.h>
@@ -16,15 +18,19 @@
 #ifdef NO_MCE_OPS
 #else
 #include <mce/ioctl.h>
+#include <mce/dsp.h>
 
 #include "context.h"
 #include "data_thread.h"
 #include "frame_manip.h"
+#include "gapcheck.h"
+#include "pipeline.h"
+#include "rt.h"
+#include "stats.h"
 
-#define FRAME_USLEEP 1000
-
-
-static int copy_frames_mmap(mce_acq_t *acq);
+/* Without the driver's control page, query the buffer occupancy for
+ * the statistics only every this many polls. */
+#define RING_SAMPLE_POLLS 64
 
 static int set_n_frames(mce_acq_t *acq, int n_frames, int dsp_only);
 
@@ -38,6 +44,11 @@ static int load_data_params(mce_acq_t *acq);
 
 static int load_ret_dat(mce_acq_t *acq);
 
+
+static int start_thread(mce_acq_t *acq, int n_frames);
+
+static void free_frame_buffers(mce_acq_t *acq);
+
 #if 0
 static int cards_to_rcsflags(int c);
 #endif
@@ -49,6 +60,7 @@ int mcedata_acq_create(mce_acq_t *acq, mce_context_t* context,
         mcedata_storage_t *storage)
 {
     int ret_val = 0;
+    int storage_ready = 0;
 
     // Zero the structure!
     memset(acq, 0, sizeof(*acq));
@@ -57,16 +69,17 @@ int mcedata_acq_create(mce_acq_t *acq, mce_context_t* context,
     acq->options = options;
     acq->context = context;
     acq->storage = storage;
+    acq_stats_reset(&acq->stats);
 
     // Load frame size parameters from MCE
     ret_val = load_frame_params(acq, cards);
     if (ret_val != 0)
-        return ret_val;
+        goto fail;
 
     // Load data description stuff
     ret_val = load_data_params(acq);
     if (ret_val != 0)
-        return ret_val;
+        goto fail;
 
     // Save frame size and other options
     acq->frame_size = acq->rows * acq->cols * acq->n_cards +
@@ -76,14 +89,28 @@ int mcedata_acq_create(mce_acq_t *acq, mce_context_t* context,
     if (acq->frame_size > MCEDATA_PACKET_MAX) {
         fprintf(stderr, "MCE packet size too large (%i dwords), failing.\n",
                 acq->frame_size);
-        return -MCE_ERR_FRAME_SIZE;
+        ret_val = -MCE_ERR_FRAME_SIZE;
+        goto fail;
+    }
+
+    // Plan the data reordering, and a place to put the result.
+    acq->reorder = frame_reorder_create(acq);
+    acq->frame_buf = malloc(MCEDATA_PACKET_MAX * sizeof(uint32_t));
+    acq->view = malloc(sizeof(*acq->view));
+    acq->gapcheck = calloc(1, sizeof(*acq->gapcheck));
+    if (acq->reorder == NULL || acq->frame_buf == NULL || acq->view == NULL ||
+            acq->gapcheck == NULL) {
+        mcelib_error(context, "Could not set up frame reordering.\n");
+        ret_val = -MCE_ERR_FRAME_SIZE;
+        goto fail;
     }
+    mcedata_frame_view_init(acq->view, acq);
 
     // Lookup "cc ret_dat_s" (frame count) or fail
     if ((ret_val=mcecmd_load_param(
                     acq->context, &acq->ret_dat_s, "cc", "ret_dat_s")) != 0) {
         /* fprintf(stderr, "Could not load 'cc ret_dat_s'\n"); */
-        return ret_val;
+        goto fail;
     }
 
     // Set frame size in driver.
@@ -92,23 +119,49 @@ int mcedata_acq_create(mce_acq_t *acq, mce_context_t* context,
     if (ret_val != 0) {
         mcelib_error(context, "Could not set data size to %i [%i]\n",
                 acq->frame_size, ret_val);
-        return -MCE_ERR_FRAME_SIZE;
+        ret_val = -MCE_ERR_FRAME_SIZE;
+        goto fail;
     }
 
     if (acq->storage->init != NULL && acq->storage->init(acq) != 0) {
         mcelib_error(context, "Storage init action failed.\n");
-        return -MCE_ERR_FRAME_OUTPUT;
+        ret_val = -MCE_ERR_FRAME_OUTPUT;
+        goto fail;
     }
+    storage_ready = 1;
 
     // Sensible defaults.
     acq->timeout_ms = 1000;
 
+    if (options & MCEDATA_PIPELINE) {
+        ret_val = mcedata_acq_set_pipeline(acq, MCEDATA_PIPELINE_DEPTH,
+                MCEDATA_PIPELINE_WORKERS);
+        if (ret_val != 0)
+            goto fail;
+    }
+
+    // Keep page faults out of the acquisition loop, if so configured.
+    rt_lock_acq(acq);
+
     acq->ready = 1;
     return 0;
+
+fail:
+    // The storage is still the caller's; just undo its init.
+    if (storage_ready && acq->storage->cleanup != NULL)
+        acq->storage->cleanup(acq);
+    free_frame_buffers(acq);
+    return ret_val;
 }
 
 int mcedata_acq_destroy(mce_acq_t *acq)
 {
+    if (acq->thread != NULL)
+        mcedata_acq_stop(acq);
+
+    mcedata_pipeline_destroy(acq->pipeline);
+    acq->pipeline = NULL;
+
     if (acq->storage->cleanup != NULL && acq->storage->cleanup(acq) != 0) {
         mcelib_error(acq->context, "Storage init action failed.\n");
         return -MCE_ERR_FRAME_OUTPUT;
@@ -116,18 +169,81 @@ int mcedata_acq_destroy(mce_acq_t *acq)
 
     acq->storage = mcedata_storage_destroy(acq->storage);
 
+    free_frame_buffers(acq);
     return 0;
 }
 
-mce_acq_t *mcedata_acq_duplicate(mce_acq_t *acq)
+/* Free what mcedata_acq_create set up for handling frames. */
+static void free_frame_buffers(mce_acq_t *acq)
 {
-    mce_acq_t *acq_copy = (mce_acq_t *)malloc(sizeof(*acq));
-    if (acq_copy != NULL)
-        memcpy(acq_copy, acq, sizeof(*acq));
-    return acq_copy;
+    frame_reorder_destroy(acq->reorder);
+    acq->reorder = NULL;
+    free(acq->frame_buf);
+    acq->frame_buf = NULL;
+    free(acq->view);
+    acq->view = NULL;
+    if (acq->gapcheck != NULL)
+        gapcheck_set_log(acq->gapcheck, NULL);
+    free(acq->gapcheck);
+    acq->gapcheck = NULL;
 }
 
-int mcedata_acq_go(mce_acq_t *acq, int n_frames)
+int mcedata_acq_set_pipeline(mce_acq_t *acq, int depth, int n_workers)
+{
+    mcedata_pipeline_destroy(acq->pipeline);
+    acq->pipeline = NULL;
+
+    if (depth <= 0)
+        return 0;
+    if (n_workers <= 0)
+        n_workers = MCEDATA_PIPELINE_WORKERS;
+
+    acq->pipeline = mcedata_pipeline_create(acq, depth, n_workers);
+    if (acq->pipeline == NULL) {
+        mcelib_error(acq->context, "Could not create acquisition pipeline "
+                "(depth=%i, workers=%i).\n", depth, n_workers);
+        return -MCE_ERR_FRAME_OUTPUT;
+    }
+    return 0;
+}
+
+int mcedata_acq_pipeline_stats(mce_acq_t *acq,
+        mcedata_pipeline_stats_t *stats, int reset)
+{
+    if (acq->pipeline == NULL) {
+        memset(stats, 0, sizeof(*stats));
+        return -MCE_ERR_NOT_ACTIVE;
+    }
+    mcedata_pipeline_get_stats(acq->pipeline, stats, reset);
+    return 0;
+}
+
+int mcedata_acq_set_gap_log(mce_acq_t *acq, const char *filename)
+{
+    if (gapcheck_set_log(acq->gapcheck, filename) != 0) {
+        mcelib_error(acq->context, "Could not open gap log '%s'.\n",
+                filename);
+        return -MCE_ERR_FRAME_OUTPUT;
+    }
+    return 0;
+}
+
+int mcedata_acq_stats(mce_acq_t *acq, mce_acq_stats_t *stats)
+{
+    memcpy(stats, &acq->stats, sizeof(*stats));
+    return 0;
+}
+
+int mcedata_acq_stats_summary(const mce_acq_stats_t *stats, char *buf,
+        int size)
+{
+    return acq_stats_summary(stats, buf, size);
+}
+
+/* acq_start_frames - get the MCE and driver going on n_frames frames (or
+ * whatever ret_dat_s says, if n_frames < 0). */
+
+int acq_start_frames(mce_acq_t *acq, int n_frames)
 {
     int ret_val = 0;
 
@@ -138,6 +254,9 @@ int mcedata_acq_go(mce_acq_t *acq, int n_frames)
         return -MCE_ERR_FRAME_UNKNOWN;
     }
 
+    if (acq->context->data.map == NULL)
+        return -MCE_ERR_NEED_DATA;
+
     // Does checking / setting ret_dat_s really slow us down?
     if (n_frames < 0) {
         n_frames = get_n_frames(acq);
@@ -156,33 +275,133 @@ int mcedata_acq_go(mce_acq_t *acq, int n_frames)
     if (ret_val != 0)
         return ret_val;
 
-    // Launch the data thread, or just block for data.
     acq->n_frames = n_frames;
+    return 0;
+}
 
-    if (acq->options & MCEDATA_THREAD) {
-        data_thread_t d;
-        d.state = MCETHREAD_IDLE;
-        d.acq = acq;
-        if ((ret_val=data_thread_launcher(&d)) != 0)
-            return ret_val;
+int mcedata_acq_go(mce_acq_t *acq, int n_frames)
+{
+    int ret_val;
 
-        while (d.state != MCETHREAD_IDLE) {
-            /* printf("thread state = %i\n", d.state); */
-            usleep(FRAME_USLEEP);
-        }
+    if (acq != NULL)
+        acq->stream.chunk = 0;
 
-    } else {
-        /* Block for frames, and return */
-        if (acq->context->data.map != NULL) {
-            ret_val = copy_frames_mmap(acq);
-        } else {
-            ret_val = -1;
-        }
+    // The thread option just runs the loop in another thread.
+    if (acq != NULL && (acq->options & MCEDATA_THREAD)) {
+        ret_val = mcedata_acq_start(acq, n_frames);
+        if (ret_val == 0)
+            ret_val = mcedata_acq_wait(acq, -1);
+        return ret_val;
     }
 
+    ret_val = acq_start_frames(acq, n_frames);
+    if (ret_val != 0)
+        return ret_val;
+
+    /* Block for frames, and return */
+    return copy_frames_mmap(acq);
+}
+
+int mcedata_acq_start(mce_acq_t *acq, int n_frames)
+{
+    if (acq != NULL)
+        acq->stream.chunk = 0;
+    return start_thread(acq, n_frames);
+}
+
+int mcedata_acq_stream(mce_acq_t *acq, int chunk_frames)
+{
+    int ret_val;
+
+    if (chunk_frames <= 0)
+        chunk_frames = MCEDATA_STREAM_CHUNK;
+
+    memset(&acq->stream, 0, sizeof(acq->stream));
+    acq->stream.chunk = chunk_frames;
+
+    ret_val = start_thread(acq, chunk_frames);
+    if (ret_val != 0)
+        acq->stream.chunk = 0;
     return ret_val;
 }
 
+static int start_thread(mce_acq_t *acq, int n_frames)
+{
+    int ret_val;
+
+    if (acq != NULL && acq->thread != NULL) {
+        // Clean up after a previous acquisition, if it's done.
+        if (mcedata_acq_wait(acq, 0) != 0)
+            return -MCE_ERR_ACTIVE;
+    }
+
+    ret_val = acq_start_frames(acq, n_frames);
+    if (ret_val != 0)
+        return ret_val;
+
+    acq->status = 0;
+    acq->n_frames_complete = 0;
+    acq->thread = data_thread_launcher(acq);
+    if (acq->thread == NULL) {
+        mcelib_error(acq->context, "Could not launch data thread.\n");
+        mcecmd_stop_application(acq->context, &acq->ret_dat);
+        return -MCE_ERR_FAILURE;
+    }
+    return 0;
+}
+
+int mcedata_acq_wait(mce_acq_t *acq, int timeout_ms)
+{
+    int ret_val;
+
+    if (acq->thread == NULL)
+        return -MCE_ERR_NOT_ACTIVE;
+    if (data_thread_is_self(acq->thread))
+        return -MCE_ERR_ACTIVE;
+
+    ret_val = data_thread_wait(acq->thread, timeout_ms);
+    if (ret_val != 0)
+        return ret_val;
+
+    data_thread_destroy(acq->thread);
+    acq->thread = NULL;
+    return acq->status;
+}
+
+int mcedata_acq_stop(mce_acq_t *acq)
+{
+    int ret_val;
+
+    if (acq->thread == NULL)
+        return -MCE_ERR_NOT_ACTIVE;
+    if (data_thread_is_self(acq->thread))
+        return -MCE_ERR_ACTIVE;
+
+    // Ask the MCE to end the acquisition with a STOP frame; and don't
+    // start another chunk, if we're streaming.
+    acq->stream.stop = 1;
+    if (data_thread_wait(acq->thread, 0) != 0 &&
+            mcecmd_stop_application(acq->context, &acq->ret_dat) != 0)
+        mcelib_warning(acq->context, "Could not send STOP to MCE.\n");
+
+    ret_val = mcedata_acq_wait(acq,
+            acq->timeout_ms > 0 ? acq->timeout_ms : 1000);
+    if (ret_val == -MCE_ERR_TIMEOUT) {
+        // Nothing from the MCE; have the driver kick the data thread.
+        mcedata_fake_stopframe(acq->context);
+        ret_val = mcedata_acq_wait(acq, -1);
+    }
+    // Ending on the STOP we asked for is a success.
+    return (ret_val == -MCE_ERR_FRAME_STOP) ? 0 : ret_val;
+}
+
+void mcedata_acq_set_callback(mce_acq_t *acq,
+        mcedata_acq_callback_t callback, void *user_data)
+{
+    acq->callback = callback;
+    acq->callback_data = user_data;
+}
+
 
 /* set_n_frames - must tell both the MCE and the DSP about the number
  * of frames to expect. */
@@ -385,78 +604,263 @@ int load_ret_dat(mce_acq_t *acq)
 }
 
 
-#define COPY_FRAMES_SLEEP_US 1000
+/* Frame numbers given to storage are ints; a stream that runs past
+ * INT_MAX frames starts them again from 0. */
+#define STORAGE_INDEX(index) ((int)((index) & INT_MAX))
 
-int copy_frames_mmap(mce_acq_t *acq)
+/* Milliseconds on the monotonic clock, for frame timeouts. */
+static long long mono_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* stream_frame - in streaming mode, start the next chunk when the MCE
+ * signals its LAST frame.  Returns the revised EXIT_* code. */
+static int stream_frame(mce_acq_t *acq, const uint32_t *data, int done)
+{
+    mcedata_stream_t *st = &acq->stream;
+
+    st->frames++;
+
+    switch (done) {
+        case EXIT_COUNT:
+            // Chunk length is the MCE's business; it will send LAST.
+            return 0;
+
+        case EXIT_LAST:
+            if (st->stop)
+                return done;
+            // After a restart the MCE counts frames from ret_dat_s[0]
+            // again; sync_number keeps going.
+            gapcheck_restart(acq->gapcheck);
+            if (mcecmd_start_application(acq->context, &acq->ret_dat) != 0) {
+                mcelib_error(acq->context, "stream: could not restart "
+                        "acquisition after %lli frames\n", st->frames);
+                return EXIT_WRITE;
+            }
+            st->restarts++;
+            st->chunk_frames = 0;
+            return 0;
+    }
+    return done;
+}
+
+/* Report a frame_counter or sync_number discontinuity found by
+ * gapcheck_frame, and update the counts. */
+static void gap_event(mce_acq_t *acq)
+{
+    const gapcheck_t *g = acq->gapcheck;
+    mce_acq_stats_t *stats = &acq->stats;
+    int n_events = g->gap_events + g->sync_events;
+
+    if (n_events <= MCEDATA_GAP_WARNINGS) {
+        if (g->kind == GAP_SYNC)
+            mcelib_warning(acq->context, "frame %lli: sync_number %u, "
+                    "expected %u\n", g->index, g->sync, g->expected_sync);
+        else
+            mcelib_warning(acq->context, "frame %lli: frame_counter %u, "
+                    "expected %u (%s)\n", g->index, g->counter,
+                    g->expected_counter,
+                    g->kind == GAP_MISSING ? "missing frames" : "repeated");
+    }
+
+    stats->gaps = g->missing;
+    stats->gap_events = g->gap_events;
+    stats->repeats = g->repeats;
+    stats->sync_events = g->sync_events;
+    acq->stream.gaps = g->missing;
+    acq->stream.gap_events = g->gap_events;
+}
+
+/* Check frame number index for the end of acquisition; returns
+ * non-zero (an EXIT_* code) if this is the last frame.  chksum is the
+ * XOR of the whole frame, which is usually worked out while copying
+ * it. */
+static int frame_done(mce_acq_t *acq, long long index, const uint32_t *data,
+        uint32_t chksum)
 {
-    int ret_val = 0;
     int done = 0;
-    int count = 0;
-    uint32_t *data;
 
-    int max_waits = (acq->timeout_ms * 1000 + COPY_FRAMES_SLEEP_US/2)  /
-        COPY_FRAMES_SLEEP_US;
-    if (max_waits == 0 && acq->timeout_ms > 0)
-        max_waits = 1;
+    // A stream counts the frames of each GO; stream_frame starts over.
+    if (acq->stream.chunk > 0) {
+        if (++acq->stream.chunk_frames >= acq->n_frames)
+            done = EXIT_COUNT;
+    } else if (index + 1 >= acq->n_frames) {
+        done = EXIT_COUNT;
+    }
+
+    // Validate the checksum before interpreting status bits.
+    if (chksum == 0) {
+        if (frame_property(data, &frame_header_v6, status_v6)
+                & FRAME_STATUS_V6_STOP)
+            done = EXIT_STOP;
+
+        if (frame_property(data, &frame_header_v6, status_v6)
+                & FRAME_STATUS_V6_LAST)
+            done = EXIT_LAST;
+    } else {
+        if (acq->stats.checksum_errors < MCEDATA_CHECKSUM_WARNINGS)
+            mcelib_warning(acq->context, "checksum verification failed "
+                    "(frame %lli)\n", index);
+        acq->stats.checksum_errors++;
+        acq->stats.last_checksum_error = STORAGE_INDEX(index);
+    }
+
+    acq->stats.frames++;
+    if (gapcheck_frame(acq->gapcheck, index, data) != GAP_NONE)
+        gap_event(acq);
+
+    if (acq->stream.chunk > 0)
+        done = stream_frame(acq, data, done);
+
+    return done;
+}
+
+/* Handle frame number index, at data in the driver buffer; returns
+ * non-zero (an EXIT_* code) if the acquisition is complete.  Storage
+ * post_view gets a view of the frame as it is in the driver buffer.
+ * Storage post_frame gets the frame in row-major order: single-card
+ * frames are passed straight from the driver buffer, others are
+ * reordered into acq->frame_buf in a single pass.  t is the frame's
+ * arrival time, for acq->frame_time. */
+int acq_copy_frame(mce_acq_t *acq, long long index, uint32_t *data,
+        const mce_host_time_t *t)
+{
+    uint32_t *frame = data;
+    uint32_t chksum;
+    int count = STORAGE_INDEX(index);
+    double t0;
+
+    // In pipelined mode, the workers do the rest.
+    if (acq->pipeline != NULL) {
+        chksum = mcedata_pipeline_push(acq->pipeline, count, data, t);
+        return frame_done(acq, index, data, chksum);
+    }
+
+    acq->frame_time = *t;
+
+    if (acq->storage->pre_frame != NULL &&
+            acq->storage->pre_frame(acq) != 0) {
+        mcelib_warning(acq->context, "pre_frame action failed\n");
+    }
+
+    t0 = acq_stats_now();
+    if (acq->storage->post_view != NULL) {
+        acq->view->data = data;
+        if (acq->storage->post_view(acq, count, acq->view))
+            mcelib_warning(acq->context, "post_view action failed\n");
+    }
+
+    // Logical formatting; the copy also gets us the checksum.
+    if (acq->storage->post_frame == NULL || acq->reorder->identity) {
+        chksum = mcecmd_checksum(data, acq->frame_size);
+    } else {
+        chksum = frame_reorder_apply(acq->reorder, acq->frame_buf, data);
+        frame = acq->frame_buf;
+    }
+
+    if ( (acq->storage->post_frame != NULL) &&
+            acq->storage->post_frame( acq, count, frame ) ) {
+        mcelib_warning(acq->context, "post_frame action failed\n");
+    }
+    acq->stats.storage_time += acq_stats_now() - t0;
 
+    return frame_done(acq, index, data, chksum);
+}
+
+int copy_frames_mmap(mce_acq_t *acq)
+{
+    int ret_val = 0;
+    int done = 0;
+    long long count = 0;
+    int offsets[DSP_FRAME_BATCH_MAX];
+    mce_host_time_t arrival;
+    host_clock_t clock = { 0, 0 };
+    struct rt_saved *rt;
+    char summary[MCE_LONG];
+    int i, n;
+
+    rt = rt_thread_enter(acq->context, RT_ACQ);
     acq->n_frames_complete = 0;
+    acq_stats_reset(&acq->stats);
+    gapcheck_reset(acq->gapcheck);
+    mcedata_buffer_occupancy(acq->context, &acq->stats.ring_size);
 
     /* memmap loop */
     while (!done) {
 
-        int waits = 0;
+        // Timeout applies to the wait for each batch; timeout_ms <= 0
+        // means wait forever.
+        long long deadline = -1;
+        n = 0;
         while (!done) {
-            // The poll returns 1 if there are frames ready.
-            if (mcedata_poll_offset(acq->context, &ret_val) != 0)
+            int wait_ms = -1;
+
+            // Collect offsets of all ready frames, but no more than we need.
+            if (acq->stream.chunk > 0 ||
+                    acq->n_frames - count > DSP_FRAME_BATCH_MAX)
+                n = DSP_FRAME_BATCH_MAX;
+            else
+                n = acq->n_frames - count;
+            n = mcedata_poll_batch(acq->context, offsets, n);
+            acq->stats.polls++;
+            if (n > 0) {
+                acq_host_time(&clock, &arrival);
                 break;
-            if (ret_val != EAGAIN) {
+            }
+            if (n < 0) {
                 done = EXIT_KILL;
                 break;
             }
-            usleep(COPY_FRAMES_SLEEP_US);
-            if (max_waits > 0 && ++waits >= max_waits)
-                done = EXIT_TIMEOUT;
-        }
-        if (done)
-            break;
-
-        if (acq->storage->pre_frame != NULL &&
-                acq->storage->pre_frame(acq) != 0) {
-            mcelib_warning(acq->context, "pre_frame action failed\n");
-        }
-
-        // New frame at offset ret_val
-        data = acq->context->data.map + ret_val;
 
-        // Logical formatting
-        sort_columns( acq, data );
+            if (acq->timeout_ms > 0) {
+                if (deadline < 0)
+                    deadline = mono_ms() + acq->timeout_ms;
+                wait_ms = (int)(deadline - mono_ms());
+                if (wait_ms <= 0) {
+                    done = EXIT_TIMEOUT;
+                    break;
+                }
+            }
+            acq->stats.empty_polls++;
 
-        if ( (acq->storage->post_frame != NULL) &&
-                acq->storage->post_frame( acq, count, data ) ) {
-            mcelib_warning(acq->context, "post_frame action failed\n");
+            // Sleep until the driver signals a new frame.
+            if (mcedata_wait_frame(acq->context, wait_ms) < 0)
+                done = EXIT_READ;
         }
+        if (done)
+            break;
 
-        if (++count >= acq->n_frames)
-            done = EXIT_COUNT;
-
-        // Validate the checksum before interpreting status bits.
-        uint32_t cs = mcecmd_checksum(data, acq->frame_size);
-        if (cs == 0) {
-            if (frame_property(data, &frame_header_v6, status_v6)
-                    & FRAME_STATUS_V6_STOP)
-                done = EXIT_STOP;
-
-            if (frame_property(data, &frame_header_v6, status_v6)
-                    & FRAME_STATUS_V6_LAST)
-                done = EXIT_LAST;
-        } else {
-            mcelib_warning(acq->context, "checksum verification failed\n");
+        // Buffer occupancy is free with the control page; otherwise
+        // the batch size is a lower bound, and we query now and then.
+        if (acq->context->data.ctrl != NULL ||
+                acq->stats.polls % RING_SAMPLE_POLLS == 0)
+            acq_stats_ring(&acq->stats,
+                    mcedata_buffer_occupancy(acq->context, NULL));
+        acq_stats_ring(&acq->stats, n);
+
+        // Process the batch, stopping early at end of acquisition.
+        for (i=0; i<n && !done; i++) {
+            uint32_t *data = acq->context->data.map + offsets[i];
+            double t0 = acq_stats_now();
+            done = acq_copy_frame(acq, count++, data, &arrival);
+            acq_stats_latency(&acq->stats, acq_stats_now() - t0);
         }
 
         // Inform driver of consumption
-        mcedata_consume_frame(acq->context);
+        if ((ret_val = mcedata_consume_frames(acq->context, i)) != i) {
+            mcelib_warning(acq->context,
+                    "failed to consume frames (%i of %i)\n", ret_val, i);
+        }
     }
 
+    // Everything should be stored before we return.
+    if (acq->pipeline != NULL)
+        mcedata_pipeline_drain(acq->pipeline);
+    mcedata_multisync_drain(acq);
+
     switch (done) {
         case EXIT_COUNT:
         case EXIT_LAST:
@@ -480,8 +884,23 @@ int copy_frames_mmap(mce_acq_t *acq)
             break;
     }
 
-    acq->n_frames_complete = count;
+    // A stream can outrun an int; acq->stream.frames has the total.
+    acq->n_frames_complete = (count > INT_MAX) ? INT_MAX : count;
 
+    if (acq->stats.checksum_errors > MCEDATA_CHECKSUM_WARNINGS)
+        mcelib_warning(acq->context, "%i of %lli frames failed checksum\n",
+                acq->stats.checksum_errors, count);
+    if (acq->stats.gap_events + acq->stats.sync_events > MCEDATA_GAP_WARNINGS)
+        mcelib_warning(acq->context, "%i frame_counter gaps (%lli frames "
+                "missing), %i sync_number errors\n", acq->stats.gap_events,
+                acq->stats.gaps, acq->stats.sync_events);
+    if (acq->gapcheck->log != NULL)
+        fflush(acq->gapcheck->log);
+
+    acq_stats_summary(&acq->stats, summary, sizeof(summary));
+    maslog_print_level(acq->context->maslog, summary, MASLOG_INFO);
+
+    rt_thread_leave(rt);
     return 0;
 }
 
@@ -532,6 +951,18 @@ static int rcsflags_to_cards(int c)
     return out;
 }
 
+#endif
+
+/* These don't need the driver. */
+
+mce_acq_t *mcedata_acq_duplicate(mce_acq_t *acq)
+{
+    mce_acq_t *acq_copy = (mce_acq_t *)malloc(sizeof(*acq));
+    if (acq_copy != NULL)
+        memcpy(acq_copy, acq, sizeof(*acq));
+    return acq_copy;
+}
+
 int mcelib_symlink(const char *newpath, const char *target)
 {
     int err = 0;
@@ -572,4 +1003,3 @@ int mcelib_symlink(const char *newpath, const char *target)
     free(tmp);
     return 0;
 }
-#endif
@@ -0,0 +1,588 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Aggregated acquisition from several frame sources (typically one
+ * MCE per fibre card), aligned on header sync_number.  See
+ * mce/aggregate.h. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mce_library.h>
+#include <mce/dsp.h>
+
+#include "context.h"
+#include "data_thread.h"
+#include "rt.h"
+#include "stats.h"
+
+#define HELD_MAX (MCEDATA_AGG_MAX_SKEW + 1)
+
+/* Sleep for this long when a source can't be poll()ed. */
+#define AGG_WAIT_US 1000
+
+typedef struct agg_queue {
+    mcedata_source_t *source;
+    const uint32_t *frames[HELD_MAX];   // held frames, oldest first
+    int head;
+    int held;
+    int ended;
+} agg_queue_t;
+
+struct mcedata_aggregate {
+    mce_acq_t acq;                  // for the storage chain
+    int n_sources;
+    int max_skew;
+    agg_queue_t queue[MCEDATA_AGG_SOURCES];
+    uint32_t *frame;                // super-frame being assembled
+    host_clock_t clock;
+    mcedata_aggregate_stats_t stats;
+};
+
+
+static uint32_t frame_sync(const uint32_t *frame)
+{
+    return frame_property(frame, &frame_header_v6, sync_number);
+}
+
+static long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void agg_warning(mcedata_aggregate_t *agg, const char *msg, int i)
+{
+    if (agg->acq.context != NULL)
+        mcelib_warning(agg->acq.context, "aggregate: %s (source %i)\n",
+                msg, i);
+}
+
+
+/* Queue handling */
+
+static const uint32_t *queue_head(agg_queue_t *q)
+{
+    return q->frames[q->head];
+}
+
+static void queue_pop(agg_queue_t *q)
+{
+    q->source->release(q->source, 1);
+    q->head = (q->head + 1) % HELD_MAX;
+    q->held--;
+}
+
+/* Take any frames the source has ready, up to the limit; returns the
+ * number taken. */
+static int queue_fill(agg_queue_t *q, int limit)
+{
+    const uint32_t *frame;
+    int err, n = 0;
+
+    while (!q->ended && q->held < limit) {
+        err = q->source->next(q->source, &frame);
+        if (err == 0)
+            break;
+        if (err < 0) {
+            q->ended = 1;
+            break;
+        }
+        q->frames[(q->head + q->held) % HELD_MAX] = frame;
+        q->held++;
+        n++;
+    }
+    return n;
+}
+
+/* Wait for any source to have something new, for up to timeout_ms. */
+static void agg_wait(mcedata_aggregate_t *agg, int timeout_ms)
+{
+    struct pollfd pfd[MCEDATA_AGG_SOURCES];
+    int i, n = 0, blind = 0;
+
+    for (i=0; i<agg->n_sources; i++) {
+        agg_queue_t *q = agg->queue + i;
+        if (q->ended || q->held > 0)
+            continue;
+        if (q->source->fd < 0) {
+            blind = 1;
+            continue;
+        }
+        pfd[n].fd = q->source->fd;
+        pfd[n].events = POLLIN;
+        pfd[n].revents = 0;
+        n++;
+    }
+
+    if (blind || n == 0) {
+        if (timeout_ms < 0 || timeout_ms * 1000 > AGG_WAIT_US)
+            timeout_ms = AGG_WAIT_US / 1000;
+        if (n == 0) {
+            usleep(timeout_ms * 1000);
+            return;
+        }
+    }
+    poll(pfd, n, timeout_ms);
+}
+
+
+/* Aggregator */
+
+mcedata_aggregate_t *mcedata_aggregate_create(mce_context_t *context,
+        mcedata_source_t **sources, int n_sources, int max_skew,
+        mcedata_storage_t *storage)
+{
+    mcedata_aggregate_t *agg;
+    int i;
+
+    if (n_sources <= 0 || n_sources > MCEDATA_AGG_SOURCES || storage == NULL)
+        return NULL;
+
+    agg = calloc(1, sizeof(*agg));
+    if (agg == NULL)
+        return NULL;
+
+    if (max_skew <= 0 || max_skew > MCEDATA_AGG_MAX_SKEW)
+        max_skew = MCEDATA_AGG_MAX_SKEW;
+    agg->max_skew = max_skew;
+    agg->n_sources = n_sources;
+    for (i=0; i<n_sources; i++) {
+        agg->queue[i].source = sources[i];
+        agg->acq.frame_size += sources[i]->frame_size;
+    }
+
+    // Storage sees an acq whose frames are the super-frames.
+    agg->acq.context = context;
+    agg->acq.storage = storage;
+    agg->acq.ready = 1;
+    agg->frame = malloc(agg->acq.frame_size * sizeof(uint32_t));
+    if (agg->frame == NULL) {
+        free(agg);
+        return NULL;
+    }
+
+    if (storage->init != NULL && storage->init(&agg->acq) != 0) {
+        if (context != NULL)
+            mcelib_error(context, "Storage init action failed.\n");
+        free(agg->frame);
+        free(agg);
+        return NULL;
+    }
+    return agg;
+}
+
+int mcedata_aggregate_destroy(mcedata_aggregate_t *agg)
+{
+    int i, err = 0;
+
+    if (agg->acq.storage->cleanup != NULL &&
+            agg->acq.storage->cleanup(&agg->acq) != 0)
+        err = -MCE_ERR_FRAME_OUTPUT;
+    mcedata_storage_destroy(agg->acq.storage);
+
+    for (i=0; i<agg->n_sources; i++) {
+        mcedata_source_t *s = agg->queue[i].source;
+        if (agg->queue[i].held > 0)
+            s->release(s, agg->queue[i].held);
+        if (s->destroy != NULL)
+            s->destroy(s);
+    }
+
+    free(agg->frame);
+    free(agg);
+    return err;
+}
+
+int mcedata_aggregate_stats(mcedata_aggregate_t *agg,
+        mcedata_aggregate_stats_t *stats)
+{
+    memcpy(stats, &agg->stats, sizeof(*stats));
+    return 0;
+}
+
+/* Drop the head frame of source i as unmatched. */
+static void drop_head(mcedata_aggregate_t *agg, int i)
+{
+    if (agg->stats.unmatched[i]++ == 0)
+        agg_warning(agg, "unmatched frames", i);
+    queue_pop(agg->queue + i);
+}
+
+/* Store the head frames of every source as one super-frame. */
+static void store_heads(mcedata_aggregate_t *agg)
+{
+    mce_acq_t *acq = &agg->acq;
+    uint32_t *out = agg->frame;
+    int i;
+
+    for (i=0; i<agg->n_sources; i++) {
+        agg_queue_t *q = agg->queue + i;
+        memcpy(out, queue_head(q), q->source->frame_size * sizeof(*out));
+        out += q->source->frame_size;
+        queue_pop(q);
+    }
+
+    // The parts arrived separately; the super-frame is complete now.
+    acq_host_time(&agg->clock, &acq->frame_time);
+
+    if (acq->storage->pre_frame != NULL && acq->storage->pre_frame(acq) != 0)
+        agg_warning(agg, "pre_frame action failed", -1);
+    if (acq->storage->post_frame != NULL &&
+            acq->storage->post_frame(acq, agg->stats.frames, agg->frame) != 0)
+        agg_warning(agg, "post_frame action failed", -1);
+
+    agg->stats.last_sync = frame_sync(agg->frame);
+    agg->stats.frames++;
+}
+
+/* Try to match up the head frames.  Returns 1 if a super-frame was
+ * stored, 0 if we need more frames. */
+static int align(mcedata_aggregate_t *agg)
+{
+    uint32_t newest = 0;
+    int i, have_all = 1;
+
+    for (i=0; i<agg->n_sources; i++) {
+        agg_queue_t *q = agg->queue + i;
+        if (q->held > agg->stats.max_held)
+            agg->stats.max_held = q->held;
+        if (q->held == 0) {
+            have_all = 0;
+            continue;
+        }
+        if (i == 0 || (int32_t)(frame_sync(queue_head(q)) - newest) > 0)
+            newest = frame_sync(queue_head(q));
+    }
+
+    if (!have_all) {
+        // Don't wait forever for a source that's fallen silent.
+        for (i=0; i<agg->n_sources; i++)
+            while (agg->queue[i].held > agg->max_skew)
+                drop_head(agg, i);
+        return 0;
+    }
+
+    // Anything older than the newest head has no partner coming.  A
+    // source that lost frames too may then show a newer head still, so
+    // go round again until the heads agree.
+    for (;;) {
+        int matched = 1;
+        for (i=0; i<agg->n_sources; i++) {
+            agg_queue_t *q = agg->queue + i;
+            while (q->held > 0 &&
+                    (int32_t)(frame_sync(queue_head(q)) - newest) < 0)
+                drop_head(agg, i);
+            if (q->held == 0)
+                return 0;
+            if (frame_sync(queue_head(q)) != newest) {
+                newest = frame_sync(queue_head(q));
+                matched = 0;
+            }
+        }
+        if (matched)
+            break;
+    }
+
+    store_heads(agg);
+    return 1;
+}
+
+static int aggregate_run(mcedata_aggregate_t *agg, int n_frames,
+        int timeout_ms)
+{
+    mce_acq_t *acq = &agg->acq;
+    long long deadline = -1;
+    int i, err, stored = 0;
+
+    acq->n_frames = n_frames;
+    acq->n_frames_complete = 0;
+
+    for (i=0; i<agg->n_sources; i++) {
+        mcedata_source_t *s = agg->queue[i].source;
+        agg->queue[i].ended = 0;
+        if (s->start != NULL && (err = s->start(s, n_frames)) != 0)
+            return err;
+    }
+
+    while (stored < n_frames) {
+        int got = 0, ended = 0;
+
+        for (i=0; i<agg->n_sources; i++) {
+            got += queue_fill(agg->queue + i, agg->max_skew + 1);
+            if (agg->queue[i].ended && agg->queue[i].held == 0)
+                ended = 1;
+        }
+
+        if (align(agg)) {
+            stored++;
+            deadline = -1;
+            continue;
+        }
+
+        // One source is done; nothing else can be matched.
+        if (ended)
+            break;
+
+        if (got > 0) {
+            deadline = -1;
+            continue;
+        }
+
+        if (timeout_ms > 0) {
+            if (deadline < 0)
+                deadline = now_ms() + timeout_ms;
+            if (now_ms() >= deadline) {
+                acq->n_frames_complete = stored;
+                return -MCE_ERR_FRAME_TIMEOUT;
+            }
+        }
+        agg_wait(agg, deadline < 0 ? -1 : (int)(deadline - now_ms()));
+    }
+
+    // Whatever is left over has no partner.
+    for (i=0; i<agg->n_sources; i++) {
+        while (agg->queue[i].held > 0 &&
+                (stored < n_frames || agg->queue[i].ended))
+            drop_head(agg, i);
+    }
+
+    if (acq->storage->flush != NULL)
+        acq->storage->flush(acq);
+    acq->n_frames_complete = stored;
+    return 0;
+}
+
+int mcedata_aggregate_go(mcedata_aggregate_t *agg, int n_frames,
+        int timeout_ms)
+{
+    struct rt_saved *rt = NULL;
+    int err;
+
+    // Tuned like the single-MCE acquisition loop, when there's a context.
+    if (agg->acq.context != NULL)
+        rt = rt_thread_enter(agg->acq.context, RT_ACQ);
+    err = aggregate_run(agg, n_frames, timeout_ms);
+    rt_thread_leave(rt);
+    return err;
+}
+
+
+/* Frame sources */
+
+static int source_destroy(mcedata_source_t *s)
+{
+    free(s->source_data);
+    free(s);
+    return 0;
+}
+
+
+/* Frame source: an MCE, through its data driver.  The acq describes
+ * the frame layout and is used to start the MCE; its own storage is
+ * not used. */
+
+#ifdef NO_MCE_OPS
+MAS_UNSUPPORTED(mcedata_source_t *mcedata_source_acq_create(mce_acq_t *acq))
+#else
+
+typedef struct acq_source {
+    mce_acq_t *acq;
+    int offsets[DSP_FRAME_BATCH_MAX];   // unconsumed frames, oldest first
+    int polled;                     // offsets known
+    int given;                      // frames handed out, not released
+    int ended;
+} acq_source_t;
+
+static int acq_source_start(mcedata_source_t *s, int n_frames)
+{
+    acq_source_t *a = s->source_data;
+    a->ended = 0;
+    return acq_start_frames(a->acq, n_frames);
+}
+
+static int acq_source_next(mcedata_source_t *s, const uint32_t **frame)
+{
+    acq_source_t *a = s->source_data;
+    mce_context_t *context = a->acq->context;
+    uint32_t status;
+    int n;
+
+    if (a->ended)
+        return -1;
+
+    // Poll for a whole batch when the last one has been handed out.
+    if (a->given >= a->polled) {
+        n = mcedata_poll_batch(context, a->offsets, DSP_FRAME_BATCH_MAX);
+        if (n < 0)
+            return n;
+        a->polled = n;
+        if (n <= a->given)
+            return 0;
+    }
+
+    *frame = (uint32_t*)(context->data.map + a->offsets[a->given++]);
+
+    // That's all, if the MCE says so.
+    status = frame_property(*frame, &frame_header_v6, status_v6);
+    if (status & (FRAME_STATUS_V6_LAST | FRAME_STATUS_V6_STOP))
+        a->ended = 1;
+    return 1;
+}
+
+static int acq_source_release(mcedata_source_t *s, int n)
+{
+    acq_source_t *a = s->source_data;
+    a->given -= n;
+    a->polled = (a->polled > n) ? a->polled - n : 0;
+    memmove(a->offsets, a->offsets + n, a->polled * sizeof(a->offsets[0]));
+    return mcedata_consume_frames(a->acq->context, n) == n ? 0 : -1;
+}
+
+mcedata_source_t *mcedata_source_acq_create(mce_acq_t *acq)
+{
+    mcedata_source_t *s = calloc(1, sizeof(*s));
+    acq_source_t *a = calloc(1, sizeof(*a));
+    if (s == NULL || a == NULL) {
+        free(s);
+        free(a);
+        return NULL;
+    }
+
+    a->acq = acq;
+    s->frame_size = acq->frame_size;
+    s->fd = acq->context->data.can_poll ? acq->context->data.fd : -1;
+    s->start = acq_source_start;
+    s->next = acq_source_next;
+    s->release = acq_source_release;
+    s->destroy = source_destroy;
+    s->source_data = a;
+    return s;
+}
+#endif
+
+
+/* Frame source: frames already in memory. */
+
+typedef struct memory_source {
+    const uint32_t *frames;
+    int n_frames;
+    int index;
+} memory_source_t;
+
+static int memory_source_next(mcedata_source_t *s, const uint32_t **frame)
+{
+    memory_source_t *m = s->source_data;
+    if (m->index >= m->n_frames)
+        return -1;
+    *frame = m->frames + (size_t)m->index++ * s->frame_size;
+    return 1;
+}
+
+static int memory_source_release(mcedata_source_t *s, int n)
+{
+    return 0;
+}
+
+mcedata_source_t *mcedata_source_memory_create(const uint32_t *frames,
+        int frame_size, int n_frames)
+{
+    mcedata_source_t *s = calloc(1, sizeof(*s));
+    memory_source_t *m = calloc(1, sizeof(*m));
+    if (s == NULL || m == NULL) {
+        free(s);
+        free(m);
+        return NULL;
+    }
+
+    m->frames = frames;
+    m->n_frames = n_frames;
+    s->frame_size = frame_size;
+    s->fd = -1;
+    s->next = memory_source_next;
+    s->release = memory_source_release;
+    s->destroy = source_destroy;
+    s->source_data = m;
+    return s;
+}
+
+
+/* Frame source: a flatfile recording. */
+
+typedef struct file_source {
+    FILE *fin;
+    uint32_t *buffer;               // HELD_MAX frames
+    int head;
+    int held;
+} file_source_t;
+
+static int file_source_next(mcedata_source_t *s, const uint32_t **frame)
+{
+    file_source_t *f = s->source_data;
+    uint32_t *slot;
+
+    if (f->held >= HELD_MAX)
+        return 0;
+    slot = f->buffer + (size_t)((f->head + f->held) % HELD_MAX) *
+        s->frame_size;
+    if (fread(slot, sizeof(uint32_t), s->frame_size, f->fin) !=
+            s->frame_size)
+        return -1;
+    f->held++;
+    *frame = slot;
+    return 1;
+}
+
+static int file_source_release(mcedata_source_t *s, int n)
+{
+    file_source_t *f = s->source_data;
+    f->head = (f->head + n) % HELD_MAX;
+    f->held -= n;
+    return 0;
+}
+
+static int file_source_destroy(mcedata_source_t *s)
+{
+    file_source_t *f = s->source_data;
+    fclose(f->fin);
+    free(f->buffer);
+    return source_destroy(s);
+}
+
+mcedata_source_t *mcedata_source_flatfile_create(const char *filename,
+        int frame_size)
+{
+    mcedata_source_t *s = calloc(1, sizeof(*s));
+    file_source_t *f = calloc(1, sizeof(*f));
+    if (s == NULL || f == NULL || frame_size <= 0)
+        goto fail;
+
+    f->buffer = malloc((size_t)HELD_MAX * frame_size * sizeof(uint32_t));
+    if (f->buffer == NULL)
+        goto fail;
+    f->fin = fopen(filename, "r");
+    if (f->fin == NULL)
+        goto fail;
+
+    s->frame_size = frame_size;
+    s->fd = -1;
+    s->next = file_source_next;
+    s->release = file_source_release;
+    s->destroy = file_source_destroy;
+    s->source_data = f;
+    return s;
+
+fail:
+    if (f != NULL)
+        free(f->buffer);
+    free(f);
+    free(s);
+    return NULL;
+}
@@ -0,0 +1,778 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#define _GNU_SOURCE
+
+/* Compressed frame archives; the format is described in mce/archive.h.
+ *
+ * The writer keeps a block of whole frames and encodes it when it is
+ * full (or flushed), channel by channel: delta- and zigzag-coded and
+ * bit-packed.  The reader maps the file and decodes just the channels
+ * it is asked for, finding them through the index; for whole frames it
+ * decodes whole blocks, keeping the last one. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "context.h"
+
+#define ARCHIVE_BLOCK_FRAMES 256    /* default frames per block */
+
+/* Bound on the encoded size of a block. */
+#define ARCHIVE_BLOCK_BYTES(n, frame_size) \
+    ((size_t)(n) * (frame_size) * 4 + (size_t)(frame_size) + 8)
+
+/* Bytes taken by a channel of n frames packed w bits wide. */
+#define ARCHIVE_CHANNEL_BYTES(n, w) (4 + ((size_t)((n) - 1) * (w) + 7) / 8)
+
+
+/* Encoding and decoding */
+
+static inline uint32_t zigzag(uint32_t d)
+{
+    return (d << 1) ^ (uint32_t)((int32_t)d >> 31);
+}
+
+static inline uint32_t unzigzag(uint32_t z)
+{
+    return (z >> 1) ^ -(z & 1);
+}
+
+/* Pack n values of w bits from z; returns the end of the output. */
+
+static uint8_t *archive_pack(const uint32_t *z, int n, int w, uint8_t *out)
+{
+    uint64_t acc = 0;
+    int bits = 0;
+    int k;
+
+    if (w == 0)
+        return out;
+    for (k=0; k<n; k++) {
+        acc |= (uint64_t)z[k] << bits;
+        bits += w;
+        if (bits >= 32) {
+            uint32_t word = (uint32_t)acc;
+            memcpy(out, &word, 4);
+            out += 4;
+            acc >>= 32;
+            bits -= 32;
+        }
+    }
+    for (; bits > 0; bits -= 8) {
+        *out++ = (uint8_t)acc;
+        acc >>= 8;
+    }
+    return out;
+}
+
+/* Unpack n values of w bits into z. */
+
+static void archive_unpack(const uint8_t *in, int n, int w, uint32_t *z)
+{
+    const uint8_t *end = in + ((size_t)n * w + 7) / 8;
+    uint64_t mask = (1ULL << w) - 1;
+    uint64_t acc = 0;
+    int bits = 0;
+    int k;
+
+    if (w == 0) {
+        memset(z, 0, n * sizeof(*z));
+        return;
+    }
+    for (k=0; k<n; k++) {
+        if (bits < w) {
+            if (end - in >= 4) {
+                uint32_t word;
+                memcpy(&word, in, 4);
+                acc |= (uint64_t)word << bits;
+                bits += 32;
+                in += 4;
+            } else {
+                while (bits < w) {
+                    acc |= (uint64_t)*in++ << bits;
+                    bits += 8;
+                }
+            }
+        }
+        z[k] = (uint32_t)(acc & mask);
+        acc >>= w;
+        bits -= w;
+    }
+}
+
+/* Encode n frames into out; z holds block_frames words of scratch.
+ * Returns the size of the encoding. */
+
+static size_t archive_encode(const uint32_t *frames, int n, int frame_size,
+        uint32_t *z, uint8_t *out)
+{
+    uint8_t *widths = out, *p = out + frame_size;
+    int i, k;
+
+    for (i=0; i<frame_size; i++) {
+        const uint32_t *in = frames + i;
+        uint32_t prev = in[0], all = 0;
+        memcpy(p, &prev, 4);
+        p += 4;
+        for (k=1; k<n; k++) {
+            uint32_t v = in[k * frame_size];
+            z[k-1] = zigzag(v - prev);
+            all |= z[k-1];
+            prev = v;
+        }
+        widths[i] = (all == 0) ? 0 : 32 - __builtin_clz(all);
+        p = archive_pack(z, n - 1, widths[i], p);
+    }
+    return p - out;
+}
+
+/* Decode the first n values of a channel, packed w bits wide, to out,
+ * stride words apart; z holds n words of scratch. */
+
+static void archive_decode_channel(const uint8_t *in, int n, int w,
+        uint32_t *z, uint32_t *out, int stride)
+{
+    uint32_t v;
+    int k;
+
+    memcpy(&v, in, 4);
+    archive_unpack(in + 4, n - 1, w, z);
+    out[0] = v;
+    for (k=1; k<n; k++) {
+        v += unzigzag(z[k-1]);
+        out[(size_t)k * stride] = v;
+    }
+}
+
+static int archive_write_all(int fd, const void *data, size_t len)
+{
+    const char *p = (const char*)data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+/* Writer (storage module) */
+
+typedef struct archive_struct {
+
+    char filename[MCE_LONG];
+    char symlink[MCE_LONG];
+    int fd;
+
+    int frame_size;
+    int block_frames;
+    uint32_t *frames;               // the block being gathered
+    int count;                      // frames in it
+    uint32_t *scratch;
+    uint8_t *encoded;
+
+    off_t offset;                   // where the next block goes
+    uint64_t frame_count;           // frames written so far
+    mce_archive_index_t *index;
+    uint8_t *widths;                // frame_size per block, for the index
+    int n_blocks;
+    int max_blocks;
+
+} archive_t;
+
+/* Encode and write out the frames gathered so far. */
+
+static int archive_write_block(archive_t *f)
+{
+    mce_archive_block_t block;
+    mce_archive_index_t *entry;
+
+    if (f->count == 0)
+        return 0;
+
+    if (f->n_blocks == f->max_blocks) {
+        int max = f->max_blocks ? 2 * f->max_blocks : 64;
+        void *index = realloc(f->index, max * sizeof(*f->index));
+        void *widths = realloc(f->widths, (size_t)max * f->frame_size);
+        if (index != NULL)
+            f->index = index;
+        if (widths != NULL)
+            f->widths = widths;
+        if (index == NULL || widths == NULL)
+            return -1;
+        f->max_blocks = max;
+    }
+
+    memset(&block, 0, sizeof(block));
+    block.magic = MCE_ARCHIVE_BLOCK;
+    block.n_frames = f->count;
+    block.frame0 = f->frame_count;
+    block.size = archive_encode(f->frames, f->count, f->frame_size,
+            f->scratch, f->encoded);
+
+    if (archive_write_all(f->fd, &block, sizeof(block)) ||
+            archive_write_all(f->fd, f->encoded, block.size))
+        return -1;
+
+    entry = f->index + f->n_blocks;
+    entry->offset = f->offset;
+    entry->frame0 = block.frame0;
+    entry->n_frames = block.n_frames;
+    entry->size = block.size;
+    memcpy(f->widths + (size_t)f->n_blocks * f->frame_size, f->encoded,
+            f->frame_size);
+    f->n_blocks++;
+
+    f->offset += sizeof(block) + block.size;
+    f->frame_count += f->count;
+    f->count = 0;
+    return 0;
+}
+
+static int archive_init(mce_acq_t *acq)
+{
+    archive_t *f = (archive_t*)acq->storage->action_data;
+    mce_archive_header_t header;
+    int i;
+
+    f->frame_size = acq->frame_size;
+    f->frames = malloc((size_t)f->block_frames * f->frame_size *
+            sizeof(*f->frames));
+    f->scratch = malloc(f->block_frames * sizeof(*f->scratch));
+    f->encoded = malloc(ARCHIVE_BLOCK_BYTES(f->block_frames, f->frame_size));
+    if (f->frames == NULL || f->scratch == NULL || f->encoded == NULL) {
+        sprintf(acq->errstr, "Could not allocate archive buffers");
+        return -1;
+    }
+    f->count = 0;
+    f->frame_count = 0;
+    f->n_blocks = 0;
+
+    f->fd = open(f->filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (f->fd < 0) {
+        snprintf(acq->errstr, sizeof(acq->errstr),
+                "Failed to open file '%.*s'", MCELIB_ERR_NAME, f->filename);
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = MCE_ARCHIVE_MAGIC;
+    header.version = MCE_ARCHIVE_VERSION;
+    header.frame_size = f->frame_size;
+    header.header_size = (f->frame_size > MCEDATA_HEADER) ?
+        MCEDATA_HEADER : f->frame_size;
+    header.block_frames = f->block_frames;
+    header.cards = acq->cards;
+    header.rows = acq->rows;
+    header.cols = acq->cols;
+    for (i=0; i<MCEDATA_CARDS; i++) {
+        header.row0[i] = acq->row0[i];
+        header.col0[i] = acq->col0[i];
+    }
+    if (archive_write_all(f->fd, &header, sizeof(header))) {
+        snprintf(acq->errstr, sizeof(acq->errstr), "Failed to write '%.*s'",
+                MCELIB_ERR_NAME, f->filename);
+        return -1;
+    }
+    f->offset = sizeof(header);
+
+    /* Update the indirection, maybe */
+    mcelib_symlink(f->symlink, f->filename);
+
+    return 0;
+}
+
+static int archive_post(mce_acq_t *acq, int frame_index, uint32_t *data)
+{
+    archive_t *f = (archive_t*)acq->storage->action_data;
+
+    if (f->fd < 0)
+        return -1;
+
+    memcpy(f->frames + (size_t)f->count * f->frame_size, data,
+            f->frame_size * sizeof(*data));
+    if (++f->count < f->block_frames)
+        return 0;
+    return archive_write_block(f);
+}
+
+/* Write out a short block. */
+
+static int archive_flush(mce_acq_t *acq)
+{
+    archive_t *f = (archive_t*)acq->storage->action_data;
+
+    if (f->fd < 0)
+        return -1;
+    return archive_write_block(f);
+}
+
+static void archive_free(archive_t *f)
+{
+    free(f->frames);
+    free(f->scratch);
+    free(f->encoded);
+    free(f->index);
+    free(f->widths);
+    f->frames = NULL;
+    f->scratch = NULL;
+    f->encoded = NULL;
+    f->index = NULL;
+    f->widths = NULL;
+    f->max_blocks = 0;
+}
+
+static int archive_cleanup(mce_acq_t *acq)
+{
+    archive_t *f = (archive_t*)acq->storage->action_data;
+    mce_archive_trailer_t trailer;
+    int err = 0;
+
+    if (f->fd >= 0) {
+        if (archive_write_block(f))
+            err = -1;
+
+        memset(&trailer, 0, sizeof(trailer));
+        trailer.magic = MCE_ARCHIVE_INDEX;
+        trailer.n_blocks = f->n_blocks;
+        trailer.index_offset = f->offset;
+        if (archive_write_all(f->fd, f->index,
+                    f->n_blocks * sizeof(*f->index)) ||
+                archive_write_all(f->fd, f->widths,
+                    (size_t)f->n_blocks * f->frame_size) ||
+                archive_write_all(f->fd, &trailer, sizeof(trailer)))
+            err = -1;
+
+        close(f->fd);
+        f->fd = -1;
+    }
+
+    archive_free(f);
+    return err;
+}
+
+static int archive_destructor(mcedata_storage_t *storage)
+{
+    archive_t *f = (archive_t*)storage->action_data;
+    if (f == NULL)
+        return 0;
+
+    archive_free(f);
+    free(f);
+
+    memset(storage, 0, sizeof(*storage));
+    return 0;
+}
+
+mcedata_storage_t archive_actions = {
+    .init = archive_init,
+    .cleanup = archive_cleanup,
+    .post_frame = archive_post,
+    .flush = archive_flush,
+    .destroy = archive_destructor,
+};
+
+
+mcedata_storage_t* mcedata_archive_create(const char *filename,
+        const char *symlink, int block_frames)
+{
+    archive_t *f = (archive_t*)calloc(1, sizeof(archive_t));
+    mcedata_storage_t *storage =
+        (mcedata_storage_t*)malloc(sizeof(mcedata_storage_t));
+    if (f==NULL || storage==NULL) {
+        free(f);
+        free(storage);
+        return NULL;
+    }
+
+    //Initialize storage with the file operations, then set local data.
+    memcpy(storage, &archive_actions, sizeof(archive_actions));
+    storage->action_data = f;
+
+    f->fd = -1;
+    f->block_frames = (block_frames > 0) ? block_frames :
+        ARCHIVE_BLOCK_FRAMES;
+    if (symlink!=NULL)
+        strcpy(f->symlink, symlink);
+
+    strcpy(f->filename, filename);
+    return storage;
+}
+
+
+/* Reader */
+
+struct mcedata_archive {
+    const uint8_t *map;             // the whole file
+    size_t map_size;
+    mce_archive_header_t header;
+    mce_archive_index_t *index;
+    const uint8_t *widths;          // of each block, in the index; or NULL
+    int n_blocks;
+    long frame_count;
+
+    // Where each channel starts, in one block.
+    int located;                    // that block, or -1
+    size_t *start;                  // frame_size + 1 offsets
+
+    // The last block decoded whole.
+    int cached;                     // its index, or -1
+    uint32_t *frames;
+    uint32_t *scratch;
+    uint32_t *values;               // of one channel
+};
+
+/* Load the index from the trailer; returns -1 if there isn't one. */
+
+static int archive_load_index(mcedata_archive_t *a)
+{
+    mce_archive_trailer_t trailer;
+    size_t offset = a->map_size - sizeof(trailer);
+    size_t entry_size = sizeof(*a->index) + a->header.frame_size;
+
+    if (a->map_size < sizeof(a->header) + sizeof(trailer))
+        return -1;
+    memcpy(&trailer, a->map + offset, sizeof(trailer));
+    if (trailer.magic != MCE_ARCHIVE_INDEX ||
+            trailer.index_offset < sizeof(a->header) ||
+            trailer.index_offset > offset ||
+            (offset - trailer.index_offset) / entry_size != trailer.n_blocks ||
+            (offset - trailer.index_offset) % entry_size != 0)
+        return -1;
+
+    a->n_blocks = trailer.n_blocks;
+    a->index = malloc((trailer.n_blocks + 1) * sizeof(*a->index));
+    if (a->index == NULL)
+        return -1;
+    memcpy(a->index, a->map + trailer.index_offset,
+            trailer.n_blocks * sizeof(*a->index));
+    a->widths = a->map + trailer.index_offset +
+        trailer.n_blocks * sizeof(*a->index);
+    return 0;
+}
+
+/* Rebuild the index from the block headers, up to the first that is
+ * damaged or incomplete. */
+
+static int archive_scan(mcedata_archive_t *a)
+{
+    size_t offset = sizeof(a->header);
+    int max = 0;
+
+    free(a->index);
+    a->index = NULL;
+    a->widths = NULL;
+    a->n_blocks = 0;
+    while (offset + sizeof(mce_archive_block_t) <= a->map_size) {
+        mce_archive_block_t block;
+        mce_archive_index_t *entry;
+        memcpy(&block, a->map + offset, sizeof(block));
+        if (block.magic != MCE_ARCHIVE_BLOCK ||
+                block.n_frames == 0 ||
+                block.n_frames > a->header.block_frames ||
+                block.size > a->map_size - offset - sizeof(block))
+            break;
+        if (a->n_blocks == max) {
+            void *index;
+            max = max ? 2 * max : 64;
+            index = realloc(a->index, max * sizeof(*a->index));
+            if (index == NULL)
+                return -1;
+            a->index = index;
+        }
+        entry = a->index + a->n_blocks++;
+        entry->offset = offset;
+        entry->frame0 = block.frame0;
+        entry->n_frames = block.n_frames;
+        entry->size = block.size;
+        offset += sizeof(block) + block.size;
+    }
+    return 0;
+}
+
+/* Check that the blocks lie within the file, in order. */
+
+static int archive_check_index(const mcedata_archive_t *a)
+{
+    const mce_archive_header_t *h = &a->header;
+    uint64_t frame0 = 0;
+    int b;
+
+    for (b=0; b<a->n_blocks; b++) {
+        const mce_archive_index_t *entry = a->index + b;
+        if (entry->n_frames == 0 || entry->n_frames > h->block_frames ||
+                entry->frame0 != frame0 ||
+                entry->offset < sizeof(*h) ||
+                entry->offset + sizeof(mce_archive_block_t) > a->map_size ||
+                entry->size < h->frame_size ||
+                entry->size > a->map_size - entry->offset -
+                sizeof(mce_archive_block_t))
+            return -1;
+        frame0 += entry->n_frames;
+    }
+    return 0;
+}
+
+mcedata_archive_t *mcedata_archive_open(const char *filename)
+{
+    mcedata_archive_t *a = calloc(1, sizeof(*a));
+    mce_archive_header_t *h;
+    void *map;
+    off_t file_size;
+    int fd;
+
+    if (a == NULL)
+        return NULL;
+    a->located = -1;
+    a->cached = -1;
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        goto fail;
+    file_size = lseek(fd, 0, SEEK_END);
+    if (file_size < (off_t)sizeof(*h)) {
+        close(fd);
+        goto fail;
+    }
+    map = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        goto fail;
+    a->map = map;
+    a->map_size = file_size;
+
+    h = &a->header;
+    memcpy(h, a->map, sizeof(*h));
+    if (h->magic != MCE_ARCHIVE_MAGIC ||
+            h->version != MCE_ARCHIVE_VERSION ||
+            h->frame_size == 0 || h->header_size > h->frame_size ||
+            h->block_frames == 0)
+        goto fail;
+
+    if (archive_load_index(a) && archive_scan(a))
+        goto fail;
+    if (archive_check_index(a))
+        goto fail;
+    if (a->n_blocks > 0) {
+        mce_archive_index_t *last = a->index + a->n_blocks - 1;
+        a->frame_count = last->frame0 + last->n_frames;
+    }
+
+    a->start = malloc((h->frame_size + 1) * sizeof(*a->start));
+    a->frames = malloc((size_t)h->block_frames * h->frame_size *
+            sizeof(*a->frames));
+    a->scratch = malloc(h->block_frames * sizeof(*a->scratch));
+    a->values = malloc(h->block_frames * sizeof(*a->values));
+    if (a->start == NULL || a->frames == NULL || a->scratch == NULL ||
+            a->values == NULL)
+        goto fail;
+    return a;
+
+fail:
+    mcedata_archive_close(a);
+    return NULL;
+}
+
+void mcedata_archive_close(mcedata_archive_t *a)
+{
+    if (a == NULL)
+        return;
+    if (a->map != NULL)
+        munmap((void*)a->map, a->map_size);
+    free(a->index);
+    free(a->start);
+    free(a->frames);
+    free(a->scratch);
+    free(a->values);
+    free(a);
+}
+
+const mce_archive_header_t *mcedata_archive_header(const mcedata_archive_t *a)
+{
+    return &a->header;
+}
+
+int mcedata_archive_frame_size(const mcedata_archive_t *a)
+{
+    return a->header.frame_size;
+}
+
+long mcedata_archive_frame_count(const mcedata_archive_t *a)
+{
+    return a->frame_count;
+}
+
+int mcedata_archive_channel(const mcedata_archive_t *a, int mce_row,
+        int mce_col)
+{
+    const mce_archive_header_t *h = &a->header;
+    int card = mce_col / MCEDATA_COLUMNS;
+    int slot = 0, i, r, c;
+
+    if (mce_row < 0 || mce_col < 0 || card >= MCEDATA_CARDS ||
+            !(h->cards & (1 << card)))
+        return -1;
+    for (i=0; i<card; i++)
+        if (h->cards & (1 << i))
+            slot++;
+    r = mce_row - h->row0[card];
+    c = mce_col - card*MCEDATA_COLUMNS - h->col0[card];
+    if (r < 0 || r >= (int)h->rows || c < 0 || c >= (int)h->cols)
+        return -1;
+    i = h->header_size + (r * __builtin_popcount(h->cards) + slot) * h->cols
+        + c;
+    return (i < (int)h->frame_size) ? i : -1;
+}
+
+/* The block holding frame i (which must exist). */
+
+static int archive_find(const mcedata_archive_t *a, long i)
+{
+    int lo = 0, hi = a->n_blocks - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if ((long)a->index[mid].frame0 <= i)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+/* Block b's data, and its bit widths (from the index if there is one). */
+
+static const uint8_t *archive_block_data(const mcedata_archive_t *a, int b)
+{
+    return a->map + a->index[b].offset + sizeof(mce_archive_block_t);
+}
+
+static const uint8_t *archive_block_widths(const mcedata_archive_t *a, int b)
+{
+    if (a->widths != NULL)
+        return a->widths + (size_t)b * a->header.frame_size;
+    return archive_block_data(a, b);
+}
+
+/* Work out where each channel of block b starts. */
+
+static int archive_locate(mcedata_archive_t *a, int b)
+{
+    const mce_archive_index_t *entry = a->index + b;
+    const uint8_t *widths = archive_block_widths(a, b);
+    int frame_size = a->header.frame_size;
+    size_t p = frame_size;
+    int i;
+
+    if (a->located == b)
+        return 0;
+    a->located = -1;
+    for (i=0; i<frame_size; i++) {
+        if (widths[i] > 32)
+            return -1;
+        a->start[i] = p;
+        p += ARCHIVE_CHANNEL_BYTES(entry->n_frames, widths[i]);
+    }
+    a->start[i] = p;
+    if (p > entry->size)
+        return -1;
+    a->located = b;
+    return 0;
+}
+
+static int archive_load_block(mcedata_archive_t *a, int b)
+{
+    const uint8_t *data = archive_block_data(a, b);
+    const uint8_t *widths = archive_block_widths(a, b);
+    int frame_size = a->header.frame_size;
+    int n = a->index[b].n_frames;
+    int i;
+
+    if (a->cached == b)
+        return 0;
+    a->cached = -1;
+    if (archive_locate(a, b))
+        return -1;
+    for (i=0; i<frame_size; i++)
+        archive_decode_channel(data + a->start[i], n, widths[i], a->scratch,
+                a->frames + i, frame_size);
+    a->cached = b;
+    return 0;
+}
+
+long mcedata_archive_read(mcedata_archive_t *a, long first, long count,
+        uint32_t *frames)
+{
+    int frame_size = a->header.frame_size;
+    long done = 0;
+
+    if (first < 0 || count < 0)
+        return -1;
+    while (done < count && first + done < a->frame_count) {
+        long i = first + done;
+        int b = archive_find(a, i);
+        const mce_archive_index_t *entry = a->index + b;
+        long k = i - entry->frame0;
+        long n = entry->n_frames - k;
+        if (n > count - done)
+            n = count - done;
+        if (archive_load_block(a, b))
+            return -1;
+        memcpy(frames + done * frame_size, a->frames + k * frame_size,
+                n * frame_size * sizeof(*frames));
+        done += n;
+    }
+    return done;
+}
+
+long mcedata_archive_read_channels(mcedata_archive_t *a, long first,
+        long count, const int *channels, int n_channels, uint32_t *out)
+{
+    long done = 0;
+    int j;
+
+    if (first < 0 || count < 0)
+        return -1;
+    for (j=0; j<n_channels; j++)
+        if (channels[j] >= (int)a->header.frame_size)
+            return -1;
+
+    while (done < count && first + done < a->frame_count) {
+        long i = first + done;
+        int b = archive_find(a, i);
+        const mce_archive_index_t *entry = a->index + b;
+        const uint8_t *data = archive_block_data(a, b);
+        const uint8_t *widths = archive_block_widths(a, b);
+        long k0 = i - entry->frame0;
+        long n = entry->n_frames - k0;
+        long k;
+        if (n > count - done)
+            n = count - done;
+        if (archive_locate(a, b))
+            return -1;
+        for (j=0; j<n_channels; j++) {
+            uint32_t *dest = out + done * n_channels + j;
+            int c = channels[j];
+            if (c < 0) {
+                for (k=0; k<n; k++)
+                    dest[k * n_channels] = 0;
+                continue;
+            }
+            // Differences run from the start of the block.
+            archive_decode_channel(data + a->start[c], k0 + n, widths[c],
+                    a->scratch, a->values, 1);
+            for (k=0; k<n; k++)
+                dest[k * n_channels] = a->values[k0 + k];
+        }
+        done += n;
+    }
+    return done;
+}
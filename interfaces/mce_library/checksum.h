@@ -0,0 +1,40 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#ifndef _CHECKSUM_H_
+#define _CHECKSUM_H_
+
+/* Frame checksums are a plain XOR, so order doesn't matter and the
+ * work can be spread across vector lanes.  The vector type is a GCC
+ * extension; the compiler picks the instructions (SSE2 on x86-64), and
+ * loads and stores go through memcpy so alignment doesn't matter. */
+
+#include <stdint.h>
+#include <string.h>
+
+typedef uint32_t xor_vec_t __attribute__((vector_size(16)));
+
+#define XOR_LANES ((int)(sizeof(xor_vec_t) / sizeof(uint32_t)))
+
+static inline xor_vec_t xor_load(const uint32_t *p)
+{
+    xor_vec_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void xor_store(uint32_t *p, xor_vec_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline uint32_t xor_fold(xor_vec_t v)
+{
+    uint32_t chksum = 0;
+    int i;
+    for (i=0; i<XOR_LANES; i++)
+        chksum ^= v[i];
+    return chksum;
+}
+
+#endif
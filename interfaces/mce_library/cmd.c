@@ -198,9 +198,11 @@ int mcecmd_send_command(mce_context_t* context, mce_command *cmd, mce_reply *rep
        command packet transfers.  Reply packet will have zeros for
        card address and thus fail the consistency check. */
 
+    pthread_mutex_lock(&C_cmd.lock);
     do {
         err = mcecmd_send_command_now(context, cmd);
         if (err<0) {
+            pthread_mutex_unlock(&C_cmd.lock);
             sprintf(errstr, "command not sent, error %#x.", -err);
             maslog_print_level(context->maslog, errstr, MASLOG_INFO);
             memset(rep, 0, sizeof(*rep));
@@ -209,6 +211,7 @@ int mcecmd_send_command(mce_context_t* context, mce_command *cmd, mce_reply *rep
 
         err = mcecmd_read_reply_now(context, rep);
         if (err != 0) {
+            pthread_mutex_unlock(&C_cmd.lock);
             sprintf(errstr, "reply [communication error] %s",
                     mcelib_error_string(err));
             maslog_print_level(context->maslog, errstr, LOG_LEVEL_REP_ER);
@@ -223,6 +226,7 @@ int mcecmd_send_command(mce_context_t* context, mce_command *cmd, mce_reply *rep
             err = mcecmd_cmd_match_rep(cmd, rep);
 
     } while (attempts++ < MAX_SEND_ATTEMPTS && err == -MCE_ERR_REPLY);
+    pthread_mutex_unlock(&C_cmd.lock);
 
     switch (-err) {
 
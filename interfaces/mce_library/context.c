@@ -11,6 +11,7 @@
 #include <mce/defaults.h>
 
 #include "context.h"
+#include "rt.h"
 #include "autoversion.h"
 #include "../defaults/config.h"
 
@@ -198,6 +199,7 @@ mce_context_t* mcelib_create_termio(int fibre_card, const char *mas_config,
         return NULL;
 
     memset(c, 0, sizeof(mce_context_t));
+    pthread_mutex_init(&c->cmd.lock, NULL);
     if (fibre_card == MCE_DEFAULT_MCE)
         c->fibre_card = mcelib_default_mce();
     else
@@ -303,6 +305,9 @@ mce_context_t* mcelib_create_termio(int fibre_card, const char *mas_config,
     c->jam_dir = get_default_dir(c, masconfig, "jamdir", MAS_JAMDIR);
     free(mas_cfg);
 
+    /* acquisition thread tuning */
+    rt_load_config(c);
+
     return c;
 }
 
@@ -342,6 +347,7 @@ void mcelib_destroy(mce_context_t* context)
     free(context->temp_dir);
     free(context->test_dir);
 
+    pthread_mutex_destroy(&context->cmd.lock);
     free(context);
 }
 
@@ -5,9 +5,12 @@
 #define MCELIB_CONTEXT_H
 
 #include <stdint.h>
+#include <pthread.h>
 #include <mce_library.h>
 #include <libmaslog.h>
 
+#include "ring.h"
+
 struct maslog_struct {
     int fd;
     const mce_context_t *context; /* for configuration information */
@@ -37,6 +40,8 @@ typedef struct mceconfig {
 typedef struct mcecmd {
     int connected;
     int fd;
+    pthread_mutex_t lock;     /* one command/reply at a time; a streaming
+                                 data thread also sends GO */
 
     char dev_name[MCE_LONG];
     char errstr[MCE_LONG];
@@ -53,6 +58,13 @@ typedef struct mcedata {
 
     void *map;
     int map_size;
+
+    int can_poll;   /* driver wakes poll() when frames arrive */
+    int batch_max;  /* max frames per FRAME_POLL_BATCH; 0 if unsupported */
+
+    const volatile struct dsp_ctrl_page *ctrl; /* driver control page */
+    int ctrl_size;
+    mcering_layout_t ring;  /* buffer layout, cached from ctrl */
 } mcedata_t;
 
 #define MCEDATA_PACKET_MAX 4096 /* Maximum frame size in dwords */
@@ -64,6 +76,21 @@ typedef struct mcedsp {
     int fd;
 } mcedsp_t;
 
+/* Real-time tuning of the acquisition threads, from the "acquisition"
+ * section of mas.cfg; see rt.h. */
+
+#define MCELIB_RT_CPUS 64
+
+typedef struct mcelib_rt {
+    int acq_cpus[MCELIB_RT_CPUS];     /* CPUs for the acquisition loop */
+    int n_acq_cpus;                   /*   ... 0 for no pinning */
+    int worker_cpus[MCELIB_RT_CPUS];  /* CPUs for storage workers */
+    int n_worker_cpus;
+    int priority;                     /* SCHED_FIFO priority; 0 for none */
+    int lock_memory;                  /* mlock acquisition buffers */
+    int warned;                       /* RT_WARN_* already reported */
+} mcelib_rt_t;
+
 /* Context structure associates connections on the three modules. */
 
 struct mce_context {
@@ -76,6 +103,7 @@ struct mce_context {
     unsigned int      flags;          /* MCELIB public flags */
     struct config_t  *mas_cfg;        /* MAS configuration */
     int               fibre_card;     /* logical fibre card number */
+    mcelib_rt_t       rt;             /* acquisition thread tuning */
     enum { MCE_DSP_UNKNOWN, MCE_DSP_OLD, MCE_DSP } drv_type; /* driver type */
 
     /* the terminal output routine, this allows the caller to redirect terminal
@@ -121,6 +149,10 @@ int mcelib_print(const mce_context_t *context, const char *fmt,
         ...) __attribute__ ((format (printf, 2, 3)));
 int mcelib_symlink(const char *symlink, const char *target);
 
+/* Longest name quoted in an errstr message ("%.*s"), leaving room for
+   the rest of the text. */
+#define MCELIB_ERR_NAME (MCE_LONG - 64)
+
 typedef enum {
     MCE_SUBSYSTEM_DSP, MCE_SUBSYSTEM_CMD, MCE_SUBSYSTEM_DATA
 } mce_subsystem_t;
@@ -15,11 +15,13 @@ MAS_UNSUPPORTED(int mcedata_close(mce_context_t *context))
 #include <ctype.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 
 #include "mce/defaults.h"
 #include <mce/ioctl.h>
+#include <mce/dsp.h>
 
 /* Local header files */
 
@@ -56,6 +58,39 @@ int mcedata_open(mce_context_t *context)
         }
     }
 
+    // Can we sleep in poll() rather than spinning on FRAME_POLL?
+    C_data.can_poll = !mcelib_legacy(context) &&
+        (ioctl(C_data.fd, DSPIOCT_QUERY, QUERY_POLL) > 0);
+
+    // And collect several frame offsets per ioctl?
+    C_data.batch_max = 0;
+    if (!mcelib_legacy(context)) {
+        int n = ioctl(C_data.fd, DSPIOCT_QUERY, QUERY_BATCH);
+        if (n > DSP_FRAME_BATCH_MAX)
+            n = DSP_FRAME_BATCH_MAX;
+        if (n > 0)
+            C_data.batch_max = n;
+    }
+
+    // Map the control page, so ready frames can be found without ioctls.
+    C_data.ctrl = NULL;
+    if (!mcelib_legacy(context) && C_data.map != NULL) {
+        int offset = ioctl(C_data.fd, DSPIOCT_QUERY, QUERY_CTRL_OFFSET);
+        int size = sysconf(_SC_PAGESIZE);
+        if (offset > 0) {
+            map = mmap(NULL, size, PROT_READ, MAP_SHARED, C_data.fd, offset);
+            if (map == MAP_FAILED) {
+                map = NULL;
+            } else if (((struct dsp_ctrl_page*)map)->magic != DSP_CTRL_MAGIC ||
+                    mcering_load_layout(&C_data.ring, map) != 0) {
+                munmap(map, size);
+                map = NULL;
+            }
+            C_data.ctrl = map;
+            C_data.ctrl_size = size;
+        }
+    }
+
     return 0;
 }
 
@@ -65,6 +100,9 @@ int mcedata_close(mce_context_t *context)
 
     if (C_data.map != NULL)
         munmap(C_data.map, C_data.map_size);
+    if (C_data.ctrl != NULL)
+        munmap((void*)C_data.ctrl, C_data.ctrl_size);
+    C_data.ctrl = NULL;
 
     C_data.map_size = 0;
     C_data.map = NULL;
@@ -115,6 +153,30 @@ void mcedata_buffer_query(mce_context_t* context, int *head, int *tail,
     *count = DATAIOCTL(context, DSPIOCT_QUERY, DATADEV_IOCT_QUERY, QUERY_MAX);
 }
 
+/* mcedata_buffer_occupancy
+
+   Number of frames waiting in the driver buffer.  The buffer size, in
+   frames, is stored in *size unless size is NULL.  Reads the control
+   page when it is mapped, and uses mcedata_buffer_query otherwise.
+ */
+int mcedata_buffer_occupancy(mce_context_t* context, int *size)
+{
+    int head, tail, count;
+
+    if (C_data.ctrl != NULL) {
+        count = C_data.ctrl->n_frames;
+        head = C_data.ctrl->head_index;
+        tail = C_data.ctrl->tail_index;
+    } else {
+        mcedata_buffer_query(context, &head, &tail, &count);
+    }
+    if (size != NULL)
+        *size = count;
+    if (count <= 0)
+        return 0;
+    return ((head - tail) % count + count) % count;
+}
+
 /* mcedata_poll_offset
 
    Get byte offset into memmap of next unconsumed data frame.
@@ -147,6 +209,129 @@ int mcedata_consume_frame(mce_context_t* context)
             DSPIOCT_FRAME_CONSUME, DATADEV_IOCT_FRAME_CONSUME);
 }
 
+/* mcedata_poll_batch
+
+   Get byte offsets into memmap of up to max unconsumed data frames,
+   in order, starting from the oldest.  These remain valid until the
+   frames are released with mcedata_consume_frames.
+
+   Returns the number of offsets stored (0 if no frames are ready), or
+   -MCE_ERR_FRAME_KILL if the driver wants you to exit, or another
+   negative error code.
+
+   When the driver's control page is mapped, no ioctl is issued.
+   With drivers that do not support batching, at most one frame is
+   returned.
+ */
+int mcedata_poll_batch(mce_context_t* context, int *offsets, int max)
+{
+    struct dsp_frame_batch batch;
+    int i;
+
+    if (max <= 0)
+        return 0;
+
+    // Read ready frames straight from the control page when we can; a
+    // pending kill must still be collected (and cleared) by ioctl.
+    if (C_data.ctrl != NULL && !C_data.ctrl->force_exit) {
+        int n = mcering_poll(&C_data.ring, C_data.ctrl, offsets, max);
+        if (n >= 0)
+            return n;
+    }
+
+    if (C_data.batch_max <= 0) {
+        if (mcedata_poll_offset(context, offsets))
+            return 1;
+        return (offsets[0] == EAGAIN) ? 0 : -MCE_ERR_FRAME_KILL;
+    }
+
+    batch.max = (max < C_data.batch_max) ? max : C_data.batch_max;
+    batch.count = 0;
+    if (ioctl(C_data.fd, DSPIOCT_FRAME_POLL_BATCH, &batch) < 0) {
+        if (errno == EAGAIN)
+            return 0;
+        if (errno == ENODATA)
+            return -MCE_ERR_FRAME_KILL;
+        return -MCE_ERR_DEVICE;
+    }
+
+    for (i=0; i<batch.count; i++)
+        offsets[i] = batch.offsets[i];
+    return batch.count;
+}
+
+/* mcedata_consume_frames
+
+   Release the n oldest frames back to the driver.  Returns the number
+   of frames consumed, or a negative error code.
+ */
+int mcedata_consume_frames(mce_context_t* context, int n)
+{
+    int i, err;
+
+    if (C_data.batch_max > 0) {
+        err = ioctl(C_data.fd, DSPIOCT_FRAME_CONSUME_N, n);
+        return (err < 0) ? -MCE_ERR_DEVICE : err;
+    }
+
+    for (i=0; i<n; i++) {
+        if (mcedata_consume_frame(context) < 0)
+            return -MCE_ERR_DEVICE;
+    }
+    return n;
+}
+
+/* mcedata_wait_frame
+
+   Sleep until the driver has a frame (or a fake stop frame) ready for
+   mcedata_poll_offset, or until timeout_ms has elapsed.  A negative
+   timeout_ms waits indefinitely.
+
+   Returns 1 if the caller should poll for a frame, 0 on timeout, and
+   a negative error code on failure.  Spurious returns of 1 are
+   possible (e.g. on signal delivery), so callers must poll and wait
+   again as necessary.
+
+   Drivers that cannot wake poll() (the U0106 driver, and older U0107
+   drivers) are handled by sleeping for MCEDATA_WAIT_FALLBACK_US (or
+   the timeout, if shorter) and returning 1.
+ */
+
+#define MCEDATA_WAIT_FALLBACK_US 1000
+
+int mcedata_wait_frame(mce_context_t* context, int timeout_ms)
+{
+    struct pollfd pfd;
+    int err;
+
+    C_data_check;
+
+    if (!C_data.can_poll) {
+        if (timeout_ms == 0)
+            return 0;
+        if (timeout_ms > 0 && timeout_ms * 1000 < MCEDATA_WAIT_FALLBACK_US)
+            usleep(timeout_ms * 1000);
+        else
+            usleep(MCEDATA_WAIT_FALLBACK_US);
+        return 1;
+    }
+
+    pfd.fd = C_data.fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    err = poll(&pfd, 1, timeout_ms);
+    if (err < 0)
+        return (errno == EINTR) ? 1 : -MCE_ERR_DEVICE;
+    if (err == 0)
+        return 0;
+    if (pfd.revents & POLLIN)
+        return 1;
+
+    /* POLLERR, POLLHUP, POLLNVAL */
+    return -MCE_ERR_DEVICE;
+}
+
 int mcedata_lock_query(mce_context_t* context)
 {
     return DATAIOCTL(context, DSPIOCT_DATA_LOCK, DATADEV_IOCT_LOCK, LOCK_QUERY);
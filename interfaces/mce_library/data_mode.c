@@ -4,6 +4,7 @@
 #define _GNU_SOURCE
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <mce/data_mode.h>
 
 /* This is stupid cpp tricks, to be sure.
@@ -15,6 +16,10 @@
    fields, and the second set just serve to form a comma delimited
    list of the mce_data_field variables for inclusion in the master
    list.
+
+   The first set also defines an extract function for each packed
+   field, with the bit positions, sizes and scales as constants, so
+   that each one compiles to a simple (vectorizable) loop.
 */
 
 
@@ -26,6 +31,47 @@
 #define DATA_FIELD_DECLARE(MODE, NAME) \
     static struct mce_data_field DATA_FIELD(MODE, NAME)
 
+/* Extract functions, e.g. mode4_ERROR_extract */
+#define EXTRACT_FN(MODE, NAME) \
+    mode ## MODE ## _ ## NAME ## _extract
+
+/* Bits [START, START+COUNT) of x, sign-extended if SIGNED. */
+#define EXTRACT_BITS(x, START, COUNT, SIGNED) \
+    ((SIGNED) ? (int32_t)((x) << (32 - (START) - (COUNT))) >> (32 - (COUNT)) \
+     : (int32_t)(((x) >> (START)) & (uint32_t)((1ULL << (COUNT)) - 1)))
+
+/* Only one branch survives, COUNT being a constant. */
+#define DEFINE_EXTRACT(MODE, NAME, START, COUNT, SIGNED) \
+    static void EXTRACT_FN(MODE, NAME)(const uint32_t *restrict in, void *out, \
+            int n) \
+    { \
+        int k; \
+        if (MCE_DATA_EXTRACT_INT_SIZE(COUNT) == 1) { \
+            int8_t *restrict o = out; \
+            for (k=0; k<n; k++) \
+                o[k] = EXTRACT_BITS(in[k], START, COUNT, SIGNED); \
+        } else if (MCE_DATA_EXTRACT_INT_SIZE(COUNT) == 2) { \
+            int16_t *restrict o = out; \
+            for (k=0; k<n; k++) \
+                o[k] = EXTRACT_BITS(in[k], START, COUNT, SIGNED); \
+        } else { \
+            int32_t *restrict o = out; \
+            for (k=0; k<n; k++) \
+                o[k] = EXTRACT_BITS(in[k], START, COUNT, SIGNED); \
+        } \
+    }
+
+#define DEFINE_EXTRACT_SCALE(MODE, NAME, START, COUNT, SCALE, SIGNED) \
+    static void EXTRACT_FN(MODE, NAME)(const uint32_t *restrict in, void *out, \
+            int n) \
+    { \
+        float *restrict o = out; \
+        int k; \
+        for (k=0; k<n; k++) \
+            o[k] = (float)EXTRACT_BITS(in[k], START, COUNT, SIGNED) * \
+                (float)(SCALE); \
+    }
+
 /* Macro set 1 */
 
 #define DECLARE_RAW(MODE, NAME) \
@@ -44,6 +90,7 @@
     };
 
 #define DECLARE_EXTRACT(MODE, NAME, START, COUNT, SIGNED) \
+    DEFINE_EXTRACT(MODE, NAME, START, COUNT, SIGNED) \
     DATA_FIELD_DECLARE(MODE, NAME) = { \
         .data_mode = MODE, \
         .type = DATA_MODE_EXTRACT, \
@@ -51,9 +98,11 @@
         .bit_start = START, \
         .bit_count = COUNT, \
         .has_sign = SIGNED, \
+        .extract = EXTRACT_FN(MODE, NAME), \
     };
 
 #define DECLARE_EXTRACT_SCALE(MODE, NAME, START, COUNT, SCALE, SIGNED) \
+    DEFINE_EXTRACT_SCALE(MODE, NAME, START, COUNT, SCALE, SIGNED) \
     DATA_FIELD_DECLARE(MODE, NAME) = { \
         .data_mode = MODE, \
         .type = DATA_MODE_EXTRACT_SCALE, \
@@ -62,6 +111,7 @@
         .bit_count = COUNT, \
         .scalar = SCALE, \
         .has_sign = SIGNED, \
+        .extract = EXTRACT_FN(MODE, NAME), \
     };
 
 
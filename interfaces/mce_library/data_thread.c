@@ -2,196 +2,112 @@
  *      vim: sw=4 ts=4 et tw=80
  */
 #include <errno.h>
-#include <unistd.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "context.h"
 #include "data_thread.h"
-#include "frame_manip.h"
 
 
-/*
- * data_go
+/* DATA THREAD:
  *
- *  - lock down
- *  - flush data device
- *  - start data collector
- *  - inform driver of frame size
- *  - set sequence numbers
- *  - send go to selected column(s)
+ * data_thread is launched by mcedata_acq_start, just after the GO.  It
+ * runs the usual mmap acquisition loop, then the user's completion
+ * callback, and then goes idle.
  */
-#if 0
-void data_setflag(data_thread_t *d, int flag)
-{
-    d->flags |= flag;
-}
 
-void data_clearflag(data_thread_t *d, int flag)
+static void *data_thread(void *p_void)
 {
-    d->flags &= ~flag;
-}
+    data_thread_t *d = (data_thread_t*) p_void;
+    mce_acq_t *acq = d->acq;
 
-int data_checkflags(data_thread_t *d, int flags)
-{
-    return d->flags & flags;
-}
+    d->state = MCETHREAD_GO;
+    copy_frames_mmap(acq);
 
-int  data_stop(params_t *p, char *errstr)
-{
-    data_setflag(&p->data_data, FLAG_STOP);
+    if (acq->callback != NULL)
+        acq->callback(acq, acq->callback_data);
 
-    return command_stop(&p->mce_comms, &p->frame_setup);
-}
+    pthread_mutex_lock(&d->lock);
+    d->state = MCETHREAD_IDLE;
+    pthread_cond_broadcast(&d->idle);
+    pthread_mutex_unlock(&d->lock);
 
-int data_reset(params_t *p)
-{
-    data_kill(p);
-    data_clearflag( &p->data_data, FLAG_ALL );
-    return 0;
+    return (void*)d;
 }
-#endif
-
 
-#define SUBNAME "data_go: "
-
-
-
-/* DATA THREAD:
- *
- * data_thread is launched just prior to the initiation of the GO.
- */
+data_thread_t *data_thread_launcher(mce_acq_t *acq)
+{
+    pthread_condattr_t attr;
+    data_thread_t *d = calloc(1, sizeof(*d));
+    if (d == NULL)
+        return NULL;
 
-inline int stop_bit(char *packet) {
-    //Stop flag is bit 0 of first word
-    return *( (uint32_t*)packet + 0) & 1;
+    d->acq = acq;
+    d->state = MCETHREAD_LAUNCH;
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&d->idle, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&d->thread, NULL, data_thread, (void*)d) != 0) {
+        pthread_cond_destroy(&d->idle);
+        pthread_mutex_destroy(&d->lock);
+        free(d);
+        return NULL;
+    }
+    return d;
 }
 
+/* data_thread_wait - wait up to timeout_ms (forever, if negative) for
+ * the thread to finish.  Returns 0 if it has, or -MCE_ERR_TIMEOUT. */
 
-void *data_thread(void *p_void)
+int data_thread_wait(data_thread_t *d, int timeout_ms)
 {
-    int ret_val;
-    data_thread_t *d =(data_thread_t*) p_void;
-    int size = d->acq->frame_size*sizeof(uint32_t);
-    int fd = d->acq->context->data.fd;
-    mcedata_storage_t *acts = d->acq->storage;
-    uint32_t *data = malloc(size);
-    int done = 0;
-
-    if (data==NULL) {
-        sprintf(d->errstr, "Could not allocate data buffer memory\n");
-        d->state = MCETHREAD_ERROR;
-        return (void*)d;
-    }
-
-    mcelib_print(d->acq->context, "data_thread: entry");
-    //logger_print(&p->logger, "Data thread starting\n");
-
-    d->count = 0;
-    d->chksum = 0;
-    d->drop = 0;
-
-    int index = 0;
-    int count = 0;
-    while (!done) {
-
-        if (acts->pre_frame != NULL && acts->pre_frame(d->acq)) {
-            mcelib_warning(d->acq->context, "pre_frame action failed\n");
+    struct timespec until;
+    int err = 0;
+
+    if (timeout_ms > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &until);
+        until.tv_sec += timeout_ms / 1000;
+        until.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
         }
-
-        ret_val = read(fd, (char*)data + index, size - index);
-
-        if (ret_val<0) {
-            if (errno==EAGAIN) {
-                usleep(1000);
-            } else {
-                // Error: clear rest of frame and quit
-                mcelib_error(d->acq->context,
-                        "read failed with code %i\n", ret_val);
-                memset((char*)data + index, 0, size - index);
-                done = EXIT_READ;
-                break;
-            }
-        } else if (ret_val==0) {
-            done = EXIT_EOF;
-        } else
-            index += ret_val;
-
-        if (d->state == MCETHREAD_STOP)
-            done = EXIT_STOP;
-
-        // Only dump complete frames to disk
-        if (index < size)
-            continue;
-
-        // Logical formatting
-        sort_columns( d->acq, data );
-
-        if ( (acts->post_frame != NULL) && acts->post_frame( d->acq, count, data ) ) {
-            mcelib_warning(d->acq->context, "post_frame action failed\n");
-        }
-
-        index = 0;
-        if (++count >= d->acq->n_frames)
-            done = EXIT_COUNT;
     }
 
-    d->state = MCETHREAD_IDLE;
-
-#if 0
-    sprintf(errstr, "Data thread exiting with %i of %i expected frames; ",
-            d->count,
-            p->frame_setup.seq_last - p->frame_setup.seq_first + 1);
-
-    switch (done) {
-
-        case EXIT_STOP:
-            strcat(errstr, "user STOP received.\n");
-            break;
-
-        case EXIT_READ:
-            strcat(errstr, "device read error.\n");
-            break;
-
-        case EXIT_WRITE:
-            strcat(errstr, "file write error.\n");
-            break;
-
-        case EXIT_LAST:
-            strcat(errstr, "last frame detected.\n");
-            break;
-
-        case EXIT_EOF:
-            strcat(errstr, "device signaled EOF.\n");
-            break;
-
-        default:
-            strcat(errstr, "unexpected loop termination.\n");
+    pthread_mutex_lock(&d->lock);
+    while (d->state != MCETHREAD_IDLE && err == 0) {
+        if (timeout_ms < 0)
+            err = pthread_cond_wait(&d->idle, &d->lock);
+        else if (timeout_ms == 0)
+            err = ETIMEDOUT;
+        else
+            err = pthread_cond_timedwait(&d->idle, &d->lock, &until);
     }
+    pthread_mutex_unlock(&d->lock);
 
-    printf("data_thread: %s\n", errstr);
-    logger_print(&p->logger, errstr);
-
-    if (data_refile_stop(&p->datafile)) {
-        sprintf(errstr, "error closing data file '%s'.\n",
-                p->datafile.filename);
-        printf("data_thread: %s\n", errstr);
-        logger_print(&p->logger, errstr);
-    }
+    return (d->state == MCETHREAD_IDLE) ? 0 : -MCE_ERR_TIMEOUT;
+}
 
-    data_clearflag(d, FLAG_STOP);
-    data_setflag(d, FLAG_DONE);
-    d->done = 1;
-    d->error = err;
-#endif
+/* data_thread_is_self - non-zero when called from the data thread
+ * itself (from storage or the completion callback), which must not
+ * wait for itself. */
 
-    return (void*)d;
+int data_thread_is_self(data_thread_t *d)
+{
+    return pthread_equal(pthread_self(), d->thread);
 }
 
-int data_thread_launcher(data_thread_t *d)
-{
-    d->state = MCETHREAD_LAUNCH;
-    int err = pthread_create(&d->thread, NULL, data_thread, (void*)d);
+/* data_thread_destroy - join and free an idle thread. */
 
-    return err;
+void data_thread_destroy(data_thread_t *d)
+{
+    pthread_join(d->thread, NULL);
+    pthread_cond_destroy(&d->idle);
+    pthread_mutex_destroy(&d->lock);
+    free(d);
 }
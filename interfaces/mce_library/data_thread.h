@@ -18,16 +18,17 @@
 #define EXIT_KILL      8
 
 
+/* Asynchronous acquisition state, one per running mcedata_acq_start. */
+
 typedef struct data_thread_struct {
 
     pthread_t thread;
 
     mce_acq_t *acq;
-    unsigned state;
+    volatile unsigned state;
 
-    int count;
-    int chksum;
-    int drop;
+    pthread_mutex_t lock;
+    pthread_cond_t idle;    // signalled when state becomes IDLE
 
     char errstr[MCE_LONG];
 
@@ -43,8 +44,21 @@ enum {
     MCETHREAD_ERROR
 };
 
-int  data_thread_launcher();
-int  data_thread_stop();
-int  data_thread_go();
+data_thread_t *data_thread_launcher(mce_acq_t *acq);
+int  data_thread_wait(data_thread_t *d, int timeout_ms);
+int  data_thread_is_self(data_thread_t *d);
+void data_thread_destroy(data_thread_t *d);
+
+/* The mmap acquisition loop, from acq.c */
+int copy_frames_mmap(mce_acq_t *acq);
+
+/* Handle one frame (number index of the go) at data, from acq.c; used
+ * by copy_frames_mmap and the tests.  Returns an EXIT_* code at the
+ * end of the acquisition, otherwise 0. */
+int acq_copy_frame(mce_acq_t *acq, long long index, uint32_t *data,
+        const mce_host_time_t *t);
+
+/* Issue GO for n_frames on acq's MCE, from acq.c; used by aggregate.c */
+int acq_start_frames(mce_acq_t *acq, int n_frames);
 
 #endif
@@ -3,13 +3,26 @@
  */
 #define _GNU_SOURCE
 
-/* Dirfile storage module */
+/* Dirfile storage module
+ *
+ * Fields are written in blocks.  Incoming frames are kept whole, a
+ * tile of DIRFILE_TILE at a time; each full tile is transposed into
+ * the per-channel buffers, and when those hold block_frames samples
+ * every field gets a single pwrite() on its raw fd.  A tile of frames
+ * fits in cache, so the transpose reads each frame from cache and
+ * writes each channel's buffer a cache line at a time. */
 
 #include <stdlib.h>
 #include <string.h>
+#include <fnmatch.h>
 #include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "context.h"
+#include "rotate.h"
 
 #define MINIMUM_DIRFILE_VERSION 3 /* earlier versions have annoying limitations
                                      on field name length (in addition to worse
@@ -26,13 +39,55 @@
 
 #define DIRFILE_CHANNELS      (MCEDATA_CARDS*MCEDATA_COLUMNS*MCEDATA_ROWS)
 
-typedef struct {
-    uint32_t *data;                 // buffer for this channel's data
-    int count;                 // number of data in buffer
-    int decimation;            // If non-zero, indicates how often to record a data point
-    int decimation_count;      // Decimation counter
+#define DIRFILE_TILE          16    /* frames transposed at once */
+#define DIRFILE_BLOCK_FRAMES  1024  /* default samples per field per write */
+
+#define DIRFILE_RULES         16    /* mcedata_dirfile_decimate calls */
+#define DIRFILE_MAX_DECIMATION 65536
+#define DIRFILE_MAX_RATIO     (1 << 20) /* of full rate to slowest field */
 
-    FILE *fout;                // File handle for this channel's data
+/* Summaries of decimated fields, in MCEDATA_DECIMATE_MEAN order. */
+#define DIRFILE_SUMMARIES     3
+static const char *summary_suffix[DIRFILE_SUMMARIES] = {
+    "_mean", "_min", "_max"
+};
+
+/* Host arrival time fields (acq->frame_time); INT64 needs version 5. */
+#define HOST_TIME_FIELD "host_time_ns"  /* CLOCK_REALTIME */
+#define HOST_MONO_FIELD "host_mono_ns"  /* CLOCK_MONOTONIC */
+#define HOST_TIME_VERSION 5
+
+/* Outputs of a decimated field, other than the samples themselves. */
+struct dirfile_summary {
+    int fd[DIRFILE_SUMMARIES];         // -1 if not wanted
+    off_t offset[DIRFILE_SUMMARIES];
+    double *mean;
+    uint32_t *min;
+    uint32_t *max;
+};
+
+/* A packed data mode field stored unpacked (MCEDATA_DIRFILE_EXTRACT). */
+struct dirfile_extract {
+    const struct mce_data_field *field;
+    int fd;
+    off_t offset;
+    void *buf;                 // block_frames values
+};
+
+typedef struct {
+    uint32_t *data;            // this channel's samples in the current block
+    int decimation;            // Samples per stored sample (<= 1: all)
+    int decimation_count;      // Samples so far in the current group
+    int outputs;               // MCEDATA_DECIMATE_*, if decimated
+    uint32_t first;            // The current group: first sample,
+    int64_t sum;               //   sum,
+    uint32_t min, max;         //   and extremes (signed if has_sign)
+    struct dirfile_summary *summary;   // NULL unless outputs asks for it
+    struct dirfile_extract *extract;   // unpacked fields, n_extract of them
+    int n_extract;
+
+    int fd;                    // This channel's data file, or -1
+    off_t offset;              // where the next block goes
     char *basename;            // Base of field name (e.g. r00c00 or num_rows)
     char *filename;            // Raw field name (e.g. tesdatar00c00 or num_rows)
     int free_on_destroy;       // Should destructor free data, basename, filename?
@@ -42,18 +97,30 @@ typedef struct {
     int has_sign;              // Indicates raw field should be treated as signed.
 } channel_t;
 
+typedef struct dirfile_rule {
+    char fields[MCE_SHORT];    // "header", or a pattern for fnmatch
+    int factor;
+    int outputs;
+} dirfile_rule_t;
+
 typedef struct dirfile_struct {
 
     channel_t *channels;
 
-    int data_size;
-
-    int frame_count;
-    int write_period;
-
     int channel_count;
 
-    int flush;
+    int frame_size;            // dwords per frame
+    int block_frames;          // samples per field per write
+    int block_count;           // samples in the channel buffers
+    uint32_t *stage;           // frames not yet transposed, whole
+    int stage_count;
+    int options;               // MCEDATA_DIRFILE_SYNC, _EXTRACT
+    int n_workers;             // writer threads; 0 to write inline
+    struct dirfile_pool *pool;
+
+    dirfile_rule_t rules[DIRFILE_RULES];
+    int n_rules;
+    int rate;                  // full rate / slowest rate, for the spfs
 
     char basename[MCE_LONG];
     char include[MCE_LONG];
@@ -63,6 +130,14 @@ typedef struct dirfile_struct {
     int spf;
     int version;
 
+    int64_t *host_real;        // arrival time buffers; NULL if not written
+    int64_t *host_mono;        //   (block_frames each, like channels)
+    int host_real_fd;
+    int host_mono_fd;
+    off_t host_offset;
+
+    long prealloc;             // samples per field to reserve on disk, or 0
+
     // struct frame_header_abstraction frame_description;
 
 } dirfile_t;
@@ -152,6 +227,18 @@ static int dirfile_free(dirfile_t *d)
 
     // What am I, C++?
     for (i=0; i<d->channel_count; i++) {
+        struct dirfile_summary *s = d->channels[i].summary;
+        int j;
+        for (j=0; j<d->channels[i].n_extract; j++)
+            FREE_NOT_NULL(d->channels[i].extract[j].buf);
+        FREE_NOT_NULL(d->channels[i].extract);
+        d->channels[i].n_extract = 0;
+        if (s != NULL) {
+            FREE_NOT_NULL(s->mean);
+            FREE_NOT_NULL(s->min);
+            FREE_NOT_NULL(s->max);
+            FREE_NOT_NULL(d->channels[i].summary);
+        }
         if (d->channels[i].free_on_destroy) {
             FREE_NOT_NULL(d->channels[i].data);
             FREE_NOT_NULL(d->channels[i].filename);
@@ -160,35 +247,475 @@ static int dirfile_free(dirfile_t *d)
     }
 
     FREE_NOT_NULL(d->channels);
+    FREE_NOT_NULL(d->stage);
+    FREE_NOT_NULL(d->host_real);
+    FREE_NOT_NULL(d->host_mono);
 
     return 0;
 }
 
-/* Checks data buffers and calls fwrite on any that are more than
- * half-full.
- */
+/* Gather n frames (stride dwords apart) into the buffers of channels
+ * [0, n_channels), starting at sample dest. */
 
-static int dirfile_write(mce_acq_t *acq, dirfile_t *f)
+static void dirfile_gather(channel_t *channels, int n_channels,
+        const uint32_t *frames, int stride, int n, int dest)
 {
-    int i;
-    int thresh = f->data_size / 2;
-    char filename[MCE_LONG];
+    int i, k;
+
+    for (i=0; i<n_channels; i++) {
+        const channel_t *c = channels + i;
+        const uint32_t *in = frames + c->frame_offset;
+        uint32_t *out = c->data + dest;
+        if (n == DIRFILE_TILE) {
+            // The usual case; a fixed count, so the compiler unrolls it.
+            for (k=0; k<DIRFILE_TILE; k++)
+                out[k] = in[k*stride];
+        } else {
+            for (k=0; k<n; k++)
+                out[k] = in[k*stride];
+        }
+    }
+}
 
-    strcpy(filename, f->basename);
+/* Move the staged frames into the channel buffers. */
 
-    int writes = 0;
-    for (i=0; i<f->channel_count; i++) {
-        channel_t *c = f->channels + i;
-        if (!f->flush && c->count < thresh)
+static void dirfile_transpose(dirfile_t *f)
+{
+    dirfile_gather(f->channels, f->channel_count, f->stage, f->frame_size,
+            f->stage_count, f->block_count);
+    f->block_count += f->stage_count;
+    f->stage_count = 0;
+}
+
+static int dirfile_pwrite(int fd, const void *data, size_t len, off_t offset)
+{
+    const char *p = (const char*)data;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+/* Decimation (mcedata_dirfile_decimate). */
+
+static int dirfile_less(const channel_t *c, uint32_t a, uint32_t b)
+{
+    return c->has_sign ? (int32_t)a < (int32_t)b : a < b;
+}
+
+/* Store the current group as the m-th output sample, and start afresh. */
+
+static void dirfile_emit(channel_t *c, int m)
+{
+    struct dirfile_summary *s = c->summary;
+
+    c->data[m] = c->first;
+    if (s != NULL) {
+        s->mean[m] = (double)c->sum / c->decimation_count;
+        s->min[m] = c->min;
+        s->max[m] = c->max;
+    }
+    c->decimation_count = 0;
+}
+
+/* Reduce the first n samples of a decimated channel, in place, to one
+ * per complete group; with finish, a partial group at the end counts
+ * too.  Groups carry over from one call to the next.  Returns the
+ * number of output samples. */
+
+static int dirfile_decimate(channel_t *c, int n, int finish)
+{
+    int k, m = 0;
+
+    for (k=0; k<n; k++) {
+        uint32_t v = c->data[k];
+        if (c->decimation_count++ == 0) {
+            c->first = c->min = c->max = v;
+            c->sum = 0;
+        }
+        c->sum += c->has_sign ? (int64_t)(int32_t)v : (int64_t)v;
+        if (dirfile_less(c, v, c->min))
+            c->min = v;
+        if (dirfile_less(c, c->max, v))
+            c->max = v;
+        // m < k here, so this never clobbers samples still to come.
+        if (c->decimation_count == c->decimation)
+            dirfile_emit(c, m++);
+    }
+    if (finish && c->decimation_count > 0)
+        dirfile_emit(c, m++);
+    return m;
+}
+
+/* Write the first n samples of channels [0, n_channels), decimating
+ * as need be.  finish also stores partial groups, at the very end. */
+
+static int dirfile_write_fields(channel_t *channels, int n_channels, int n,
+        int sync, int finish)
+{
+    int err = 0;
+    int i, j;
+
+    for (i=0; i<n_channels; i++) {
+        channel_t *c = channels + i;
+        struct dirfile_summary *s = c->summary;
+        int m = n;
+
+        // Unpack first; decimation reuses c->data.
+        for (j=0; j<c->n_extract && n>0; j++) {
+            struct dirfile_extract *e = c->extract + j;
+            size_t len = n * MCE_DATA_EXTRACT_SIZE(e->field);
+            e->field->extract(c->data, e->buf, n);
+            if (dirfile_pwrite(e->fd, e->buf, len, e->offset))
+                err = -1;
+            e->offset += len;
+            if (sync)
+                fdatasync(e->fd);
+        }
+
+        if (c->decimation > 1)
+            m = dirfile_decimate(c, n, finish);
+        if (m == 0)
             continue;
-        if (c->fout == NULL)
+
+        if (c->fd >= 0) {
+            size_t len = m * sizeof(uint32_t);
+            if (dirfile_pwrite(c->fd, c->data, len, c->offset))
+                err = -1;
+            c->offset += len;
+            if (sync)
+                fdatasync(c->fd);
+        }
+        if (s == NULL)
             continue;
-        fwrite(c->data, c->count, sizeof(uint32_t), c->fout);
-        c->count = 0;
-        writes++;
-        fflush(c->fout); // Avoid issue with dropped samples when writing to NFS mount
+        for (j=0; j<DIRFILE_SUMMARIES; j++) {
+            const void *buf = (j == 0) ? (const void*)s->mean :
+                (j == 1) ? (const void*)s->min : (const void*)s->max;
+            size_t len = m * ((j == 0) ? sizeof(double) : sizeof(uint32_t));
+            if (s->fd[j] < 0)
+                continue;
+            if (dirfile_pwrite(s->fd[j], buf, len, s->offset[j]))
+                err = -1;
+            s->offset[j] += len;
+            if (sync)
+                fdatasync(s->fd[j]);
+        }
+    }
+    return err;
+}
+
+static int dirfile_write_host(int real_fd, int mono_fd, off_t *offset,
+        const int64_t *real, const int64_t *mono, int n, int sync)
+{
+    size_t len = n * sizeof(int64_t);
+    int err = 0;
+
+    if (real_fd < 0 || mono_fd < 0)
+        return 0;
+
+    if (dirfile_pwrite(real_fd, real, len, *offset) ||
+            dirfile_pwrite(mono_fd, mono, len, *offset))
+        err = -1;
+    *offset += len;
+    if (sync) {
+        fdatasync(real_fd);
+        fdatasync(mono_fd);
+    }
+    return err;
+}
+
+
+/* Writer pool (mcedata_dirfile_set_workers).  The acquisition thread
+ * only copies each frame into the active frame block; a full block is
+ * handed to the workers and the other block becomes active.  Each
+ * worker owns a contiguous run of channels (fds, buffers and offsets)
+ * and gathers and writes just those; worker 0 also writes the host
+ * time fields.  The output is the same as the serial writer's.
+ *
+ * The pool doesn't refer back to its dirfile_t, which dirfileseq moves
+ * about (while the workers may be busy). */
+
+struct dirfile_worker {
+    pthread_t thread;
+    struct dirfile_pool *pool;
+    channel_t *channels;
+    int n_channels;
+    int host;                  // also writes the host time fields
+};
+
+struct dirfile_pool {
+    int frame_size;
+    int block_frames;
+    int sync;                  // MCEDATA_DIRFILE_SYNC
+    int host_real_fd;          // host time fields, or -1
+    int host_mono_fd;
+    off_t host_offset;
+    int n_workers;
+    struct dirfile_worker *workers;
+
+    uint32_t *frames[2];       // whole frames, block_frames each
+    int64_t *host_real[2];
+    int64_t *host_mono[2];
+    int active;                // block being filled
+    int count;                 // frames in it
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int pending;               // block being written, or -1
+    int pending_count;
+    int generation;            // bumped for each block handed over
+    int busy;                  // workers still on the pending block
+    int shutdown;
+    int error;
+};
+
+static void dirfile_pool_run(struct dirfile_worker *w, int block, int n)
+{
+    struct dirfile_pool *p = w->pool;
+    const uint32_t *frames = p->frames[block];
+    int err, t;
+
+    for (t=0; t<n; t+=DIRFILE_TILE) {
+        int m = (n - t < DIRFILE_TILE) ? n - t : DIRFILE_TILE;
+        dirfile_gather(w->channels, w->n_channels,
+                frames + t * p->frame_size, p->frame_size, m, t);
+    }
+    err = dirfile_write_fields(w->channels, w->n_channels, n, p->sync, 0);
+    if (w->host && dirfile_write_host(p->host_real_fd, p->host_mono_fd,
+                &p->host_offset, p->host_real[block], p->host_mono[block],
+                n, p->sync))
+        err = -1;
+
+    pthread_mutex_lock(&p->lock);
+    if (err)
+        p->error = err;
+    if (--p->busy == 0) {
+        p->pending = -1;
+        pthread_cond_broadcast(&p->cond);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void *dirfile_pool_worker(void *arg)
+{
+    struct dirfile_worker *w = (struct dirfile_worker*)arg;
+    struct dirfile_pool *p = w->pool;
+    int generation = 0;
+
+    pthread_mutex_lock(&p->lock);
+    while (1) {
+        while (p->generation == generation && !p->shutdown)
+            pthread_cond_wait(&p->cond, &p->lock);
+        if (p->generation == generation)
+            break;
+        generation = p->generation;
+        pthread_mutex_unlock(&p->lock);
+
+        dirfile_pool_run(w, p->pending, p->pending_count);
+
+        pthread_mutex_lock(&p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/* Wait for the workers to finish the pending block; returns -1 if any
+ * write since the last call failed. */
+
+static int dirfile_pool_wait(struct dirfile_pool *p)
+{
+    int err;
+
+    pthread_mutex_lock(&p->lock);
+    while (p->pending >= 0)
+        pthread_cond_wait(&p->cond, &p->lock);
+    err = p->error;
+    p->error = 0;
+    pthread_mutex_unlock(&p->lock);
+    return err;
+}
+
+/* Hand the active block to the workers. */
+
+static int dirfile_pool_submit(struct dirfile_pool *p)
+{
+    int err;
+
+    if (p->count == 0)
+        return 0;
+    err = dirfile_pool_wait(p);
+
+    pthread_mutex_lock(&p->lock);
+    p->pending = p->active;
+    p->pending_count = p->count;
+    p->busy = p->n_workers;
+    p->generation++;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+
+    p->active = !p->active;
+    p->count = 0;
+    return err;
+}
+
+static void dirfile_pool_destroy(struct dirfile_pool *p)
+{
+    int i;
+
+    if (p == NULL)
+        return;
+
+    pthread_mutex_lock(&p->lock);
+    p->shutdown = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    for (i=0; i<p->n_workers; i++)
+        pthread_join(p->workers[i].thread, NULL);
+
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->lock);
+    for (i=0; i<2; i++) {
+        free(p->frames[i]);
+        free(p->host_real[i]);
+        free(p->host_mono[i]);
+    }
+    free(p->workers);
+    free(p);
+}
+
+static struct dirfile_pool *dirfile_pool_create(const mce_context_t *context,
+        dirfile_t *f, int n_workers)
+{
+    struct dirfile_pool *p = calloc(1, sizeof(*p));
+    int i;
+
+    if (p == NULL)
+        return NULL;
+    if (n_workers > f->channel_count)
+        n_workers = f->channel_count;
+
+    p->frame_size = f->frame_size;
+    p->block_frames = f->block_frames;
+    p->sync = (f->options & MCEDATA_DIRFILE_SYNC) != 0;
+    p->host_real_fd = (f->host_real != NULL) ? f->host_real_fd : -1;
+    p->host_mono_fd = (f->host_real != NULL) ? f->host_mono_fd : -1;
+    p->host_offset = f->host_offset;
+    p->pending = -1;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+
+    p->workers = calloc(n_workers, sizeof(*p->workers));
+    for (i=0; i<2; i++) {
+        p->frames[i] = malloc((size_t)f->block_frames * f->frame_size *
+                sizeof(uint32_t));
+        if (p->frames[i] == NULL)
+            goto fail;
+        if (f->host_real != NULL) {
+            p->host_real[i] = malloc(f->block_frames * sizeof(int64_t));
+            p->host_mono[i] = malloc(f->block_frames * sizeof(int64_t));
+            if (p->host_real[i] == NULL || p->host_mono[i] == NULL)
+                goto fail;
+        }
+    }
+    if (p->workers == NULL)
+        goto fail;
+
+    // Contiguous, even shares of the channels.
+    for (i=0; i<n_workers; i++) {
+        struct dirfile_worker *w = p->workers + i;
+        int lo = i * f->channel_count / n_workers;
+        int hi = (i+1) * f->channel_count / n_workers;
+        w->pool = p;
+        w->channels = f->channels + lo;
+        w->n_channels = hi - lo;
+        w->host = (i == 0);
+        if (pthread_create(&w->thread, NULL, dirfile_pool_worker, w) != 0) {
+            mcelib_error(context, "Could not start dirfile writer %i.\n", i);
+            goto fail;
+        }
+        p->n_workers++;
+    }
+    return p;
+
+fail:
+    dirfile_pool_destroy(p);
+    return NULL;
+}
+
+
+/* Write out everything buffered, including a partial block; one
+ * pwrite per field. */
+
+static int dirfile_write(dirfile_t *f)
+{
+    int err;
+
+    if (f->pool != NULL) {
+        err = dirfile_pool_submit(f->pool);
+        if (dirfile_pool_wait(f->pool))
+            err = -1;
+        return err;
+    }
+
+    dirfile_transpose(f);
+    if (f->block_count == 0)
+        return 0;
+
+    err = dirfile_write_fields(f->channels, f->channel_count,
+            f->block_count, f->options & MCEDATA_DIRFILE_SYNC, 0);
+    if (f->host_real != NULL && dirfile_write_host(f->host_real_fd,
+                f->host_mono_fd, &f->host_offset, f->host_real, f->host_mono,
+                f->block_count, f->options & MCEDATA_DIRFILE_SYNC))
+        err = -1;
+
+    f->block_count = 0;
+    return err;
+}
+
+/* Does c keep (some of) its samples under its own name? */
+
+static int dirfile_has_samples(const channel_t *c)
+{
+    return c->decimation <= 1 || (c->outputs & MCEDATA_DECIMATE_SAMPLE);
+}
+
+/* Samples per frame of c's fields, as declared in the format file. */
+
+static int dirfile_spf(const dirfile_t *f, const channel_t *c)
+{
+    return f->spf * f->rate / ((c->decimation > 1) ? c->decimation : 1);
+}
+
+/* The dirfile type of an unpacked field. */
+
+static const char *dirfile_extract_type(const struct mce_data_field *m)
+{
+    if (m->type == DATA_MODE_EXTRACT_SCALE)
+        return "FLOAT32";
+    switch (MCE_DATA_EXTRACT_INT_SIZE(m->bit_count)) {
+        case 1:
+            return m->has_sign ? "INT8" : "UINT8";
+        case 2:
+            return m->has_sign ? "INT16" : "UINT16";
     }
+    return m->has_sign ? "INT32" : "UINT32";
+}
 
+static int dirfile_is_extracted(const channel_t *c,
+        const struct mce_data_field *m)
+{
+    int j;
+    for (j=0; j<c->n_extract; j++)
+        if (c->extract[j].field == m)
+            return 1;
     return 0;
 }
 
@@ -198,7 +725,7 @@ int write_format_file(const mce_context_t *context, dirfile_t* f)
     char filename[MCE_LONG];
     FILE* format;
     FILE *infile = NULL;
-    int i;
+    int i, j;
 
     strcpy(filename, f->basename);
     strcat(filename, "format");
@@ -209,14 +736,42 @@ int write_format_file(const mce_context_t *context, dirfile_t* f)
     }
 
     for (i=0; i<f->channel_count; i++) {
-        if (f->channels[i].has_sign) {
-            fprintf(format, "%-20s RAW %s %i\n", f->channels[i].filename,
-                    (f->version >= 5) ? " INT32" : "S", f->spf);
-        } else {
-            fprintf(format, "%-20s RAW %s %i\n", f->channels[i].filename,
-                    (f->version >= 5) ? "UINT32" : "U", f->spf);
+        channel_t *c = f->channels + i;
+        const char *type;
+        if (c->has_sign)
+            type = (f->version >= 5) ? " INT32" : "S";
+        else
+            type = (f->version >= 5) ? "UINT32" : "U";
+        if (dirfile_has_samples(c))
+            fprintf(format, "%-20s RAW %s %i\n", c->filename, type,
+                    dirfile_spf(f, c));
+        if (c->summary == NULL)
+            continue;
+        for (j=0; j<DIRFILE_SUMMARIES; j++) {
+            char name[MCE_SHORT + 8];
+            if (!(c->outputs & (MCEDATA_DECIMATE_MEAN << j)))
+                continue;
+            sprintf(name, "%s%s", c->filename, summary_suffix[j]);
+            fprintf(format, "%-20s RAW %s %i\n", name, (j > 0) ? type :
+                    (f->version >= 5) ? "FLOAT64" : "d", dirfile_spf(f, c));
         }
     }
+    for (i=0; i<f->channel_count; i++) {
+        channel_t *c = f->channels + i;
+        for (j=0; j<c->n_extract; j++) {
+            char name[MCE_SHORT + 16];
+            const struct mce_data_field *m = c->extract[j].field;
+            sprintf(name, OUTPUT_FORMAT, m->name, c->basename);
+            fprintf(format, "%-20s RAW %7s %i\n", name,
+                    dirfile_extract_type(m), dirfile_spf(f, c));
+        }
+    }
+    if (f->host_real != NULL) {
+        fprintf(format, "%-20s RAW  INT64 %i\n", HOST_TIME_FIELD,
+                f->spf * f->rate);
+        fprintf(format, "%-20s RAW  INT64 %i\n", HOST_MONO_FIELD,
+                f->spf * f->rate);
+    }
 
     /* Write data mode decoder fields! */
     fprintf(format, "\n\n# Data mode field extraction\n");
@@ -225,12 +780,13 @@ int write_format_file(const mce_context_t *context, dirfile_t* f)
         char final_field[1024];
         struct mce_data_field** m;
         channel_t *c = f->channels + i;
-        if (c->data_mode < 0)
+        if (c->data_mode < 0 || !dirfile_has_samples(c))
             continue;
 
         for (m = mce_data_fields; *m != NULL; m++) {
             double scalar = 1.;
-            if ((*m)->data_mode != c->data_mode)
+            if ((*m)->data_mode != c->data_mode ||
+                    dirfile_is_extracted(c, *m))
                 continue;
             /* Final field name can now be determined */
             sprintf(final_field, OUTPUT_FORMAT,
@@ -370,18 +926,164 @@ static int count_items(frame_item* items)
 }
 
 
-/* Methods */
+/* Reserve space for n samples of size bytes in fd; see
+ * MCEDATA_SEQ_PREALLOCATE.  Failure just means we don't. */
 
-static int dirfile_init(mce_acq_t *acq)
+static void dirfile_reserve(int fd, off_t offset, long n, int size)
+{
+    if (n > 0)
+        fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, (off_t)n * size);
+}
+
+/* Give back whatever dirfile_reserve didn't use. */
+
+static void dirfile_trim(int fd, off_t size)
+{
+    if (ftruncate(fd, size) != 0)
+        perror("ftruncate");
+}
+
+/* Open a field for writing at its end, as fopen(..., "a") would. */
+
+static int dirfile_open_field(const char *filename, off_t *offset)
+{
+    int fd = open(filename, O_WRONLY | O_CREAT, 0666);
+    if (fd >= 0)
+        *offset = lseek(fd, 0, SEEK_END);
+    return fd;
+}
+
+static long gcd(long a, long b)
+{
+    while (b != 0) {
+        long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* Set each channel's decimation from the rules (the first n_header
+ * channels are the "header"), and f->rate from them. */
+
+static int dirfile_apply_rules(const mce_context_t *context, dirfile_t *f,
+        int n_header)
+{
+    long rate = 1;
+    int i, j;
+
+    for (i=0; i<f->channel_count; i++) {
+        channel_t *c = f->channels + i;
+        struct dirfile_summary *s;
+
+        c->decimation = 1;
+        c->decimation_count = 0;
+        c->outputs = 0;
+        for (j=0; j<f->n_rules; j++) {
+            const dirfile_rule_t *r = f->rules + j;
+            if (strcmp(r->fields, "header") == 0 ? i < n_header :
+                    fnmatch(r->fields, c->filename, 0) == 0) {
+                c->decimation = r->factor;
+                c->outputs = r->outputs;
+            }
+        }
+        if (c->decimation <= 1)
+            continue;
+        if (c->outputs == 0)
+            c->outputs = MCEDATA_DECIMATE_SAMPLE;
+
+        rate = rate / gcd(rate, c->decimation) * c->decimation;
+        if (rate > DIRFILE_MAX_RATIO) {
+            mcelib_error(context, "Dirfile decimation factors are too "
+                    "disparate (ratio of rates > %i).\n", DIRFILE_MAX_RATIO);
+            return -1;
+        }
+
+        if (!(c->outputs & ~MCEDATA_DECIMATE_SAMPLE))
+            continue;
+        s = c->summary = calloc(1, sizeof(*s));
+        if (s == NULL)
+            return -1;
+        for (j=0; j<DIRFILE_SUMMARIES; j++)
+            s->fd[j] = -1;
+        if (c->outputs & MCEDATA_DECIMATE_MEAN)
+            s->mean = malloc(f->block_frames * sizeof(*s->mean));
+        if (c->outputs & MCEDATA_DECIMATE_MIN)
+            s->min = malloc(f->block_frames * sizeof(*s->min));
+        if (c->outputs & MCEDATA_DECIMATE_MAX)
+            s->max = malloc(f->block_frames * sizeof(*s->max));
+        if (((c->outputs & MCEDATA_DECIMATE_MEAN) && s->mean == NULL) ||
+                ((c->outputs & MCEDATA_DECIMATE_MIN) && s->min == NULL) ||
+                ((c->outputs & MCEDATA_DECIMATE_MAX) && s->max == NULL)) {
+            mcelib_error(context, "Could not allocate decimation buffers.\n");
+            return -1;
+        }
+    }
+    f->rate = rate;
+    return 0;
+}
+
+/* With MCEDATA_DIRFILE_EXTRACT, set up the unpacked fields of the
+ * detector channels in packed data modes. */
+
+static int dirfile_setup_extract(const mce_context_t *context, dirfile_t *f)
+{
+    int i;
+
+    if (!(f->options & MCEDATA_DIRFILE_EXTRACT))
+        return 0;
+    if (f->version < 5) {
+        mcelib_warning(context, "Dirfile version %i can't hold unpacked "
+                "data mode fields.\n", f->version);
+        return 0;
+    }
+
+    for (i=0; i<f->channel_count; i++) {
+        channel_t *c = f->channels + i;
+        struct mce_data_field **m;
+        int n = 0;
+
+        // Decimated fields keep the format file's bit extraction.
+        if (c->data_mode < 0 || c->decimation > 1)
+            continue;
+        for (m = mce_data_fields; *m != NULL; m++)
+            if ((*m)->data_mode == c->data_mode && (*m)->extract != NULL)
+                n++;
+        if (n == 0)
+            continue;
+
+        c->extract = calloc(n, sizeof(*c->extract));
+        if (c->extract == NULL)
+            return -1;
+        for (m = mce_data_fields; *m != NULL; m++) {
+            struct dirfile_extract *e = c->extract + c->n_extract;
+            if ((*m)->data_mode != c->data_mode || (*m)->extract == NULL)
+                continue;
+            e->field = *m;
+            e->fd = -1;
+            c->n_extract++;
+            e->buf = malloc(f->block_frames * MCE_DATA_EXTRACT_SIZE(*m));
+            if (e->buf == NULL) {
+                mcelib_error(context, "Could not allocate unpacking "
+                        "buffers.\n");
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Create the dirfile f->basename and open all of its fields. */
+
+static int dirfile_open(mce_acq_t *acq, dirfile_t *f)
 {
-    int i, ofs;
+    int i, j, ofs;
     int n_fields = 0;
     int n_header = 0;
     int n_data = 0;
     int n_cols = 0;
     frame_item checksum;
     int cards[4];
-    dirfile_t *f = (dirfile_t*)acq->storage->action_data;
 
     // Should do an open test / touch here...
     if (strlen(f->basename)!=0 && f->basename[strlen(f->basename)-1] != '/') {
@@ -406,12 +1108,37 @@ static int dirfile_init(mce_acq_t *acq)
     n_header = count_items(header_items);
     n_fields = n_header + n_data + 1;         //checksum!
 
-    // Allocate buffer memory.  Size target 1 / 2 frames
-    f->data_size = n_fields * 2;
-    dirfile_alloc(acq->context, f, n_fields, MCE_SHORT, f->data_size);
+    // Allocate buffer memory: a block for each field, and a tile of
+    // whole frames.  Blocks are a whole number of tiles.
+    if (f->block_frames <= 0)
+        f->block_frames = DIRFILE_BLOCK_FRAMES;
+    f->block_frames = (f->block_frames + DIRFILE_TILE - 1) /
+        DIRFILE_TILE * DIRFILE_TILE;
+    f->block_count = 0;
+    f->stage_count = 0;
+    f->frame_size = acq->frame_size;
+    f->host_real_fd = -1;
+    f->host_mono_fd = -1;
+    if (dirfile_alloc(acq->context, f, n_fields, MCE_SHORT, f->block_frames))
+        return -1;
+    for (i=0; i<n_fields; i++)
+        f->channels[i].fd = -1;
+    f->stage = malloc(DIRFILE_TILE * f->frame_size * sizeof(uint32_t));
+    if (f->stage == NULL) {
+        mcelib_error(acq->context, "Could not allocate frame buffer.\n");
+        return -1;
+    }
 
-    // How often should we call the write routines?
-    f->write_period = f->data_size / 2;
+    // Host arrival times, if the format can hold them.
+    if (f->version >= HOST_TIME_VERSION) {
+        f->host_real = malloc(f->block_frames * sizeof(int64_t));
+        f->host_mono = malloc(f->block_frames * sizeof(int64_t));
+        if (f->host_real == NULL || f->host_mono == NULL) {
+            mcelib_error(acq->context, "Could not allocate host time "
+                    "buffers.\n");
+            return -1;
+        }
+    }
 
     // Header data
     add_items(f, header_items);
@@ -433,6 +1160,10 @@ static int dirfile_init(mce_acq_t *acq)
     checksum.name = "checksum";
     add_item(f, &checksum);
 
+    if (dirfile_apply_rules(acq->context, f, n_header) ||
+            dirfile_setup_extract(acq->context, f))
+        return -1;
+
     // Write format file
     if (write_format_file(acq->context, f)) {
         mcelib_error(acq->context, "Could not write format file.\n");
@@ -443,79 +1174,245 @@ static int dirfile_init(mce_acq_t *acq)
     for (i=0; i<f->channel_count; i++) {
         char filename[2048];
         channel_t *c = f->channels + i;
-        sprintf(filename, "%s%s", f->basename, c->filename);
-        c->fout = fopen64(filename, "a");
-        if (c->fout == NULL) {
-            mcelib_error(acq->context, "Could not open %ith channel file.\n",
-                    i);
+        long prealloc = f->prealloc / c->decimation;
+        if (dirfile_has_samples(c)) {
+            sprintf(filename, "%s%s", f->basename, c->filename);
+            c->fd = dirfile_open_field(filename, &c->offset);
+            if (c->fd < 0) {
+                mcelib_error(acq->context, "Could not open %ith channel "
+                        "file.\n", i);
+                return -1;
+            }
+            dirfile_reserve(c->fd, c->offset, prealloc, sizeof(uint32_t));
+        }
+        if (c->summary == NULL)
+            continue;
+        for (j=0; j<DIRFILE_SUMMARIES; j++) {
+            struct dirfile_summary *s = c->summary;
+            if (!(c->outputs & (MCEDATA_DECIMATE_MEAN << j)))
+                continue;
+            sprintf(filename, "%s%s%s", f->basename, c->filename,
+                    summary_suffix[j]);
+            s->fd[j] = dirfile_open_field(filename, s->offset + j);
+            if (s->fd[j] < 0) {
+                mcelib_error(acq->context, "Could not open %s.\n", filename);
+                return -1;
+            }
+            dirfile_reserve(s->fd[j], s->offset[j], prealloc,
+                    (j == 0) ? sizeof(double) : sizeof(uint32_t));
+        }
+    }
+    for (i=0; i<f->channel_count; i++) {
+        char filename[2048];
+        channel_t *c = f->channels + i;
+        for (j=0; j<c->n_extract; j++) {
+            struct dirfile_extract *e = c->extract + j;
+            sprintf(filename, "%s" OUTPUT_FORMAT, f->basename,
+                    e->field->name, c->basename);
+            e->fd = dirfile_open_field(filename, &e->offset);
+            if (e->fd < 0) {
+                mcelib_error(acq->context, "Could not open %s.\n", filename);
+                return -1;
+            }
+            dirfile_reserve(e->fd, e->offset, f->prealloc,
+                    MCE_DATA_EXTRACT_SIZE(e->field));
+        }
+    }
+    if (f->host_real != NULL) {
+        char filename[2048];
+        off_t mono_offset;
+        sprintf(filename, "%s%s", f->basename, HOST_TIME_FIELD);
+        f->host_real_fd = dirfile_open_field(filename, &f->host_offset);
+        sprintf(filename, "%s%s", f->basename, HOST_MONO_FIELD);
+        f->host_mono_fd = dirfile_open_field(filename, &mono_offset);
+        if (f->host_real_fd < 0 || f->host_mono_fd < 0) {
+            mcelib_error(acq->context, "Could not open host time files.\n");
             return -1;
         }
+        dirfile_reserve(f->host_real_fd, f->host_offset, f->prealloc,
+                sizeof(int64_t));
+        dirfile_reserve(f->host_mono_fd, mono_offset, f->prealloc,
+                sizeof(int64_t));
     }
 
-    /* Update the indirection, maybe */
-    mcelib_symlink(f->symlink, f->basename);
+    if (f->n_workers > 0) {
+        f->pool = dirfile_pool_create(acq->context, f, f->n_workers);
+        if (f->pool == NULL) {
+            mcelib_error(acq->context, "Could not start dirfile writers.\n");
+            return -1;
+        }
+    }
 
     return 0;
 }
 
-static int dirfile_cleanup(mce_acq_t *acq)
+/* Write out everything buffered and close all the fields. */
+
+static void dirfile_close(dirfile_t *f)
 {
-    int i;
-    dirfile_t *f = (dirfile_t*)acq->storage->action_data;
+    int i, j;
 
     // Force all channels to write out.
-    f->flush = 1;
-    dirfile_write(acq, f);
-    f->flush = 0;
+    if (f->stage != NULL)
+        dirfile_write(f);
+    if (f->pool != NULL) {
+        f->host_offset = f->pool->host_offset;
+        dirfile_pool_destroy(f->pool);
+        f->pool = NULL;
+    }
+    // The decimated fields' last, partial groups.
+    if (f->rate > 1)
+        dirfile_write_fields(f->channels, f->channel_count, 0,
+                f->options & MCEDATA_DIRFILE_SYNC, 1);
 
     // Close all files
     for (i=0; i<f->channel_count; i++) {
         channel_t *c = f->channels + i;
-        if (c->fout == NULL)
+        struct dirfile_summary *s = c->summary;
+        for (j=0; j<c->n_extract; j++) {
+            struct dirfile_extract *e = c->extract + j;
+            if (e->fd < 0)
+                continue;
+            if (f->prealloc > 0)
+                dirfile_trim(e->fd, e->offset);
+            close(e->fd);
+            e->fd = -1;
+        }
+        if (s != NULL) {
+            for (j=0; j<DIRFILE_SUMMARIES; j++) {
+                if (s->fd[j] < 0)
+                    continue;
+                if (f->prealloc > 0)
+                    dirfile_trim(s->fd[j], s->offset[j]);
+                close(s->fd[j]);
+                s->fd[j] = -1;
+            }
+        }
+        if (c->fd < 0)
+            continue;
+        if (f->prealloc > 0)
+            dirfile_trim(c->fd, c->offset);
+        close(c->fd);
+        c->fd = -1;
+    }
+    if (f->host_real == NULL)
+        return;
+    if (f->host_real_fd >= 0) {
+        if (f->prealloc > 0)
+            dirfile_trim(f->host_real_fd, f->host_offset);
+        close(f->host_real_fd);
+        f->host_real_fd = -1;
+    }
+    if (f->host_mono_fd >= 0) {
+        if (f->prealloc > 0)
+            dirfile_trim(f->host_mono_fd, f->host_offset);
+        close(f->host_mono_fd);
+        f->host_mono_fd = -1;
+    }
+}
+
+/* Delete the (closed) dirfile from disk. */
+
+static void dirfile_remove(dirfile_t *f)
+{
+    char filename[MCE_LONG + 32];
+    int i, j;
+
+    for (i=0; i<f->channel_count; i++) {
+        sprintf(filename, "%s%s", f->basename, f->channels[i].filename);
+        unlink(filename);
+        for (j=0; j<f->channels[i].n_extract; j++) {
+            sprintf(filename, "%s" OUTPUT_FORMAT, f->basename,
+                    f->channels[i].extract[j].field->name,
+                    f->channels[i].basename);
+            unlink(filename);
+        }
+        if (f->channels[i].summary == NULL)
             continue;
-        fflush(c->fout);
-        fclose(c->fout);
-        c->fout = NULL;
+        for (j=0; j<DIRFILE_SUMMARIES; j++) {
+            sprintf(filename, "%s%s%s", f->basename,
+                    f->channels[i].filename, summary_suffix[j]);
+            unlink(filename);
+        }
     }
+    sprintf(filename, "%s%s", f->basename, HOST_TIME_FIELD);
+    unlink(filename);
+    sprintf(filename, "%s%s", f->basename, HOST_MONO_FIELD);
+    unlink(filename);
+    sprintf(filename, "%sformat", f->basename);
+    unlink(filename);
+    strcat(filename, ".extra");
+    unlink(filename);
+    rmdir(f->basename);
+}
+
+
+/* Methods */
+
+static int dirfile_init(mce_acq_t *acq)
+{
+    dirfile_t *f = (dirfile_t*)acq->storage->action_data;
+
+    if (dirfile_open(acq, f))
+        return -1;
+
+    /* Update the indirection, maybe */
+    mcelib_symlink(f->symlink, f->basename);
 
     return 0;
 }
 
+static int dirfile_cleanup(mce_acq_t *acq)
+{
+    dirfile_close((dirfile_t*)acq->storage->action_data);
+    return 0;
+}
+
 static int dirfile_post(mce_acq_t *acq, int frame_index, uint32_t *data)
 {
     dirfile_t *f = (dirfile_t*)acq->storage->action_data;
-    int i;
 
-    // Break frame into streams
-    // FIXME - bounds checking on f->data
-    for (i=0; i<f->channel_count; i++) {
-        channel_t* c = f->channels + i;
-        if (c->decimation) {
-            int store = (c->decimation==0);
-            c->decimation = (c->decimation+1) % c->decimation_count;
-            if (!store)
-                continue;
+    if (f->stage == NULL)
+        return -1;
+
+    if (f->pool != NULL) {
+        struct dirfile_pool *p = f->pool;
+        memcpy(p->frames[p->active] + p->count * f->frame_size, data,
+                f->frame_size * sizeof(*data));
+        if (p->host_real[0] != NULL) {
+            p->host_real[p->active][p->count] = acq->frame_time.real_ns;
+            p->host_mono[p->active][p->count] = acq->frame_time.mono_ns;
         }
-        c->data[c->count++] = data[c->frame_offset];
+        if (++p->count < p->block_frames)
+            return 0;
+        return dirfile_pool_submit(p);
     }
 
-    if (f->frame_count++ >= f->write_period) {
-        f->frame_count = 0;
-        return dirfile_write(acq, f);
-    } else {
-        return 0;
+    // Keep the frame whole for now; see dirfile_transpose.
+    memcpy(f->stage + f->stage_count * f->frame_size, data,
+            f->frame_size * sizeof(*data));
+    if (f->host_real != NULL) {
+        int n = f->block_count + f->stage_count;
+        f->host_real[n] = acq->frame_time.real_ns;
+        f->host_mono[n] = acq->frame_time.mono_ns;
     }
+
+    if (++f->stage_count < DIRFILE_TILE)
+        return 0;
+    dirfile_transpose(f);
+
+    if (f->block_count < f->block_frames)
+        return 0;
+    return dirfile_write(f);
 }
 
 static int dirfile_flush(mce_acq_t *acq)
 {
     dirfile_t *f = (dirfile_t*)acq->storage->action_data;
 
-    f->flush = 1;
-    dirfile_write(acq, f);
-    f->flush = 0;
-
-    return 0;
+    if (f->stage == NULL)
+        return 0;
+    return dirfile_write(f);
 }
 
 
@@ -559,6 +1456,7 @@ mcedata_storage_t* mcedata_dirfile_create(const char *basename, int options,
 
     memset(f, 0, sizeof(*f));
     strcpy(f->basename, basename);
+    f->options = options;
     if (symlink != NULL)
         strcpy(f->symlink, symlink);
     if (include != NULL)
@@ -578,7 +1476,12 @@ mcedata_storage_t* mcedata_dirfile_create(const char *basename, int options,
  */
 
 /* This is an extension of dirfile_struct; so leave active_dirfile as
- * the first entry! */
+ * the first entry!
+ *
+ * As for fileseq, a helper thread (rotate.h) creates the next dirfile
+ * while the current one is written, and closes the old one after the
+ * switch; with MCEDATA_SEQ_PREALLOCATE each field is given disk space
+ * for a whole interval up front. */
 
 typedef struct dirfileseq_struct {
     dirfile_t active_dirfile;  // Must be first struct member!
@@ -593,41 +1496,136 @@ typedef struct dirfileseq_struct {
     char include[MCE_LONG];
     int spf;
     int version;
+    int options;
+    int block_frames;
+    int n_workers;
+    dirfile_rule_t rules[DIRFILE_RULES];
+    int n_rules;
+
+    mce_acq_t *acq;            // for the helper's dirfile_open
+    rotator_t *rotator;
 } dirfileseq_t;
 
 
+static void *dirfileseq_open(void *user, int idx)
+{
+    dirfileseq_t *f = (dirfileseq_t*)user;
+    dirfile_t *d = (dirfile_t*)calloc(1, sizeof(*d));
+    if (d == NULL)
+        return NULL;
+
+    sprintf(d->basename, f->format, idx);
+    strcpy(d->include, f->include);
+    d->spf = f->spf;
+    d->version = f->version;
+    d->options = f->options;
+    d->block_frames = f->block_frames;
+    d->n_workers = f->n_workers;
+    memcpy(d->rules, f->rules, sizeof(d->rules));
+    d->n_rules = f->n_rules;
+    if (f->options & MCEDATA_SEQ_PREALLOCATE)
+        d->prealloc = f->interval;
+
+    if (dirfile_open(f->acq, d)) {
+        dirfile_close(d);
+        dirfile_free(d);
+        free(d);
+        return NULL;
+    }
+    return d;
+}
+
+/* Close a dirfile that has been written to; runs on the helper thread. */
+static void dirfileseq_retire(void *arg)
+{
+    dirfile_t *d = (dirfile_t*)arg;
+    dirfile_close(d);
+    dirfile_free(d);
+    free(d);
+}
+
+/* Dispose of a dirfile that was made ahead of time but never used. */
+static void dirfileseq_discard(void *arg)
+{
+    dirfile_t *d = (dirfile_t*)arg;
+    dirfile_close(d);
+    dirfile_remove(d);
+    dirfile_free(d);
+    free(d);
+}
+
 static int dirfileseq_cycle(mce_acq_t *acq, dirfileseq_t *f, int this_frame)
 {
     int new_idx = this_frame / f->interval;
+    dirfile_t *d;
 
     if (f->active_idx == new_idx)
         return 0;
 
-    // Is there an active dirfile that needs closing?
+    // Is there an active dirfile that needs closing?  The helper can
+    // have it, buffers and all.
     if (f->active_idx != -1) {
-        dirfile_cleanup(acq);
-        dirfile_free(&f->active_dirfile);
+        d = (dirfile_t*)malloc(sizeof(*d));
+        if (d == NULL) {
+            dirfile_close(&f->active_dirfile);
+            dirfile_free(&f->active_dirfile);
+        } else {
+            memcpy(d, &f->active_dirfile, sizeof(*d));
+            rotator_defer(f->rotator, dirfileseq_retire, d);
+        }
         memset(&f->active_dirfile, 0, sizeof(f->active_dirfile));
     }
 
-    // Setup new filename and init dirfile
     f->active_idx = new_idx;
-    sprintf(f->active_dirfile.basename, f->format, new_idx);
-    strcpy(f->active_dirfile.symlink, f->symlink);
-    strcpy(f->active_dirfile.include, f->include);
-    f->active_dirfile.spf = f->spf;
-    f->active_dirfile.version = f->version;
-    return dirfile_init(acq);
+    d = (dirfile_t*)rotator_take(f->rotator, new_idx);
+    if (d == NULL) {
+        sprintf(acq->errstr, "Could not create dirfile %i", new_idx);
+        return -1;
+    }
+    memcpy(&f->active_dirfile, d, sizeof(*d));
+    free(d);
+
+    /* Update the indirection, maybe */
+    rotator_symlink(f->rotator, f->symlink, f->active_dirfile.basename);
+
+    // And get the next one ready.
+    rotator_prepare(f->rotator, new_idx + 1);
+
+    return 0;
 }
 
 static int dirfileseq_init(mce_acq_t *acq)
 {
     dirfileseq_t *f = (dirfileseq_t *)acq->storage->action_data;
+
+    f->acq = acq;
+    f->rotator = rotator_create(acq->context, dirfileseq_open,
+            dirfileseq_discard, f);
+    if (f->rotator == NULL) {
+        mcelib_error(acq->context, "Could not start dirfile rotation "
+                "thread.\n");
+        return -1;
+    }
     dirfileseq_cycle(acq, f, 0);
 
     return 0;
 }
 
+static int dirfileseq_cleanup(mce_acq_t *acq)
+{
+    dirfileseq_t *f = (dirfileseq_t *)acq->storage->action_data;
+
+    dirfile_close(&f->active_dirfile);
+
+    // Waits for the helper to finish closing old dirfiles.
+    if (f->rotator != NULL) {
+        rotator_destroy(f->rotator);
+        f->rotator = NULL;
+    }
+
+    return 0;
+}
+
 static int dirfileseq_post(mce_acq_t *acq, int frame_index, uint32_t *data)
 {
     dirfileseq_t *f = (dirfileseq_t*)acq->storage->action_data;
@@ -663,7 +1661,7 @@ static int dirfileseq_destructor(mcedata_storage_t *storage)
 
 mcedata_storage_t dirfileseq_actions = {
     .init = dirfileseq_init,
-    .cleanup = dirfile_cleanup,
+    .cleanup = dirfileseq_cleanup,
     .post_frame = dirfileseq_post,
     .flush = dirfile_flush,
     .destroy = dirfileseq_destructor,
@@ -689,6 +1687,7 @@ mcedata_storage_t* mcedata_dirfileseq_create(const char *basename, int interval,
     f->active_idx = -1;
     f->interval = interval;
     f->digits = digits;
+    f->options = options;
 
     // Produce format like "basename.%03i"
     sprintf(f->format, "%s.%%0%ii", basename, f->digits);
@@ -703,3 +1702,59 @@ mcedata_storage_t* mcedata_dirfileseq_create(const char *basename, int interval,
 
     return storage;
 }
+
+int mcedata_dirfile_set_block(mcedata_storage_t *storage, int block_frames)
+{
+    if (storage->init == dirfile_init)
+        ((dirfile_t*)storage->action_data)->block_frames = block_frames;
+    else if (storage->init == dirfileseq_init)
+        ((dirfileseq_t*)storage->action_data)->block_frames = block_frames;
+    else
+        return -1;
+    return 0;
+}
+
+int mcedata_dirfile_set_workers(mcedata_storage_t *storage, int n_workers)
+{
+    if (n_workers < 0)
+        return -1;
+    if (storage->init == dirfile_init)
+        ((dirfile_t*)storage->action_data)->n_workers = n_workers;
+    else if (storage->init == dirfileseq_init)
+        ((dirfileseq_t*)storage->action_data)->n_workers = n_workers;
+    else
+        return -1;
+    return 0;
+}
+
+static int dirfile_add_rule(dirfile_rule_t *rules, int *n_rules,
+        const char *fields, int factor, int outputs)
+{
+    dirfile_rule_t *r = rules + *n_rules;
+    if (*n_rules >= DIRFILE_RULES || strlen(fields) >= sizeof(r->fields))
+        return -1;
+    strcpy(r->fields, fields);
+    r->factor = factor;
+    r->outputs = outputs;
+    (*n_rules)++;
+    return 0;
+}
+
+int mcedata_dirfile_decimate(mcedata_storage_t *storage, const char *fields,
+        int factor, int outputs)
+{
+    if (fields == NULL || factor < 1 || factor > DIRFILE_MAX_DECIMATION ||
+            (outputs & ~(MCEDATA_DECIMATE_SAMPLE | MCEDATA_DECIMATE_MEAN |
+                         MCEDATA_DECIMATE_MIN | MCEDATA_DECIMATE_MAX)))
+        return -1;
+    if (storage->init == dirfile_init) {
+        dirfile_t *f = (dirfile_t*)storage->action_data;
+        return dirfile_add_rule(f->rules, &f->n_rules, fields, factor,
+                outputs);
+    } else if (storage->init == dirfileseq_init) {
+        dirfileseq_t *f = (dirfileseq_t*)storage->action_data;
+        return dirfile_add_rule(f->rules, &f->n_rules, fields, factor,
+                outputs);
+    }
+    return -1;
+}
@@ -164,6 +164,9 @@ const char *mcelib_error_string(int error)
         case MCE_ERR_FRAME_COLS:
             return "Frame columns could not be determined or was invalid.";
 
+        case MCE_ERR_FRAME_OVERRUN:
+            return "A storage queue overflowed.";
+
         case 0:
             return "Success.";
     }
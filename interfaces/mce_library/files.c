@@ -11,6 +11,7 @@
 #include <unistd.h>
 
 #include "context.h"
+#include "rotate.h"
 
 // #define FILEOPS_BASIC
 
@@ -45,6 +46,12 @@ static int storage_destructor(mcedata_storage_t *storage)
 
 /* File sequencing structure and operations */
 
+/* Segments are opened, and closed, by a helper thread (see rotate.h);
+ * at a file boundary fileseq_post only swaps in the file that has
+ * been opened ahead of time.  With MCEDATA_SEQ_PREALLOCATE the helper
+ * also reserves disk space for a whole interval, which is given back
+ * (ftruncate) when the file is closed. */
+
 typedef struct fileseq_struct {
     char filename[MCE_LONG];
     FILE *fout;
@@ -55,24 +62,116 @@ typedef struct fileseq_struct {
     int next_switch;
     int frame_count;
     char format[MCE_LONG];
+    int options;
+    int active_idx;            // -1 if no file is open
+    off_t prealloc;            // bytes to reserve per file, or 0
+    rotator_t *rotator;
 } fileseq_t;
 
+typedef struct fileseq_seg {
+    char filename[MCE_LONG];
+    FILE *fout;
+    int created;               // the file did not exist before
+    off_t prealloc;
+} fileseq_seg_t;
+
+static void *fileseq_open(void *user, int idx)
+{
+    fileseq_t *f = (fileseq_t*)user;
+    fileseq_seg_t *s = (fileseq_seg_t*)calloc(1, sizeof(*s));
+    if (s == NULL)
+        return NULL;
+
+    sprintf(s->filename, f->format, idx);
+    s->created = (access(s->filename, F_OK) != 0);
+    s->fout = fopen64(s->filename, "a");
+    if (s->fout == NULL) {
+        free(s);
+        return NULL;
+    }
+
+    // Not fatal; not every filesystem can.
+    if (f->prealloc > 0 && fallocate(fileno(s->fout), FALLOC_FL_KEEP_SIZE,
+                0, f->prealloc) == 0)
+        s->prealloc = f->prealloc;
+
+    return s;
+}
+
+/* Close a segment that has been written to; runs on the helper thread. */
+static void fileseq_retire(void *arg)
+{
+    fileseq_seg_t *s = (fileseq_seg_t*)arg;
+
+    fflush(s->fout);
+    if (s->prealloc > 0)
+        if (ftruncate(fileno(s->fout), ftello64(s->fout)) != 0)
+            perror("ftruncate");
+    fclose(s->fout);
+    free(s);
+}
+
+/* Close a segment that was never used, and remove it if we made it. */
+static void fileseq_discard(void *arg)
+{
+    fileseq_seg_t *s = (fileseq_seg_t*)arg;
+    off_t size = ftello64(s->fout);
+
+    if (s->prealloc > 0 && !(s->created && size == 0))
+        if (ftruncate(fileno(s->fout), size) != 0)
+            perror("ftruncate");
+    fclose(s->fout);
+    if (s->created && size == 0)
+        unlink(s->filename);
+    free(s);
+}
+
+/* Hand the current file, if any, to the helper to close. */
+static void fileseq_release(fileseq_t *f)
+{
+    fileseq_seg_t *s;
+
+    if (f->fout == NULL)
+        return;
+
+    s = (fileseq_seg_t*)calloc(1, sizeof(*s));
+    if (s == NULL) {
+        fclose(f->fout);
+    } else {
+        strcpy(s->filename, f->filename);
+        s->fout = f->fout;
+        s->prealloc = f->prealloc;
+        rotator_defer(f->rotator, fileseq_retire, s);
+    }
+    f->fout = NULL;
+}
+
 static int fileseq_cycle(mce_acq_t *acq, fileseq_t *f, int this_frame)
 {
     int new_idx = this_frame / f->interval;
-    if (f->fout != NULL)
-        fclose(f->fout);
+    fileseq_seg_t *s;
 
-    sprintf(f->filename, f->format, new_idx);
-    f->fout = fopen64(f->filename, "a");
+    if (f->active_idx == new_idx && f->fout != NULL)
+        return 0;
 
-    if (f->fout == NULL) {
+    fileseq_release(f);
+
+    s = (fileseq_seg_t*)rotator_take(f->rotator, new_idx);
+    if (s == NULL) {
+        sprintf(f->filename, f->format, new_idx);
         sprintf(acq->errstr, "Failed to open file '%s'", f->filename);
         return -1;
     }
+    strcpy(f->filename, s->filename);
+    f->fout = s->fout;
+    f->active_idx = new_idx;
+    free(s);
 
     /* Update the indirection, maybe */
-    mcelib_symlink(f->symlink, f->filename);
+    rotator_symlink(f->rotator, f->symlink, f->filename);
+
+    // And get the next one ready.
+    rotator_prepare(f->rotator, new_idx + 1);
 
     return 0;
 }
@@ -80,6 +179,16 @@ static int fileseq_cycle(mce_acq_t *acq, fileseq_t *f, int this_frame)
 static int fileseq_init(mce_acq_t *acq)
 {
     fileseq_t *f = (fileseq_t*)acq->storage->action_data;
+
+    if (f->options & MCEDATA_SEQ_PREALLOCATE)
+        f->prealloc = (off_t)f->interval * acq->frame_size * sizeof(uint32_t);
+
+    f->rotator = rotator_create(acq->context, fileseq_open, fileseq_discard,
+            f);
+    if (f->rotator == NULL) {
+        sprintf(acq->errstr, "Could not start file rotation thread");
+        return -1;
+    }
     fileseq_cycle(acq, f, 0);
 
     return 0;
@@ -88,10 +197,16 @@ static int fileseq_init(mce_acq_t *acq)
 static int fileseq_cleanup(mce_acq_t *acq)
 {
     fileseq_t *f = (fileseq_t*)acq->storage->action_data;
-    if (f->fout != NULL) {
-        fclose(f->fout);
-        f->fout = NULL;
-    }
+
+    if (f->rotator == NULL)
+        return 0;
+
+    fileseq_release(f);
+    f->active_idx = -1;
+
+    // Waits for the closes.
+    rotator_destroy(f->rotator);
+    f->rotator = NULL;
 
     return 0;
 }
@@ -140,6 +255,12 @@ mcedata_storage_t fileseq_actions = {
 
 /* Flat file structure and operations */
 
+/* Each flatfile has a sidecar, <filename>.time, holding the host
+ * arrival time of each frame (acq->frame_time) as a pair of native
+ * int64: CLOCK_MONOTONIC ns, then CLOCK_REALTIME ns. */
+
+#define FLATFILE_TIME_SUFFIX ".time"
+
 typedef struct flatfile_struct {
 
     char filename[MCE_LONG];
@@ -150,6 +271,7 @@ typedef struct flatfile_struct {
 #else
     FILE *fout;
 #endif
+    FILE *tout;
 
 } flatfile_t;
 
@@ -164,6 +286,16 @@ static int flatfile_init(mce_acq_t *acq)
             return -1;
         }
     }
+    if (f->tout == NULL) {
+        char filename[MCE_LONG + sizeof(FLATFILE_TIME_SUFFIX)];
+        sprintf(filename, "%s" FLATFILE_TIME_SUFFIX, f->filename);
+        f->tout = fopen(filename, "a");
+        if (f->tout == NULL) {
+            snprintf(acq->errstr, sizeof(acq->errstr),
+                    "Failed to open file '%.*s'", MCELIB_ERR_NAME, filename);
+            return -1;
+        }
+    }
 
     /* Update the indirection, maybe */
     mcelib_symlink(f->symlink, f->filename);
@@ -178,6 +310,10 @@ static int flatfile_cleanup(mce_acq_t *acq)
         FILE_CLOSE(f);
         FILE_CLEAR(f);
     }
+    if (f->tout != NULL) {
+        fclose(f->tout);
+        f->tout = NULL;
+    }
     f->filename[0] = 0;
 
     return 0;
@@ -193,6 +329,10 @@ static int flatfile_post(mce_acq_t *acq, int frame_index, uint32_t *data)
     if (FILE_WRITE(f, data, acq->frame_size*sizeof(*data)))
         return -1;
 
+    if (f->tout != NULL && fwrite(&acq->frame_time, sizeof(acq->frame_time),
+                1, f->tout) == 0)
+        return -1;
+
     return 0;
 }
 
@@ -201,6 +341,8 @@ static int flatfile_flush(mce_acq_t *acq)
     flatfile_t *f = (flatfile_t*)acq->storage->action_data;
     if (FILE_FLUSH(f))
         return -1;
+    if (f->tout != NULL && fflush(f->tout))
+        return -1;
     return 0;
 }
 
@@ -271,6 +413,37 @@ mcedata_storage_t rambuff_actions = {
 };
 
 
+/* Ram buffer, view flavour: no buffer, and no reordering. */
+
+typedef struct rambuff_view_struct {
+
+    unsigned long user_data;
+    rambuff_view_callback_t callback;
+
+} rambuff_view_t;
+
+
+static int rambuff_view_post(mce_acq_t *acq, int frame_index,
+        const mce_frame_view_t *view)
+{
+    rambuff_view_t *f = (rambuff_view_t*)acq->storage->action_data;
+
+    if (f->callback != NULL) {
+        f->callback(f->user_data, view);
+    }
+
+    return 0;
+}
+
+mcedata_storage_t rambuff_view_actions = {
+    .init = NULL,
+    .cleanup = NULL,
+    .pre_frame = NULL,
+    .post_view = rambuff_view_post,
+    .destroy = storage_destructor,
+};
+
+
 
 
 
@@ -335,6 +508,13 @@ void mcedata_flatfile_destroy(mce_acq_t *acq)
 
 mcedata_storage_t* mcedata_fileseq_create(const char *basename, int interval,
         int digits, const char *symlink)
+{
+    return mcedata_fileseq_create_options(basename, interval, digits, symlink,
+            0);
+}
+
+mcedata_storage_t* mcedata_fileseq_create_options(const char *basename,
+        int interval, int digits, const char *symlink, int options)
 {
     fileseq_t *f = (fileseq_t*)malloc(sizeof(fileseq_t));
     mcedata_storage_t *storage = (mcedata_storage_t*)malloc(sizeof(mcedata_storage_t));
@@ -354,6 +534,8 @@ mcedata_storage_t* mcedata_fileseq_create(const char *basename, int interval,
     sprintf(f->format, "%s.%%0%ii", f->basename, f->digits);
 
     f->interval = interval;
+    f->options = options;
+    f->active_idx = -1;
 
     if (symlink!=NULL)
         strcpy(f->symlink, symlink);
@@ -397,6 +579,25 @@ mcedata_storage_t* mcedata_rambuff_create(rambuff_callback_t callback,
     return storage;
 }
 
+mcedata_storage_t* mcedata_rambuff_view_create(rambuff_view_callback_t callback,
+        unsigned long user_data)
+{
+    rambuff_view_t *f = (rambuff_view_t*)malloc(sizeof(rambuff_view_t));
+    mcedata_storage_t *storage = (mcedata_storage_t*)malloc(sizeof(mcedata_storage_t));
+    if (f==NULL || storage==NULL)
+        return NULL;
+
+    memcpy(storage, &rambuff_view_actions, sizeof(rambuff_view_actions));
+    storage->action_data = f;
+
+    memset(f, 0, sizeof(*f));
+
+    f->user_data = user_data;
+    f->callback = callback;
+
+    return storage;
+}
+
 #if 0
 void mcedata_rambuff_destroy(mce_acq_t *acq)
 {
@@ -0,0 +1,338 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#define _GNU_SOURCE
+
+/* Buffered flat file storage: the same output as flatfile, but frames
+ * are gathered into two large page-aligned buffers.  While one fills,
+ * a writer thread pwrite()s the other, so the acquisition loop makes
+ * no system calls except when it gets a whole buffer ahead of the disk.
+ *
+ * With MCEDATA_FLATFILE_DIRECT the file is opened O_DIRECT, bypassing
+ * the page cache.  Direct writes must be block-aligned, so a flush
+ * only writes out whole blocks; the rest stays in the buffer (and is
+ * written again, with what follows, next time).  The final, partial
+ * block is written after O_DIRECT is turned off. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "context.h"
+
+#define FLATBUF_ALIGN 4096
+#define FLATBUF_DEFAULT_SIZE (8 << 20)      /* bytes, per buffer */
+
+typedef struct flatbuf_struct {
+
+    char filename[MCE_LONG];
+    char symlink[MCE_LONG];
+    int options;
+    int fd;
+    FILE *tout;                     // arrival times, as for flatfile
+
+    size_t size;                    // bytes per buffer
+    char *buf[2];
+    int active;                     // buffer being filled
+    size_t fill;                    // bytes in it
+    off_t offset;                   // file offset of its first byte
+
+    // Hand-off to the writer: one buffer at a time.
+    pthread_t writer;
+    int running;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int pending;                    // buffer to write, or -1
+    size_t pending_len;
+    off_t pending_offset;
+    int shutdown;
+    int error;                      // errno of a failed write
+
+} flatbuf_t;
+
+
+static int write_all(int fd, const char *p, size_t len, off_t offset)
+{
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+static void *flatbuf_writer(void *arg)
+{
+    flatbuf_t *f = arg;
+
+    pthread_mutex_lock(&f->lock);
+    while (1) {
+        while (f->pending < 0 && !f->shutdown)
+            pthread_cond_wait(&f->cond, &f->lock);
+        if (f->pending < 0)
+            break;
+
+        pthread_mutex_unlock(&f->lock);
+        int err = write_all(f->fd, f->buf[f->pending], f->pending_len,
+                f->pending_offset);
+        pthread_mutex_lock(&f->lock);
+
+        if (err != 0 && f->error == 0)
+            f->error = err;
+        f->pending = -1;
+        pthread_cond_broadcast(&f->cond);
+    }
+    pthread_mutex_unlock(&f->lock);
+    return NULL;
+}
+
+/* Wait for the writer to finish with its buffer; returns its errno. */
+static int flatbuf_wait(flatbuf_t *f)
+{
+    int err;
+    pthread_mutex_lock(&f->lock);
+    while (f->pending >= 0)
+        pthread_cond_wait(&f->cond, &f->lock);
+    err = f->error;
+    pthread_mutex_unlock(&f->lock);
+    return err;
+}
+
+/* Hand the first len bytes of the active buffer to the writer, and
+ * carry whatever follows them over to the other buffer, which becomes
+ * active. */
+static int flatbuf_submit(flatbuf_t *f, size_t len)
+{
+    int next = !f->active;
+    int err = flatbuf_wait(f);
+    if (err != 0)
+        return err;
+
+    if (f->fill > len)
+        memcpy(f->buf[next], f->buf[f->active] + len, f->fill - len);
+
+    pthread_mutex_lock(&f->lock);
+    f->pending = f->active;
+    f->pending_len = len;
+    f->pending_offset = f->offset;
+    pthread_cond_signal(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+
+    f->offset += len;
+    f->fill -= len;
+    f->active = next;
+    return 0;
+}
+
+static int flatbuf_init(mce_acq_t *acq)
+{
+    flatbuf_t *f = (flatbuf_t*)acq->storage->action_data;
+    char filename[MCE_LONG + sizeof(".time")];
+    int flags = O_WRONLY | O_CREAT;
+
+    if (f->options & MCEDATA_FLATFILE_DIRECT)
+        flags |= O_DIRECT;
+    f->fd = open(f->filename, flags, 0666);
+    if (f->fd < 0 && (flags & O_DIRECT)) {
+        mcelib_warning(acq->context, "O_DIRECT not supported for '%s'; "
+                "using buffered writes.\n", f->filename);
+        flags &= ~O_DIRECT;
+        f->fd = open(f->filename, flags, 0666);
+    }
+    if (f->fd < 0) {
+        snprintf(acq->errstr, sizeof(acq->errstr),
+                "Failed to open file '%.*s'", MCELIB_ERR_NAME, f->filename);
+        return -1;
+    }
+
+    // Append, as flatfile does.  Direct writes need an aligned start.
+    f->offset = lseek(f->fd, 0, SEEK_END);
+    if ((flags & O_DIRECT) && f->offset % FLATBUF_ALIGN != 0) {
+        mcelib_warning(acq->context, "'%s' is not block-aligned; not "
+                "using O_DIRECT.\n", f->filename);
+        fcntl(f->fd, F_SETFL, fcntl(f->fd, F_GETFL) & ~O_DIRECT);
+        f->options &= ~MCEDATA_FLATFILE_DIRECT;
+    } else if (!(flags & O_DIRECT))
+        f->options &= ~MCEDATA_FLATFILE_DIRECT;
+
+    sprintf(filename, "%s.time", f->filename);
+    f->tout = fopen(filename, "a");
+    if (f->tout == NULL) {
+        snprintf(acq->errstr, sizeof(acq->errstr),
+                "Failed to open file '%.*s'", MCELIB_ERR_NAME, filename);
+        return -1;
+    }
+
+    f->active = 0;
+    f->fill = 0;
+    f->pending = -1;
+    f->shutdown = 0;
+    f->error = 0;
+    if (pthread_create(&f->writer, NULL, flatbuf_writer, f) != 0) {
+        sprintf(acq->errstr, "Could not start writer thread");
+        return -1;
+    }
+    f->running = 1;
+
+    /* Update the indirection, maybe */
+    mcelib_symlink(f->symlink, f->filename);
+
+    return 0;
+}
+
+static int flatbuf_post(mce_acq_t *acq, int frame_index, uint32_t *data)
+{
+    flatbuf_t *f = (flatbuf_t*)acq->storage->action_data;
+    const char *p = (const char*)data;
+    size_t len = acq->frame_size * sizeof(*data);
+
+    if (!f->running)
+        return -1;
+
+    // A frame may straddle the two buffers.
+    while (len > 0) {
+        size_t n = f->size - f->fill;
+        if (n > len)
+            n = len;
+        memcpy(f->buf[f->active] + f->fill, p, n);
+        f->fill += n;
+        p += n;
+        len -= n;
+        if (f->fill == f->size && flatbuf_submit(f, f->size) != 0)
+            return -1;
+    }
+
+    if (fwrite(&acq->frame_time, sizeof(acq->frame_time), 1, f->tout) == 0)
+        return -1;
+
+    return 0;
+}
+
+static int flatbuf_flush(mce_acq_t *acq)
+{
+    flatbuf_t *f = (flatbuf_t*)acq->storage->action_data;
+    size_t len = f->fill;
+
+    if (!f->running)
+        return -1;
+    if (f->options & MCEDATA_FLATFILE_DIRECT)
+        len -= len % FLATBUF_ALIGN;
+    if (len > 0 && flatbuf_submit(f, len) != 0)
+        return -1;
+    if (flatbuf_wait(f) != 0 || fflush(f->tout) != 0)
+        return -1;
+    return 0;
+}
+
+static int flatbuf_cleanup(mce_acq_t *acq)
+{
+    flatbuf_t *f = (flatbuf_t*)acq->storage->action_data;
+    int err = 0;
+
+    if (f->running) {
+        if (flatbuf_flush(acq) != 0)
+            err = -1;
+
+        pthread_mutex_lock(&f->lock);
+        f->shutdown = 1;
+        pthread_cond_signal(&f->cond);
+        pthread_mutex_unlock(&f->lock);
+        pthread_join(f->writer, NULL);
+        f->running = 0;
+
+        // The unaligned tail of a direct file.
+        if (f->fill > 0) {
+            fcntl(f->fd, F_SETFL, fcntl(f->fd, F_GETFL) & ~O_DIRECT);
+            if (write_all(f->fd, f->buf[f->active], f->fill, f->offset))
+                err = -1;
+            f->offset += f->fill;
+            f->fill = 0;
+        }
+    }
+    if (f->fd >= 0) {
+        close(f->fd);
+        f->fd = -1;
+    }
+    if (f->tout != NULL) {
+        fclose(f->tout);
+        f->tout = NULL;
+    }
+    f->filename[0] = 0;
+
+    return err;
+}
+
+static int flatbuf_destructor(mcedata_storage_t *storage)
+{
+    flatbuf_t *f = (flatbuf_t*)storage->action_data;
+    if (f == NULL)
+        return 0;
+
+    free(f->buf[0]);
+    free(f->buf[1]);
+    pthread_cond_destroy(&f->cond);
+    pthread_mutex_destroy(&f->lock);
+    free(f);
+
+    memset(storage, 0, sizeof(*storage));
+    return 0;
+}
+
+mcedata_storage_t flatbuf_actions = {
+    .init = flatbuf_init,
+    .cleanup = flatbuf_cleanup,
+    .post_frame = flatbuf_post,
+    .flush = flatbuf_flush,
+    .destroy = flatbuf_destructor,
+};
+
+
+mcedata_storage_t* mcedata_flatfile_buffered_create(const char *filename,
+        const char *symlink, int buffer_size, int options)
+{
+    flatbuf_t *f = (flatbuf_t*)calloc(1, sizeof(flatbuf_t));
+    mcedata_storage_t *storage =
+        (mcedata_storage_t*)malloc(sizeof(mcedata_storage_t));
+    if (f==NULL || storage==NULL)
+        goto fail;
+
+    // Whole blocks only.
+    f->size = (buffer_size > 0) ? buffer_size : FLATBUF_DEFAULT_SIZE;
+    f->size = (f->size + FLATBUF_ALIGN - 1) / FLATBUF_ALIGN * FLATBUF_ALIGN;
+    if (posix_memalign((void**)&f->buf[0], FLATBUF_ALIGN, f->size) != 0 ||
+            posix_memalign((void**)&f->buf[1], FLATBUF_ALIGN, f->size) != 0)
+        goto fail;
+
+    //Initialize storage with the file operations, then set local data.
+    memcpy(storage, &flatbuf_actions, sizeof(flatbuf_actions));
+    storage->action_data = f;
+
+    f->fd = -1;
+    f->options = options;
+    pthread_mutex_init(&f->lock, NULL);
+    pthread_cond_init(&f->cond, NULL);
+
+    if (symlink!=NULL)
+        strcpy(f->symlink, symlink);
+
+    strcpy(f->filename, filename);
+    return storage;
+
+fail:
+    if (f != NULL) {
+        free(f->buf[0]);
+        free(f->buf[1]);
+    }
+    free(f);
+    free(storage);
+    return NULL;
+}
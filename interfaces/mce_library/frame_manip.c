@@ -1,11 +1,12 @@
 /* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
  *      vim: sw=4 ts=4 et tw=80
  */
+#include <stdlib.h>
 #include <string.h>
-#include <assert.h>
 
 #include "context.h"
 #include "frame_manip.h"
+#include "checksum.h"
 
 
 /* Define frame header for header version 6 */
@@ -45,54 +46,125 @@ static int count_bits( int bits )
 }
 
 
-int sort_columns( mce_acq_t *acq, uint32_t *data )
-{
-    uint32_t temp[MCEDATA_PACKET_MAX];
+/* Reorder plans
+ *
+ * The MCE sends the data block card-major (all rows of the first card,
+ * then all rows of the next...); we present it row-major, with the
+ * reporting cards side by side.  The output is a sequence of runs
+ * (one row of one card, acq->cols words each) so the plan just holds
+ * the source offset of each run, and the output is written in order.
+ */
 
+frame_reorder_t *frame_reorder_create(const mce_acq_t *acq)
+{
+    frame_reorder_t *plan;
     int header_size = MCEDATA_HEADER;
     int footer_size = MCEDATA_FOOTER;
-
     int columns = acq->cols;
-    int cards_in = count_bits(acq->cards);
-    int cards_out = cards_in;
-    int rows = (acq->frame_size - header_size - footer_size) /
-        columns / cards_in;
-
-    int data_size_out = cards_out*rows*columns;
-    int data_size_in = cards_out*rows*columns;
-
-    int c, r, c_in = 0;
-
-#if 0
-    printf("temp=%lu data=%lu, c_bits=%i, r=%i c=%i c_in=%i c_out=%i\n",
-            temp, data, acq->cards, rows, columns, cards_in, cards_out);
-    fflush(stdout);
-#endif
-
-    if (cards_out == 1 && cards_in == 1)
-        return 0;
-
-    assert(acq->frame_size <= MCEDATA_PACKET_MAX);
-
-    memcpy(temp, data, header_size*sizeof(*temp));
-    memset(temp + header_size, 0, data_size_out*sizeof(*temp));
-    memcpy(temp + header_size + data_size_out,
-            data + header_size + data_size_in,
-            footer_size*sizeof(*temp));
-
-    for (c=0; c<cards_out; c++) {
-        if ( (acq->cards & (1 << c)) == 0 )
-            continue;
-        for (r=0; r<rows; r++) {
-            memcpy(temp+header_size + (r*cards_out + c)*columns,
-                    data+header_size + (rows*c_in + r)*columns,
-                    columns*sizeof(*temp));
+    int cards = count_bits(acq->cards);
+    int rows, r, c;
+
+    if (columns <= 0 || cards <= 0 ||
+            acq->frame_size > MCEDATA_PACKET_MAX ||
+            acq->frame_size < header_size + footer_size)
+        return NULL;
+
+    rows = (acq->frame_size - header_size - footer_size) / columns / cards;
+
+    plan = calloc(1, sizeof(*plan));
+    if (plan == NULL)
+        return NULL;
+
+    plan->frame_size = acq->frame_size;
+    plan->header_size = header_size;
+    plan->footer_size = footer_size;
+    plan->data_size = rows * columns * cards;
+    plan->run_size = columns;
+    plan->n_runs = rows * cards;
+    plan->identity = (cards == 1);
+    if (plan->identity)
+        return plan;
+
+    plan->src = malloc(plan->n_runs * sizeof(*plan->src));
+    if (plan->src == NULL) {
+        free(plan);
+        return NULL;
+    }
+
+    // Card c's row r comes from block c, and goes to slot c of row r.
+    for (r=0; r<rows; r++)
+        for (c=0; c<cards; c++)
+            plan->src[r*cards + c] = header_size + (rows*c + r)*columns;
+
+    return plan;
+}
+
+void frame_reorder_destroy(frame_reorder_t *plan)
+{
+    if (plan == NULL)
+        return;
+    free(plan->src);
+    free(plan);
+}
+
+/* Copy one frame from src to dst (which must not overlap), reordering
+ * the data block.  Returns the XOR of all words copied, i.e. the frame
+ * checksum, which is 0 for a good frame. */
+uint32_t frame_reorder_apply(const frame_reorder_t *plan, uint32_t *dst,
+        const uint32_t *src)
+{
+    const int *run = plan->src;
+    uint32_t *out;
+    uint32_t chksum;
+    int i;
+
+    if (plan->identity)
+        return mcecmd_copy_checksum(dst, src, plan->frame_size);
+
+    chksum = mcecmd_copy_checksum(dst, src, plan->header_size);
+    out = dst + plan->header_size;
+
+    // Full-width runs are exactly two vectors.
+    if (plan->run_size == MCEDATA_COLUMNS && MCEDATA_COLUMNS == 2*XOR_LANES) {
+        xor_vec_t a = {0};
+        for (i=0; i<plan->n_runs; i++, out += MCEDATA_COLUMNS) {
+            xor_vec_t x = xor_load(src + run[i]);
+            xor_vec_t y = xor_load(src + run[i] + XOR_LANES);
+            xor_store(out, x);
+            xor_store(out + XOR_LANES, y);
+            a ^= x ^ y;
         }
-        c_in++;
+        chksum ^= xor_fold(a);
+    } else {
+        // Narrow rectangles: a call to memcpy costs more than the copy.
+        int j, n = plan->run_size;
+        for (i=0; i<plan->n_runs; i++, out += n)
+            for (j=0; j<n; j++)
+                chksum ^= (out[j] = src[run[i] + j]);
     }
 
-    memcpy(data, temp,
-            (header_size+footer_size+data_size_out)*sizeof(*data));
+    chksum ^= mcecmd_copy_checksum(out, src + plan->header_size +
+            plan->data_size,
+            plan->frame_size - plan->header_size - plan->data_size);
+    return chksum;
+}
+
+/* Frame views (see mce/frame_view.h) */
 
-    return 0;
+void mcedata_frame_view_init(mce_frame_view_t *view, const mce_acq_t *acq)
+{
+    int i, k = 0;
+
+    memset(view, 0, sizeof(*view));
+    view->frame_size = acq->frame_size;
+    view->header_size = MCEDATA_HEADER;
+    view->rows = acq->rows;
+    view->cols = acq->cols;
+    view->n_cards = acq->n_cards;
+    view->cards = acq->cards;
+    for (i=0; i<MCEDATA_CARDS; i++) {
+        view->slot[i] = (acq->cards & (1 << i)) ? k++ : -1;
+        view->row0[i] = acq->row0[i];
+        view->col0[i] = acq->col0[i];
+    }
 }
@@ -3,6 +3,23 @@
 
 #include <mce/acq.h>
 
-int sort_columns( mce_acq_t* acq, uint32_t* data );
+/* Plan for reordering frames from the MCE's card-major layout into
+ * row-major order; built once per acquisition. */
+
+typedef struct frame_reorder {
+    int frame_size;     /* dwords */
+    int header_size;
+    int footer_size;
+    int data_size;
+    int run_size;       /* dwords per run (one row of one card) */
+    int n_runs;
+    int identity;       /* single card; plain copy */
+    int *src;           /* source offset of each output run */
+} frame_reorder_t;
+
+frame_reorder_t *frame_reorder_create(const mce_acq_t *acq);
+void frame_reorder_destroy(frame_reorder_t *plan);
+uint32_t frame_reorder_apply(const frame_reorder_t *plan, uint32_t *dst,
+        const uint32_t *src);
 
 #endif
@@ -0,0 +1,128 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "context.h"
+#include "gapcheck.h"
+
+static const char *kind_names[] = { "ok", "missing", "repeat", "sync" };
+
+void gapcheck_reset(gapcheck_t *g)
+{
+    FILE *log = g->log;
+    memset(g, 0, sizeof(*g));
+    g->log = log;
+}
+
+void gapcheck_restart(gapcheck_t *g)
+{
+    g->state = (g->state == 2) ? 3 : 0;
+}
+
+int gapcheck_set_log(gapcheck_t *g, const char *filename)
+{
+    if (g->log != NULL)
+        fclose(g->log);
+    g->log = NULL;
+    if (filename == NULL)
+        return 0;
+
+    g->log = fopen(filename, "a");
+    if (g->log == NULL)
+        return -1;
+    fprintf(g->log, "# index kind frame_counter expected sync_number "
+            "expected\n");
+    return 0;
+}
+
+static int record(gapcheck_t *g, enum gapcheck_kind kind, long long index,
+        uint32_t counter, uint32_t sync)
+{
+    g->kind = kind;
+    g->index = index;
+    g->counter = counter;
+    g->expected_counter = g->next_counter;
+    g->sync = sync;
+    g->expected_sync = g->next_sync;
+
+    switch (kind) {
+        case GAP_MISSING:
+            g->missing += (uint32_t)(counter - g->next_counter);
+            g->gap_events++;
+            break;
+        case GAP_REPEAT:
+            g->repeats++;
+            g->gap_events++;
+            break;
+        case GAP_SYNC:
+            g->sync_events++;
+            break;
+        default:
+            break;
+    }
+
+    if (g->log != NULL)
+        fprintf(g->log, "%lli %s %u %u %u %u\n", index, kind_names[kind],
+                counter, g->next_counter, sync, g->next_sync);
+    return kind;
+}
+
+int gapcheck_event(gapcheck_t *g, long long index, uint32_t counter,
+        uint32_t sync)
+{
+    int32_t dc = (int32_t)(counter - g->next_counter);
+    int kind = GAP_NONE;
+
+    switch (g->state) {
+        case 0:
+            // First frame: nothing to compare with.
+            g->state = 1;
+            break;
+
+        case 1:
+            // Second frame: learn the sync step, if the counter agrees.
+            if (dc != 0) {
+                kind = record(g, dc > 0 ? GAP_MISSING : GAP_REPEAT,
+                        index, counter, sync);
+                if (dc > 0)
+                    g->sync_step = (sync - (g->next_sync)) / (dc + 1);
+            } else {
+                g->sync_step = sync - g->next_sync;
+            }
+            g->state = 2;
+            break;
+
+        case 3:
+            // First frame after a restart: frame_counter starts over, so
+            // count what's missing by sync_number.
+            if (sync != g->next_sync && g->sync_step != 0) {
+                int32_t ds = (int32_t)(sync - g->next_sync);
+                if (ds < 0)
+                    kind = record(g, GAP_REPEAT, index, counter, sync);
+                else if (ds % g->sync_step != 0)
+                    kind = record(g, GAP_SYNC, index, counter, sync);
+                else {
+                    // As if the counter had carried on.
+                    g->next_counter = counter - ds / g->sync_step;
+                    kind = record(g, GAP_MISSING, index, counter, sync);
+                }
+            }
+            g->state = 2;
+            break;
+
+        default:
+            if (dc != 0) {
+                kind = record(g, dc > 0 ? GAP_MISSING : GAP_REPEAT,
+                        index, counter, sync);
+            } else if (sync != g->next_sync) {
+                kind = record(g, GAP_SYNC, index, counter, sync);
+            }
+    }
+
+    // Carry on from here; until the step is known, remember the sync.
+    g->next_counter = counter + 1;
+    g->next_sync = sync + (g->state == 2 ? g->sync_step : 0);
+    return kind;
+}
@@ -0,0 +1,75 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#ifndef _GAPCHECK_H_
+#define _GAPCHECK_H_
+
+/* Frame continuity checks, on the header frame_counter (which should
+ * go up by one each frame) and sync_number (which should go up by the
+ * same amount each frame: 0 without a sync box, or the data rate with
+ * one).  The per-frame test is inline and cheap; anything unexpected
+ * goes to gapcheck_event, which classifies it, counts it, and writes
+ * a line to the log file, if there is one. */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <mce_library.h>
+
+enum gapcheck_kind { GAP_NONE, GAP_MISSING, GAP_REPEAT, GAP_SYNC };
+
+typedef struct gapcheck {
+    /* Prediction for the next frame */
+    uint32_t next_counter;
+    uint32_t next_sync;
+    uint32_t sync_step;
+    int state;              /* frames seen since reset, up to 2; 3 after
+                               a restart */
+
+    /* Counts */
+    long long missing;      /* frames missing, by frame_counter */
+    int gap_events;         /* frame_counter discontinuities */
+    int repeats;            /* ... of which backwards */
+    int sync_events;        /* sync_number steps not matching frame_counter */
+
+    /* Most recent event */
+    enum gapcheck_kind kind;
+    long long index;
+    uint32_t counter, expected_counter;
+    uint32_t sync, expected_sync;
+
+    FILE *log;              /* sidecar, or NULL */
+} gapcheck_t;
+
+void gapcheck_reset(gapcheck_t *g);
+
+/* The next frame starts a new frame_counter sequence (after a new GO
+ * in the same stream); sync_number carries on, so frames lost across
+ * the restart are still found, once the sync step is known. */
+void gapcheck_restart(gapcheck_t *g);
+
+/* Open (or, with NULL, close) the sidecar log; returns 0 or -1. */
+int gapcheck_set_log(gapcheck_t *g, const char *filename);
+
+/* Slow path of gapcheck_frame. */
+int gapcheck_event(gapcheck_t *g, long long index, uint32_t counter,
+        uint32_t sync);
+
+/* Check frame number "index" (counting from the start of the go).
+ * Returns the kind of event detected (GAP_NONE almost always). */
+static inline int gapcheck_frame(gapcheck_t *g, long long index,
+        const uint32_t *data)
+{
+    uint32_t counter = frame_property(data, &frame_header_v6, frame_counter);
+    uint32_t sync = frame_property(data, &frame_header_v6, sync_number);
+
+    if (__builtin_expect(counter == g->next_counter &&
+                sync == g->next_sync && g->state == 2, 1)) {
+        g->next_counter = counter + 1;
+        g->next_sync = sync + g->sync_step;
+        return GAP_NONE;
+    }
+    return gapcheck_event(g, index, counter, sync);
+}
+
+#endif
@@ -8,8 +8,14 @@
  * of data to multiple outputs (e.g. a flatfile and a rambuffer; a
  * flatfile and a dirfile.
  *
- * It basically just maintains a list of mce_acq_t objects, and calls
- * them in sequence for each storage action.
+ * It maintains a list of mce_acq_t objects, each with its own queue of
+ * frames and its own worker thread, which passes them on to that
+ * sync's storage.  Each frame is copied once, into a buffer that is
+ * queued to every sync and counts the syncs still to see it; the last
+ * one puts it back on the free list.  So a slow sync holds up neither
+ * the others nor the acquisition, until its queue is full; then its
+ * policy says whether to wait, to drop its oldest frame, or to give up
+ * on that sync.
  *
  * Note that a superior interface would just pass around / store
  * mce_storage_t objects, each of which would have a pointer to the
@@ -22,81 +28,452 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "context.h"
-
-
-#define MAX_SYNCS  10
-
-
-/* Maintain a list of storage objects.  Note that this list is a set
- * of pointers, whose non-null entries must start at index 0 and be
- * contiguous (i.e. there can't be holes in the list).
- */
+#include "rt.h"
+#include "stats.h"
+
+#define LOAD(x)     __atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+
+
+/* A frame, as handed to the syncs.  For syncs that take views the
+ * frame as the MCE sent it follows the (reordered) frame in data. */
+
+typedef struct sync_buffer {
+    struct sync_buffer *next;       // on the free list
+    int refs;                       // syncs still to see it
+    int words;                      // room in data
+    int pre_frame;                  // pre_frame was called for it
+    int has_view;
+    int frame_index;
+    mce_host_time_t frame_time;
+    mce_frame_view_t view;          // geometry, if has_view
+    uint32_t data[];
+} sync_buffer_t;
+
+/* One sync: its acq, queue and worker.  The queue is indexed by
+ * sequence numbers, which only increase; "tail" is the next to be
+ * filled (by the acquisition), "head" the next to be taken (by the
+ * worker, or dropped by the acquisition; whoever moves head owns the
+ * frame), and "done" counts frames stored or dropped. */
+
+typedef struct sync_queue {
+    struct multisync_struct *owner;
+    mce_acq_t *acq;
+    int num;                        // position in the list
+    int depth;
+    int policy;
+    sync_buffer_t **frames;
+
+    long long tail;
+    long long head;
+    long long done;
+    long long dropped;
+    int stopped;
+    int shutdown;
+
+    pthread_t thread;
+    int running;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int sleepers;
+} sync_queue_t;
 
 typedef struct multisync_struct {
+    mce_acq_t *parent;              // the multisync acq
+    int n_syncs;
     int max_syncs;
-    int stopped[MAX_SYNCS];
-    int options[MAX_SYNCS];
-    mce_acq_t *syncs[MAX_SYNCS];
+    sync_queue_t **syncs;
+
+    int frame_size;
+    int views;                      // some sync takes views
+    sync_buffer_t *free_list;       // pushed by anyone, popped by post
+    sync_buffer_t *current;         // being filled (post_view, post_frame)
+    int pre_frame;                  // pre_frame called for the next frame
 
     multisync_err_callback_t err_callback;
     void *user_data;
+    int error;                      // frame error, for post_frame to return
 } multisync_t;
 
 
+/* Buffers */
+
+/* Only the acquisition pops the free list, so popping is ABA-safe. */
+static sync_buffer_t *buffer_get(multisync_t *f)
+{
+    int words = f->frame_size * (f->views ? 2 : 1);
+    sync_buffer_t *b = LOAD(f->free_list);
+
+    while (b != NULL && !__atomic_compare_exchange_n(&f->free_list, &b,
+                b->next, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+    if (b != NULL && b->words < words) {
+        free(b);
+        b = NULL;
+    }
+    if (b == NULL) {
+        b = malloc(sizeof(*b) + words * sizeof(uint32_t));
+        if (b == NULL)
+            return NULL;
+        b->words = words;
+    }
+    b->refs = 0;
+    b->pre_frame = 0;
+    b->has_view = 0;
+    return b;
+}
+
+static void buffer_put(multisync_t *f, sync_buffer_t *b)
+{
+    if (__atomic_sub_fetch(&b->refs, 1, __ATOMIC_SEQ_CST) > 0)
+        return;
+    b->next = LOAD(f->free_list);
+    while (!__atomic_compare_exchange_n(&f->free_list, &b->next, b, 0,
+                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+}
+
+
+/* Queues */
+
+typedef int (*sync_test_t)(sync_queue_t *s);
+
+static int has_space(sync_queue_t *s)
+{
+    return s->tail - LOAD(s->head) < s->depth;
+}
+
+static int has_work(sync_queue_t *s)
+{
+    return LOAD(s->head) < LOAD(s->tail) || LOAD(s->shutdown);
+}
+
+static int is_drained(sync_queue_t *s)
+{
+    return LOAD(s->done) == LOAD(s->tail);
+}
+
+/* Sleep until test passes; as in the pipeline, sleepers register
+ * before re-testing, and wakers test for sleepers after publishing. */
+static void sync_wait(sync_queue_t *s, sync_test_t test)
+{
+    if (test(s))
+        return;
+    pthread_mutex_lock(&s->lock);
+    __atomic_add_fetch(&s->sleepers, 1, __ATOMIC_SEQ_CST);
+    while (!test(s))
+        pthread_cond_wait(&s->cond, &s->lock);
+    __atomic_sub_fetch(&s->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void sync_wake(sync_queue_t *s)
+{
+    if (LOAD(s->sleepers) == 0)
+        return;
+    pthread_mutex_lock(&s->lock);
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Take the frame at the head of the queue; NULL if someone else did. */
+static sync_buffer_t *sync_take(sync_queue_t *s)
+{
+    long long seq = LOAD(s->head);
+    sync_buffer_t *b;
+
+    if (seq >= LOAD(s->tail))
+        return NULL;
+    b = s->frames[seq % s->depth];
+    if (!__atomic_compare_exchange_n(&s->head, &seq, seq + 1, 0,
+                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        return NULL;
+    return b;
+}
+
+static void sync_finish(sync_queue_t *s, sync_buffer_t *b)
+{
+    buffer_put(s->owner, b);
+    __atomic_add_fetch(&s->done, 1, __ATOMIC_SEQ_CST);
+    sync_wake(s);
+}
+
+/* Report a failed action of sync s; the callback, if any, says whether
+ * to stop using it.  Frame errors, which mostly happen in the workers,
+ * are also passed back to the acquisition by post_frame or flush. */
+static void sync_error(sync_queue_t *s, int err, mcedata_stage_t stage)
+{
+    multisync_t *f = s->owner;
+    if (stage != mcedata_acq_init && stage != mcedata_acq_flush &&
+            stage != mcedata_acq_cleanup)
+        STORE(f->error, err);
+    if (f->err_callback)
+        STORE(s->stopped, f->err_callback(f->user_data, s->num, err, stage));
+    else
+        mcelib_warning(s->acq->context, "multisync: sync %i failed (%i)\n",
+                s->num, err);
+}
+
+/* Storage time, by sync, for mcedata_acq_stats.  Each of the first
+ * MCEDATA_STATS_SYNCS syncs has its own slot; the rest share
+ * sync_time_rest, as the workers share n_syncs. */
+static void sync_time(mce_acq_t *acq, int i, double us)
+{
+    int n = LOAD(acq->stats.n_syncs);
+    if (i < MCEDATA_STATS_SYNCS) {
+        acq->stats.sync_time[i] += us;
+    } else {
+        double old, sum;
+        __atomic_load(&acq->stats.sync_time_rest, &old, __ATOMIC_SEQ_CST);
+        do {
+            sum = old + us;
+        } while (!__atomic_compare_exchange(&acq->stats.sync_time_rest,
+                    &old, &sum, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+    }
+    while (n <= i && !__atomic_compare_exchange_n(&acq->stats.n_syncs, &n,
+                i + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+}
+
+static void sync_store(sync_queue_t *s, sync_buffer_t *b)
+{
+    mcedata_storage_t *storage = s->acq->storage;
+    multisync_t *f = s->owner;
+    double t0 = acq_stats_now();
+    int err;
+
+    s->acq->frame_time = b->frame_time;
+    if (b->pre_frame && storage->pre_frame != NULL &&
+            (err = storage->pre_frame(s->acq)) != 0)
+        sync_error(s, err, mcedata_acq_pre_frame);
+    if (b->has_view && storage->post_view != NULL && !LOAD(s->stopped)) {
+        mce_frame_view_t view = b->view;
+        view.data = b->data + f->frame_size;
+        if ((err = storage->post_view(s->acq, b->frame_index, &view)) != 0)
+            sync_error(s, err, mcedata_acq_post_view);
+    }
+    if (storage->post_frame != NULL && !LOAD(s->stopped) &&
+            (err = storage->post_frame(s->acq, b->frame_index, b->data)) != 0)
+        sync_error(s, err, mcedata_acq_post_frame);
+    sync_time(f->parent, s->num, acq_stats_now() - t0);
+}
+
+static void *sync_worker(void *arg)
+{
+    sync_queue_t *s = arg;
+    struct rt_saved *rt = rt_thread_enter(s->acq->context, RT_WORKER);
+
+    while (1) {
+        sync_buffer_t *b;
+
+        sync_wait(s, has_work);
+        b = sync_take(s);
+        if (b == NULL) {
+            if (LOAD(s->head) >= LOAD(s->tail) && LOAD(s->shutdown))
+                break;
+            continue;
+        }
+        if (!LOAD(s->stopped))
+            sync_store(s, b);
+        sync_finish(s, b);
+    }
+    rt_thread_leave(rt);
+    return NULL;
+}
+
+/* Queue b for sync s, as its policy allows.  Called by the
+ * acquisition only. */
+static void sync_push(sync_queue_t *s, sync_buffer_t *b)
+{
+    while (!has_space(s)) {
+        sync_buffer_t *old;
+        switch (s->policy) {
+            case MCEDATA_MULTISYNC_DROP:
+                old = sync_take(s);
+                if (old != NULL) {
+                    s->dropped++;
+                    sync_finish(s, old);
+                }
+                break;
+
+            case MCEDATA_MULTISYNC_STOP:
+                // Whatever the callback says, this sync is done.
+                sync_error(s, -MCE_ERR_FRAME_OVERRUN,
+                        mcedata_acq_post_frame);
+                STORE(s->stopped, 1);
+                buffer_put(s->owner, b);
+                return;
+
+            default:
+                sync_wait(s, has_space);
+        }
+    }
+    s->frames[s->tail % s->depth] = b;
+    STORE(s->tail, s->tail + 1);
+    sync_wake(s);
+}
+
+static int sync_start(sync_queue_t *s)
+{
+    if (s->running)
+        return 0;
+    STORE(s->shutdown, 0);
+    if (pthread_create(&s->thread, NULL, sync_worker, s) != 0) {
+        mcelib_error(s->acq->context,
+                "could not start multisync worker thread.\n");
+        return -1;
+    }
+    s->running = 1;
+    return 0;
+}
+
+/* Let the worker store everything queued, then stop it. */
+static void sync_stop(sync_queue_t *s)
+{
+    if (!s->running)
+        return;
+    sync_wait(s, is_drained);
+    pthread_mutex_lock(&s->lock);
+    STORE(s->shutdown, 1);
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->thread, NULL);
+    s->running = 0;
+}
+
+static void sync_free(sync_queue_t *s)
+{
+    sync_stop(s);
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+    free(s->frames);
+    free(s);
+}
+
+
 /* Methods */
 
-/* Use a template for all the ones that just want an mce_acq_t*: */
-
-#define DECLARE_MULTISYNC(MEMBER,STOP_OVERRIDE) \
-    static int multisync_ ## MEMBER(mce_acq_t* acq)                 \
-    {                                                               \
-        multisync_t *f = (multisync_t*)acq->storage->action_data;   \
-        int i, err = 0;                                             \
-                                                                    \
-        for (i=0; i<f->max_syncs && f->syncs[i] != NULL; i++) {     \
-            if (f->syncs[i]->storage->MEMBER == NULL)               \
-                continue;                                           \
-            if (!(STOP_OVERRIDE) && f->stopped[i])                  \
-                continue;                                           \
-            err = f->syncs[i]->storage->MEMBER(f->syncs[i]);        \
-            if (err != 0) {                                         \
-                if (f->err_callback)                                \
-                    f->stopped[i] = f->err_callback(f->user_data,   \
-                          i, err, mcedata_acq_ ## MEMBER);          \
-                break;                                              \
-            }                                                       \
-        }                                                           \
-        return err;                                                 \
-    }
-
-DECLARE_MULTISYNC(init, 0)
-DECLARE_MULTISYNC(cleanup, 1)
-DECLARE_MULTISYNC(pre_frame, 0)
-DECLARE_MULTISYNC(flush, 0)
+static void multisync_drain(multisync_t *f)
+{
+    int i;
+    for (i=0; i<f->n_syncs; i++)
+        sync_wait(f->syncs[i], is_drained);
+}
 
-static int multisync_post_frame(mce_acq_t *acq, int frame_index, uint32_t *data)
+static int multisync_init(mce_acq_t *acq)
+{
+    multisync_t *f = (multisync_t*)acq->storage->action_data;
+    int i, err = 0;
+
+    f->parent = acq;
+    f->frame_size = acq->frame_size;
+    for (i=0; i<f->n_syncs; i++) {
+        sync_queue_t *s = f->syncs[i];
+        if (s->acq->storage->init != NULL && !s->stopped &&
+                (err = s->acq->storage->init(s->acq)) != 0) {
+            sync_error(s, err, mcedata_acq_init);
+            break;
+        }
+        if ((err = sync_start(s)) != 0)
+            break;
+    }
+    return err;
+}
+
+/* The workers are idle after a drain, so the rest are called from
+ * here. */
+
+static int multisync_flush(mce_acq_t *acq)
 {
     multisync_t *f = (multisync_t*)acq->storage->action_data;
     int i, err = 0;
 
-    for (i=0; i<f->max_syncs && f->syncs[i] != NULL; i++) {
-        if (f->syncs[i]->storage->post_frame == NULL)
+    multisync_drain(f);
+    for (i=0; i<f->n_syncs; i++) {
+        sync_queue_t *s = f->syncs[i];
+        if (s->acq->storage->flush == NULL || LOAD(s->stopped))
             continue;
-        if (f->stopped[i])
+        if ((err = s->acq->storage->flush(s->acq)) != 0) {
+            sync_error(s, err, mcedata_acq_flush);
+            break;
+        }
+    }
+    if (err == 0)
+        err = __atomic_exchange_n(&f->error, 0, __ATOMIC_SEQ_CST);
+    return err;
+}
+
+static int multisync_cleanup(mce_acq_t *acq)
+{
+    multisync_t *f = (multisync_t*)acq->storage->action_data;
+    int i, err = 0;
+
+    for (i=0; i<f->n_syncs; i++)
+        sync_stop(f->syncs[i]);
+    for (i=0; i<f->n_syncs; i++) {
+        sync_queue_t *s = f->syncs[i];
+        if (s->acq->storage->cleanup == NULL)
             continue;
-        err = f->syncs[i]->storage->post_frame(f->syncs[i], frame_index, data);
-        if (err != 0) {
-            if (f->err_callback)
-                f->stopped[i] = f->err_callback(f->user_data, i, err,
-                        mcedata_acq_post_frame);
+        if ((err = s->acq->storage->cleanup(s->acq)) != 0) {
+            sync_error(s, err, mcedata_acq_cleanup);
             break;
         }
     }
     return err;
 }
 
+static int multisync_pre_frame(mce_acq_t *acq)
+{
+    multisync_t *f = (multisync_t*)acq->storage->action_data;
+    f->pre_frame = 1;
+    return 0;
+}
+
+/* Keep the frame as the MCE sent it; post_frame follows. */
+static int multisync_post_view(mce_acq_t *acq, int frame_index,
+        const mce_frame_view_t *view)
+{
+    multisync_t *f = (multisync_t*)acq->storage->action_data;
+
+    if (f->current == NULL && (f->current = buffer_get(f)) == NULL)
+        return -1;
+    f->current->view = *view;
+    memcpy(f->current->data + f->frame_size, view->data,
+            f->frame_size * sizeof(uint32_t));
+    f->current->has_view = 1;
+    return 0;
+}
+
+static int multisync_post_frame(mce_acq_t *acq, int frame_index, uint32_t *data)
+{
+    multisync_t *f = (multisync_t*)acq->storage->action_data;
+    sync_buffer_t *b = f->current;
+    int i, n = 0;
+
+    f->current = NULL;
+    if (b == NULL && (b = buffer_get(f)) == NULL)
+        return -1;
+    memcpy(b->data, data, f->frame_size * sizeof(uint32_t));
+    b->frame_index = frame_index;
+    b->frame_time = acq->frame_time;
+    b->pre_frame = f->pre_frame;
+    f->pre_frame = 0;
+
+    // Count the syncs first, so no worker can free it early.
+    for (i=0; i<f->n_syncs; i++)
+        if (!LOAD(f->syncs[i]->stopped))
+            n++;
+    b->refs = n + 1;
+    for (i=0; i<f->n_syncs; i++)
+        if (!LOAD(f->syncs[i]->stopped) && n-- > 0)
+            sync_push(f->syncs[i], b);
+    // Syncs stopped meanwhile still hold a reference.
+    while (n-- > 0)
+        buffer_put(f, b);
+    buffer_put(f, b);
+    return __atomic_exchange_n(&f->error, 0, __ATOMIC_SEQ_CST);
+}
+
 
 /* Generic destructor (not to be confused with cleanup member function) */
 
@@ -104,22 +481,32 @@ static int multisync_destructor(mcedata_storage_t *storage)
 {
     int i, err;
     multisync_t *f = (multisync_t*)storage->action_data;
+    sync_buffer_t *b;
     if (f == NULL)
         return 0;
 
     // Perhaps this cascade of destruction should be optional.
-    for (i=0; i<f->max_syncs && f->syncs[i] != NULL; i++) {
-        if (f->syncs[i]->storage->destroy == NULL)
-            continue;
-        err = f->syncs[i]->storage->destroy(f->syncs[i]->storage);
+    for (i=0; i<f->n_syncs; i++) {
+        sync_queue_t *s = f->syncs[i];
+        sync_stop(s);
+        err = 0;
+        if (s->acq->storage->destroy != NULL)
+            err = s->acq->storage->destroy(s->acq->storage);
         // Also free the acq structure (see _add function)
-        free(f->syncs[i]);
+        free(s->acq);
+        sync_free(s);
         f->syncs[i] = NULL;
         if (err != 0)
             break;
     }
 
     // Free the private data for the storage module, clear the structure
+    free(f->current);
+    while ((b = f->free_list) != NULL) {
+        f->free_list = b->next;
+        free(b);
+    }
+    free(f->syncs);
     free(f);
 
     memset(storage, 0, sizeof(*storage));
@@ -127,7 +514,8 @@ static int multisync_destructor(mcedata_storage_t *storage)
 }
 
 
-/* Must provide every method of mcedata_storage! */
+/* Must provide every method of mcedata_storage!  (Except post_view,
+   which is filled in by mcedata_multisync_add as needed.) */
 
 mcedata_storage_t multisync_actions = {
     .init = multisync_init,
@@ -144,8 +532,11 @@ mcedata_storage_t* mcedata_multisync_create(int options)
     multisync_t *f = (multisync_t*)malloc(sizeof(multisync_t));
     mcedata_storage_t *storage =
         (mcedata_storage_t*)malloc(sizeof(mcedata_storage_t));
-    if (f==NULL || storage==NULL)
+    if (f==NULL || storage==NULL) {
+        free(f);
+        free(storage);
         return NULL;
+    }
 
     //Initialize storage with the file operations, then set local data.
     memcpy(storage, &multisync_actions, sizeof(multisync_actions));
@@ -153,38 +544,87 @@ mcedata_storage_t* mcedata_multisync_create(int options)
 
     //Make sure all pointers are NULL, and n_sync = 0.
     memset(f, 0, sizeof(*f));
-    f->max_syncs = MAX_SYNCS;
     return storage;
 }
 
 /* Allow user to add a sync. */
 
-int mcedata_multisync_add(mce_acq_t *multisync_acq,
-        mcedata_storage_t *sync)
+int mcedata_multisync_add_queue(mce_acq_t *multisync_acq,
+        mcedata_storage_t *sync, int depth, int policy)
 {
-    int i, error = 0;
     multisync_t *f = (multisync_t*)multisync_acq->storage->action_data;
-    if (f == NULL)
+    sync_queue_t *s;
+    mce_acq_t *acq;
+    int error = 0;
+
+    if (f == NULL || multisync_acq->storage->init != multisync_init)
         return -1;
 
-    // Append this sync to the list.
-    for (i=0; i < f->max_syncs; i++) {
-        if (f->syncs[i] == NULL) {
-            // Duplicate the main acq, and replace the storage -- this is not ideal.
-            // Don't forget to free it later, but just the main pointer.  Blech.
-            mce_acq_t *acq = mcedata_acq_duplicate(multisync_acq);
-            if (acq == NULL)
-                return -1;
-            acq->storage = sync;
-            f->syncs[i] = acq;
-            if (sync->init != NULL)
-                error = sync->init(acq);
-            return error;
-        }
+    if (f->n_syncs == f->max_syncs) {
+        int max = f->max_syncs ? 2 * f->max_syncs : 8;
+        void *syncs = realloc(f->syncs, max * sizeof(*f->syncs));
+        if (syncs == NULL)
+            return -1;
+        f->syncs = syncs;
+        f->max_syncs = max;
+    }
+
+    s = calloc(1, sizeof(*s));
+    if (s == NULL)
+        return -1;
+    s->depth = (depth > 0) ? depth : MCEDATA_MULTISYNC_DEPTH;
+    s->frames = malloc(s->depth * sizeof(*s->frames));
+    // Duplicate the main acq, and replace the storage -- this is not ideal.
+    // Don't forget to free it later, but just the main pointer.  Blech.
+    acq = mcedata_acq_duplicate(multisync_acq);
+    if (s->frames == NULL || acq == NULL) {
+        free(s->frames);
+        free(s);
+        free(acq);
+        return -1;
+    }
+    acq->storage = sync;
+    s->owner = f;
+    s->acq = acq;
+    s->num = f->n_syncs;
+    s->policy = policy;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    f->syncs[f->n_syncs++] = s;
+    f->parent = multisync_acq;
+    f->frame_size = multisync_acq->frame_size;
+
+    // Only ask for views if someone wants them.
+    if (sync->post_view != NULL) {
+        multisync_acq->storage->post_view = multisync_post_view;
+        f->views = 1;
     }
+    if (sync->init != NULL)
+        error = sync->init(acq);
+    if (error == 0)
+        error = sync_start(s);
+    return error;
+}
 
-    // No room left...
-    return -2;
+int mcedata_multisync_add(mce_acq_t *multisync_acq,
+        mcedata_storage_t *sync)
+{
+    return mcedata_multisync_add_queue(multisync_acq, sync, 0,
+            MCEDATA_MULTISYNC_BLOCK);
+}
+
+void mcedata_multisync_drain(mce_acq_t *acq)
+{
+    if (acq->storage != NULL && acq->storage->init == multisync_init)
+        multisync_drain((multisync_t*)acq->storage->action_data);
+}
+
+long long mcedata_multisync_dropped(mce_acq_t *multisync_acq, int sync_num)
+{
+    multisync_t *f = (multisync_t*)multisync_acq->storage->action_data;
+    if (sync_num < 0 || sync_num >= f->n_syncs)
+        return -1;
+    return LOAD(f->syncs[sync_num]->dropped);
 }
 
 /* set a user-provided callback for when acq's fail */
@@ -0,0 +1,582 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#define _GNU_SOURCE
+
+/* Network frame streaming; the protocol is described in mce/netserve.h.
+ *
+ * post_frame only copies the frame into a queue and, if the server
+ * thread is asleep, pokes it through a pipe.  The server thread does
+ * everything else: accepting subscribers (through massock), reading
+ * their requests, cutting each frame down to what each one asked for
+ * and queueing it in that subscriber's send buffer, and sending from
+ * the buffers as the sockets allow. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+#include <mce/socks.h>
+#include "context.h"
+
+#define NETSERVE_DEPTH    256           /* frames queued for the server */
+#define NETSERVE_CLIENTS  16
+#define NETSERVE_SEND     (4 << 20)     /* default send buffer, bytes */
+#define NETSERVE_RECV     65536         /* longest request */
+
+#define LOAD(x)     __atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+
+enum { SUB_ALL, SUB_HEADER, SUB_CHANNELS };
+
+typedef struct {
+    int active;
+    int decimate;
+    int phase;                      // frames to skip before the next
+    int mode;
+    int n_words;                    // words per frame message
+    int *words;                     // SUB_CHANNELS
+} netserve_sub_t;
+
+typedef struct {
+    mce_host_time_t time;
+    uint64_t seq;
+    int frame_index;
+} netserve_slot_t;
+
+typedef struct {
+    char addr[SOCKS_STR];
+    int send_max;
+    mce_context_t *context;
+
+    // Queue from the acquisition to the server thread
+    int frame_size;
+    uint32_t *frames;
+    netserve_slot_t *slots;
+    long long head;                 // written by post_frame
+    long long tail;                 // written by the server
+    uint64_t seq;
+    long long skipped;
+
+    // Server thread
+    listener_t list;
+    int listening;
+    netserve_sub_t subs[NETSERVE_CLIENTS];
+    mce_netserve_info_t info;       // geometry, for INFO messages
+    uint32_t *scratch;              // a CHANNELS frame
+    long long dropped;
+    pthread_t thread;
+    int running;
+    int quit;
+    int wake[2];
+    int asleep;
+} netserve_t;
+
+
+/* Subscribers (server thread only) */
+
+static void netserve_drop(netserve_t *f, int i)
+{
+    massock_client_delete(f->list.clients + i);
+    free(f->subs[i].words);
+    memset(f->subs + i, 0, sizeof(f->subs[i]));
+}
+
+/* Queue a message for subscriber i; 0, or -1 if it doesn't fit. */
+static int netserve_queue(netserve_t *f, int i, mce_netserve_msg_t *msg,
+        const void *data)
+{
+    massock_client_t *cl = f->list.clients + i;
+    int bytes = msg->n_words * sizeof(uint32_t);
+
+    if (cl->send_max - cl->send_idx < (int)sizeof(*msg) + bytes)
+        return -1;
+    massock_client_queue(cl, (const char*)msg, sizeof(*msg));
+    massock_client_queue(cl, data, bytes);
+    return 0;
+}
+
+static void netserve_reply(netserve_t *f, int i, int type, const void *data,
+        int n_words)
+{
+    mce_netserve_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.magic = MCE_NETSERVE_MAGIC;
+    msg.type = type;
+    msg.n_words = n_words;
+    if (netserve_queue(f, i, &msg, data) != 0)
+        netserve_drop(f, i);
+}
+
+static void netserve_error(netserve_t *f, int i, const char *text)
+{
+    uint32_t words[32];
+    memset(words, 0, sizeof(words));
+    strncpy((char*)words, text, sizeof(words) - 1);
+    netserve_reply(f, i, MCE_NETSERVE_ERROR, words,
+            (strlen((char*)words) + 4) / 4);
+}
+
+/* Parse a request:
+ *   SUBSCRIBE [DECIMATE n] [ALL | HEADER | CHANNELS w w ...] */
+static void netserve_request(netserve_t *f, int i, char *line)
+{
+    netserve_sub_t sub = { .active = 1, .decimate = 1, .mode = SUB_ALL };
+    mce_netserve_info_t info = f->info;
+    char *save, *tok = strtok_r(line, " \t\r", &save);
+    int n_max = 0;
+
+    if (tok == NULL)
+        return;
+    if (strcasecmp(tok, "SUBSCRIBE") != 0) {
+        netserve_error(f, i, "unknown request");
+        return;
+    }
+    while ((tok = strtok_r(NULL, " \t\r", &save)) != NULL) {
+        char *end;
+        if (sub.mode == SUB_CHANNELS) {
+            if (sub.n_words == n_max) {
+                n_max = n_max ? 2 * n_max : 64;
+                sub.words = realloc(sub.words, n_max * sizeof(int));
+            }
+            sub.words[sub.n_words++] = strtol(tok, &end, 0);
+        } else if (strcasecmp(tok, "DECIMATE") == 0) {
+            if ((tok = strtok_r(NULL, " \t\r", &save)) == NULL)
+                break;
+            sub.decimate = strtol(tok, &end, 0);
+            if (sub.decimate < 1)
+                break;
+        } else if (strcasecmp(tok, "ALL") == 0) {
+            sub.mode = SUB_ALL;
+            continue;
+        } else if (strcasecmp(tok, "HEADER") == 0) {
+            sub.mode = SUB_HEADER;
+            continue;
+        } else if (strcasecmp(tok, "CHANNELS") == 0) {
+            sub.mode = SUB_CHANNELS;
+            continue;
+        } else
+            break;
+        if (*end != 0)
+            break;
+    }
+    if (tok != NULL || (sub.mode == SUB_CHANNELS && sub.n_words == 0)) {
+        free(sub.words);
+        netserve_error(f, i, "bad SUBSCRIBE request");
+        return;
+    }
+
+    if (sub.mode == SUB_ALL)
+        sub.n_words = f->frame_size;
+    else if (sub.mode == SUB_HEADER)
+        sub.n_words = f->info.header_size;
+    sub.phase = 1;
+    free(f->subs[i].words);
+    f->subs[i] = sub;
+
+    info.decimate = sub.decimate;
+    info.n_words = sub.n_words;
+    netserve_reply(f, i, MCE_NETSERVE_INFO, &info, sizeof(info) / 4);
+}
+
+/* Handle the complete lines in subscriber i's receive buffer. */
+static void netserve_recv(netserve_t *f, int i)
+{
+    massock_client_t *cl = f->list.clients + i;
+    char *nl;
+
+    while (cl->fd > 0 &&
+            (nl = memchr(cl->recv_buf, '\n', cl->recv_idx)) != NULL) {
+        int len = nl - cl->recv_buf;
+        char *line = strndup(cl->recv_buf, len);
+        cl->recv_idx -= len + 1;
+        memmove(cl->recv_buf, nl + 1, cl->recv_idx);
+        if (line != NULL)
+            netserve_request(f, i, line);
+        free(line);
+    }
+    if (cl->fd > 0 && cl->recv_idx == cl->recv_max)
+        netserve_drop(f, i);
+}
+
+/* Send queued frames to their subscribers. */
+static void netserve_forward(netserve_t *f)
+{
+    long long tail = LOAD(f->tail);
+    mce_netserve_msg_t msg;
+    int i, k;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.magic = MCE_NETSERVE_MAGIC;
+    msg.type = MCE_NETSERVE_FRAME;
+
+    for (; tail < LOAD(f->head); tail++) {
+        netserve_slot_t *slot = f->slots + tail % NETSERVE_DEPTH;
+        const uint32_t *frame = f->frames +
+            (size_t)(tail % NETSERVE_DEPTH) * f->frame_size;
+
+        msg.frame_index = slot->frame_index;
+        msg.seq = slot->seq;
+        msg.mono_ns = slot->time.mono_ns;
+        msg.real_ns = slot->time.real_ns;
+        for (i=0; i<NETSERVE_CLIENTS; i++) {
+            netserve_sub_t *sub = f->subs + i;
+            const uint32_t *data = frame;
+            if (!sub->active || --sub->phase > 0)
+                continue;
+            sub->phase = sub->decimate;
+
+            if (sub->mode == SUB_CHANNELS) {
+                for (k=0; k<sub->n_words; k++) {
+                    int w = sub->words[k];
+                    f->scratch[k] = (w >= 0 && w < f->frame_size) ?
+                        frame[w] : 0;
+                }
+                data = f->scratch;
+            }
+            msg.n_words = sub->n_words;
+            if (netserve_queue(f, i, &msg, data) != 0) {
+                mcelib_warning(f->context, "netserve: dropped a subscriber "
+                        "that fell behind.\n");
+                netserve_drop(f, i);
+                __atomic_add_fetch(&f->dropped, 1, __ATOMIC_SEQ_CST);
+            }
+        }
+        STORE(f->tail, tail + 1);
+    }
+}
+
+static void *netserve_thread(void *arg)
+{
+    netserve_t *f = arg;
+    listener_t *list = &f->list;
+    char poke[64];
+    int i;
+
+    while (!LOAD(f->quit)) {
+        struct timeval tv = { .tv_sec = 0, .tv_usec = 100000 };
+        fd_set rfd = list->rfd_master, wfd;
+        int n;
+
+        FD_ZERO(&wfd);
+        FD_SET(f->wake[0], &rfd);
+        for (i=0; i<NETSERVE_CLIENTS; i++)
+            if (list->clients[i].fd > 0 && list->clients[i].send_idx > 0)
+                FD_SET(list->clients[i].fd, &wfd);
+
+        // As in the pipeline: announce the nap, then look for work.
+        STORE(f->asleep, 1);
+        if (LOAD(f->head) != LOAD(f->tail))
+            tv.tv_usec = 0;
+        n = select(FD_SETSIZE, &rfd, &wfd, NULL, &tv);
+        STORE(f->asleep, 0);
+        if (n < 0) {
+            FD_ZERO(&rfd);
+            if (errno != EINTR)
+                mcelib_warning(f->context, "netserve: select failed.\n");
+        }
+
+        if (FD_ISSET(f->wake[0], &rfd))
+            while (read(f->wake[0], poke, sizeof(poke)) > 0);
+        if (FD_ISSET(list->sock, &rfd)) {
+            massock_client_t *cl = massock_listener_accept(list);
+            if (cl != NULL)
+                fcntl(cl->fd, F_SETFL, fcntl(cl->fd, F_GETFL) | O_NONBLOCK);
+        }
+        for (i=0; i<NETSERVE_CLIENTS; i++) {
+            massock_client_t *cl = list->clients + i;
+            if (cl->fd <= 0 || !FD_ISSET(cl->fd, &rfd))
+                continue;
+            if (massock_client_recv(cl) & (LISTENER_ERR | LISTENER_CLOSE))
+                netserve_drop(f, i);
+            else
+                netserve_recv(f, i);
+        }
+
+        netserve_forward(f);
+
+        for (i=0; i<NETSERVE_CLIENTS; i++) {
+            massock_client_t *cl = list->clients + i;
+            if (cl->fd > 0 && cl->send_idx > 0 &&
+                    (massock_client_flush(cl) & LISTENER_ERR))
+                netserve_drop(f, i);
+        }
+    }
+    return NULL;
+}
+
+
+/* Storage methods */
+
+static void netserve_stop(netserve_t *f)
+{
+    int i;
+
+    if (f->running) {
+        STORE(f->quit, 1);
+        if (write(f->wake[1], "", 1) < 0)
+            ;   // the thread wakes up by itself soon enough
+        pthread_join(f->thread, NULL);
+        f->running = 0;
+    }
+    if (f->listening) {
+        for (i=0; i<NETSERVE_CLIENTS; i++)
+            if (f->list.clients[i].fd > 0)
+                netserve_drop(f, i);
+        massock_listener_close(&f->list);
+        close(f->list.sock);
+        massock_listener_cleanup(&f->list);
+        f->listening = 0;
+    }
+    for (i=0; i<2; i++)
+        if (f->wake[i] >= 0) {
+            close(f->wake[i]);
+            f->wake[i] = -1;
+        }
+    free(f->frames);
+    free(f->slots);
+    free(f->scratch);
+    f->frames = f->scratch = NULL;
+    f->slots = NULL;
+}
+
+static int netserve_init(mce_acq_t *acq)
+{
+    netserve_t *f = (netserve_t*)acq->storage->action_data;
+    int i, err;
+
+    netserve_stop(f);
+    f->context = acq->context;
+    f->frame_size = acq->frame_size;
+    f->head = f->tail = 0;
+    f->seq = 0;
+    f->quit = 0;
+
+    memset(&f->info, 0, sizeof(f->info));
+    f->info.frame_size = acq->frame_size;
+    f->info.header_size = (acq->frame_size > MCEDATA_HEADER) ?
+        MCEDATA_HEADER : acq->frame_size;
+    f->info.cards = acq->cards;
+    f->info.rows = acq->rows;
+    f->info.cols = acq->cols;
+    for (i=0; i<MCEDATA_CARDS; i++) {
+        f->info.row0[i] = acq->row0[i];
+        f->info.col0[i] = acq->col0[i];
+    }
+
+    f->frames = malloc((size_t)NETSERVE_DEPTH * f->frame_size *
+            sizeof(uint32_t));
+    f->slots = malloc(NETSERVE_DEPTH * sizeof(*f->slots));
+    f->scratch = malloc(NETSERVE_RECV / 2 * sizeof(uint32_t));
+    if (f->frames == NULL || f->slots == NULL || f->scratch == NULL ||
+            pipe2(f->wake, O_NONBLOCK) != 0) {
+        sprintf(acq->errstr, "netserve: out of memory");
+        netserve_stop(f);
+        return -1;
+    }
+
+    if (massock_listener_init(&f->list, NETSERVE_CLIENTS, NETSERVE_RECV,
+                f->send_max) != 0) {
+        sprintf(acq->errstr, "netserve: out of memory");
+        netserve_stop(f);
+        return -1;
+    }
+    if ((err = massock_listener_listen(&f->list, f->addr)) != 0) {
+        sprintf(acq->errstr, "netserve: could not listen on %.200s: %s",
+                f->addr, massock_error(err, errno));
+        massock_listener_cleanup(&f->list);
+        netserve_stop(f);
+        return -1;
+    }
+    f->listening = 1;
+
+    if (pthread_create(&f->thread, NULL, netserve_thread, f) != 0) {
+        sprintf(acq->errstr, "netserve: could not start server thread");
+        netserve_stop(f);
+        return -1;
+    }
+    f->running = 1;
+    return 0;
+}
+
+static int netserve_post(mce_acq_t *acq, int frame_index, uint32_t *data)
+{
+    netserve_t *f = (netserve_t*)acq->storage->action_data;
+    long long head = f->head;
+    netserve_slot_t *slot;
+
+    if (!f->running)
+        return -1;
+
+    // Never wait: if the server is that far behind, skip the frame.
+    if (head - LOAD(f->tail) >= NETSERVE_DEPTH) {
+        f->seq++;
+        STORE(f->skipped, f->skipped + 1);
+        return 0;
+    }
+    slot = f->slots + head % NETSERVE_DEPTH;
+    slot->frame_index = frame_index;
+    slot->time = acq->frame_time;
+    slot->seq = f->seq++;
+    memcpy(f->frames + (size_t)(head % NETSERVE_DEPTH) * f->frame_size,
+            data, f->frame_size * sizeof(uint32_t));
+    STORE(f->head, head + 1);
+
+    if (LOAD(f->asleep) && __atomic_exchange_n(&f->asleep, 0,
+                __ATOMIC_SEQ_CST) && write(f->wake[1], "", 1) < 0)
+        ;   // already poked
+    return 0;
+}
+
+static int netserve_cleanup(mce_acq_t *acq)
+{
+    netserve_t *f = (netserve_t*)acq->storage->action_data;
+    netserve_stop(f);
+    return 0;
+}
+
+static int netserve_destructor(mcedata_storage_t *storage)
+{
+    netserve_t *f = (netserve_t*)storage->action_data;
+    if (f == NULL)
+        return 0;
+
+    netserve_stop(f);
+    free(f);
+
+    memset(storage, 0, sizeof(*storage));
+    return 0;
+}
+
+mcedata_storage_t netserve_actions = {
+    .init = netserve_init,
+    .cleanup = netserve_cleanup,
+    .post_frame = netserve_post,
+    .destroy = netserve_destructor,
+};
+
+
+mcedata_storage_t* mcedata_netserve_create(const char *addr, int send_max)
+{
+    netserve_t *f = (netserve_t*)calloc(1, sizeof(netserve_t));
+    mcedata_storage_t *storage =
+        (mcedata_storage_t*)malloc(sizeof(mcedata_storage_t));
+    if (f==NULL || storage==NULL || strlen(addr) >= SOCKS_STR) {
+        free(f);
+        free(storage);
+        return NULL;
+    }
+
+    //Initialize storage with the file operations, then set local data.
+    memcpy(storage, &netserve_actions, sizeof(netserve_actions));
+    storage->action_data = f;
+
+    f->send_max = (send_max > 0) ? send_max : NETSERVE_SEND;
+    f->wake[0] = f->wake[1] = -1;
+    strcpy(f->addr, addr);
+    return storage;
+}
+
+int mcedata_netserve_port(mcedata_storage_t *storage)
+{
+    netserve_t *f = (netserve_t*)storage->action_data;
+    struct sockaddr_in sa;
+    socklen_t len = sizeof(sa);
+
+    if (storage->init != netserve_init || !f->listening ||
+            getsockname(f->list.sock, (struct sockaddr*)&sa, &len) != 0)
+        return -1;
+    return ntohs(sa.sin_port);
+}
+
+long long mcedata_netserve_skipped(mcedata_storage_t *storage)
+{
+    netserve_t *f = (netserve_t*)storage->action_data;
+    return LOAD(f->skipped);
+}
+
+long long mcedata_netserve_dropped(mcedata_storage_t *storage)
+{
+    netserve_t *f = (netserve_t*)storage->action_data;
+    return LOAD(f->dropped);
+}
+
+
+/* Subscribing */
+
+struct mcedata_netclient {
+    int fd;
+};
+
+static int netclient_recv_all(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+mcedata_netclient_t *mcedata_netclient_open(const char *addr,
+        const char *request)
+{
+    mcedata_netclient_t *c;
+    size_t len = strlen(request);
+    char *line = malloc(len + 2);
+    int fd = massock_connect(addr, -1);
+
+    if (fd < 0 || line == NULL) {
+        if (fd >= 0)
+            close(fd);
+        free(line);
+        return NULL;
+    }
+    sprintf(line, "%s\n", request);
+    if (send(fd, line, len + 1, MSG_NOSIGNAL) != len + 1 ||
+            (c = malloc(sizeof(*c))) == NULL) {
+        close(fd);
+        free(line);
+        return NULL;
+    }
+    free(line);
+    c->fd = fd;
+    return c;
+}
+
+void mcedata_netclient_close(mcedata_netclient_t *c)
+{
+    if (c == NULL)
+        return;
+    close(c->fd);
+    free(c);
+}
+
+int mcedata_netclient_read(mcedata_netclient_t *c, mce_netserve_msg_t *msg,
+        uint32_t *data, int max_words)
+{
+    uint32_t junk[256];
+    int n;
+
+    if (netclient_recv_all(c->fd, msg, sizeof(*msg)) != 0 ||
+            msg->magic != MCE_NETSERVE_MAGIC)
+        return -1;
+    n = (msg->n_words < max_words) ? msg->n_words : max_words;
+    if (netclient_recv_all(c->fd, data, n * sizeof(uint32_t)) != 0)
+        return -1;
+    for (n = msg->n_words - n; n > 0; n -= 256)
+        if (netclient_recv_all(c->fd, junk,
+                    ((n < 256) ? n : 256) * sizeof(uint32_t)) != 0)
+            return -1;
+    return msg->type;
+}
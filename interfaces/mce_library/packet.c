@@ -5,6 +5,7 @@
 
 #include <string.h>
 #include "context.h"
+#include "checksum.h"
 
 int mcecmd_load_command(mce_command *cmd, uint32_t command,
         uint32_t card_id, uint32_t para_id,
@@ -47,9 +48,49 @@ uint32_t mcecmd_cmd_checksum( const mce_command *cmd )
 
 uint32_t mcecmd_checksum( const uint32_t *data, int count )
 {
-    uint32_t chksum = 0;
-    while (count>0)
-        chksum ^= data[--count];
+    xor_vec_t a = {0}, b = {0}, c = {0}, d = {0};
+    uint32_t chksum;
+    int i = 0;
+
+    // Four accumulators, to keep several loads in flight.
+    for (; i + 4*XOR_LANES <= count; i += 4*XOR_LANES) {
+        a ^= xor_load(data + i);
+        b ^= xor_load(data + i + XOR_LANES);
+        c ^= xor_load(data + i + 2*XOR_LANES);
+        d ^= xor_load(data + i + 3*XOR_LANES);
+    }
+    for (; i + XOR_LANES <= count; i += XOR_LANES)
+        a ^= xor_load(data + i);
+
+    chksum = xor_fold(a ^ b ^ c ^ d);
+    for (; i < count; i++)
+        chksum ^= data[i];
+    return chksum;
+}
+
+uint32_t mcecmd_copy_checksum( uint32_t *dest, const uint32_t *src, int count )
+{
+    xor_vec_t a = {0}, b = {0};
+    uint32_t chksum;
+    int i = 0;
+
+    for (; i + 2*XOR_LANES <= count; i += 2*XOR_LANES) {
+        xor_vec_t x = xor_load(src + i);
+        xor_vec_t y = xor_load(src + i + XOR_LANES);
+        xor_store(dest + i, x);
+        xor_store(dest + i + XOR_LANES, y);
+        a ^= x;
+        b ^= y;
+    }
+    for (; i + XOR_LANES <= count; i += XOR_LANES) {
+        xor_vec_t x = xor_load(src + i);
+        xor_store(dest + i, x);
+        a ^= x;
+    }
+
+    chksum = xor_fold(a ^ b);
+    for (; i < count; i++)
+        chksum ^= (dest[i] = src[i]);
     return chksum;
 }
 
@@ -0,0 +1,299 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "context.h"
+#include "frame_manip.h"
+#include "pipeline.h"
+#include "rt.h"
+#include "stats.h"
+
+/* The queue is indexed by frame sequence numbers, which only increase;
+ * frame seq lives in slot seq % depth.  The reader owns "produced",
+ * workers advance "claimed" and, strictly in order, "posted".  Slots
+ * below posted are free for re-use.  All three are accessed
+ * atomically, so the hand-off itself takes no lock; the mutex and
+ * condition are only used to sleep when there is nothing to do.
+ *
+ * The reader only copies the frame, as it is, into its slot.  Each
+ * worker reorders the frames it claims into its own buffer, so that
+ * with several workers the reordering of consecutive frames overlaps;
+ * only the storage calls wait for their turn. */
+
+#define LOAD(x)     __atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+
+struct mcedata_pipeline {
+    mce_acq_t *acq;
+
+    int depth;
+    int frame_size;         // dwords
+    uint32_t *frames;       // depth * frame_size
+    int *count;             // acquisition frame number, by slot
+    mce_host_time_t *time;  // arrival time, by slot
+    uint32_t *ordered;      // n_workers * frame_size, reorder buffers
+
+    long long produced;
+    long long claimed;
+    long long posted;
+
+    int n_workers;
+    pthread_t *workers;
+    int next_buffer;        // hands out the reorder buffers
+    int shutdown;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int sleepers;
+
+    // Statistics; maintained by the reader.
+    int high_water;
+    long long frames_total;
+    long long full_waits;
+};
+
+typedef int (*pipe_test_t)(mcedata_pipeline_t *pipe, long long seq);
+
+static int has_space(mcedata_pipeline_t *pipe, long long seq)
+{
+    return seq - LOAD(pipe->posted) < pipe->depth;
+}
+
+static int has_work(mcedata_pipeline_t *pipe, long long seq)
+{
+    return LOAD(pipe->claimed) < LOAD(pipe->produced) || LOAD(pipe->shutdown);
+}
+
+static int is_turn(mcedata_pipeline_t *pipe, long long seq)
+{
+    return LOAD(pipe->posted) == seq;
+}
+
+static int is_drained(mcedata_pipeline_t *pipe, long long seq)
+{
+    return LOAD(pipe->posted) == LOAD(pipe->produced);
+}
+
+/* Sleep until test passes.  Sleepers register before re-testing, and
+ * wakers test for sleepers after publishing, so wake-ups are not lost. */
+static void pipe_wait(mcedata_pipeline_t *pipe, pipe_test_t test,
+        long long seq)
+{
+    if (test(pipe, seq))
+        return;
+    pthread_mutex_lock(&pipe->lock);
+    __atomic_add_fetch(&pipe->sleepers, 1, __ATOMIC_SEQ_CST);
+    while (!test(pipe, seq))
+        pthread_cond_wait(&pipe->cond, &pipe->lock);
+    __atomic_sub_fetch(&pipe->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+static void pipe_wake(mcedata_pipeline_t *pipe)
+{
+    if (LOAD(pipe->sleepers) == 0)
+        return;
+    pthread_mutex_lock(&pipe->lock);
+    pthread_cond_broadcast(&pipe->cond);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+static void *pipe_worker(void *arg)
+{
+    mcedata_pipeline_t *pipe = arg;
+    mce_acq_t *acq = pipe->acq;
+    struct rt_saved *rt = rt_thread_enter(acq->context, RT_WORKER);
+    uint32_t *buf = pipe->ordered + (size_t)pipe->frame_size *
+        __atomic_fetch_add(&pipe->next_buffer, 1, __ATOMIC_SEQ_CST);
+
+    while (1) {
+        long long seq;
+        uint32_t *raw, *data;
+        double t0;
+        int slot;
+
+        pipe_wait(pipe, has_work, 0);
+        seq = LOAD(pipe->claimed);
+        if (seq >= LOAD(pipe->produced)) {
+            if (LOAD(pipe->shutdown))
+                break;
+            continue;
+        }
+        if (!__atomic_compare_exchange_n(&pipe->claimed, &seq, seq + 1, 0,
+                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            continue;
+
+        slot = seq % pipe->depth;
+        raw = data = pipe->frames + slot * pipe->frame_size;
+        if (acq->storage->post_frame != NULL && !acq->reorder->identity) {
+            frame_reorder_apply(acq->reorder, buf, raw);
+            data = buf;
+        }
+
+        // Storage sees frames one at a time, in order.
+        pipe_wait(pipe, is_turn, seq);
+        acq->frame_time = pipe->time[slot];
+
+        if (acq->storage->pre_frame != NULL &&
+                acq->storage->pre_frame(acq) != 0) {
+            mcelib_warning(acq->context, "pre_frame action failed\n");
+        }
+        t0 = acq_stats_now();
+        if (acq->storage->post_view != NULL) {
+            mce_frame_view_t view = *acq->view;
+            view.data = raw;
+            if (acq->storage->post_view(acq, pipe->count[slot], &view))
+                mcelib_warning(acq->context, "post_view action failed\n");
+        }
+        if (acq->storage->post_frame != NULL &&
+                acq->storage->post_frame(acq, pipe->count[slot], data)) {
+            mcelib_warning(acq->context, "post_frame action failed\n");
+        }
+        acq->stats.storage_time += acq_stats_now() - t0;
+
+        STORE(pipe->posted, seq + 1);
+        pipe_wake(pipe);
+    }
+    rt_thread_leave(rt);
+    return NULL;
+}
+
+mcedata_pipeline_t *mcedata_pipeline_create(mce_acq_t *acq, int depth,
+        int n_workers)
+{
+    mcedata_pipeline_t *pipe;
+    int i;
+
+    if (depth <= 0 || n_workers <= 0)
+        return NULL;
+
+    pipe = calloc(1, sizeof(*pipe));
+    if (pipe == NULL)
+        return NULL;
+
+    pipe->acq = acq;
+    pipe->depth = depth;
+    pipe->frame_size = acq->frame_size;
+    pipe->frames = malloc((size_t)depth * pipe->frame_size * sizeof(uint32_t));
+    pipe->count = malloc(depth * sizeof(int));
+    pipe->time = malloc(depth * sizeof(mce_host_time_t));
+    pipe->ordered = malloc((size_t)n_workers * pipe->frame_size *
+            sizeof(uint32_t));
+    pipe->workers = calloc(n_workers, sizeof(pthread_t));
+    if (pipe->frames == NULL || pipe->count == NULL || pipe->time == NULL ||
+            pipe->ordered == NULL || pipe->workers == NULL)
+        goto fail;
+
+    rt_lock(acq->context, pipe->frames,
+            (size_t)depth * pipe->frame_size * sizeof(uint32_t));
+    rt_lock(acq->context, pipe->ordered,
+            (size_t)n_workers * pipe->frame_size * sizeof(uint32_t));
+
+    pthread_mutex_init(&pipe->lock, NULL);
+    pthread_cond_init(&pipe->cond, NULL);
+
+    for (i=0; i<n_workers; i++) {
+        if (pthread_create(pipe->workers + i, NULL, pipe_worker, pipe) != 0) {
+            mcelib_error(acq->context,
+                    "could not start pipeline worker thread.\n");
+            break;
+        }
+        pipe->n_workers++;
+    }
+    if (pipe->n_workers == 0) {
+        mcedata_pipeline_destroy(pipe);
+        return NULL;
+    }
+    return pipe;
+
+fail:
+    free(pipe->frames);
+    free(pipe->count);
+    free(pipe->time);
+    free(pipe->ordered);
+    free(pipe->workers);
+    free(pipe);
+    return NULL;
+}
+
+void mcedata_pipeline_destroy(mcedata_pipeline_t *pipe)
+{
+    int i;
+
+    if (pipe == NULL)
+        return;
+
+    mcedata_pipeline_drain(pipe);
+
+    pthread_mutex_lock(&pipe->lock);
+    STORE(pipe->shutdown, 1);
+    pthread_cond_broadcast(&pipe->cond);
+    pthread_mutex_unlock(&pipe->lock);
+
+    for (i=0; i<pipe->n_workers; i++)
+        pthread_join(pipe->workers[i], NULL);
+
+    pthread_cond_destroy(&pipe->cond);
+    pthread_mutex_destroy(&pipe->lock);
+
+    free(pipe->frames);
+    free(pipe->count);
+    free(pipe->time);
+    free(pipe->ordered);
+    free(pipe->workers);
+    free(pipe);
+}
+
+uint32_t mcedata_pipeline_push(mcedata_pipeline_t *pipe, int count,
+        const uint32_t *data, const mce_host_time_t *t)
+{
+    uint32_t *dest;
+    uint32_t chksum;
+    long long seq = pipe->produced;
+    int slot = seq % pipe->depth;
+    int queued;
+
+    if (!has_space(pipe, seq)) {
+        pipe->full_waits++;
+        pipe_wait(pipe, has_space, seq);
+    }
+
+    // A plain copy, so the driver gets its buffer back soon; the
+    // workers do the reordering.
+    dest = pipe->frames + slot * pipe->frame_size;
+    chksum = mcecmd_copy_checksum(dest, data, pipe->frame_size);
+    pipe->count[slot] = count;
+    pipe->time[slot] = *t;
+    STORE(pipe->produced, seq + 1);
+    pipe_wake(pipe);
+
+    pipe->frames_total++;
+    queued = seq + 1 - LOAD(pipe->posted);
+    if (queued > pipe->high_water)
+        pipe->high_water = queued;
+    return chksum;
+}
+
+void mcedata_pipeline_drain(mcedata_pipeline_t *pipe)
+{
+    pipe_wait(pipe, is_drained, 0);
+}
+
+void mcedata_pipeline_get_stats(mcedata_pipeline_t *pipe,
+        mcedata_pipeline_stats_t *stats, int reset)
+{
+    stats->depth = pipe->depth;
+    stats->n_workers = pipe->n_workers;
+    stats->queued = LOAD(pipe->produced) - LOAD(pipe->posted);
+    stats->high_water = pipe->high_water;
+    stats->frames = pipe->frames_total;
+    stats->full_waits = pipe->full_waits;
+    if (reset) {
+        pipe->high_water = 0;
+        pipe->frames_total = 0;
+        pipe->full_waits = 0;
+    }
+}
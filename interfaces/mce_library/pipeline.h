@@ -0,0 +1,35 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+/* Pipelined acquisition - the acquisition loop copies each frame out
+ * of the driver's buffer into a preallocated queue and releases it at
+ * once; worker threads then reorder the frames, in parallel, and pass
+ * them, in order, to the storage handlers.  Slow storage then only
+ * stalls the DMA ring once the queue is full. */
+
+#include <mce_library.h>
+
+typedef struct mcedata_pipeline mcedata_pipeline_t;
+
+mcedata_pipeline_t *mcedata_pipeline_create(mce_acq_t *acq, int depth,
+        int n_workers);
+
+void mcedata_pipeline_destroy(mcedata_pipeline_t *pipe);
+
+/* Queue a copy of the frame at data, which will be presented to
+ * storage as frame number "count", with acq->frame_time set to *t.
+ * Blocks while the queue is full.  Returns the frame checksum (0 if
+ * good). */
+uint32_t mcedata_pipeline_push(mcedata_pipeline_t *pipe, int count,
+        const uint32_t *data, const mce_host_time_t *t);
+
+/* Block until every queued frame has been passed to storage. */
+void mcedata_pipeline_drain(mcedata_pipeline_t *pipe);
+
+void mcedata_pipeline_get_stats(mcedata_pipeline_t *pipe,
+        mcedata_pipeline_stats_t *stats, int reset);
+
+#endif
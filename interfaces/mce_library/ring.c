@@ -0,0 +1,94 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#include <string.h>
+
+#include "ring.h"
+
+#define LAYOUT_TRIES 100
+
+int mcering_load_layout(mcering_layout_t *layout,
+        const volatile struct dsp_ctrl_page *ctrl)
+{
+    int i, tries;
+    unsigned gen;
+
+    for (tries=0; tries<LAYOUT_TRIES; tries++) {
+        gen = ctrl->generation;
+        if (gen & 1)
+            continue;
+        __sync_synchronize();
+
+        layout->n_frames = ctrl->n_frames;
+        layout->frame_size = ctrl->frame_size;
+        layout->n_blocks = ctrl->n_blocks;
+        if (layout->n_blocks < 0 || layout->n_blocks > DSP_CTRL_MAX_BLOCKS)
+            layout->n_blocks = 0;
+        for (i=0; i<layout->n_blocks; i++) {
+            layout->blocks[i].offset = ctrl->blocks[i].offset;
+            layout->blocks[i].start_frame = ctrl->blocks[i].start_frame;
+            layout->blocks[i].end_frame = ctrl->blocks[i].end_frame;
+        }
+
+        __sync_synchronize();
+        if (ctrl->generation == gen) {
+            layout->generation = gen;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int mcering_count(const mcering_layout_t *layout, int head, int tail)
+{
+    if (layout->n_frames <= 0)
+        return 0;
+    return (head - tail + layout->n_frames) % layout->n_frames;
+}
+
+int mcering_offset(const mcering_layout_t *layout, int index)
+{
+    int i;
+    for (i=0; i<layout->n_blocks; i++) {
+        const struct dsp_ctrl_block *b = layout->blocks + i;
+        if (index >= b->start_frame && index < b->end_frame)
+            return b->offset + (index - b->start_frame) * layout->frame_size;
+    }
+    return -1;
+}
+
+int mcering_walk(const mcering_layout_t *layout, int head, int tail,
+        int *offsets, int max)
+{
+    int n = 0;
+
+    if (layout->n_frames <= 0)
+        return 0;
+
+    while (tail != head && n < max) {
+        int offset = mcering_offset(layout, tail);
+        if (offset < 0)
+            break;
+        offsets[n++] = offset;
+        if (++tail >= layout->n_frames)
+            tail = 0;
+    }
+    return n;
+}
+
+int mcering_poll(mcering_layout_t *layout,
+        const volatile struct dsp_ctrl_page *ctrl, int *offsets, int max)
+{
+    int head, tail;
+
+    if (ctrl->generation != layout->generation &&
+            mcering_load_layout(layout, ctrl) != 0)
+        return -1;
+
+    head = ctrl->head_index;
+    tail = ctrl->tail_index;
+    // Don't read frame data ahead of the head index.
+    __sync_synchronize();
+
+    return mcering_walk(layout, head, tail, offsets, max);
+}
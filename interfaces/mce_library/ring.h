@@ -0,0 +1,43 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#ifndef _RING_H_
+#define _RING_H_
+
+/* Ring walker - locates ready frames in the driver's data buffer using
+ * the read-only control page (struct dsp_ctrl_page), so that polling
+ * for frames needs no ioctl. */
+
+#include <mce/dsp.h>
+
+typedef struct mcering_layout {
+    unsigned generation;    /* ctrl->generation this was copied from */
+    int n_frames;
+    int frame_size;
+    int n_blocks;
+    struct dsp_ctrl_block blocks[DSP_CTRL_MAX_BLOCKS];
+} mcering_layout_t;
+
+/* Copy the buffer layout from the control page; returns 0 on success
+ * or -1 if a consistent copy could not be obtained. */
+int mcering_load_layout(mcering_layout_t *layout,
+        const volatile struct dsp_ctrl_page *ctrl);
+
+/* Number of frames between tail and head. */
+int mcering_count(const mcering_layout_t *layout, int head, int tail);
+
+/* Byte offset in the data mmap of frame index, or -1 if out of range. */
+int mcering_offset(const mcering_layout_t *layout, int index);
+
+/* Store the offsets of up to max frames starting at tail and stopping
+ * at head; returns the number stored. */
+int mcering_walk(const mcering_layout_t *layout, int head, int tail,
+        int *offsets, int max);
+
+/* Reload layout if stale, then walk from the control page's tail to
+ * its head.  Returns the number of offsets stored, or -1 if the
+ * layout could not be loaded. */
+int mcering_poll(mcering_layout_t *layout,
+        const volatile struct dsp_ctrl_page *ctrl, int *offsets, int max);
+
+#endif
@@ -0,0 +1,202 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Background file rotation; see rotate.h. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "context.h"
+#include "rotate.h"
+#include "rt.h"
+
+#define ROTATOR_JOBS 16
+
+typedef struct rotator_item {
+    rotator_job_t job;              // NULL: open segment "idx"
+    void *arg;
+    int idx;
+} rotator_item_t;
+
+struct rotator {
+    mce_context_t *context;
+    rotator_open_t open;
+    rotator_job_t discard;
+    void *user;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    rotator_item_t queue[ROTATOR_JOBS];
+    int head;                       // next job to run
+    int count;                      // jobs queued, including the running one
+    int shutdown;
+
+    // The segment opened ahead of time.
+    int preparing;
+    int ready_idx;
+    void *ready;
+};
+
+typedef struct rotator_link {
+    char link[MCE_LONG];
+    char target[MCE_LONG];
+} rotator_link_t;
+
+
+static void *rotator_thread(void *arg)
+{
+    rotator_t *r = arg;
+    struct rt_saved *rt = rt_thread_enter(r->context, RT_BACKGROUND);
+
+    pthread_mutex_lock(&r->lock);
+    while (1) {
+        rotator_item_t item;
+
+        while (r->count == 0 && !r->shutdown)
+            pthread_cond_wait(&r->cond, &r->lock);
+        if (r->count == 0)
+            break;
+        item = r->queue[r->head];
+        pthread_mutex_unlock(&r->lock);
+
+        if (item.job != NULL) {
+            item.job(item.arg);
+            pthread_mutex_lock(&r->lock);
+        } else {
+            void *seg = r->open(r->user, item.idx);
+            pthread_mutex_lock(&r->lock);
+            r->ready = seg;
+            r->ready_idx = item.idx;
+            r->preparing = 0;
+        }
+
+        r->head = (r->head + 1) % ROTATOR_JOBS;
+        r->count--;
+        pthread_cond_broadcast(&r->cond);
+    }
+    pthread_mutex_unlock(&r->lock);
+    rt_thread_leave(rt);
+    return NULL;
+}
+
+/* Queue an item; call with the lock held. */
+static void rotator_push(rotator_t *r, rotator_job_t job, void *arg, int idx)
+{
+    rotator_item_t *item;
+
+    while (r->count == ROTATOR_JOBS)
+        pthread_cond_wait(&r->cond, &r->lock);
+
+    item = r->queue + (r->head + r->count) % ROTATOR_JOBS;
+    item->job = job;
+    item->arg = arg;
+    item->idx = idx;
+    r->count++;
+    pthread_cond_broadcast(&r->cond);
+}
+
+rotator_t *rotator_create(mce_context_t *context, rotator_open_t open,
+        rotator_job_t discard, void *user)
+{
+    rotator_t *r = calloc(1, sizeof(*r));
+    if (r == NULL)
+        return NULL;
+
+    r->context = context;
+    r->open = open;
+    r->discard = discard;
+    r->user = user;
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+
+    if (pthread_create(&r->thread, NULL, rotator_thread, r) != 0) {
+        pthread_cond_destroy(&r->cond);
+        pthread_mutex_destroy(&r->lock);
+        free(r);
+        return NULL;
+    }
+    return r;
+}
+
+void rotator_destroy(rotator_t *r)
+{
+    if (r == NULL)
+        return;
+
+    pthread_mutex_lock(&r->lock);
+    r->shutdown = 1;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->thread, NULL);
+
+    if (r->ready != NULL)
+        r->discard(r->ready);
+
+    pthread_cond_destroy(&r->cond);
+    pthread_mutex_destroy(&r->lock);
+    free(r);
+}
+
+void rotator_prepare(rotator_t *r, int idx)
+{
+    pthread_mutex_lock(&r->lock);
+    if (!r->preparing && r->ready == NULL) {
+        r->preparing = 1;
+        rotator_push(r, NULL, NULL, idx);
+    }
+    pthread_mutex_unlock(&r->lock);
+}
+
+void *rotator_take(rotator_t *r, int idx)
+{
+    void *seg = NULL;
+
+    pthread_mutex_lock(&r->lock);
+    while (r->preparing)
+        pthread_cond_wait(&r->cond, &r->lock);
+    if (r->ready != NULL) {
+        if (r->ready_idx == idx)
+            seg = r->ready;
+        else
+            rotator_push(r, r->discard, r->ready, 0);
+        r->ready = NULL;
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    // Not what we expected; do it the slow way.
+    if (seg == NULL)
+        seg = r->open(r->user, idx);
+    return seg;
+}
+
+void rotator_defer(rotator_t *r, rotator_job_t job, void *arg)
+{
+    pthread_mutex_lock(&r->lock);
+    rotator_push(r, job, arg, 0);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static void rotator_do_symlink(void *arg)
+{
+    rotator_link_t *l = arg;
+    mcelib_symlink(l->link, l->target);
+    free(l);
+}
+
+void rotator_symlink(rotator_t *r, const char *link, const char *target)
+{
+    rotator_link_t *l;
+
+    if (link == NULL || link[0] == 0)
+        return;
+    l = malloc(sizeof(*l));
+    if (l == NULL)
+        return;
+    strcpy(l->link, link);
+    strcpy(l->target, target);
+    rotator_defer(r, rotator_do_symlink, l);
+}
@@ -0,0 +1,47 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#ifndef _ROTATE_H_
+#define _ROTATE_H_
+
+/* Background file rotation, for the sequenced storage modules
+ * (fileseq, dirfileseq).  A helper thread opens the next segment
+ * while the current one is being written, and closes old segments
+ * after they have been swapped out, so that post_frame only has to
+ * swap pointers at a segment boundary.
+ *
+ * A "segment" is whatever the storage module's open function returns
+ * (an open file, a dirfile...). */
+
+typedef struct rotator rotator_t;
+
+/* Open segment idx; returns NULL on failure. */
+typedef void *(*rotator_open_t)(void *user, int idx);
+
+/* Work to do in the background, e.g. closing a segment. */
+typedef void (*rotator_job_t)(void *arg);
+
+/* discard disposes of a segment that was opened ahead of time but
+ * never used.  The helper runs at background priority (RT_BACKGROUND,
+ * with context's settings), so as not to slow down the acquisition. */
+rotator_t *rotator_create(mce_context_t *context, rotator_open_t open,
+        rotator_job_t discard, void *user);
+
+/* Finish all background work, discard any unused segment, and stop
+ * the thread. */
+void rotator_destroy(rotator_t *r);
+
+/* Start opening segment idx in the background. */
+void rotator_prepare(rotator_t *r, int idx);
+
+/* Get segment idx: the prepared one if it's the right one (waiting for
+ * it to be ready, if need be), otherwise opened here and now. */
+void *rotator_take(rotator_t *r, int idx);
+
+/* Run job(arg) on the helper thread, in order. */
+void rotator_defer(rotator_t *r, rotator_job_t job, void *arg);
+
+/* Point link at target (mcelib_symlink), in the background. */
+void rotator_symlink(rotator_t *r, const char *link, const char *target);
+
+#endif
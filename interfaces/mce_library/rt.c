@@ -0,0 +1,208 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#define _GNU_SOURCE
+
+/* Real-time tuning of acquisition threads; see rt.h. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <libconfig.h>
+
+#include "context.h"
+#include "rt.h"
+
+#define RT_SECTION "acquisition"
+
+/* For RT_BACKGROUND: the lowest nice level, and the lowest best-effort
+ * I/O priority (see ioprio_set(2); glibc has no wrapper). */
+#define RT_BACKGROUND_NICE  19
+#define IOPRIO_WHO_PROCESS  1
+#define IOPRIO_CLASS_BE     2
+#define IOPRIO_CLASS_SHIFT  13
+#define IOPRIO_BE_LOWEST    ((IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | 7)
+
+struct rt_saved {
+    int affinity;                   // which of these to restore
+    int sched;
+    cpu_set_t cpus;
+    int policy;
+    struct sched_param param;
+};
+
+/* Warn about a fallback, the first time only. */
+#define RT_WARN(c, kind, ...) do { \
+    if (!((c)->rt.warned & (kind))) { \
+        (c)->rt.warned |= (kind); \
+        mcelib_warning((c), __VA_ARGS__); \
+    } } while (0)
+
+static int load_cpus(mce_context_t *c, config_setting_t *section,
+        const char *name, int *cpus)
+{
+    config_setting_t *item = config_setting_get_member(section, name);
+    int i, n = 0;
+
+    if (item == NULL)
+        return 0;
+    if (config_setting_type(item) != CONFIG_TYPE_ARRAY) {
+        mcelib_warning(c, "%s.%s should be an array of CPU numbers; "
+                "ignored.\n", RT_SECTION, name);
+        return 0;
+    }
+
+    for (i=0; i<config_setting_length(item) && n < MCELIB_RT_CPUS; i++) {
+        int cpu = config_setting_get_int_elem(item, i);
+        if (cpu < 0 || cpu >= CPU_SETSIZE) {
+            mcelib_warning(c, "%s.%s: no such CPU %i; ignored.\n",
+                    RT_SECTION, name, cpu);
+            continue;
+        }
+        cpus[n++] = cpu;
+    }
+    return n;
+}
+
+void rt_load_config(mce_context_t *c)
+{
+    config_setting_t *section, *item;
+    int min, max;
+
+    memset(&c->rt, 0, sizeof(c->rt));
+    if (c->mas_cfg == NULL ||
+            (section = config_lookup(c->mas_cfg, RT_SECTION)) == NULL)
+        return;
+
+    c->rt.n_acq_cpus = load_cpus(c, section, "cpus", c->rt.acq_cpus);
+    c->rt.n_worker_cpus = load_cpus(c, section, "worker_cpus",
+            c->rt.worker_cpus);
+
+    if ((item = config_setting_get_member(section, "priority")) != NULL) {
+        c->rt.priority = config_setting_get_int(item);
+        min = sched_get_priority_min(SCHED_FIFO);
+        max = sched_get_priority_max(SCHED_FIFO);
+        if (c->rt.priority != 0 &&
+                (c->rt.priority < min || c->rt.priority > max)) {
+            mcelib_warning(c, "%s.priority must be 0 or in [%i, %i]; "
+                    "ignored.\n", RT_SECTION, min, max);
+            c->rt.priority = 0;
+        }
+    }
+
+    if ((item = config_setting_get_member(section, "lock_memory")) != NULL)
+        c->rt.lock_memory = config_setting_get_bool(item);
+}
+
+struct rt_saved *rt_thread_enter(mce_context_t *c, enum rt_role role)
+{
+    struct rt_saved *saved;
+    struct sched_param param;
+    pthread_t self = pthread_self();
+    const int *cpus = (role == RT_ACQ) ? c->rt.acq_cpus : c->rt.worker_cpus;
+    int n_cpus = (role == RT_ACQ) ? c->rt.n_acq_cpus : c->rt.n_worker_cpus;
+    int i, err;
+
+    // Best effort, and nothing to restore: these threads end with
+    // their job.
+    if (role == RT_BACKGROUND) {
+        pid_t tid = syscall(SYS_gettid);
+        setpriority(PRIO_PROCESS, tid, RT_BACKGROUND_NICE);
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_BE_LOWEST);
+    }
+
+    if (n_cpus == 0 && (c->rt.priority == 0 || role == RT_BACKGROUND))
+        return NULL;
+
+    saved = calloc(1, sizeof(*saved));
+    if (saved == NULL)
+        return NULL;
+
+    if (n_cpus > 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (i=0; i<n_cpus; i++)
+            CPU_SET(cpus[i], &set);
+        err = pthread_getaffinity_np(self, sizeof(saved->cpus), &saved->cpus);
+        if (err == 0)
+            err = pthread_setaffinity_np(self, sizeof(set), &set);
+        if (err == 0)
+            saved->affinity = 1;
+        else
+            RT_WARN(c, RT_WARN_AFFINITY, "could not pin %s thread to the "
+                    "configured CPUs: %s\n", role == RT_ACQ ? "acquisition" :
+                    "storage", strerror(err));
+    }
+
+    if (c->rt.priority > 0 && role != RT_BACKGROUND) {
+        param.sched_priority = c->rt.priority;
+        err = pthread_getschedparam(self, &saved->policy, &saved->param);
+        if (err == 0)
+            err = pthread_setschedparam(self, SCHED_FIFO, &param);
+        if (err == 0)
+            saved->sched = 1;
+        else
+            RT_WARN(c, RT_WARN_PRIORITY, "could not set SCHED_FIFO "
+                    "priority %i (%s); using normal scheduling.\n",
+                    c->rt.priority, strerror(err));
+    }
+
+    return saved;
+}
+
+void rt_thread_leave(struct rt_saved *saved)
+{
+    pthread_t self = pthread_self();
+
+    if (saved == NULL)
+        return;
+    if (saved->sched)
+        pthread_setschedparam(self, saved->policy, &saved->param);
+    if (saved->affinity)
+        pthread_setaffinity_np(self, sizeof(saved->cpus), &saved->cpus);
+    free(saved);
+}
+
+void rt_lock(mce_context_t *c, void *p, size_t size)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    volatile char *q = p;
+    size_t i;
+
+    if (!c->rt.lock_memory || p == NULL)
+        return;
+
+    // mlock faults the pages in; if it can't, touch them at least.
+    if (mlock(p, size) == 0)
+        return;
+    RT_WARN(c, RT_WARN_LOCK, "could not lock acquisition buffers in "
+            "memory: %s\n", strerror(errno));
+    for (i=0; i<size; i+=page)
+        q[i] = q[i];
+}
+
+void rt_lock_acq(mce_acq_t *acq)
+{
+    mce_context_t *c = acq->context;
+    struct rlimit lim;
+
+    if (!c->rt.lock_memory)
+        return;
+
+    // Locking all future allocations too is only safe when they can't
+    // fail for it, i.e. when the locked memory limit doesn't apply.
+    if ((geteuid() == 0 || (getrlimit(RLIMIT_MEMLOCK, &lim) == 0 &&
+                    lim.rlim_cur == RLIM_INFINITY)) &&
+            mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+        return;
+
+    // Just our own buffers, then; the data map is populated by the
+    // driver at mmap time.
+    rt_lock(c, acq->frame_buf, MCEDATA_PACKET_MAX * sizeof(uint32_t));
+}
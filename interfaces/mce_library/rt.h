@@ -0,0 +1,43 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#ifndef _RT_H_
+#define _RT_H_
+
+/* Real-time tuning of acquisition threads: CPU affinity, SCHED_FIFO
+ * priority and locked memory, as configured in the "acquisition"
+ * section of mas.cfg (see config2/components/acquisition).  Whatever
+ * can't be applied (usually for lack of privilege) is reported once
+ * per context, and acquisition carries on without it. */
+
+#include <stddef.h>
+#include "context.h"
+
+/* RT_BACKGROUND is for housekeeping threads (file rotation) that must
+ * not compete with the others: they run on the worker CPUs, but at the
+ * lowest CPU and I/O priority, which is not undone by rt_thread_leave. */
+enum rt_role { RT_ACQ, RT_WORKER, RT_BACKGROUND };
+
+#define RT_WARN_AFFINITY (1 << 0)
+#define RT_WARN_PRIORITY (1 << 1)
+#define RT_WARN_LOCK     (1 << 2)
+
+/* Fill c->rt from c->mas_cfg; all off if there's no such section. */
+void rt_load_config(mce_context_t *c);
+
+/* Apply the settings for role to the calling thread.  Returns the
+ * previous settings, for rt_thread_leave, or NULL if nothing was
+ * changed. */
+struct rt_saved *rt_thread_enter(mce_context_t *c, enum rt_role role);
+
+/* Restore the settings saved by rt_thread_enter, and free them. */
+void rt_thread_leave(struct rt_saved *saved);
+
+/* If lock_memory is set, fault in and lock size bytes at p. */
+void rt_lock(mce_context_t *c, void *p, size_t size);
+
+/* Lock the process' memory (including storage buffers) where that is
+ * safe, otherwise just acq's own buffers. */
+void rt_lock_acq(mce_acq_t *acq);
+
+#endif
@@ -0,0 +1,360 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#define _GNU_SOURCE
+
+/* Shared-memory frame rings; the layout and protocol are described in
+ * mce/shmring.h.
+ *
+ * The writer never waits for, or even knows about, its readers: each
+ * post_frame overwrites the oldest slot.  Readers copy a slot out
+ * between two reads of its sequence word and discard the copy if the
+ * writer got there in the meantime. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "context.h"
+
+#define SHMRING_DEPTH 1024          /* default slots */
+
+#define LOAD(x)          __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define STORE(x, v)      __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+
+#define SHMRING_SLOT(h, i) ((mce_shmring_slot_t*)((char*)(h) + \
+            MCE_SHMRING_DATA + (size_t)(i) * (h)->slot_size))
+
+
+/* Writing */
+
+typedef struct {
+    char name[MCE_LONG];
+    int depth;
+
+    mce_shmring_header_t *header;   // the mapping
+    size_t size;
+    uint64_t head;
+} shmring_t;
+
+/* Retire whatever object is called name: mark it closed, for its
+ * readers, and unlink it. */
+static void shmring_retire(const char *name)
+{
+    mce_shmring_header_t *h;
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+        return;
+    h = mmap(NULL, sizeof(*h), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (h != MAP_FAILED) {
+        if (h->magic == MCE_SHMRING_MAGIC)
+            STORE(h->closed, 1);
+        munmap(h, sizeof(*h));
+    }
+    close(fd);
+    shm_unlink(name);
+}
+
+static void shmring_unmap(shmring_t *f)
+{
+    if (f->header == NULL)
+        return;
+    STORE(f->header->closed, 1);
+    munmap(f->header, f->size);
+    f->header = NULL;
+    shm_unlink(f->name);
+}
+
+static int shmring_init(mce_acq_t *acq)
+{
+    shmring_t *f = (shmring_t*)acq->storage->action_data;
+    mce_shmring_header_t *h;
+    size_t slot_size;
+    int fd, i;
+
+    shmring_unmap(f);
+    shmring_retire(f->name);
+
+    // Whole cache lines per slot, so that slots don't share them.
+    slot_size = (sizeof(mce_shmring_slot_t) + acq->frame_size * 4 + 63) & ~63;
+    f->size = MCE_SHMRING_DATA + f->depth * slot_size;
+    f->head = 0;
+
+    fd = shm_open(f->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        snprintf(acq->errstr, sizeof(acq->errstr),
+                "Failed to create shared memory '%.*s'", MCELIB_ERR_NAME,
+                f->name);
+        return -1;
+    }
+    if (ftruncate(fd, f->size) != 0 ||
+            (h = mmap(NULL, f->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, 0)) == MAP_FAILED) {
+        snprintf(acq->errstr, sizeof(acq->errstr),
+                "Failed to map shared memory '%.*s'", MCELIB_ERR_NAME,
+                f->name);
+        close(fd);
+        shm_unlink(f->name);
+        return -1;
+    }
+    close(fd);
+
+    // ftruncate zeroed it; every slot starts out empty (seq 0).
+    h->version = MCE_SHMRING_VERSION;
+    h->frame_size = acq->frame_size;
+    h->header_size = (acq->frame_size > MCEDATA_HEADER) ?
+        MCEDATA_HEADER : acq->frame_size;
+    h->depth = f->depth;
+    h->slot_size = slot_size;
+    h->cards = acq->cards;
+    h->rows = acq->rows;
+    h->cols = acq->cols;
+    for (i=0; i<MCEDATA_CARDS; i++) {
+        h->row0[i] = acq->row0[i];
+        h->col0[i] = acq->col0[i];
+    }
+    // Readers check the magic last.
+    STORE(h->magic, MCE_SHMRING_MAGIC);
+    f->header = h;
+    return 0;
+}
+
+static int shmring_post(mce_acq_t *acq, int frame_index, uint32_t *data)
+{
+    shmring_t *f = (shmring_t*)acq->storage->action_data;
+    mce_shmring_header_t *h = f->header;
+    mce_shmring_slot_t *slot;
+    uint64_t s = f->head;
+
+    if (h == NULL)
+        return -1;
+
+    slot = SHMRING_SLOT(h, s % f->depth);
+    __atomic_store_n(&slot->seq, 2*s + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->mono_ns = acq->frame_time.mono_ns;
+    slot->real_ns = acq->frame_time.real_ns;
+    slot->frame_index = frame_index;
+    memcpy(slot + 1, data, h->frame_size * sizeof(uint32_t));
+    STORE(slot->seq, 2*s + 2);
+
+    f->head = s + 1;
+    STORE(h->head, s + 1);
+    return 0;
+}
+
+static int shmring_cleanup(mce_acq_t *acq)
+{
+    shmring_t *f = (shmring_t*)acq->storage->action_data;
+    shmring_unmap(f);
+    return 0;
+}
+
+static int shmring_destructor(mcedata_storage_t *storage)
+{
+    shmring_t *f = (shmring_t*)storage->action_data;
+    if (f == NULL)
+        return 0;
+
+    shmring_unmap(f);
+    free(f);
+
+    memset(storage, 0, sizeof(*storage));
+    return 0;
+}
+
+mcedata_storage_t shmring_actions = {
+    .init = shmring_init,
+    .cleanup = shmring_cleanup,
+    .post_frame = shmring_post,
+    .destroy = shmring_destructor,
+};
+
+
+mcedata_storage_t* mcedata_shmring_create(const char *name, int depth)
+{
+    shmring_t *f = (shmring_t*)calloc(1, sizeof(shmring_t));
+    mcedata_storage_t *storage =
+        (mcedata_storage_t*)malloc(sizeof(mcedata_storage_t));
+    if (f==NULL || storage==NULL || strlen(name) >= MCE_LONG) {
+        free(f);
+        free(storage);
+        return NULL;
+    }
+
+    //Initialize storage with the file operations, then set local data.
+    memcpy(storage, &shmring_actions, sizeof(shmring_actions));
+    storage->action_data = f;
+
+    f->depth = (depth > 1) ? depth : SHMRING_DEPTH;
+    strcpy(f->name, name);
+    return storage;
+}
+
+
+/* Reading */
+
+struct mcedata_shmring {
+    char name[MCE_LONG];
+    const mce_shmring_header_t *header;
+    size_t size;
+    dev_t dev;                      // of the object being followed
+    ino_t ino;
+
+    uint64_t next;                  // next frame to read
+    long long lost;
+};
+
+/* Map the object now called ring->name, if it is a new, initialized ring;
+ * start following it from its head.  Returns 0 on success. */
+static int shmring_attach(mcedata_shmring_t *ring)
+{
+    const mce_shmring_header_t *h;
+    struct stat st;
+    size_t size;
+    int fd = shm_open(ring->name, O_RDONLY, 0);
+
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || st.st_size < MCE_SHMRING_DATA ||
+            (ring->header != NULL && st.st_dev == ring->dev &&
+             st.st_ino == ring->ino)) {
+        close(fd);
+        return -1;
+    }
+    size = st.st_size;
+    h = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED)
+        return -1;
+    if (LOAD(h->magic) != MCE_SHMRING_MAGIC ||
+            h->version != MCE_SHMRING_VERSION ||
+            MCE_SHMRING_DATA + (size_t)h->depth * h->slot_size > size) {
+        munmap((void*)h, size);
+        return -1;
+    }
+
+    if (ring->header != NULL)
+        munmap((void*)ring->header, ring->size);
+    ring->header = h;
+    ring->size = size;
+    ring->dev = st.st_dev;
+    ring->ino = st.st_ino;
+    ring->next = LOAD(h->head);
+    return 0;
+}
+
+mcedata_shmring_t *mcedata_shmring_open(const char *name)
+{
+    mcedata_shmring_t *ring;
+    if (strlen(name) >= MCE_LONG)
+        return NULL;
+    ring = (mcedata_shmring_t*)calloc(1, sizeof(*ring));
+    if (ring == NULL)
+        return NULL;
+    strcpy(ring->name, name);
+    if (shmring_attach(ring) != 0) {
+        free(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+void mcedata_shmring_close(mcedata_shmring_t *ring)
+{
+    if (ring == NULL)
+        return;
+    munmap((void*)ring->header, ring->size);
+    free(ring);
+}
+
+const mce_shmring_header_t *mcedata_shmring_header(
+        const mcedata_shmring_t *ring)
+{
+    return ring->header;
+}
+
+long long mcedata_shmring_lost(const mcedata_shmring_t *ring)
+{
+    return ring->lost;
+}
+
+/* Give up on frames the writer has overwritten, or is about to: frame
+ * head is being written into the slot of frame head - depth. */
+static void shmring_skip(mcedata_shmring_t *ring, uint64_t head)
+{
+    uint64_t oldest = head - ring->header->depth + 1;
+    if (head >= ring->header->depth && ring->next < oldest) {
+        ring->lost += oldest - ring->next;
+        ring->next = oldest;
+    }
+}
+
+int mcedata_shmring_read(mcedata_shmring_t *ring, uint32_t *data,
+        int max_words, mce_shmring_frame_t *info)
+{
+    const mce_shmring_header_t *h = ring->header;
+    const mce_shmring_slot_t *slot;
+    uint64_t head, seq;
+
+    if ((int)h->frame_size > max_words)
+        return -1;
+
+    while (1) {
+        head = LOAD(h->head);
+        if (ring->next >= head) {
+            // Nothing new; has the writer moved on?  If so, the next
+            // read is from the new ring, whose frame size may differ.
+            if (LOAD(h->closed))
+                shmring_attach(ring);
+            return 0;
+        }
+        shmring_skip(ring, head);
+
+        slot = SHMRING_SLOT(h, ring->next % h->depth);
+        seq = LOAD(slot->seq);
+        if (seq == 2*ring->next + 2) {
+            if (info != NULL) {
+                info->seq = ring->next;
+                info->frame_index = slot->frame_index;
+                info->frame_time.mono_ns = slot->mono_ns;
+                info->frame_time.real_ns = slot->real_ns;
+            }
+            memcpy(data, slot + 1, h->frame_size * sizeof(uint32_t));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq) {
+                ring->next++;
+                return h->frame_size;
+            }
+        }
+        // Overwritten under us (so the writer is at least depth frames
+        // on); catch up and try again.
+        shmring_skip(ring, LOAD(h->head));
+    }
+}
+
+int mcedata_shmring_channel(const mcedata_shmring_t *ring, int mce_row,
+        int mce_col)
+{
+    const mce_shmring_header_t *h = ring->header;
+    int card = mce_col / MCEDATA_COLUMNS;
+    int slot = 0, i, r, c;
+
+    if (mce_row < 0 || mce_col < 0 || card >= MCEDATA_CARDS ||
+            !(h->cards & (1 << card)))
+        return -1;
+    for (i=0; i<card; i++)
+        if (h->cards & (1 << i))
+            slot++;
+    r = mce_row - h->row0[card];
+    c = mce_col - card*MCEDATA_COLUMNS - h->col0[card];
+    if (r < 0 || r >= (int)h->rows || c < 0 || c >= (int)h->cols)
+        return -1;
+    i = h->header_size + (r * __builtin_popcount(h->cards) + slot) * h->cols
+        + c;
+    return (i < (int)h->frame_size) ? i : -1;
+}
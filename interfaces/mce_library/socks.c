@@ -288,6 +288,22 @@ massock_listen_flags massock_listener_select( listener_t *list )
 }
 
 
+massock_client_t *massock_listener_accept( listener_t *list )
+{
+    massock_client_t *client;
+    int fd = accept_now(list->sock);
+
+    if (fd <= 0)
+        return NULL;
+    if ( (client = massock_client_add(list, fd)) == NULL) {
+        close(fd);
+        return NULL;
+    }
+    FD_SET(client->fd, &list->rfd_master);
+    return client;
+}
+
+
 massock_client_t* massock_client_add( listener_t *list, int fd )
 {
     if (list==NULL)
@@ -321,6 +337,8 @@ int massock_client_delete( massock_client_t *client )
 
     client->flags = 0;
     client->fd = 0;
+    client->recv_idx = 0;
+    client->send_idx = 0;
 
     return 0;
 }
@@ -391,3 +409,37 @@ massock_listen_flags massock_client_recv( massock_client_t *client )
 
     return retf;
 }
+
+
+int massock_client_queue( massock_client_t *client, const char *buf, int count )
+{
+    if (client==NULL || client->send_buf==NULL)
+        return -1;
+    if (count > client->send_max - client->send_idx)
+        return -1;
+
+    memcpy(client->send_buf + client->send_idx, buf, count);
+    client->send_idx += count;
+    return 0;
+}
+
+
+massock_listen_flags massock_client_flush( massock_client_t *client )
+{
+    if (client==NULL || client->send_buf==NULL)
+        return LISTENER_ERR;
+    if (client->send_idx == 0)
+        return LISTENER_OK;
+
+    ssize_t err = send(client->fd, client->send_buf, client->send_idx,
+            MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    if (err < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ?
+            LISTENER_OK : LISTENER_ERR;
+
+    // Keep what's left at the front of the buffer.
+    client->send_idx -= err;
+    memmove(client->send_buf, client->send_buf + err, client->send_idx);
+    return LISTENER_DATA;
+}
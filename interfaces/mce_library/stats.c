@@ -0,0 +1,78 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "context.h"
+#include "stats.h"
+
+double acq_stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+void acq_stats_reset(mce_acq_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->last_checksum_error = -1;
+}
+
+void acq_stats_latency(mce_acq_stats_t *stats, double us)
+{
+    int bin = 0;
+    long long t = (long long)us;
+
+    while (t > 0 && bin < MCEDATA_LATENCY_BINS - 1) {
+        t >>= 1;
+        bin++;
+    }
+    stats->latency[bin]++;
+    if (us > stats->latency_max)
+        stats->latency_max = us;
+}
+
+void acq_stats_ring(mce_acq_stats_t *stats, int waiting)
+{
+    if (waiting > stats->ring_high_water)
+        stats->ring_high_water = waiting;
+}
+
+double acq_stats_percentile(const mce_acq_stats_t *stats, double fraction)
+{
+    long long total = 0, sum = 0;
+    int i;
+
+    for (i=0; i<MCEDATA_LATENCY_BINS; i++)
+        total += stats->latency[i];
+    if (total == 0)
+        return 0;
+
+    for (i=0; i<MCEDATA_LATENCY_BINS - 1; i++) {
+        sum += stats->latency[i];
+        if (sum >= fraction * total)
+            break;
+    }
+    if (i == MCEDATA_LATENCY_BINS - 1)
+        return stats->latency_max;
+    return (double)(1LL << i);
+}
+
+int acq_stats_summary(const mce_acq_stats_t *stats, char *buf, int size)
+{
+    return snprintf(buf, size, "acq: %lli frames, %i checksum errors, "
+            "%lli missing (%i gaps), %i sync errors, %lli/%lli empty polls, "
+            "ring high water %i/%i, latency p50<%.0f p99<%.0f max %.0f us, "
+            "storage %.2f us/frame",
+            stats->frames, stats->checksum_errors,
+            stats->gaps, stats->gap_events, stats->sync_events,
+            stats->empty_polls, stats->polls,
+            stats->ring_high_water, stats->ring_size,
+            acq_stats_percentile(stats, 0.5),
+            acq_stats_percentile(stats, 0.99),
+            stats->latency_max,
+            stats->frames > 0 ? stats->storage_time / stats->frames : 0.);
+}
@@ -0,0 +1,57 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#ifndef _STATS_H_
+#define _STATS_H_
+
+/* Acquisition statistics bookkeeping (mce_acq_stats_t, in mce/acq.h). */
+
+#include <time.h>
+#include <mce_library.h>
+
+/* Monotonic clock, in microseconds. */
+double acq_stats_now(void);
+
+/* Frame arrival time.  Only CLOCK_MONOTONIC is read each time;
+ * CLOCK_REALTIME is derived from it through an offset that is
+ * re-measured every HOST_CLOCK_RESYNC_NS, which halves the cost (see
+ * test/bench_timestamp).  A step in the wall clock shows up within
+ * that interval.  Zero the host_clock_t to start. */
+
+#define HOST_CLOCK_RESYNC_NS 1000000000LL
+
+typedef struct host_clock {
+    int64_t offset_ns;              // CLOCK_REALTIME - CLOCK_MONOTONIC
+    int64_t resync_ns;              // when to measure it again
+} host_clock_t;
+
+static inline void acq_host_time(host_clock_t *c, mce_host_time_t *t)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    t->mono_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    if (t->mono_ns >= c->resync_ns) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        c->offset_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec -
+            t->mono_ns;
+        c->resync_ns = t->mono_ns + HOST_CLOCK_RESYNC_NS;
+    }
+    t->real_ns = t->mono_ns + c->offset_ns;
+}
+
+void acq_stats_reset(mce_acq_stats_t *stats);
+
+/* Add one frame's handling time to the histogram. */
+void acq_stats_latency(mce_acq_stats_t *stats, double us);
+
+/* Note the number of frames waiting in the driver buffer. */
+void acq_stats_ring(mce_acq_stats_t *stats, int waiting);
+
+/* Latency below which the given fraction of frames were handled (an
+ * upper bin edge), or 0 if there are no frames. */
+double acq_stats_percentile(const mce_acq_stats_t *stats, double fraction);
+
+/* One-line summary, for the log. */
+int acq_stats_summary(const mce_acq_stats_t *stats, char *buf, int size);
+
+#endif
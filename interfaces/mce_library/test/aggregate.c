@@ -0,0 +1,184 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Check sync_number alignment of two frame sources: leading frames,
+ * frames lost by one source or by both, a stalled source, and a
+ * recording read back through the flatfile source. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "check.h"
+
+#define FRAME_SIZE (MCEDATA_HEADER + 4 + MCEDATA_FOOTER)
+#define SYNC(f) ((f)[frame_header_v6.sync_number & FRAME_OFFSET_MASK])
+
+/* Fill frames with sync numbers first, first+1, ..., leaving out the
+ * n_skip from skip on; returns the number of frames. */
+static int make_frames(uint32_t *frames, int n, uint32_t first,
+        uint32_t skip, int n_skip)
+{
+    uint32_t sync = first;
+    int i;
+    for (i=0; i<n; i++, sync++) {
+        if (sync == skip)
+            sync += n_skip;
+        memset(frames + i*FRAME_SIZE, 0, FRAME_SIZE*sizeof(uint32_t));
+        SYNC(frames + i*FRAME_SIZE) = sync;
+        frames[i*FRAME_SIZE + MCEDATA_HEADER] = sync * 10;
+    }
+    return n;
+}
+
+/* Check that each super-frame is made of matching frames. */
+typedef struct {
+    int frames;
+    int bad;
+    uint32_t last;
+} collect_t;
+
+static int collect(unsigned long user_data, int frame_size, uint32_t *buffer)
+{
+    collect_t *c = (collect_t*)user_data;
+    uint32_t sync = SYNC(buffer);
+    if (frame_size != 2*FRAME_SIZE || SYNC(buffer + FRAME_SIZE) != sync ||
+            buffer[FRAME_SIZE + MCEDATA_HEADER] != sync * 10 ||
+            (c->frames > 0 && (int32_t)(sync - c->last) <= 0))
+        c->bad++;
+    c->last = sync;
+    c->frames++;
+    return 0;
+}
+
+/* A source that goes quiet, without ending, after "left" frames. */
+static int stall_left;
+
+static int stall_next(mcedata_source_t *s, const uint32_t **frame)
+{
+    mcedata_source_t *inner = s->source_data;
+    if (stall_left == 0)
+        return 0;
+    stall_left--;
+    return inner->next(inner, frame);
+}
+
+static int stall_release(mcedata_source_t *s, int n)
+{
+    mcedata_source_t *inner = s->source_data;
+    return inner->release(inner, n);
+}
+
+static int stall_destroy(mcedata_source_t *s)
+{
+    mcedata_source_t *inner = s->source_data;
+    inner->destroy(inner);
+    return 0;
+}
+
+int main()
+{
+    static uint32_t a[100*FRAME_SIZE], b[100*FRAME_SIZE];
+    mcedata_source_t *src[2];
+    mcedata_source_t stall;
+    mcedata_aggregate_t *agg;
+    mcedata_aggregate_stats_t st;
+    collect_t c;
+    char filename[] = "/tmp/aggregate_XXXXXX";
+    FILE *fout;
+    int n_a, n_b, fd, err;
+
+    /* B starts 3 frames late and loses 120-121; A ends first. */
+    n_a = make_frames(a, 50, 100, 0, 0);
+    n_b = make_frames(b, 60, 103, 120, 2);
+    memset(&c, 0, sizeof(c));
+    src[0] = mcedata_source_memory_create(a, FRAME_SIZE, n_a);
+    src[1] = mcedata_source_memory_create(b, FRAME_SIZE, n_b);
+    agg = mcedata_aggregate_create(NULL, src, 2, 8,
+            mcedata_rambuff_create(collect, (unsigned long)&c));
+    CHECK(agg != NULL, "create");
+    err = mcedata_aggregate_go(agg, 1000, 100);
+    mcedata_aggregate_stats(agg, &st);
+    CHECK(err == 0, "go returned %i", err);
+    CHECK(c.frames == 45 && st.frames == 45, "stored %i", c.frames);
+    CHECK(c.bad == 0, "%i mismatched super-frames", c.bad);
+    CHECK(st.unmatched[0] == 5, "A unmatched %lli", st.unmatched[0]);
+    CHECK(st.last_sync == 149, "last sync %u", st.last_sync);
+    mcedata_aggregate_destroy(agg);
+
+    /* Both lose frames, different ones: A has 2,5,6,7,..., B has
+       2,3,6,7,...; 5 and 3 have no partner. */
+    n_a = make_frames(a, 20, 2, 3, 2);
+    n_b = make_frames(b, 20, 2, 4, 2);
+    memset(&c, 0, sizeof(c));
+    src[0] = mcedata_source_memory_create(a, FRAME_SIZE, n_a);
+    src[1] = mcedata_source_memory_create(b, FRAME_SIZE, n_b);
+    agg = mcedata_aggregate_create(NULL, src, 2, 8,
+            mcedata_rambuff_create(collect, (unsigned long)&c));
+    err = mcedata_aggregate_go(agg, 1000, 100);
+    mcedata_aggregate_stats(agg, &st);
+    CHECK(err == 0, "go returned %i", err);
+    CHECK(c.frames == 19 && c.bad == 0, "stored %i, bad %i", c.frames, c.bad);
+    CHECK(st.unmatched[0] == 1 && st.unmatched[1] == 1,
+            "unmatched %lli, %lli", st.unmatched[0], st.unmatched[1]);
+    mcedata_aggregate_destroy(agg);
+
+    /* B stalls after 10 frames: A is held to max_skew, then times out. */
+    make_frames(b, 100, 100, 0, 0);
+    n_a = make_frames(a, 100, 100, 0, 0);
+    memset(&c, 0, sizeof(c));
+    memset(&stall, 0, sizeof(stall));
+    stall_left = 10;
+    stall.frame_size = FRAME_SIZE;
+    stall.fd = -1;
+    stall.next = stall_next;
+    stall.release = stall_release;
+    stall.destroy = stall_destroy;
+    stall.source_data = mcedata_source_memory_create(b, FRAME_SIZE, 100);
+    src[0] = mcedata_source_memory_create(a, FRAME_SIZE, n_a);
+    src[1] = &stall;
+    agg = mcedata_aggregate_create(NULL, src, 2, 8,
+            mcedata_rambuff_create(collect, (unsigned long)&c));
+    err = mcedata_aggregate_go(agg, 50, 20);
+    mcedata_aggregate_stats(agg, &st);
+    CHECK(err == -MCE_ERR_FRAME_TIMEOUT, "go returned %i", err);
+    CHECK(c.frames == 10 && c.bad == 0, "stored %i, bad %i", c.frames, c.bad);
+    CHECK(st.unmatched[0] == 100 - 10 - 8, "A unmatched %lli",
+            st.unmatched[0]);
+    CHECK(st.max_held <= 9, "held %i", st.max_held);
+
+    /* B comes back; A's held frames are older, so B catches up. */
+    stall_left = 1000;
+    err = mcedata_aggregate_go(agg, 50, 20);
+    mcedata_aggregate_stats(agg, &st);
+    CHECK(err == 0, "go returned %i", err);
+    CHECK(c.frames == 18 && c.bad == 0, "stored %i, bad %i", c.frames, c.bad);
+    CHECK(st.unmatched[1] == 82, "B unmatched %lli", st.unmatched[1]);
+    mcedata_aggregate_destroy(agg);
+
+    /* A recording of A against B in memory. */
+    fd = mkstemp(filename);
+    fout = fdopen(fd, "w");
+    fwrite(a, sizeof(uint32_t), 30*FRAME_SIZE, fout);
+    fclose(fout);
+    memset(&c, 0, sizeof(c));
+    src[0] = mcedata_source_flatfile_create(filename, FRAME_SIZE);
+    src[1] = mcedata_source_memory_create(b, FRAME_SIZE, 100);
+    CHECK(src[0] != NULL, "flatfile source");
+    agg = mcedata_aggregate_create(NULL, src, 2, 0,
+            mcedata_rambuff_create(collect, (unsigned long)&c));
+    err = mcedata_aggregate_go(agg, 1000, 100);
+    mcedata_aggregate_stats(agg, &st);
+    CHECK(err == 0 && c.frames == 30 && c.bad == 0, "stored %i, bad %i",
+            c.frames, c.bad);
+    mcedata_aggregate_destroy(agg);
+    unlink(filename);
+
+    printf("aggregate: %s\n", failures ? "FAILED" : "ok");
+    return failures != 0;
+}
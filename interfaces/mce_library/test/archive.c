@@ -0,0 +1,252 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Round trips through compressed archives: smooth, constant and random
+ * channels (all bit widths), short blocks from flushes, reads of whole
+ * frames and of a few channels, of every size from anywhere, channels
+ * found by MCE row and column, and an archive cut short, without its
+ * index. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "check.h"
+
+/* RC2 and RC4, 4 rows by 5 columns each. */
+#define CARDS (MCEDATA_RC2 | MCEDATA_RC4)
+#define ROWS 4
+#define COLS 5
+#define N_DATA (2*ROWS*COLS)
+#define FRAME_SIZE (MCEDATA_HEADER + N_DATA + 1)
+
+static mce_context_t ctx;
+
+/* Channel i of frame k: a mix of steady, slow, fast and random. */
+static uint32_t sample(int k, int i)
+{
+    static uint32_t seed = 12345;
+    switch (i % 5) {
+        case 0:
+            return 0xdeadbeef;
+        case 1:
+            return k * 3 - 1000 * i;
+        case 2:
+            return (k & 1) ? -i : i << 20;
+        case 3:
+            return (uint32_t)(k * k) << (i % 32);
+    }
+    seed = seed * 1103515245 + 12345;
+    return seed ^ (seed << 7);
+}
+
+static uint32_t *make_frames(int n_frames)
+{
+    uint32_t *frames = malloc((size_t)n_frames * FRAME_SIZE * 4);
+    int k, i;
+    for (k=0; k<n_frames; k++)
+        for (i=0; i<FRAME_SIZE; i++)
+            frames[k*FRAME_SIZE + i] = (i == 0) ? k : sample(k, i);
+    return frames;
+}
+
+static void write_archive(const char *filename, const uint32_t *frames,
+        int n_frames, int block_frames, int flush_every)
+{
+    mcedata_storage_t *s = mcedata_archive_create(filename, NULL,
+            block_frames);
+    mce_acq_t acq;
+    int k;
+
+    memset(&acq, 0, sizeof(acq));
+    acq.context = &ctx;
+    acq.storage = s;
+    acq.frame_size = FRAME_SIZE;
+    acq.cards = CARDS;
+    acq.n_cards = 2;
+    acq.rows = ROWS;
+    acq.cols = COLS;
+    acq.row0[1] = 3;
+    acq.col0[1] = 2;
+    acq.row0[3] = 10;
+    acq.col0[3] = 1;
+    CHECK(s->init(&acq) == 0, "init %s", filename);
+    for (k=0; k<n_frames; k++) {
+        CHECK(s->post_frame(&acq, k, (uint32_t*)frames + k*FRAME_SIZE) == 0,
+                "post %i", k);
+        if (flush_every > 0 && k % flush_every == 0)
+            CHECK(s->flush(&acq) == 0, "flush %i", k);
+    }
+    CHECK(s->cleanup(&acq) == 0, "cleanup");
+    mcedata_storage_destroy(s);
+}
+
+static void check_read(mcedata_archive_t *a, const uint32_t *frames,
+        long first, long count, long expect)
+{
+    uint32_t *out = malloc((count + 1) * FRAME_SIZE * 4);
+    long n = mcedata_archive_read(a, first, count, out);
+    CHECK(n == expect, "read %li+%li: %li frames, not %li", first, count,
+            n, expect);
+    if (n == expect && memcmp(out, frames + first * FRAME_SIZE,
+                n * FRAME_SIZE * 4) != 0)
+        CHECK(0, "read %li+%li: wrong data", first, count);
+    free(out);
+}
+
+/* Channels: a header word, data, the checksum, one missing. */
+static void check_channels(mcedata_archive_t *a, const uint32_t *frames,
+        long first, long count, long expect)
+{
+    const int channels[] = { 1, MCEDATA_HEADER + 7, -1, FRAME_SIZE - 1,
+                             MCEDATA_HEADER, MCEDATA_HEADER + 7 };
+    const int n_channels = sizeof(channels) / sizeof(*channels);
+    uint32_t *out = malloc((count + 1) * n_channels * 4);
+    long n = mcedata_archive_read_channels(a, first, count, channels,
+            n_channels, out);
+    long k;
+    int j;
+
+    CHECK(n == expect, "channels %li+%li: %li frames, not %li", first, count,
+            n, expect);
+    for (k=0; k<n && k<expect; k++) {
+        for (j=0; j<n_channels; j++) {
+            uint32_t want = (channels[j] < 0) ? 0 :
+                frames[(first + k) * FRAME_SIZE + channels[j]];
+            if (out[k * n_channels + j] != want) {
+                CHECK(0, "channels %li+%li: frame %li channel %i wrong",
+                        first, count, first + k, channels[j]);
+                k = n;
+                break;
+            }
+        }
+    }
+    free(out);
+}
+
+/* MCE (row, col) to offsets in the frame: RC2 is first, RC4 second. */
+static void check_geometry(mcedata_archive_t *a)
+{
+    const mce_archive_header_t *h = mcedata_archive_header(a);
+    int bad = FRAME_SIZE;
+
+    CHECK(h->cards == CARDS && h->rows == ROWS && h->cols == COLS &&
+            h->row0[3] == 10 && h->col0[3] == 1, "geometry");
+    CHECK(mcedata_archive_channel(a, 3, 10) == MCEDATA_HEADER,
+            "RC2 first channel");
+    CHECK(mcedata_archive_channel(a, 3, 11) == MCEDATA_HEADER + 1,
+            "RC2 second column");
+    CHECK(mcedata_archive_channel(a, 10, 25) == MCEDATA_HEADER + COLS,
+            "RC4 first channel");
+    CHECK(mcedata_archive_channel(a, 13, 29) == MCEDATA_HEADER + N_DATA - 1,
+            "RC4 last channel");
+    CHECK(mcedata_archive_channel(a, 4, 10) == MCEDATA_HEADER + 2*COLS,
+            "RC2 second row");
+    CHECK(mcedata_archive_channel(a, 2, 10) == -1, "above RC2");
+    CHECK(mcedata_archive_channel(a, 3, 15) == -1, "right of RC2");
+    CHECK(mcedata_archive_channel(a, 3, 2) == -1, "RC1");
+    CHECK(mcedata_archive_read_channels(a, 0, 1, &bad, 1, NULL) == -1,
+            "channel past the frame");
+}
+
+static void run(const char *base, int n_frames, int block_frames,
+        int flush_every)
+{
+    char filename[MCE_LONG];
+    uint32_t *frames = make_frames(n_frames);
+    mcedata_archive_t *a;
+    long first;
+
+    sprintf(filename, "%s/n%i_b%i_f%i", base, n_frames, block_frames,
+            flush_every);
+    write_archive(filename, frames, n_frames, block_frames, flush_every);
+
+    a = mcedata_archive_open(filename);
+    CHECK(a != NULL, "open %s", filename);
+    if (a == NULL) {
+        free(frames);
+        return;
+    }
+    CHECK(mcedata_archive_frame_size(a) == FRAME_SIZE, "frame size");
+    CHECK(mcedata_archive_frame_count(a) == n_frames, "%li frames, not %i",
+            mcedata_archive_frame_count(a), n_frames);
+    check_read(a, frames, 0, n_frames, n_frames);
+    check_channels(a, frames, 0, n_frames, n_frames);
+    for (first=0; first<n_frames; first+=37) {
+        long expect = (first + 50 > n_frames) ? n_frames - first : 50;
+        check_read(a, frames, first, 50, expect);
+        check_channels(a, frames, first, 50, expect);
+    }
+    check_read(a, frames, n_frames - 1, 1, 1);
+    check_read(a, frames, 0, 1, 1);
+    check_read(a, frames, n_frames, 10, 0);
+    check_channels(a, frames, n_frames - 1, 1, 1);
+    check_geometry(a);
+    mcedata_archive_close(a);
+    free(frames);
+}
+
+/* Cut the archive in the middle of its last block: the reader finds
+ * the whole blocks before it. */
+static void run_truncated(const char *base)
+{
+    char filename[MCE_LONG];
+    uint32_t *frames = make_frames(1000);
+    mcedata_archive_t *a;
+    FILE *fin;
+    long size;
+
+    sprintf(filename, "%s/truncated", base);
+    write_archive(filename, frames, 1000, 100, 0);
+    fin = fopen(filename, "r");
+    fseek(fin, 0, SEEK_END);
+    size = ftell(fin);
+    fclose(fin);
+    // Drop the index of 10 blocks, the trailer, and 100 bytes more.
+    size -= 10 * (sizeof(mce_archive_index_t) + FRAME_SIZE) +
+        sizeof(mce_archive_trailer_t) + 100;
+    CHECK(truncate(filename, size) == 0, "truncate");
+
+    a = mcedata_archive_open(filename);
+    CHECK(a != NULL, "open %s", filename);
+    if (a != NULL) {
+        CHECK(mcedata_archive_frame_count(a) == 900, "%li frames, not 900",
+                mcedata_archive_frame_count(a));
+        check_read(a, frames, 0, 1000, 900);
+        check_channels(a, frames, 450, 1000, 450);
+        mcedata_archive_close(a);
+    }
+    free(frames);
+}
+
+int main(void)
+{
+    char base[] = "/tmp/mce_test_archive.XXXXXX";
+    char cmd[64];
+
+    memset(&ctx, 0, sizeof(ctx));
+    mcelib_set_termio(&ctx, NULL);
+    if (mkdtemp(base) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    run(base, 1000, 0, 0);              // default block
+    run(base, 1000, 100, 0);            // whole blocks
+    run(base, 1001, 64, 0);             // partial block at the end
+    run(base, 500, 64, 77);             // flushes
+    run(base, 1, 16, 0);                // a single frame
+    run_truncated(base);
+
+    CHECK(mcedata_archive_open("/nonexistent") == NULL, "open nothing");
+
+    sprintf(cmd, "rm -rf %s", base);
+    CHECK(system(cmd) == 0, "%s", cmd);
+    printf("archive: %s\n", failures ? "FAILED" : "ok");
+    return failures != 0;
+}
@@ -0,0 +1,258 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Compressed archive speed and size, for four full RCs (41 rows by 8
+ * columns each) in every data mode: how many frames per second the
+ * writer can encode and store on one core, and read back, whole or
+ * just four channels of each, and the compression ratio.  The data are synthetic, with each data mode's
+ * fields filled from data_mode.def: slow signals with noise in the
+ * feedback and filter fields, noise in the error, rare flux jumps.
+ * Given a recorded flat file (and its frame size), that is used
+ * instead.  Usage: bench_archive [directory [flatfile frame_size]]
+ * (default: the current directory). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <mce_library.h>
+#include "context.h"
+
+#define ROWS 41
+#define COLS 8
+#define N_DATA (MCEDATA_CARDS*ROWS*COLS)
+#define FRAME_SIZE (MCEDATA_HEADER + N_DATA + 1)
+#define N_FRAMES 10000
+#define READ_CHUNK 1000
+#define N_CHANNELS 4
+
+static uint32_t seed = 1;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double uniform(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) / (double)(1 << 24);
+}
+
+/* Roughly normal, unit variance. */
+static double noise(void)
+{
+    return (uniform() + uniform() + uniform() + uniform() - 2.) * 1.732;
+}
+
+/* Fill frames with channels in data mode "mode". */
+static void synthesize(uint32_t *frames, int n_frames, int mode)
+{
+    struct mce_data_field **m;
+    int i, k;
+
+    memset(frames, 0, (size_t)n_frames * FRAME_SIZE * 4);
+    for (k=0; k<n_frames; k++) {
+        uint32_t *h = frames + k * FRAME_SIZE;
+        h[0] = 0x10;                    // status
+        h[1] = k;                       // frame counter
+        h[2] = 100;                     // row_len
+        h[3] = ROWS;
+        h[4] = 38;                      // data_rate
+        h[9] = ROWS;
+    }
+
+    for (m = mce_data_fields; *m != NULL; m++) {
+        int bits = ((*m)->type == DATA_MODE_EXTRACT ||
+                (*m)->type == DATA_MODE_EXTRACT_SCALE) ? (*m)->bit_count : 32;
+        int shift = ((*m)->type == DATA_MODE_EXTRACT ||
+                (*m)->type == DATA_MODE_EXTRACT_SCALE) ? (*m)->bit_start : 0;
+        uint32_t mask = (bits == 32) ? 0xffffffff : (1u << bits) - 1;
+        const char *name = (*m)->name;
+        if ((*m)->data_mode != mode)
+            continue;
+
+        for (i=0; i<N_DATA; i++) {
+            double w = 2 * M_PI / (1000 + 37 * i), c = 1, s = 0;
+            double amp = 0, sigma = 0, offset = 0;
+            int fj = (int)(uniform() * 8) - 4;
+            if (strcmp(name, MCE_DATA_ERROR) == 0)
+                sigma = 40;
+            else if (strcmp(name, MCE_DATA_FB) == 0) {
+                amp = ldexp(1, bits - 4);
+                sigma = ldexp(1, bits - 16);
+            } else if (strcmp(name, MCE_DATA_FILT) == 0) {
+                amp = ldexp(1, bits - 4);
+                sigma = ldexp(1, bits - 20);
+            } else if (strcmp(name, MCE_DATA_RAW) == 0) {
+                offset = 5000;
+                sigma = 100;
+            }
+
+            for (k=0; k<n_frames; k++) {
+                uint32_t *word = frames + k * FRAME_SIZE + MCEDATA_HEADER + i;
+                double t;
+                int32_t v;
+                if (strcmp(name, MCE_DATA_FJ) == 0) {
+                    if (uniform() < 0.001)
+                        fj += (uniform() < 0.5) ? -1 : 1;
+                    v = fj;
+                } else if (strcmp(name, MCE_DATA_ROW) == 0)
+                    v = i % ROWS;
+                else if (strcmp(name, MCE_DATA_COL) == 0)
+                    v = i / ROWS % COLS;
+                else
+                    v = (int32_t)(offset + amp * s + sigma * noise());
+                *word |= ((uint32_t)v & mask) << shift;
+                // Rotate (c, s) by w.
+                t = c * cos(w) - s * sin(w);
+                s = c * sin(w) + s * cos(w);
+                c = t;
+            }
+        }
+    }
+}
+
+static void run(mce_context_t *ctx, const char *dir, const char *label,
+        const uint32_t *frames, int n_frames, int frame_size)
+{
+    char filename[MCE_LONG + 32];
+    uint32_t *out = malloc((size_t)READ_CHUNK * frame_size * 4);
+    mcedata_storage_t *s;
+    mcedata_archive_t *a;
+    int channels[N_CHANNELS] = { MCEDATA_HEADER, MCEDATA_HEADER + 100,
+                                 MCEDATA_HEADER + 700, frame_size - 2 };
+    double t0, t_write, t_read, t_channels;
+    struct stat st;
+    mce_acq_t acq;
+    long k, n;
+    int ok = 1;
+
+    for (k=0; k<N_CHANNELS; k++)
+        channels[k] %= frame_size;      // small recorded frames
+
+    sprintf(filename, "%s/bench_archive.%i", dir, (int)getpid());
+    s = mcedata_archive_create(filename, NULL, 0);
+
+    memset(&acq, 0, sizeof(acq));
+    acq.context = ctx;
+    acq.storage = s;
+    acq.frame_size = frame_size;
+    if (s->init(&acq) != 0) {
+        printf("%-8s init failed\n", label);
+        return;
+    }
+    t0 = now();
+    for (k=0; k<n_frames; k++)
+        s->post_frame(&acq, k, (uint32_t*)frames + k * frame_size);
+    s->cleanup(&acq);
+    t_write = now() - t0;
+    mcedata_storage_destroy(s);
+    stat(filename, &st);
+
+    a = mcedata_archive_open(filename);
+    t0 = now();
+    for (k=0; a!=NULL && k<n_frames; k+=n) {
+        n = mcedata_archive_read(a, k, READ_CHUNK, out);
+        if (n <= 0 || memcmp(out, frames + k * frame_size,
+                    n * frame_size * 4) != 0) {
+            ok = 0;
+            break;
+        }
+    }
+    t_read = now() - t0;
+    t0 = now();
+    for (k=0; a!=NULL && k<n_frames; k+=n) {
+        int j;
+        n = mcedata_archive_read_channels(a, k, READ_CHUNK, channels,
+                N_CHANNELS, out);
+        for (j=0; j<n*N_CHANNELS && ok; j++)
+            ok = (out[j] == frames[(k + j/N_CHANNELS) * frame_size +
+                    channels[j%N_CHANNELS]]);
+        if (n <= 0 || !ok) {
+            ok = 0;
+            break;
+        }
+    }
+    t_channels = now() - t0;
+    mcedata_archive_close(a);
+    unlink(filename);
+    free(out);
+
+    printf("%-8s %12.0f %12.1f %12.0f %12.0f %8.2f%s\n", label,
+            n_frames / t_write, n_frames * (double)frame_size / t_write / 1e6,
+            n_frames / t_read, n_frames / t_channels,
+            (double)n_frames * frame_size * 4 / st.st_size,
+            ok ? "" : "  MISMATCH");
+}
+
+static void print_columns(void)
+{
+    printf("%-8s %12s %12s %12s %12s %8s\n", "", "write fr/s", "write Mw/s",
+            "read fr/s", "4 chan fr/s", "ratio");
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = (argc > 1) ? argv[1] : ".";
+    uint32_t *frames;
+    mce_context_t ctx;
+    char label[16];
+    int modes[32], n_modes = 0;
+    struct mce_data_field **m;
+    int i;
+
+    memset(&ctx, 0, sizeof(ctx));
+    mcelib_set_termio(&ctx, NULL);
+
+    if (argc > 3) {
+        // Recorded data.
+        int frame_size = atoi(argv[3]);
+        FILE *fin = fopen(argv[2], "r");
+        struct stat st;
+        long n_frames;
+        if (fin == NULL || frame_size <= 0 || fstat(fileno(fin), &st)) {
+            perror(argv[2]);
+            return 1;
+        }
+        n_frames = st.st_size / 4 / frame_size;
+        frames = malloc((size_t)n_frames * frame_size * 4);
+        if (frames == NULL ||
+                fread(frames, frame_size * 4, n_frames, fin) != n_frames) {
+            perror(argv[2]);
+            return 1;
+        }
+        fclose(fin);
+        printf("%li frames of %i words from %s\n", n_frames, frame_size,
+                argv[2]);
+        print_columns();
+        run(&ctx, dir, "recorded", frames, n_frames, frame_size);
+        free(frames);
+        return 0;
+    }
+
+    printf("%i frames of %i words (%i channels), synthetic\n", N_FRAMES,
+            FRAME_SIZE, N_DATA);
+    print_columns();
+    for (m = mce_data_fields; *m != NULL; m++) {
+        for (i=0; i<n_modes && modes[i] != (*m)->data_mode; i++);
+        if (i == n_modes)
+            modes[n_modes++] = (*m)->data_mode;
+    }
+    frames = malloc((size_t)N_FRAMES * FRAME_SIZE * 4);
+    for (i=0; i<n_modes; i++) {
+        synthesize(frames, N_FRAMES, modes[i]);
+        sprintf(label, "mode %i", modes[i]);
+        run(&ctx, dir, label, frames, N_FRAMES, FRAME_SIZE);
+    }
+    free(frames);
+    return 0;
+}
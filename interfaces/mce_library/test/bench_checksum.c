@@ -0,0 +1,104 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Frame validation throughput, for frame sizes from a bare header to
+ * the largest packet: the old scalar checksum, the vector checksum,
+ * copy-then-checksum, and the fused copy-checksum. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <mce_library.h>
+#include "context.h"
+
+#define RING_BYTES (32 << 20)
+#define BENCH_SECONDS 0.2
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* The previous implementation, for comparison. */
+static uint32_t legacy_checksum(const uint32_t *data, int count)
+{
+    uint32_t chksum = 0;
+    while (count>0)
+        chksum ^= data[--count];
+    return chksum;
+}
+
+enum { LEGACY, VECTOR, COPY_THEN, FUSED, N_METHODS };
+
+static double run(int method, const uint32_t *ring, int n_slots, int size,
+        uint32_t *dst, uint32_t *sink)
+{
+    double t0 = now(), t;
+    long frames = 0;
+    int i;
+
+    do {
+        for (i=0; i<n_slots; i++) {
+            const uint32_t *f = ring + (size_t)i * size;
+            switch (method) {
+                case LEGACY:
+                    *sink ^= legacy_checksum(f, size);
+                    break;
+                case VECTOR:
+                    *sink ^= mcecmd_checksum(f, size);
+                    break;
+                case COPY_THEN:
+                    memcpy(dst, f, size * sizeof(*dst));
+                    *sink ^= mcecmd_checksum(dst, size);
+                    break;
+                case FUSED:
+                    *sink ^= mcecmd_copy_checksum(dst, f, size);
+                    break;
+            }
+        }
+        frames += n_slots;
+    } while ((t = now() - t0) < BENCH_SECONDS);
+    return frames / t;
+}
+
+int main()
+{
+    static const int sizes[] = {44, 52, 108, 300, 372, 700, 1028, 1356,
+                                2048, 4096};
+    static const char *names[N_METHODS] = {
+        "scalar", "vector", "copy+vec", "fused" };
+    uint32_t *ring = malloc(RING_BYTES);
+    uint32_t *dst = malloc(MCEDATA_PACKET_MAX * sizeof(uint32_t));
+    uint32_t sink = 0;
+    int i, k, m;
+
+    for (i=0; i<RING_BYTES / (int)sizeof(uint32_t); i++)
+        ring[i] = i * 2654435761u;
+
+    printf("Frames/s (and GB/s) from a %i MB ring\n", RING_BYTES >> 20);
+    printf("%6s", "dwords");
+    for (m=0; m<N_METHODS; m++)
+        printf(" %20s", names[m]);
+    printf("\n");
+
+    for (k=0; k<sizeof(sizes)/sizeof(sizes[0]); k++) {
+        int size = sizes[k];
+        int n_slots = RING_BYTES / (size * sizeof(uint32_t));
+        printf("%6i", size);
+        for (m=0; m<N_METHODS; m++) {
+            double fps = run(m, ring, n_slots, size, dst, &sink);
+            printf(" %11.0f (%5.2f)", fps, fps * size * 4 / 1e9);
+        }
+        printf("\n");
+    }
+
+    free(ring);
+    free(dst);
+    return sink == 0x12345678;
+}
@@ -0,0 +1,99 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Capacity of the dirfile writer: how many frames per second it can
+ * store, flat out, for one to four full RCs (41 rows by 8 columns
+ * each), and so how many channel samples per second; then four RCs
+ * with writer pools of increasing size.  The time includes cleanup, so
+ * the data have all been handed to the kernel.  Usage: bench_dirfile
+ * [directory] (default: the current directory). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <mce_library.h>
+#include "context.h"
+
+#define ROWS 41
+#define COLS 8
+#define N_FRAMES 20000
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run(mce_context_t *ctx, const char *dir, int n_cards,
+        int n_workers)
+{
+    static uint32_t frame[MCEDATA_HEADER + MCEDATA_CARDS*ROWS*COLS + 1];
+    int n_fields = 13 + n_cards*ROWS*COLS + 1;
+    char name[MCE_LONG + 32];
+    mcedata_storage_t *s;
+    double t0, t;
+    mce_acq_t acq;
+    int i;
+
+    sprintf(name, "%s/rc%i_w%i", dir, n_cards, n_workers);
+    s = mcedata_dirfile_create(name, 0, NULL, 1, 0, NULL);
+    mcedata_dirfile_set_workers(s, n_workers);
+
+    memset(&acq, 0, sizeof(acq));
+    acq.context = ctx;
+    acq.storage = s;
+    acq.frame_size = MCEDATA_HEADER + n_cards*ROWS*COLS + 1;
+    acq.cards = (1 << n_cards) - 1;
+    acq.n_cards = n_cards;
+    acq.rows = ROWS;
+    acq.cols = COLS;
+
+    if (s->init(&acq) != 0) {
+        printf("%i RC: init failed\n", n_cards);
+        return;
+    }
+    t0 = now();
+    for (i=0; i<N_FRAMES; i++) {
+        frame[0] = i;
+        acq.frame_time.mono_ns = i;
+        s->post_frame(&acq, i, frame);
+    }
+    s->cleanup(&acq);
+    t = now() - t0;
+    mcedata_storage_destroy(s);
+
+    printf("%4i %8i %8i %12.0f %12.1f\n", n_cards, n_fields, n_workers,
+            N_FRAMES / t, N_FRAMES * n_fields / t / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = (argc > 1) ? argv[1] : ".";
+    char base[MCE_LONG], cmd[MCE_LONG + 16];
+    mce_context_t ctx;
+    int n;
+
+    memset(&ctx, 0, sizeof(ctx));
+    mcelib_set_termio(&ctx, NULL);
+    sprintf(base, "%s/bench_dirfile.XXXXXX", dir);
+    if (mkdtemp(base) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    printf("%i frames to %s\n", N_FRAMES, dir);
+    printf("%4s %8s %8s %12s %12s\n", "RCs", "fields", "workers",
+            "frames/s", "Msamples/s");
+    for (n=1; n<=MCEDATA_CARDS; n*=2)
+        run(&ctx, base, n, 0);
+    for (n=1; n<=8; n*=2)
+        run(&ctx, base, MCEDATA_CARDS, n);
+
+    sprintf(cmd, "rm -rf %s", base);
+    return system(cmd);
+}
@@ -0,0 +1,91 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Sustained write rate of the flat file writers, for large frames.
+ * "cached" is the rate the acquisition loop sees (until cleanup);
+ * "on disk" includes an fdatasync of the result.  Usage:
+ * bench_flatfile [directory] (default: the current directory). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <mce_library.h>
+#include "context.h"
+
+#define FRAME_SIZE 4096         /* dwords */
+#define N_FRAMES 16384          /* 256 MB */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run(mce_context_t *ctx, const char *label,
+        const char *filename, mcedata_storage_t *s)
+{
+    static uint32_t frame[FRAME_SIZE];
+    double mb = (double)N_FRAMES * FRAME_SIZE * sizeof(uint32_t) / 1e6;
+    double t0, t_cached, t_disk;
+    char time_file[MCE_LONG];
+    mce_acq_t acq;
+    int i, fd;
+
+    memset(&acq, 0, sizeof(acq));
+    acq.context = ctx;
+    acq.storage = s;
+    acq.frame_size = FRAME_SIZE;
+    unlink(filename);
+
+    t0 = now();
+    if (s->init(&acq) != 0) {
+        printf("%-22s init failed: %s\n", label, acq.errstr);
+        return;
+    }
+    for (i=0; i<N_FRAMES; i++) {
+        frame[0] = i;
+        s->post_frame(&acq, i, frame);
+    }
+    s->cleanup(&acq);
+    t_cached = now() - t0;
+
+    fd = open(filename, O_RDONLY);
+    fdatasync(fd);
+    close(fd);
+    t_disk = now() - t0;
+
+    printf("%-22s %10.0f %10.0f\n", label, mb / t_cached, mb / t_disk);
+    mcedata_storage_destroy(s);
+    unlink(filename);
+    sprintf(time_file, "%s.time", filename);
+    unlink(time_file);
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = (argc > 1) ? argv[1] : ".";
+    char filename[MCE_LONG];
+    mce_context_t ctx;
+
+    memset(&ctx, 0, sizeof(ctx));
+    mcelib_set_termio(&ctx, NULL);
+    sprintf(filename, "%s/bench_flatfile.dat", dir);
+
+    printf("%i frames of %i dwords to %s; MB/s\n", N_FRAMES, FRAME_SIZE,
+            dir);
+    printf("%-22s %10s %10s\n", "", "cached", "on disk");
+    run(&ctx, "flatfile", filename, mcedata_flatfile_create(filename, NULL));
+    run(&ctx, "buffered", filename,
+            mcedata_flatfile_buffered_create(filename, NULL, 0, 0));
+    run(&ctx, "buffered, O_DIRECT", filename,
+            mcedata_flatfile_buffered_create(filename, NULL, 0,
+                MCEDATA_FLATFILE_DIRECT));
+    return 0;
+}
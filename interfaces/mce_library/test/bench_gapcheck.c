@@ -0,0 +1,92 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Cost of the frame continuity check, per frame, on synthetic frame
+ * streams with gaps injected at various rates.  The baseline loop
+ * touches the same header words without checking them. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "gapcheck.h"
+
+#define FRAME_SIZE (MCEDATA_HEADER + 8*33 + MCEDATA_FOOTER)
+#define N_SLOTS 16384
+#define PASSES 64
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Write the next N_SLOTS frame headers, dropping a frame every
+ * "every" frames (never, if 0). */
+static void fill(uint32_t *ring, uint32_t *counter, uint32_t *sync,
+        int every)
+{
+    int i;
+    for (i=0; i<N_SLOTS; i++) {
+        uint32_t *f = ring + (size_t)i * FRAME_SIZE;
+        if (every > 0 && (*counter % every) == every - 1) {
+            ++*counter;
+            *sync += 47;
+        }
+        f[frame_header_v6.frame_counter & FRAME_OFFSET_MASK] = (*counter)++;
+        f[frame_header_v6.sync_number & FRAME_OFFSET_MASK] = *sync;
+        *sync += 47;
+    }
+}
+
+int main()
+{
+    static const int rates[] = { 0, 100000, 1000, 10 };
+    uint32_t *ring = calloc((size_t)N_SLOTS * FRAME_SIZE, sizeof(uint32_t));
+    uint32_t sink = 0;
+    int r, p, i;
+
+    printf("%10s %12s %12s %12s %10s\n", "gap every", "base ns/fr",
+            "check ns/fr", "extra ns/fr", "events");
+
+    for (r=0; r<sizeof(rates)/sizeof(rates[0]); r++) {
+        uint32_t counter = 0, sync = 0;
+        double t_base = 0, t_check = 0, t0;
+        gapcheck_t g;
+        memset(&g, 0, sizeof(g));
+
+        for (p=0; p<PASSES; p++) {
+            fill(ring, &counter, &sync, rates[r]);
+
+            t0 = now();
+            for (i=0; i<N_SLOTS; i++) {
+                const uint32_t *f = ring + (size_t)i * FRAME_SIZE;
+                sink += frame_property(f, &frame_header_v6, frame_counter) ^
+                    frame_property(f, &frame_header_v6, sync_number);
+            }
+            t_base += now() - t0;
+
+            t0 = now();
+            for (i=0; i<N_SLOTS; i++) {
+                const uint32_t *f = ring + (size_t)i * FRAME_SIZE;
+                sink += gapcheck_frame(&g, (long long)p * N_SLOTS + i, f);
+            }
+            t_check += now() - t0;
+        }
+
+        printf("%10i %12.2f %12.2f %12.2f %10i\n", rates[r],
+                t_base * 1e9 / (PASSES * N_SLOTS),
+                t_check * 1e9 / (PASSES * N_SLOTS),
+                (t_check - t_base) * 1e9 / (PASSES * N_SLOTS),
+                g.gap_events + g.sync_events);
+    }
+
+    free(ring);
+    return sink == 0x12345678;
+}
@@ -0,0 +1,143 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Throughput of network frame streaming over loopback, to one
+ * subscriber taking whole frames or to several taking a few channels
+ * each.  post_frame skips a frame rather than wait for the server
+ * thread, and a subscriber that falls behind is dropped, so here the
+ * acquisition side posts a skipped frame again until it gets in, and
+ * keeps no more than AHEAD frames ahead of the slowest subscriber:
+ * the rates are what can be sustained, end to end. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <mce_library.h>
+#include "context.h"
+
+#define FRAME_SIZE (MCEDATA_HEADER + 41 * 32 + 1)  /* 4 RCs, 41 rows */
+#define N_FRAMES 100000
+#define AHEAD 512
+
+static char addr[64];
+static int subscribed;
+
+struct subscriber {
+    const char *request;
+    mcedata_netclient_t *c;
+    long long words;
+    int received;
+    int done;
+};
+
+static void *subscribe(void *arg)
+{
+    struct subscriber *s = arg;
+    mcedata_netclient_t *c = s->c;
+    uint32_t data[FRAME_SIZE];
+    mce_netserve_msg_t msg;
+
+    if (c != NULL)
+        mcedata_netclient_read(c, &msg, data, FRAME_SIZE);
+    __atomic_add_fetch(&subscribed, 1, __ATOMIC_SEQ_CST);
+    while (c != NULL &&
+            mcedata_netclient_read(c, &msg, data, FRAME_SIZE) ==
+            MCE_NETSERVE_FRAME) {
+        s->words += msg.n_words;
+        __atomic_add_fetch(&s->received, 1, __ATOMIC_SEQ_CST);
+        if (msg.frame_index == N_FRAMES - 1)
+            break;
+    }
+    mcedata_netclient_close(c);
+    __atomic_store_n(&s->done, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run(const char *label, const char *request, int n_subs)
+{
+    struct subscriber subs[8];
+    pthread_t threads[8];
+    mce_context_t ctx;
+    mce_acq_t acq;
+    uint32_t frame[FRAME_SIZE];
+    long long words = 0, skipped;
+    double t;
+    int i, k;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.flags = MCELIB_QUIET;
+    memset(&acq, 0, sizeof(acq));
+    memset(frame, 0x5a, sizeof(frame));
+    acq.context = &ctx;
+    acq.frame_size = FRAME_SIZE;
+    acq.cards = MCEDATA_RCS;
+    acq.rows = 41;
+    acq.cols = 8;
+    acq.storage = mcedata_netserve_create("127.0.0.1:0", 0);
+    if (acq.storage->init(&acq) != 0) {
+        printf("%s: %s\n", label, acq.errstr);
+        exit(1);
+    }
+    sprintf(addr, "127.0.0.1:%i", mcedata_netserve_port(acq.storage));
+
+    subscribed = 0;
+    for (i=0; i<n_subs; i++) {
+        memset(subs + i, 0, sizeof(subs[i]));
+        subs[i].request = request;
+        subs[i].c = mcedata_netclient_open(addr, request);
+        pthread_create(threads + i, NULL, subscribe, subs + i);
+    }
+    while (__atomic_load_n(&subscribed, __ATOMIC_SEQ_CST) < n_subs)
+        usleep(1000);
+
+    t = now();
+    for (k=0; k<N_FRAMES; k++) {
+        for (i=0; i<n_subs; i++)
+            while (k - __atomic_load_n(&subs[i].received, __ATOMIC_SEQ_CST)
+                    > AHEAD && !__atomic_load_n(&subs[i].done,
+                        __ATOMIC_SEQ_CST))
+                sched_yield();
+        skipped = mcedata_netserve_skipped(acq.storage);
+        acq.storage->post_frame(&acq, k, frame);
+        while (mcedata_netserve_skipped(acq.storage) != skipped) {
+            sched_yield();
+            skipped = mcedata_netserve_skipped(acq.storage);
+            acq.storage->post_frame(&acq, k, frame);
+        }
+    }
+    for (i=0; i<n_subs; i++) {
+        pthread_join(threads[i], NULL);
+        words += subs[i].words;
+    }
+    t = now() - t;
+
+    printf("%-24s %10.0f %10.1f %10lli\n", label, subs[0].received / t,
+            words * 4e-6 / t, mcedata_netserve_dropped(acq.storage));
+    acq.storage->cleanup(&acq);
+    mcedata_storage_destroy(acq.storage);
+}
+
+int main()
+{
+    printf("%i frames of %i words\n", N_FRAMES, FRAME_SIZE);
+    printf("%-24s %10s %10s %10s\n", "", "frames/s", "MB/s", "dropped");
+    run("1 x whole frames", "SUBSCRIBE", 1);
+    run("4 x whole frames", "SUBSCRIBE", 4);
+    run("4 x 8 channels", "SUBSCRIBE CHANNELS 43 44 45 46 47 48 49 50", 4);
+    run("4 x headers", "SUBSCRIBE HEADER", 4);
+    return 0;
+}
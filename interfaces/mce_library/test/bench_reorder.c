@@ -0,0 +1,156 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Compare frame reordering by plan (one pass, into a separate buffer)
+ * with the old in-place sort_columns, for 1-4 readout cards and a few
+ * readout rectangle sizes.  Frames are taken from a ring of slots
+ * larger than the cache, as they would be from the driver buffer. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "frame_manip.h"
+
+#define N_SLOTS 1024
+#define BENCH_SECONDS 0.25
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int count_bits(int bits)
+{
+    int c = 0;
+    for (; bits != 0; bits >>= 1)
+        c += bits & 1;
+    return c;
+}
+
+/* The previous implementation, for comparison. */
+static int legacy_sort_columns(mce_acq_t *acq, uint32_t *data)
+{
+    uint32_t temp[MCEDATA_PACKET_MAX];
+    int header_size = MCEDATA_HEADER;
+    int footer_size = MCEDATA_FOOTER;
+    int columns = acq->cols;
+    int cards_in = count_bits(acq->cards);
+    int cards_out = cards_in;
+    int rows = (acq->frame_size - header_size - footer_size) /
+        columns / cards_in;
+    int data_size_out = cards_out*rows*columns;
+    int data_size_in = cards_out*rows*columns;
+    int c, r, c_in = 0;
+
+    if (cards_out == 1 && cards_in == 1)
+        return 0;
+
+    memcpy(temp, data, header_size*sizeof(*temp));
+    memset(temp + header_size, 0, data_size_out*sizeof(*temp));
+    memcpy(temp + header_size + data_size_out,
+            data + header_size + data_size_in,
+            footer_size*sizeof(*temp));
+    for (c=0; c<cards_out; c++) {
+        if ( (acq->cards & (1 << c)) == 0 )
+            continue;
+        for (r=0; r<rows; r++) {
+            memcpy(temp+header_size + (r*cards_out + c)*columns,
+                    data+header_size + (rows*c_in + r)*columns,
+                    columns*sizeof(*temp));
+        }
+        c_in++;
+    }
+    memcpy(data, temp,
+            (header_size+footer_size+data_size_out)*sizeof(*data));
+    return 0;
+}
+
+static void bench(int n_cards, int rows, int cols)
+{
+    mce_acq_t acq;
+    frame_reorder_t *plan;
+    uint32_t *slots, *check, *dst;
+    uint32_t sink = 0;
+    double t0, t_old, t_new;
+    long n_old = 0, n_new = 0;
+    int i;
+
+    memset(&acq, 0, sizeof(acq));
+    acq.cards = (1 << n_cards) - 1;
+    acq.n_cards = n_cards;
+    acq.rows = rows;
+    acq.cols = cols;
+    acq.frame_size = rows*cols*n_cards + MCEDATA_HEADER + MCEDATA_FOOTER;
+
+    plan = frame_reorder_create(&acq);
+    slots = malloc((size_t)N_SLOTS * acq.frame_size * sizeof(uint32_t));
+    check = malloc(MCEDATA_PACKET_MAX * sizeof(uint32_t));
+    dst = malloc(MCEDATA_PACKET_MAX * sizeof(uint32_t));
+    for (i=0; i<N_SLOTS * acq.frame_size; i++)
+        slots[i] = i * 2654435761u;
+
+    /* Same answer as before? */
+    memcpy(check, slots, acq.frame_size * sizeof(uint32_t));
+    legacy_sort_columns(&acq, check);
+    frame_reorder_apply(plan, dst, slots);
+    if (memcmp(check, dst, acq.frame_size * sizeof(uint32_t)) != 0)
+        printf("MISMATCH: cards=%i rows=%i cols=%i\n", n_cards, rows, cols);
+
+    /* Old: sort in place in the slot (storage reads the slot). */
+    t0 = now();
+    do {
+        for (i=0; i<N_SLOTS; i++) {
+            uint32_t *f = slots + (size_t)i * acq.frame_size;
+            legacy_sort_columns(&acq, f);
+            sink ^= f[MCEDATA_HEADER];
+        }
+        n_old += N_SLOTS;
+    } while ((t_old = now() - t0) < BENCH_SECONDS);
+
+    /* New: plan from the slot into the storage buffer, or no copy at
+     * all when the order is already right (as copy_one_frame does). */
+    t0 = now();
+    do {
+        for (i=0; i<N_SLOTS; i++) {
+            const uint32_t *f = slots + (size_t)i * acq.frame_size;
+            if (!plan->identity) {
+                frame_reorder_apply(plan, dst, f);
+                f = dst;
+            }
+            sink ^= f[MCEDATA_HEADER];
+        }
+        n_new += N_SLOTS;
+    } while ((t_new = now() - t0) < BENCH_SECONDS);
+
+    printf("%5i %5i %5i %6i %12.0f %12.0f %8.2f%s\n",
+            n_cards, rows, cols, acq.frame_size,
+            n_old / t_old, n_new / t_new, (n_new / t_new) / (n_old / t_old),
+            sink == 0x12345678 ? " " : "");
+
+    frame_reorder_destroy(plan);
+    free(slots);
+    free(check);
+    free(dst);
+}
+
+int main()
+{
+    static const int shapes[][2] = {
+        {41, 8}, {33, 8}, {8, 8}, {41, 4}, {33, 2}, {1, 8} };
+    int n_cards, k;
+
+    printf("%5s %5s %5s %6s %12s %12s %8s\n", "cards", "rows", "cols",
+            "dwords", "old fr/s", "plan fr/s", "speedup");
+    for (n_cards=1; n_cards<=MCEDATA_CARDS; n_cards++)
+        for (k=0; k<sizeof(shapes)/sizeof(shapes[0]); k++)
+            bench(n_cards, shapes[k][0], shapes[k][1]);
+    return 0;
+}
@@ -0,0 +1,136 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Cost of post_frame for fileseq and dirfileseq, which change files
+ * every INTERVAL frames: "max" is the worst of the other frames,
+ * "switch" the worst of those that change files.  The dirfiles are
+ * four full RCs (1312 detector fields), so each one is some 1300
+ * files.  Frames are posted every PERIOD_NS, a fast MCE frame rate, to
+ * give the background work the time it would have.  Usage:
+ * bench_rotate [directory] (default: the current directory). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mce_library.h>
+#include "context.h"
+
+#define ROWS 41
+#define COLS 8
+#define FRAME_SIZE (MCEDATA_HEADER + MCEDATA_CARDS*ROWS*COLS + 1)
+#define INTERVAL 4000           /* 1 s */
+#define N_FRAMES 20000          /* 5 files */
+#define PERIOD_NS 250000        /* 4 kHz */
+
+static double post_us[N_FRAMES];
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int by_value(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void run(mce_context_t *ctx, const char *label, mcedata_storage_t *s)
+{
+    static uint32_t frame[FRAME_SIZE];
+    double t0, t, t_cleanup;
+    double switch_max = 0;
+    struct timespec next;
+    mce_acq_t acq;
+    int i;
+
+    memset(&acq, 0, sizeof(acq));
+    acq.context = ctx;
+    acq.storage = s;
+    acq.frame_size = FRAME_SIZE;
+    acq.cards = MCEDATA_RCS;
+    acq.n_cards = MCEDATA_CARDS;
+    acq.rows = ROWS;
+    acq.cols = COLS;
+
+    if (s->init(&acq) != 0) {
+        printf("%-24s init failed: %s\n", label, acq.errstr);
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (i=0; i<N_FRAMES; i++) {
+        next.tv_nsec += PERIOD_NS;
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        frame[0] = i;
+        t0 = now();
+        s->post_frame(&acq, i, frame);
+        t = (now() - t0) * 1e6;
+        // The sequencers change files on these frames.
+        if (i > 0 && i % INTERVAL == 0) {
+            if (t > switch_max)
+                switch_max = t;
+            t = 0;
+        }
+        post_us[i] = t;
+    }
+    t0 = now();
+    s->cleanup(&acq);
+    t_cleanup = (now() - t0) * 1e3;
+    mcedata_storage_destroy(s);
+
+    qsort(post_us, N_FRAMES, sizeof(*post_us), by_value);
+    printf("%-24s %9.1f %9.1f %9.0f %9.0f %11.1f\n", label,
+            post_us[N_FRAMES/2], post_us[N_FRAMES*99/100],
+            post_us[N_FRAMES-1], switch_max, t_cleanup);
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = (argc > 1) ? argv[1] : ".";
+    char base[MCE_LONG], name[MCE_LONG + 32];
+    mce_context_t ctx;
+    int i;
+
+    memset(&ctx, 0, sizeof(ctx));
+    mcelib_set_termio(&ctx, NULL);
+    sprintf(base, "%s/bench_rotate.XXXXXX", dir);
+    if (mkdtemp(base) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    printf("%i frames of %i dwords, a new file every %i; "
+            "post_frame in us, cleanup in ms\n",
+            N_FRAMES, FRAME_SIZE, INTERVAL);
+    printf("%-24s %9s %9s %9s %9s %11s\n", "", "median", "99%",
+            "max", "switch", "cleanup");
+
+    sprintf(name, "%s/fs", base);
+    run(&ctx, "fileseq", mcedata_fileseq_create(name, INTERVAL, 3, NULL));
+    sprintf(name, "%s/fsp", base);
+    run(&ctx, "fileseq, preallocated",
+            mcedata_fileseq_create_options(name, INTERVAL, 3, NULL,
+                MCEDATA_SEQ_PREALLOCATE));
+    sprintf(name, "%s/dfs", base);
+    run(&ctx, "dirfileseq", mcedata_dirfileseq_create(name, INTERVAL, 3, 0,
+                NULL, 1, 0, NULL));
+    sprintf(name, "%s/dfsp", base);
+    run(&ctx, "dirfileseq, preallocated",
+            mcedata_dirfileseq_create(name, INTERVAL, 3,
+                MCEDATA_SEQ_PREALLOCATE, NULL, 1, 0, NULL));
+
+    sprintf(name, "rm -rf %s", base);
+    i = system(name);
+    return i;
+}
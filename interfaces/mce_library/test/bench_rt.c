@@ -0,0 +1,112 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Wake-up jitter of a simulated acquisition loop, with and without
+ * the real-time tuning of rt.h.  The loop wakes every PERIOD_US and
+ * stores a frame into a large buffer, which has not been touched
+ * before, while every CPU is kept busy by other threads.  Settings
+ * that can't be applied here are reported, and the "tuned" run then
+ * shows only what was. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "rt.h"
+
+#define PERIOD_US 100
+#define WAKEUPS 20000
+#define FRAME_BYTES 4096
+#define BUFFER_BYTES ((size_t)WAKEUPS * FRAME_BYTES)
+
+static volatile int stop_load;
+
+static void *load(void *arg)
+{
+    volatile unsigned long x = 0;
+    while (!stop_load)
+        x++;
+    return NULL;
+}
+
+static int cmp_long(const void *a, const void *b)
+{
+    long x = *(const long*)a, y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+static void run(mce_context_t *ctx, const char *label)
+{
+    static long late[WAKEUPS];
+    struct rt_saved *rt;
+    struct timespec next, now;
+    char frame[FRAME_BYTES];
+    char *buffer = malloc(BUFFER_BYTES);
+    int i;
+
+    memset(frame, 0x5a, sizeof(frame));
+    rt_lock(ctx, buffer, BUFFER_BYTES);
+    rt = rt_thread_enter(ctx, RT_ACQ);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (i=0; i<WAKEUPS; i++) {
+        next.tv_nsec += PERIOD_US * 1000;
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        late[i] = (now.tv_sec - next.tv_sec) * 1000000000L +
+            now.tv_nsec - next.tv_nsec;
+        memcpy(buffer + (size_t)i * FRAME_BYTES, frame, FRAME_BYTES);
+    }
+
+    rt_thread_leave(rt);
+    free(buffer);
+
+    qsort(late, WAKEUPS, sizeof(late[0]), cmp_long);
+    printf("%-8s %10.1f %10.1f %10.1f %10.1f\n", label,
+            late[WAKEUPS / 2] * 1e-3, late[WAKEUPS * 99 / 100] * 1e-3,
+            late[WAKEUPS * 999 / 1000] * 1e-3, late[WAKEUPS - 1] * 1e-3);
+}
+
+int main()
+{
+    int n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    pthread_t *loaders = calloc(n_cpus, sizeof(pthread_t));
+    mce_context_t ctx;
+    int i;
+
+    memset(&ctx, 0, sizeof(ctx));
+    mcelib_set_termio(&ctx, NULL);
+
+    for (i=0; i<n_cpus; i++)
+        pthread_create(loaders + i, NULL, load, NULL);
+
+    printf("%i wake-ups every %i us, %i CPUs busy; lateness in us\n",
+            WAKEUPS, PERIOD_US, n_cpus);
+    printf("%-8s %10s %10s %10s %10s\n", "", "median", "99%", "99.9%",
+            "max");
+
+    run(&ctx, "default");
+
+    ctx.rt.acq_cpus[0] = n_cpus - 1;
+    ctx.rt.n_acq_cpus = 1;
+    ctx.rt.priority = 50;
+    ctx.rt.lock_memory = 1;
+    run(&ctx, "tuned");
+
+    stop_load = 1;
+    for (i=0; i<n_cpus; i++)
+        pthread_join(loaders[i], NULL);
+    free(loaders);
+    return 0;
+}
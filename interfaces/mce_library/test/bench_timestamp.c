@@ -0,0 +1,62 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Cost of host timestamping, per frame.  The acquisition loop reads
+ * the clocks once per poll and hands the time to every frame found,
+ * so the cost per frame depends on how many frames each poll finds;
+ * one per poll is the worst case.  The budget is 50 ns per frame. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "stats.h"
+
+#define FRAMES (1 << 22)
+#define BUDGET_NS 50.
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main()
+{
+    static const int batches[] = { 1, 4, 16, 64 };
+    mce_acq_t acq;
+    mce_host_time_t arrival;
+    host_clock_t clock;
+    int64_t sink = 0;
+    double worst = 0;
+    int b, i, j;
+
+    memset(&acq, 0, sizeof(acq));
+    memset(&clock, 0, sizeof(clock));
+    printf("%10s %12s\n", "frames/poll", "ns/frame");
+
+    for (b=0; b<sizeof(batches)/sizeof(batches[0]); b++) {
+        double t0 = now(), ns;
+        for (i=0; i<FRAMES; i+=batches[b]) {
+            acq_host_time(&clock, &arrival);
+            for (j=0; j<batches[b]; j++) {
+                acq.frame_time = arrival;
+                sink += acq.frame_time.mono_ns;
+            }
+        }
+        ns = (now() - t0) * 1e9 / FRAMES;
+        if (ns > worst)
+            worst = ns;
+        printf("%10i %12.2f\n", batches[b], ns);
+    }
+
+    printf("worst case %.2f ns/frame (budget %.0f)%s\n", worst, BUDGET_NS,
+            worst > BUDGET_NS ? " - OVER BUDGET" : "");
+    return sink == 0x12345678;
+}
@@ -0,0 +1,22 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+#ifndef _CHECK_H_
+#define _CHECK_H_
+
+/* CHECK(cond, format, ...) - report a failed check, with the printf
+ * style message, and count it; each test returns failures != 0. */
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%i: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } } while (0)
+
+#endif
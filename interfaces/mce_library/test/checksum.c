@@ -0,0 +1,77 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Check the vector checksum and copy-checksum routines, and the
+ * checksum returned by frame reordering, against a plain XOR loop at
+ * every length and alignment. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "frame_manip.h"
+#include "check.h"
+
+static uint32_t plain_xor(const uint32_t *data, int count)
+{
+    uint32_t x = 0;
+    while (count > 0)
+        x ^= data[--count];
+    return x;
+}
+
+int main()
+{
+    static uint32_t src[MCEDATA_PACKET_MAX + 8], dst[MCEDATA_PACKET_MAX + 8];
+    int i, n, a, cards;
+
+    srand(1);
+    for (i=0; i<MCEDATA_PACKET_MAX + 8; i++)
+        src[i] = ((uint32_t)rand() << 16) ^ rand();
+
+    for (a=0; a<4; a++) {
+        for (n=0; n<300; n++) {
+            uint32_t x = plain_xor(src + a, n);
+            CHECK(mcecmd_checksum(src + a, n) == x,
+                    "checksum n=%i align=%i", n, a);
+            memset(dst, 0xa5, sizeof(dst));
+            CHECK(mcecmd_copy_checksum(dst + (3-a), src + a, n) == x,
+                    "copy_checksum n=%i align=%i", n, a);
+            CHECK(memcmp(dst + (3-a), src + a, n*sizeof(*dst)) == 0,
+                    "copy_checksum data n=%i align=%i", n, a);
+            CHECK(dst[3 - a + n] == 0xa5a5a5a5,
+                    "copy_checksum overrun n=%i align=%i", n, a);
+        }
+    }
+    CHECK(mcecmd_checksum(src, MCEDATA_PACKET_MAX) ==
+            plain_xor(src, MCEDATA_PACKET_MAX), "checksum max size");
+
+    // Reordering checksums the whole frame.
+    for (cards=1; cards<MCEDATA_COMBOS; cards++) {
+        static const int cols[3] = {8, 3, 1};
+        for (i=0; i<3; i++) {
+            mce_acq_t acq;
+            frame_reorder_t *plan;
+            memset(&acq, 0, sizeof(acq));
+            acq.cards = cards;
+            acq.n_cards = __builtin_popcount(cards);
+            acq.rows = 33;
+            acq.cols = cols[i];
+            acq.frame_size = acq.rows*acq.cols*acq.n_cards +
+                MCEDATA_HEADER + MCEDATA_FOOTER;
+            plan = frame_reorder_create(&acq);
+            CHECK(frame_reorder_apply(plan, dst, src) ==
+                    plain_xor(src, acq.frame_size),
+                    "reorder checksum cards=%#x cols=%i", cards, cols[i]);
+            frame_reorder_destroy(plan);
+        }
+    }
+
+    if (failures == 0)
+        printf("checksum: ok\n");
+    return failures != 0;
+}
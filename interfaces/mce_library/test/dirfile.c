@@ -0,0 +1,434 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Check the contents of dirfile fields: every sample of every field
+ * in order, for block sizes that do and don't divide the frame count,
+ * with flushes part way through.  The writer pool must produce exactly
+ * the same files as the serial writer.  Then the same for decimated
+ * fields and their summaries, and for unpacked data mode fields. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "check.h"
+
+#define ROWS 5
+#define COLS 3
+#define N_DATA (2*ROWS*COLS)            /* RC1 and RC3 */
+#define FRAME_SIZE (MCEDATA_HEADER + N_DATA + 1)
+
+static mce_context_t ctx;
+
+/* Odd frames are negative, as signed values, to tell signed and
+ * unsigned fields' minima and maxima apart. */
+static uint32_t sample(int frame, int offset)
+{
+    uint32_t v = frame * 7919 + offset;
+    return (frame & 1) ? -v : v;
+}
+
+/* Check that field "name" holds sample(i, offset) for i < n_frames. */
+static void check_field(const char *dir, const char *name, int offset,
+        int n_frames)
+{
+    char filename[MCE_LONG + 64];
+    uint32_t *data = malloc((n_frames + 1) * sizeof(*data));
+    FILE *fin;
+    int i, n;
+
+    sprintf(filename, "%s/%s", dir, name);
+    fin = fopen(filename, "r");
+    CHECK(fin != NULL, "open %s", filename);
+    if (fin == NULL) {
+        free(data);
+        return;
+    }
+    n = fread(data, sizeof(*data), n_frames + 1, fin);
+    fclose(fin);
+
+    CHECK(n == n_frames, "%s: %i samples, not %i", name, n, n_frames);
+    for (i=0; i<n && i<n_frames; i++)
+        if (data[i] != sample(i, offset)) {
+            CHECK(0, "%s[%i] = %u, not %u", name, i, data[i],
+                    sample(i, offset));
+            break;
+        }
+    free(data);
+}
+
+static void check_times(const char *dir, int n_frames)
+{
+    char filename[MCE_LONG + 64];
+    int64_t *t = malloc((n_frames + 1) * sizeof(*t));
+    FILE *fin;
+    int i, n;
+
+    sprintf(filename, "%s/host_mono_ns", dir);
+    fin = fopen(filename, "r");
+    CHECK(fin != NULL, "open %s", filename);
+    if (fin == NULL) {
+        free(t);
+        return;
+    }
+    n = fread(t, sizeof(*t), n_frames + 1, fin);
+    fclose(fin);
+
+    CHECK(n == n_frames, "host_mono_ns: %i samples, not %i", n, n_frames);
+    for (i=0; i<n && i<n_frames; i++)
+        if (t[i] != 1000 * i) {
+            CHECK(0, "host_mono_ns[%i] = %lli", i, (long long)t[i]);
+            break;
+        }
+    free(t);
+}
+
+/* Read up to n items of size bytes from dir/name; returns the count,
+ * or -1. */
+static int read_field(const char *dir, const char *name, void *data,
+        int size, int n)
+{
+    char filename[MCE_LONG + 64];
+    FILE *fin;
+
+    sprintf(filename, "%s/%s", dir, name);
+    fin = fopen(filename, "r");
+    CHECK(fin != NULL, "open %s", filename);
+    if (fin == NULL)
+        return -1;
+    n = fread(data, size, n, fin);
+    fclose(fin);
+    return n;
+}
+
+/* The spf that the format file gives field name, or -1. */
+static int format_spf(const char *dir, const char *name)
+{
+    char filename[MCE_LONG + 64], line[256], field[64], type[16];
+    FILE *fin;
+    int spf = -1, n;
+
+    sprintf(filename, "%s/format", dir);
+    fin = fopen(filename, "r");
+    if (fin == NULL)
+        return -1;
+    while (fgets(line, sizeof(line), fin) != NULL)
+        if (sscanf(line, "%63s RAW %15s %i", field, type, &n) == 3 &&
+                strcmp(field, name) == 0)
+            spf = n;
+    fclose(fin);
+    return spf;
+}
+
+/* Check that field "name" and its summaries hold the reductions of
+ * sample(i, offset) over groups of factor frames. */
+static void check_decimated(const char *dir, const char *name, int offset,
+        int n_frames, int factor, int outputs, int has_sign, int spf)
+{
+    int n_out = (n_frames + factor - 1) / factor;
+    uint32_t *data = malloc((n_out + 1) * sizeof(*data));
+    uint32_t *lo = malloc((n_out + 1) * sizeof(*lo));
+    uint32_t *hi = malloc((n_out + 1) * sizeof(*hi));
+    double *mean = malloc((n_out + 1) * sizeof(*mean));
+    char field[64];
+    int g, i, n;
+
+    if (outputs & MCEDATA_DECIMATE_SAMPLE) {
+        n = read_field(dir, name, data, sizeof(*data), n_out + 1);
+        CHECK(n == n_out, "%s: %i samples, not %i", name, n, n_out);
+        CHECK(format_spf(dir, name) == spf, "%s: spf %i, not %i", name,
+                format_spf(dir, name), spf);
+    } else
+        CHECK(format_spf(dir, name) == -1, "%s: in format", name);
+    sprintf(field, "%s_mean", name);
+    if (outputs & MCEDATA_DECIMATE_MEAN) {
+        n = read_field(dir, field, mean, sizeof(*mean), n_out + 1);
+        CHECK(n == n_out, "%s: %i samples, not %i", field, n, n_out);
+        CHECK(format_spf(dir, field) == spf, "%s: spf", field);
+    }
+    sprintf(field, "%s_min", name);
+    if (outputs & MCEDATA_DECIMATE_MIN)
+        CHECK(read_field(dir, field, lo, sizeof(*lo), n_out + 1) == n_out,
+                "%s: length", field);
+    sprintf(field, "%s_max", name);
+    if (outputs & MCEDATA_DECIMATE_MAX)
+        CHECK(read_field(dir, field, hi, sizeof(*hi), n_out + 1) == n_out,
+                "%s: length", field);
+
+    for (g=0; g<n_out; g++) {
+        uint32_t first = sample(g * factor, offset), min = first, max = first;
+        double sum = 0;
+        int count = 0;
+        for (i=g*factor; i<(g+1)*factor && i<n_frames; i++) {
+            uint32_t v = sample(i, offset);
+            sum += has_sign ? (double)(int32_t)v : (double)v;
+            count++;
+            if (has_sign ? (int32_t)v < (int32_t)min : v < min)
+                min = v;
+            if (has_sign ? (int32_t)v > (int32_t)max : v > max)
+                max = v;
+        }
+        if ((outputs & MCEDATA_DECIMATE_SAMPLE) && data[g] != first) {
+            CHECK(0, "%s[%i] = %u, not %u", name, g, data[g], first);
+            break;
+        }
+        if ((outputs & MCEDATA_DECIMATE_MEAN) && mean[g] != sum / count) {
+            CHECK(0, "%s_mean[%i] = %f, not %f", name, g, mean[g],
+                    sum / count);
+            break;
+        }
+        if ((outputs & MCEDATA_DECIMATE_MIN) && lo[g] != min) {
+            CHECK(0, "%s_min[%i] = %u, not %u", name, g, lo[g], min);
+            break;
+        }
+        if ((outputs & MCEDATA_DECIMATE_MAX) && hi[g] != max) {
+            CHECK(0, "%s_max[%i] = %u, not %u", name, g, hi[g], max);
+            break;
+        }
+    }
+    free(data);
+    free(lo);
+    free(hi);
+    free(mean);
+}
+
+/* Store n_frames frames in s, flushing every flush_every; the RCs are
+ * in data mode mode1 and mode3. */
+static void acquire(mcedata_storage_t *s, const char *dir, int n_frames,
+        int flush_every, int mode1, int mode3)
+{
+    uint32_t frame[FRAME_SIZE];
+    mce_acq_t acq;
+    int i, j;
+
+    memset(&acq, 0, sizeof(acq));
+    acq.context = &ctx;
+    acq.storage = s;
+    acq.frame_size = FRAME_SIZE;
+    acq.cards = MCEDATA_RC1 | MCEDATA_RC3;
+    acq.n_cards = 2;
+    acq.rows = ROWS;
+    acq.cols = COLS;
+    acq.data_mode[0] = mode1;
+    acq.data_mode[2] = mode3;
+
+    CHECK(s->init(&acq) == 0, "init %s", dir);
+    for (i=0; i<n_frames; i++) {
+        for (j=0; j<FRAME_SIZE; j++)
+            frame[j] = sample(i, j);
+        acq.frame_time.mono_ns = 1000 * i;
+        CHECK(s->post_frame(&acq, i, frame) == 0, "post %i", i);
+        if (flush_every > 0 && i % flush_every == 0)
+            CHECK(s->flush(&acq) == 0, "flush %i", i);
+    }
+    CHECK(s->cleanup(&acq) == 0, "cleanup");
+    mcedata_storage_destroy(s);
+}
+
+static void run(const char *base, int block_frames, int n_frames,
+        int flush_every, int n_workers)
+{
+    char dir[MCE_LONG], name[32];
+    mcedata_storage_t *s;
+    int r, c;
+
+    sprintf(dir, "%s/b%i_n%i_f%i_w%i", base, block_frames, n_frames,
+            flush_every, n_workers);
+    s = mcedata_dirfile_create(dir, 0, NULL, 1, 0, NULL);
+    CHECK(mcedata_dirfile_set_block(s, block_frames) == 0, "set_block");
+    CHECK(mcedata_dirfile_set_workers(s, n_workers) == 0, "set_workers");
+    acquire(s, dir, n_frames, flush_every, 0, 0);
+
+    check_field(dir, "status", 0, n_frames);
+    check_field(dir, "num_rows", 9, n_frames);
+    check_field(dir, "userfield", 12, n_frames);
+    for (r=0; r<ROWS; r++)
+        for (c=0; c<2*COLS; c++) {
+            // RC3's columns are numbered from 16.
+            sprintf(name, "tesdatar%02ic%02i", r,
+                    (c < COLS) ? c : c - COLS + 2*MCEDATA_COLUMNS);
+            check_field(dir, name, MCEDATA_HEADER + r*2*COLS + c, n_frames);
+        }
+    check_field(dir, "checksum", MCEDATA_HEADER + N_DATA, n_frames);
+    check_times(dir, n_frames);
+}
+
+/* Same again with writer pools; compare every file with the serial
+ * writer's. */
+static void run_workers(const char *base, int block_frames, int n_frames,
+        int flush_every)
+{
+    char cmd[3*MCE_LONG];
+    int n_workers;
+
+    run(base, block_frames, n_frames, flush_every, 0);
+    for (n_workers=1; n_workers<=4; n_workers+=3) {
+        run(base, block_frames, n_frames, flush_every, n_workers);
+        sprintf(cmd, "diff -r %s/b%i_n%i_f%i_w0 %s/b%i_n%i_f%i_w%i",
+                base, block_frames, n_frames, flush_every,
+                base, block_frames, n_frames, flush_every, n_workers);
+        CHECK(system(cmd) == 0, "%s", cmd);
+    }
+}
+
+/* Header at 1/7 with everything, num_rows at 1/3, detector fields at
+ * 1/4 with summaries only, except r00c00: so the full rate is 84 spf.
+ * The writer pool must agree here too. */
+static void run_decimated(const char *base, int n_frames, int n_workers)
+{
+    const int all = MCEDATA_DECIMATE_SAMPLE | MCEDATA_DECIMATE_MEAN |
+        MCEDATA_DECIMATE_MIN | MCEDATA_DECIMATE_MAX;
+    char dir[MCE_LONG], name[32];
+    mcedata_storage_t *s;
+    int r, c;
+
+    sprintf(dir, "%s/dec_n%i_w%i", base, n_frames, n_workers);
+    s = mcedata_dirfile_create(dir, 0, NULL, 1, 0, NULL);
+    CHECK(mcedata_dirfile_set_block(s, 64) == 0, "set_block");
+    CHECK(mcedata_dirfile_set_workers(s, n_workers) == 0, "set_workers");
+    CHECK(mcedata_dirfile_decimate(s, "header", 7, all) == 0, "decimate");
+    CHECK(mcedata_dirfile_decimate(s, "tesdata*", 4, all &
+                ~MCEDATA_DECIMATE_SAMPLE) == 0, "decimate");
+    CHECK(mcedata_dirfile_decimate(s, "tesdatar00c00", 1, 0) == 0,
+            "decimate");
+    CHECK(mcedata_dirfile_decimate(s, "num_rows", 3, 0) == 0, "decimate");
+    CHECK(mcedata_dirfile_decimate(s, "status", 0, 0) != 0, "factor 0");
+    acquire(s, dir, n_frames, 77, 0, 0);
+
+    check_decimated(dir, "status", 0, n_frames, 7, all, 0, 12);
+    check_decimated(dir, "userfield", 12, n_frames, 7, all, 0, 12);
+    check_decimated(dir, "num_rows", 9, n_frames, 3,
+            MCEDATA_DECIMATE_SAMPLE, 0, 28);
+    for (r=0; r<ROWS; r++)
+        for (c=0; c<2*COLS; c++) {
+            if (r == 0 && c == 0)
+                continue;
+            sprintf(name, "tesdatar%02ic%02i", r,
+                    (c < COLS) ? c : c - COLS + 2*MCEDATA_COLUMNS);
+            check_decimated(dir, name, MCEDATA_HEADER + r*2*COLS + c,
+                    n_frames, 4, all & ~MCEDATA_DECIMATE_SAMPLE, 1, 21);
+        }
+    check_field(dir, "tesdatar00c00", MCEDATA_HEADER, n_frames);
+    CHECK(format_spf(dir, "tesdatar00c00") == 84, "tesdatar00c00 spf");
+    check_field(dir, "checksum", MCEDATA_HEADER + N_DATA, n_frames);
+    CHECK(format_spf(dir, "checksum") == 84, "checksum spf");
+    CHECK(format_spf(dir, "host_mono_ns") == 84, "host_mono_ns spf");
+    check_times(dir, n_frames);
+}
+
+/* Check that dir/name holds bits [start, start+count) of sample(i,
+ * offset), as the smallest integer that holds them or, with a scale,
+ * as float. */
+static void check_unpacked(const char *dir, const char *name, int offset,
+        int n_frames, int start, int count, int has_sign, double scale)
+{
+    int size = (scale != 0) ? 4 : (count <= 8) ? 1 : (count <= 16) ? 2 : 4;
+    char *data = malloc((n_frames + 1) * size);
+    int i, n;
+
+    n = read_field(dir, name, data, size, n_frames + 1);
+    CHECK(n == n_frames, "%s: %i samples, not %i", name, n, n_frames);
+    for (i=0; i<n && i<n_frames; i++) {
+        uint32_t v = sample(i, offset);
+        int32_t x = has_sign ? (int32_t)(v << (32 - start - count)) >>
+            (32 - count) : (int32_t)((v >> start) & ((1ULL << count) - 1));
+        double got;
+        if (scale != 0)
+            got = ((float*)data)[i];
+        else if (size == 1)
+            got = has_sign ? ((int8_t*)data)[i] : ((uint8_t*)data)[i];
+        else if (size == 2)
+            got = has_sign ? ((int16_t*)data)[i] : ((uint16_t*)data)[i];
+        else
+            got = ((int32_t*)data)[i];
+        if (got != ((scale != 0) ? x * scale : x)) {
+            CHECK(0, "%s[%i] = %f, not %f", name, i, got,
+                    (scale != 0) ? x * scale : x);
+            break;
+        }
+    }
+    free(data);
+}
+
+/* RC1 in data mode 10, RC3 in mode 4, unpacked; except r01c00, which
+ * is decimated and so left packed. */
+static void run_extract(const char *base, int n_frames, int n_workers)
+{
+    char dir[MCE_LONG], name[32];
+    mcedata_storage_t *s;
+    int r, c;
+
+    sprintf(dir, "%s/ext_n%i_w%i", base, n_frames, n_workers);
+    s = mcedata_dirfile_create(dir, MCEDATA_DIRFILE_EXTRACT, NULL, 1, 0,
+            NULL);
+    CHECK(mcedata_dirfile_set_block(s, 64) == 0, "set_block");
+    CHECK(mcedata_dirfile_set_workers(s, n_workers) == 0, "set_workers");
+    CHECK(mcedata_dirfile_decimate(s, "tesdatar01c00", 2, 0) == 0,
+            "decimate");
+    acquire(s, dir, n_frames, 0, 10, 4);
+
+    for (r=0; r<ROWS; r++)
+        for (c=0; c<2*COLS; c++) {
+            int offset = MCEDATA_HEADER + r*2*COLS + c;
+            char id[16];
+            sprintf(id, "r%02ic%02i", r,
+                    (c < COLS) ? c : c - COLS + 2*MCEDATA_COLUMNS);
+            sprintf(name, "tesdata%s", id);
+            if (r == 1 && c == 0) {
+                sprintf(name, "fj_%s", id);
+                CHECK(format_spf(dir, name) == -1, "%s: unpacked", name);
+                continue;
+            }
+            check_field(dir, name, offset, n_frames);
+            if (c < COLS) {
+                sprintf(name, "fj_%s", id);
+                check_unpacked(dir, name, offset, n_frames, 0, 7, 1, 0);
+                CHECK(format_spf(dir, name) == 2, "%s: spf", name);
+                sprintf(name, "filt_%s", id);
+                check_unpacked(dir, name, offset, n_frames, 7, 25, 1, 8.);
+            } else {
+                sprintf(name, "error_%s", id);
+                check_unpacked(dir, name, offset, n_frames, 0, 14, 1, 0);
+                sprintf(name, "fb_%s", id);
+                check_unpacked(dir, name, offset, n_frames, 14, 18, 1, 0);
+            }
+        }
+}
+
+int main(void)
+{
+    char base[] = "/tmp/mce_test_dirfile.XXXXXX";
+    char cmd[128];
+
+    memset(&ctx, 0, sizeof(ctx));
+    mcelib_set_termio(&ctx, NULL);
+    if (mkdtemp(base) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    run_workers(base, 0, 3000, 0);      // default block
+    run_workers(base, 16, 1000, 0);     // one tile per block
+    run_workers(base, 100, 1001, 0);    // rounded up to 112; partial block
+    run_workers(base, 64, 1000, 77);    // flushes part way through tiles
+    run_workers(base, 32, 5, 0);        // less than a tile
+
+    run_decimated(base, 1001, 0);
+    run_decimated(base, 1001, 3);
+    sprintf(cmd, "diff -r %s/dec_n1001_w0 %s/dec_n1001_w3", base, base);
+    CHECK(system(cmd) == 0, "%s", cmd);
+
+    run_extract(base, 999, 0);
+    run_extract(base, 999, 2);
+    sprintf(cmd, "diff -r %s/ext_n999_w0 %s/ext_n999_w2", base, base);
+    CHECK(system(cmd) == 0, "%s", cmd);
+
+    sprintf(cmd, "rm -rf %s", base);
+    CHECK(system(cmd) == 0, "%s", cmd);
+    printf("dirfile: %s\n", failures ? "FAILED" : "ok");
+    return failures != 0;
+}
@@ -0,0 +1,111 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Check that the buffered flat file writer produces exactly what
+ * flatfile does: frames that straddle buffers, flushes part way
+ * through, appending to an existing file, and O_DIRECT. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "check.h"
+
+#define FRAME_SIZE 1001         /* dwords; straddles 4 kB blocks */
+
+static mce_context_t ctx;
+
+/* Store n_frames frames, starting at frame "first", flushing every
+ * flush_every frames (never, if 0). */
+static void store(mcedata_storage_t *s, int first, int n_frames,
+        int flush_every)
+{
+    mce_acq_t acq;
+    uint32_t frame[FRAME_SIZE];
+    int i, j;
+
+    memset(&acq, 0, sizeof(acq));
+    acq.context = &ctx;
+    acq.storage = s;
+    acq.frame_size = FRAME_SIZE;
+
+    CHECK(s->init(&acq) == 0, "init: %s", acq.errstr);
+    for (i=first; i<first + n_frames; i++) {
+        for (j=0; j<FRAME_SIZE; j++)
+            frame[j] = i * 7919 + j;
+        acq.frame_time.mono_ns = i;
+        CHECK(s->post_frame(&acq, i, frame) == 0, "post %i", i);
+        if (flush_every > 0 && i % flush_every == 0)
+            CHECK(s->flush(&acq) == 0, "flush %i", i);
+    }
+    CHECK(s->cleanup(&acq) == 0, "cleanup");
+    mcedata_storage_destroy(s);
+}
+
+static int same_file(const char *a, const char *b)
+{
+    FILE *fa = fopen(a, "r"), *fb = fopen(b, "r");
+    int ca, cb, same = (fa != NULL && fb != NULL);
+    while (same) {
+        ca = fgetc(fa);
+        cb = fgetc(fb);
+        same = (ca == cb);
+        if (ca == EOF)
+            break;
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return same;
+}
+
+static void compare(const char *dir, int buffer_size, int options,
+        int flush_every)
+{
+    char ref[MCE_LONG], out[MCE_LONG];
+    char ref_t[MCE_LONG + 8], out_t[MCE_LONG + 8];
+
+    sprintf(ref, "%s/flatbuf_ref", dir);
+    sprintf(out, "%s/flatbuf_out", dir);
+    sprintf(ref_t, "%s.time", ref);
+    sprintf(out_t, "%s.time", out);
+
+    // Twice, to check appending.
+    store(mcedata_flatfile_create(ref, NULL), 0, 300, 0);
+    store(mcedata_flatfile_create(ref, NULL), 300, 77, 0);
+    store(mcedata_flatfile_buffered_create(out, NULL, buffer_size, options),
+            0, 300, flush_every);
+    store(mcedata_flatfile_buffered_create(out, NULL, buffer_size, options),
+            300, 77, flush_every);
+
+    CHECK(same_file(ref, out), "data differ: buffer %i, options %i, "
+            "flush %i", buffer_size, options, flush_every);
+    CHECK(same_file(ref_t, out_t), "times differ");
+
+    unlink(ref);
+    unlink(out);
+    unlink(ref_t);
+    unlink(out_t);
+}
+
+int main()
+{
+    memset(&ctx, 0, sizeof(ctx));
+    mcelib_set_termio(&ctx, NULL);
+    ctx.flags = MCELIB_QUIET;   // O_DIRECT fallbacks are expected
+
+    compare("/tmp", 0, 0, 0);
+    compare("/tmp", 8192, 0, 0);
+    compare("/tmp", 8192, 0, 13);
+    compare(".", 8192, MCEDATA_FLATFILE_DIRECT, 0);
+    compare(".", 8192, MCEDATA_FLATFILE_DIRECT, 13);
+    compare(".", 0, MCEDATA_FLATFILE_DIRECT, 100);
+
+    printf("flatbuf: %s\n", failures ? "FAILED" : "ok");
+    return failures != 0;
+}
@@ -0,0 +1,100 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Check frame view access and iterators against the reordered frame,
+ * for a few card sets, including non-contiguous ones. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "frame_manip.h"
+#include "check.h"
+
+static void check_cards(int cards, int rows, int cols)
+{
+    uint32_t raw[MCEDATA_PACKET_MAX], sorted[MCEDATA_PACKET_MAX], x;
+    mce_frame_view_t view;
+    mce_frame_iter_t it;
+    frame_reorder_t *plan;
+    mce_acq_t acq;
+    int i, r, c, n, width;
+
+    memset(&acq, 0, sizeof(acq));
+    acq.cards = cards;
+    for (i=0; i<MCEDATA_CARDS; i++) {
+        if (cards & (1 << i))
+            acq.n_cards++;
+        acq.row0[i] = i;
+        acq.col0[i] = (i * 3) % (MCEDATA_COLUMNS - cols + 1);
+    }
+    acq.rows = rows;
+    acq.cols = cols;
+    acq.frame_size = rows*cols*acq.n_cards + MCEDATA_HEADER + MCEDATA_FOOTER;
+    width = cols*acq.n_cards;
+
+    for (i=0; i<acq.frame_size; i++)
+        raw[i] = 1000 + i;
+    plan = frame_reorder_create(&acq);
+    frame_reorder_apply(plan, sorted, raw);
+
+    mcedata_frame_view_init(&view, &acq);
+    view.data = raw;
+
+    // Element access, rows and columns match the row-major frame.
+    for (r=0; r<rows; r++)
+        for (c=0; c<width; c++)
+            CHECK(mce_frame_view_get(&view, r, c) ==
+                    sorted[MCEDATA_HEADER + r*width + c],
+                    "cards=%#x get(%i,%i)", cards, r, c);
+
+    for (r=0; r<rows; r++) {
+        mce_frame_view_row(&view, r, &it);
+        for (n=0; mce_frame_iter_next(&it, &x); n++)
+            CHECK(n < width && x == sorted[MCEDATA_HEADER + r*width + n],
+                    "cards=%#x row %i element %i", cards, r, n);
+        CHECK(n == width, "cards=%#x row %i has %i elements", cards, r, n);
+    }
+    for (c=0; c<width; c++) {
+        mce_frame_view_column(&view, c, &it);
+        for (n=0; mce_frame_iter_next(&it, &x); n++)
+            CHECK(n < rows && x == sorted[MCEDATA_HEADER + n*width + c],
+                    "cards=%#x column %i element %i", cards, c, n);
+        CHECK(n == rows, "cards=%#x column %i has %i elements", cards, c, n);
+    }
+
+    // MCE coordinates: present channels are found, others are not.
+    for (i=0, n=0; i<MCEDATA_CARDS; i++) {
+        int mc = i*MCEDATA_COLUMNS + acq.col0[i];
+        const uint32_t *p = mce_frame_view_find(&view, acq.row0[i], mc);
+        if (!(cards & (1 << i))) {
+            CHECK(p == NULL, "cards=%#x found absent card %i", cards, i);
+            continue;
+        }
+        CHECK(p != NULL && *p == mce_frame_view_get(&view, 0, n*cols),
+                "cards=%#x card %i origin", cards, i);
+        CHECK(mce_frame_view_find(&view, acq.row0[i] + rows, mc) == NULL,
+                "cards=%#x card %i row past end", cards, i);
+        CHECK(mce_frame_view_find(&view, acq.row0[i], mc + cols) == NULL,
+                "cards=%#x card %i column past end", cards, i);
+        n++;
+    }
+
+    frame_reorder_destroy(plan);
+}
+
+int main()
+{
+    check_cards(MCEDATA_RC1, 33, 8);
+    check_cards(MCEDATA_RC2 | MCEDATA_RC4, 41, 8);
+    check_cards(MCEDATA_RC1 | MCEDATA_RC3, 4, 2);
+    check_cards(MCEDATA_RCS, 11, 5);
+
+    if (failures == 0)
+        printf("frame_view: ok\n");
+    return failures != 0;
+}
@@ -0,0 +1,110 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Check the frame continuity checker on a synthetic stream with
+ * dropped frames, a repeated frame, a sync glitch, and restarts with
+ * and without frames lost across them. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "gapcheck.h"
+#include "check.h"
+
+static int feed(gapcheck_t *g, long long index, uint32_t counter,
+        uint32_t sync)
+{
+    uint32_t frame[MCEDATA_HEADER];
+    memset(frame, 0, sizeof(frame));
+    frame[frame_header_v6.frame_counter & FRAME_OFFSET_MASK] = counter;
+    frame[frame_header_v6.sync_number & FRAME_OFFSET_MASK] = sync;
+    return gapcheck_frame(g, index, frame);
+}
+
+int main()
+{
+    char logname[] = "/tmp/gapcheck_XXXXXX";
+    gapcheck_t g;
+    uint32_t c = 100, sync = 5000;
+    const int step = 47;            // data_rate, with a sync box
+    long long i = 0;
+    int k, n, lines = 0;
+    char line[256];
+    FILE *f;
+
+    memset(&g, 0, sizeof(g));
+    close(mkstemp(logname));
+    CHECK(gapcheck_set_log(&g, logname) == 0, "open log");
+
+    // Clean run.
+    for (k=0; k<1000; k++, c++, sync += step)
+        CHECK(feed(&g, i++, c, sync) == GAP_NONE, "clean frame %lli", i);
+    CHECK(g.sync_step == step, "sync step %u", g.sync_step);
+
+    // Drop 3 frames; sync_number jumps with them.
+    c += 3; sync += 3*step;
+    CHECK(feed(&g, i++, c++, sync) == GAP_MISSING, "missing");
+    sync += step;
+    for (k=0; k<10; k++, c++, sync += step)
+        CHECK(feed(&g, i++, c, sync) == GAP_NONE, "after gap %i", k);
+
+    // Repeat the last frame.
+    CHECK(feed(&g, i++, c - 1, sync - step) == GAP_REPEAT, "repeat");
+    for (k=0; k<10; k++, c++, sync += step)
+        CHECK(feed(&g, i++, c, sync) == GAP_NONE, "after repeat %i", k);
+
+    // sync_number off by one, frame_counter fine.
+    CHECK(feed(&g, i++, c++, sync + 1) == GAP_SYNC, "sync");
+    sync += step + 1;
+    for (k=0; k<10; k++, c++, sync += step)
+        CHECK(feed(&g, i++, c, sync) == GAP_NONE, "after sync %i", k);
+
+    // New GO: counter starts over, without complaint.
+    gapcheck_restart(&g);
+    c = 0;
+    for (k=0; k<10; k++, c++, sync += step)
+        CHECK(feed(&g, i++, c, sync) == GAP_NONE, "after restart %i", k);
+
+    // Another, losing 5 frames between the chunks: sync_number tells.
+    gapcheck_restart(&g);
+    c = 0;
+    sync += 5*step;
+    CHECK(feed(&g, i++, c++, sync) == GAP_MISSING, "missing at restart");
+    CHECK(g.missing == 3 + 5, "missing %lli at restart", g.missing);
+    sync += step;
+    for (k=0; k<10; k++, c++, sync += step)
+        CHECK(feed(&g, i++, c, sync) == GAP_NONE, "after lossy restart %i",
+                k);
+
+    CHECK(g.missing == 8, "missing %lli", g.missing);
+    CHECK(g.gap_events == 3, "gap_events %i", g.gap_events);
+    CHECK(g.repeats == 1, "repeats %i", g.repeats);
+    CHECK(g.sync_events == 1, "sync_events %i", g.sync_events);
+
+    // No sync box: sync_number sits at 0.
+    gapcheck_reset(&g);
+    for (k=0; k<100; k++)
+        CHECK(feed(&g, k, k, 0) == GAP_NONE, "no sync box %i", k);
+
+    gapcheck_set_log(&g, NULL);
+    f = fopen(logname, "r");
+    CHECK(f != NULL, "reopen log");
+    while (f != NULL && fgets(line, sizeof(line), f) != NULL)
+        if (line[0] != '#')
+            lines++;
+    if (f != NULL)
+        fclose(f);
+    n = 4;
+    CHECK(lines == n, "log has %i events, expected %i", lines, n);
+    unlink(logname);
+
+    if (failures == 0)
+        printf("gapcheck: ok\n");
+    return failures != 0;
+}
@@ -0,0 +1,225 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Push synthetic frames through a multisync storage to many fake
+ * syncs, some slow, under each overflow policy, and check what each
+ * sync stored: every frame in order, unless it dropped some (counted)
+ * or was stopped (reported to the error callback). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "check.h"
+
+#define FRAME_SIZE 64
+#define MAX_SINKS 16
+
+struct sink {
+    int stored;
+    int last;           /* last frame stored */
+    int bad_order;
+    int bad_data;
+    int bad_time;
+    int views;
+    int bad_view;
+    int delay_us;
+    int fail_at;        /* post_frame fails at this frame, if > 0 */
+};
+
+struct errors {
+    int count[MAX_SINKS];
+    int err[MAX_SINKS];
+    int returned;       /* by post_frame and flush */
+};
+
+static uint32_t fake_word(int frame, int i)
+{
+    return (frame << 8) | i;
+}
+
+static int sink_post(mce_acq_t *acq, int count, uint32_t *data)
+{
+    struct sink *s = acq->storage->action_data;
+    int i;
+
+    if (count <= s->last)
+        s->bad_order++;
+    s->last = count;
+    s->stored++;
+    if (acq->frame_time.mono_ns != count)
+        s->bad_time++;
+    for (i=0; i<FRAME_SIZE; i++)
+        if (data[i] != fake_word(count, i)) {
+            s->bad_data++;
+            break;
+        }
+    if (s->delay_us > 0)
+        usleep(s->delay_us);
+    return (s->fail_at > 0 && count == s->fail_at) ? -1 : 0;
+}
+
+/* The view carries the frame as sent, here bit-inverted. */
+static int sink_view(mce_acq_t *acq, int count, const mce_frame_view_t *view)
+{
+    struct sink *s = acq->storage->action_data;
+    s->views++;
+    if (view->frame_size != FRAME_SIZE || view->data[3] != ~fake_word(count, 3))
+        s->bad_view++;
+    return 0;
+}
+
+static int on_error(void *user_data, int sync_num, int err,
+        mcedata_stage_t stage)
+{
+    struct errors *e = user_data;
+    e->count[sync_num]++;
+    e->err[sync_num] = err;
+    return 1;
+}
+
+/* Sync 1 fails at this frame, if > 0. */
+static int fail_at = 0;
+
+/* Run n_frames through n_sinks syncs of the given depth and policy;
+   the syncs in slow (a bit mask) take delay_us per frame. */
+static void run(int n_sinks, int depth, int policy, int slow, int delay_us,
+        int n_frames, struct sink *sinks, struct errors *errors,
+        long long *dropped)
+{
+    mce_context_t ctx;
+    mce_acq_t acq;
+    mcedata_storage_t storages[MAX_SINKS];
+    mce_frame_view_t view;
+    uint32_t frame[FRAME_SIZE], raw[FRAME_SIZE];
+    int i, k;
+
+    memset(&ctx, 0, sizeof(ctx));
+    memset(&acq, 0, sizeof(acq));
+    memset(&view, 0, sizeof(view));
+    memset(storages, 0, sizeof(storages));
+    memset(sinks, 0, n_sinks * sizeof(*sinks));
+    memset(errors, 0, sizeof(*errors));
+    mcelib_set_termio(&ctx, NULL);
+
+    acq.context = &ctx;
+    acq.frame_size = FRAME_SIZE;
+    acq.storage = mcedata_multisync_create(0);
+    CHECK(acq.storage->init(&acq) == 0, "init failed");
+    mcedata_multisync_errcallback(&acq, on_error, errors);
+
+    for (i=0; i<n_sinks; i++) {
+        sinks[i].last = -1;
+        sinks[i].delay_us = (slow & (1 << i)) ? delay_us : 0;
+        sinks[i].fail_at = (i == 1) ? fail_at : 0;
+        storages[i].post_frame = sink_post;
+        if (i == 0)
+            storages[i].post_view = sink_view;
+        storages[i].action_data = sinks + i;
+        CHECK(mcedata_multisync_add_queue(&acq, storages + i, depth,
+                    (slow & (1 << i)) ? policy : MCEDATA_MULTISYNC_BLOCK) == 0,
+                "add %i failed", i);
+    }
+
+    view.frame_size = FRAME_SIZE;
+    view.data = raw;
+    for (k=0; k<n_frames; k++) {
+        for (i=0; i<FRAME_SIZE; i++) {
+            frame[i] = fake_word(k, i);
+            raw[i] = ~frame[i];
+        }
+        acq.frame_time.mono_ns = k;
+        CHECK(acq.storage->pre_frame(&acq) == 0, "pre_frame failed");
+        CHECK(acq.storage->post_view(&acq, k, &view) == 0, "post_view failed");
+        if (acq.storage->post_frame(&acq, k, frame) != 0)
+            errors->returned++;
+        /* The syncs have their own copies. */
+        memset(frame, 0xff, sizeof(frame));
+        memset(raw, 0xff, sizeof(raw));
+    }
+    mcedata_multisync_drain(&acq);
+    for (i=0; i<n_sinks; i++)
+        dropped[i] = mcedata_multisync_dropped(&acq, i);
+    CHECK(acq.stats.n_syncs == n_sinks, "%i syncs timed", acq.stats.n_syncs);
+    CHECK((acq.stats.sync_time_rest > 0) == (n_sinks > MCEDATA_STATS_SYNCS),
+            "sync_time_rest=%g", acq.stats.sync_time_rest);
+    if (acq.storage->flush(&acq) != 0)
+        errors->returned++;
+    CHECK(acq.storage->cleanup(&acq) == 0, "cleanup failed");
+    mcedata_storage_destroy(acq.storage);
+
+    for (i=0; i<n_sinks; i++) {
+        CHECK(sinks[i].bad_order == 0, "sync %i: %i frames out of order", i,
+                sinks[i].bad_order);
+        CHECK(sinks[i].bad_data == 0, "sync %i: %i bad frames", i,
+                sinks[i].bad_data);
+        CHECK(sinks[i].bad_time == 0, "sync %i: %i wrong times", i,
+                sinks[i].bad_time);
+    }
+    CHECK(sinks[0].views == sinks[0].stored && sinks[0].bad_view == 0,
+            "%i views for %i frames, %i bad", sinks[0].views, sinks[0].stored,
+            sinks[0].bad_view);
+
+    printf("syncs=%-2i depth=%-3i policy=%i slow=%#x frames=%i\n",
+            n_sinks, depth, policy, slow, n_frames);
+}
+
+int main()
+{
+    struct sink sinks[MAX_SINKS];
+    struct errors errors;
+    long long dropped[MAX_SINKS];
+    int i;
+
+    /* More syncs than there used to be room for. */
+    run(MAX_SINKS, 16, MCEDATA_MULTISYNC_BLOCK, 0, 0, 2000, sinks, &errors,
+            dropped);
+    for (i=0; i<MAX_SINKS; i++)
+        CHECK(sinks[i].stored == 2000 && dropped[i] == 0,
+                "sync %i stored %i", i, sinks[i].stored);
+    CHECK(errors.returned == 0, "%i errors returned", errors.returned);
+
+    /* A slow sync holds everyone up, but loses nothing. */
+    run(3, 4, MCEDATA_MULTISYNC_BLOCK, 0x2, 200, 100, sinks, &errors,
+            dropped);
+    for (i=0; i<3; i++)
+        CHECK(sinks[i].stored == 100, "sync %i stored %i", i,
+                sinks[i].stored);
+
+    /* A slow sync loses its oldest frames, and no one else's. */
+    run(3, 4, MCEDATA_MULTISYNC_DROP, 0x2, 1000, 200, sinks, &errors,
+            dropped);
+    CHECK(sinks[0].stored == 200 && sinks[2].stored == 200,
+            "fast syncs stored %i, %i", sinks[0].stored, sinks[2].stored);
+    CHECK(dropped[1] > 0 && sinks[1].stored + dropped[1] == 200,
+            "slow sync stored %i, dropped %lli", sinks[1].stored, dropped[1]);
+    CHECK(sinks[1].last == 199, "slow sync ended at %i", sinks[1].last);
+
+    /* A slow sync is given up on, and says so. */
+    run(3, 4, MCEDATA_MULTISYNC_STOP, 0x2, 1000, 200, sinks, &errors,
+            dropped);
+    CHECK(sinks[0].stored == 200 && sinks[2].stored == 200,
+            "fast syncs stored %i, %i", sinks[0].stored, sinks[2].stored);
+    CHECK(sinks[1].stored < 200, "slow sync stored %i", sinks[1].stored);
+    CHECK(errors.count[1] == 1 && errors.err[1] == -MCE_ERR_FRAME_OVERRUN,
+            "slow sync: %i errors, last %i", errors.count[1], errors.err[1]);
+    CHECK(errors.count[0] == 0 && errors.count[2] == 0, "fast syncs failed");
+    CHECK(errors.returned == 1, "%i errors returned", errors.returned);
+
+    /* A failing sync is stopped by the callback. */
+    fail_at = 10;
+    run(2, 8, MCEDATA_MULTISYNC_BLOCK, 0, 0, 100, sinks, &errors, dropped);
+    CHECK(sinks[0].stored == 100, "sync 0 stored %i", sinks[0].stored);
+    CHECK(sinks[1].stored == 11 && errors.count[1] == 1,
+            "failing sync stored %i, %i errors", sinks[1].stored,
+            errors.count[1]);
+    CHECK(errors.returned == 1, "%i errors returned", errors.returned);
+
+    printf("multisync: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
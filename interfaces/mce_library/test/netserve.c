@@ -0,0 +1,197 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Stream synthetic frames over loopback to several subscribers: one
+ * takes whole frames, one a few channels of every third frame, one
+ * just the headers; each must see exactly what it asked for.  Another
+ * subscribes and never reads; it must be disconnected, without the
+ * acquisition ever waiting for it.  Bad requests get an error. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "check.h"
+
+#define FRAME_SIZE 1000
+#define N_FRAMES 2000
+#define SEND_MAX 65536
+
+static char addr[64];
+static int subscribed;
+
+struct subscriber {
+    const char *request;
+    int decimate;
+    int n_words;
+    int words[4];       /* CHANNELS */
+    int received;
+    int bad_seq;
+    int bad_data;
+    int bad_info;
+    mcedata_netclient_t *c;
+};
+
+static uint32_t fake_word(int frame, int w)
+{
+    return (w >= 0 && w < FRAME_SIZE) ? frame * 1000 + w : 0;
+}
+
+static void *subscribe(void *arg)
+{
+    struct subscriber *s = arg;
+    mcedata_netclient_t *c = s->c;
+    uint32_t data[FRAME_SIZE];
+    mce_netserve_msg_t msg;
+    mce_netserve_info_t *info = (mce_netserve_info_t*)data;
+    int i, last = N_FRAMES - 1 - (N_FRAMES - 1) % s->decimate;
+
+    if (c == NULL ||
+            mcedata_netclient_read(c, &msg, data, FRAME_SIZE) !=
+            MCE_NETSERVE_INFO || info->frame_size != FRAME_SIZE ||
+            info->decimate != s->decimate || info->n_words != s->n_words)
+        s->bad_info++;
+    __atomic_add_fetch(&subscribed, 1, __ATOMIC_SEQ_CST);
+
+    while (c != NULL &&
+            mcedata_netclient_read(c, &msg, data, FRAME_SIZE) ==
+            MCE_NETSERVE_FRAME) {
+        int frame = msg.frame_index;
+        if (msg.seq != (uint64_t)s->received * s->decimate ||
+                msg.seq != frame || msg.mono_ns != frame ||
+                msg.n_words != s->n_words)
+            s->bad_seq++;
+        for (i=0; i<s->n_words && i<FRAME_SIZE; i++)
+            if (data[i] != fake_word(frame,
+                        s->words[0] >= 0 ? s->words[i] : i))
+                s->bad_data++;
+        s->received++;
+        if (frame == last)
+            break;
+    }
+    mcedata_netclient_close(c);
+    return NULL;
+}
+
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* A request the server refuses: an error, and no frames. */
+static void refused(const char *request)
+{
+    mcedata_netclient_t *c = mcedata_netclient_open(addr, request);
+    uint32_t data[64];
+    mce_netserve_msg_t msg;
+
+    CHECK(c != NULL, "connect failed");
+    if (c == NULL)
+        return;
+    CHECK(mcedata_netclient_read(c, &msg, data, 64) == MCE_NETSERVE_ERROR,
+            "\"%s\" accepted", request);
+    mcedata_netclient_close(c);
+}
+
+int main()
+{
+    struct subscriber subs[3] = {
+        { "SUBSCRIBE", 1, FRAME_SIZE, { -1 } },
+        { "SUBSCRIBE DECIMATE 3 CHANNELS 0 5 999 5000", 3, 4,
+            { 0, 5, 999, 5000 } },
+        { "subscribe header", 1, MCEDATA_HEADER, { -1 } },
+    };
+    pthread_t threads[3];
+    mce_context_t ctx;
+    mce_acq_t acq;
+    mcedata_netclient_t *slow;
+    mce_netserve_msg_t msg;
+    uint32_t frame[FRAME_SIZE];
+    long long t, worst = 0;
+    int i, k, port, slow_frames = 0;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.flags = MCELIB_QUIET;
+    memset(&acq, 0, sizeof(acq));
+    acq.context = &ctx;
+    acq.frame_size = FRAME_SIZE;
+    acq.cards = MCEDATA_RC2;
+    acq.rows = 1;
+    acq.cols = FRAME_SIZE - MCEDATA_HEADER - 1;
+    acq.storage = mcedata_netserve_create("127.0.0.1:0", SEND_MAX);
+    CHECK(acq.storage->init(&acq) == 0, "init failed: %s", acq.errstr);
+    port = mcedata_netserve_port(acq.storage);
+    CHECK(port > 0, "no port");
+    sprintf(addr, "127.0.0.1:%i", port);
+
+    refused("UNSUBSCRIBE");
+    refused("SUBSCRIBE CHANNELS");
+    refused("SUBSCRIBE DECIMATE 0");
+
+    slow = mcedata_netclient_open(addr, "SUBSCRIBE");
+    CHECK(slow != NULL, "slow subscriber could not connect");
+    // (massock_connect uses gethostbyname, so connect from one thread.)
+    for (i=0; i<3; i++) {
+        subs[i].c = mcedata_netclient_open(addr, subs[i].request);
+        pthread_create(threads + i, NULL, subscribe, subs + i);
+    }
+    while (__atomic_load_n(&subscribed, __ATOMIC_SEQ_CST) < 3)
+        usleep(1000);
+
+    for (k=0; k<N_FRAMES; k++) {
+        for (i=0; i<FRAME_SIZE; i++)
+            frame[i] = fake_word(k, i);
+        acq.frame_time.mono_ns = k;
+        t = now_ns();
+        acq.storage->post_frame(&acq, k, frame);
+        t = now_ns() - t;
+        if (t > worst)
+            worst = t;
+        usleep(100);
+    }
+    for (i=0; i<3; i++)
+        pthread_join(threads[i], NULL);
+
+    for (i=0; i<3; i++) {
+        CHECK(subs[i].bad_info == 0, "%s: bad INFO", subs[i].request);
+        CHECK(subs[i].received == (N_FRAMES + subs[i].decimate - 1) /
+                subs[i].decimate, "%s: received %i", subs[i].request,
+                subs[i].received);
+        CHECK(subs[i].bad_seq == 0 && subs[i].bad_data == 0,
+                "%s: %i bad headers, %i bad words", subs[i].request,
+                subs[i].bad_seq, subs[i].bad_data);
+    }
+    CHECK(mcedata_netserve_skipped(acq.storage) == 0, "skipped %lli frames",
+            mcedata_netserve_skipped(acq.storage));
+    CHECK(mcedata_netserve_dropped(acq.storage) == 1, "dropped %lli "
+            "subscribers", mcedata_netserve_dropped(acq.storage));
+    CHECK(worst < 5000000, "post_frame took %lli us", worst / 1000);
+
+    acq.storage->cleanup(&acq);
+    mcedata_storage_destroy(acq.storage);
+
+    // The slow subscriber gets what was sent before it was dropped.
+    if (slow != NULL) {
+        CHECK(mcedata_netclient_read(slow, &msg, frame, FRAME_SIZE) ==
+                MCE_NETSERVE_INFO, "slow subscriber: no INFO");
+        while (mcedata_netclient_read(slow, &msg, frame, FRAME_SIZE) ==
+                MCE_NETSERVE_FRAME)
+            slow_frames++;
+        CHECK(slow_frames < N_FRAMES, "slow subscriber was not dropped");
+        mcedata_netclient_close(slow);
+    }
+
+    printf("slow subscriber got %i of %i frames; slowest post_frame %lli us\n",
+            slow_frames, N_FRAMES, worst / 1000);
+    printf("netserve: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
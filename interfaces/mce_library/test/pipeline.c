@@ -0,0 +1,158 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Push synthetic frames through the acquisition pipeline and check
+ * that storage sees every frame, sorted, in order - with slow storage
+ * (queue fills up) and with several workers, each with its arrival
+ * time. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "frame_manip.h"
+#include "pipeline.h"
+#include "check.h"
+
+#define ROWS 33
+#define COLS 8
+#define CARDS 2
+
+struct sink {
+    int next;           /* expected frame count */
+    int bad_order;
+    int bad_data;
+    int bad_time;
+    int delay_us;
+};
+
+static uint32_t fake_word(int frame, int card, int row, int col)
+{
+    return (frame << 16) | (card << 12) | (row << 4) | col;
+}
+
+/* Card-major, as the MCE sends it. */
+static void fake_frame(uint32_t *data, int frame_size, int frame)
+{
+    int c, r, k;
+    memset(data, 0, frame_size * sizeof(*data));
+    data[1] = frame;
+    for (c=0; c<CARDS; c++)
+        for (r=0; r<ROWS; r++)
+            for (k=0; k<COLS; k++)
+                data[MCEDATA_HEADER + (c*ROWS + r)*COLS + k] =
+                    fake_word(frame, c, r, k);
+}
+
+static int sink_post(mce_acq_t *acq, int count, uint32_t *data)
+{
+    struct sink *s = acq->storage->action_data;
+    int c, r, k;
+
+    if (count != s->next)
+        s->bad_order++;
+    s->next = count + 1;
+    if (acq->frame_time.mono_ns != count || acq->frame_time.real_ns != -count)
+        s->bad_time++;
+
+    /* Row-major after reordering. */
+    for (r=0; r<ROWS; r++)
+        for (c=0; c<CARDS; c++)
+            for (k=0; k<COLS; k++)
+                if (data[MCEDATA_HEADER + (r*CARDS + c)*COLS + k] !=
+                        fake_word(count, c, r, k)) {
+                    s->bad_data++;
+                    goto done;
+                }
+done:
+    if (s->delay_us > 0)
+        usleep(s->delay_us);
+    return 0;
+}
+
+static void run(int depth, int n_workers, int n_frames, int delay_us)
+{
+    mce_context_t ctx;
+    mce_acq_t acq;
+    mcedata_storage_t storage;
+    mcedata_pipeline_t *pipe;
+    mcedata_pipeline_stats_t stats;
+    struct sink sink;
+    uint32_t frame[MCEDATA_PACKET_MAX];
+    mce_host_time_t t;
+    int i;
+
+    memset(&ctx, 0, sizeof(ctx));
+    memset(&acq, 0, sizeof(acq));
+    memset(&storage, 0, sizeof(storage));
+    memset(&sink, 0, sizeof(sink));
+
+    sink.delay_us = delay_us;
+    storage.post_frame = sink_post;
+    storage.action_data = &sink;
+
+    acq.context = &ctx;
+    acq.storage = &storage;
+    acq.cards = MCEDATA_RC1 | MCEDATA_RC2;
+    acq.n_cards = CARDS;
+    acq.rows = ROWS;
+    acq.cols = COLS;
+    acq.frame_size = ROWS*COLS*CARDS + MCEDATA_HEADER + MCEDATA_FOOTER;
+    acq.reorder = frame_reorder_create(&acq);
+
+    pipe = mcedata_pipeline_create(&acq, depth, n_workers);
+    CHECK(pipe != NULL, "create failed");
+    if (pipe == NULL)
+        return;
+
+    for (i=0; i<n_frames; i++) {
+        fake_frame(frame, acq.frame_size, i);
+        t.mono_ns = i;
+        t.real_ns = -i;
+        mcedata_pipeline_push(pipe, i, frame, &t);
+        /* The pipeline has its own copy. */
+        memset(frame, 0xff, acq.frame_size * sizeof(*frame));
+    }
+    mcedata_pipeline_drain(pipe);
+
+    mcedata_pipeline_get_stats(pipe, &stats, 1);
+    CHECK(sink.next == n_frames, "stored %i of %i frames", sink.next, n_frames);
+    CHECK(sink.bad_order == 0, "%i frames out of order", sink.bad_order);
+    CHECK(sink.bad_data == 0, "%i frames mis-sorted", sink.bad_data);
+    CHECK(sink.bad_time == 0, "%i frames with wrong time", sink.bad_time);
+    CHECK(stats.frames == n_frames, "stats.frames=%lli", stats.frames);
+    CHECK(stats.queued == 0, "stats.queued=%i", stats.queued);
+    CHECK(stats.high_water >= 1 && stats.high_water <= depth,
+            "stats.high_water=%i", stats.high_water);
+    if (delay_us > 0) {
+        CHECK(stats.high_water == depth, "slow storage: high_water=%i",
+                stats.high_water);
+        CHECK(stats.full_waits > 0, "slow storage: no full waits");
+    }
+
+    mcedata_pipeline_get_stats(pipe, &stats, 0);
+    CHECK(stats.frames == 0 && stats.high_water == 0, "stats not reset");
+
+    mcedata_pipeline_destroy(pipe);
+    frame_reorder_destroy(acq.reorder);
+
+    printf("depth=%-4i workers=%i frames=%-5i delay=%ius\n",
+            depth, n_workers, n_frames, delay_us);
+}
+
+int main()
+{
+    run(8, 1, 200, 200);
+    run(1, 1, 50, 0);
+    run(64, 1, 5000, 0);
+    run(16, 4, 5000, 0);
+    run(16, 4, 200, 100);
+
+    printf("pipeline: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
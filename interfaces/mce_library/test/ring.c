@@ -0,0 +1,134 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Check the ring walker's index arithmetic against a fake driver
+ * control page with an uneven multi-block layout. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "ring.h"
+#include "check.h"
+
+/* Lay out blocks the way the driver's set_transfer_params_multi does:
+ * each block holds as many whole frames as fit. */
+static void fake_layout(struct dsp_ctrl_page *ctrl, int frame_size,
+        int n_blocks, const int *block_sizes)
+{
+    int i, offset = 0, start = 0;
+    ctrl->generation++;
+    ctrl->frame_size = frame_size;
+    ctrl->n_blocks = n_blocks;
+    for (i=0; i<n_blocks; i++) {
+        ctrl->blocks[i].offset = offset;
+        ctrl->blocks[i].start_frame = start;
+        start += block_sizes[i] / frame_size;
+        ctrl->blocks[i].end_frame = start;
+        offset += block_sizes[i];
+    }
+    ctrl->n_frames = start;
+    ctrl->total_size = offset;
+    ctrl->head_index = 0;
+    ctrl->tail_index = 0;
+    ctrl->generation++;
+}
+
+int main()
+{
+    static const int sizes[3] = {10240, 8192, 10240};
+    /* 3 + 2 + 3 frames of 3072 bytes */
+    static const int expect[8] = {
+        0, 3072, 6144, 10240, 13312, 18432, 21504, 24576 };
+    struct dsp_ctrl_page ctrl;
+    mcering_layout_t layout;
+    mce_context_t ctx;
+    int offsets[DSP_FRAME_BATCH_MAX];
+    int i, n;
+
+    memset(&ctrl, 0, sizeof(ctrl));
+    ctrl.magic = DSP_CTRL_MAGIC;
+    fake_layout(&ctrl, 3072, 3, sizes);
+
+    CHECK(mcering_load_layout(&layout, &ctrl) == 0, "load_layout failed");
+    CHECK(layout.n_frames == 8, "n_frames=%i", layout.n_frames);
+    CHECK(layout.generation == ctrl.generation, "generation not recorded");
+
+    /* Per-frame offsets, across block boundaries and slack space. */
+    for (i=0; i<8; i++) {
+        n = mcering_offset(&layout, i);
+        CHECK(n == expect[i], "offset(%i)=%i, expected %i", i, n, expect[i]);
+    }
+    CHECK(mcering_offset(&layout, -1) == -1, "offset(-1) in range");
+    CHECK(mcering_offset(&layout, 8) == -1, "offset(8) in range");
+
+    /* Counting, with and without wraparound. */
+    CHECK(mcering_count(&layout, 5, 1) == 4, "count(5,1)");
+    CHECK(mcering_count(&layout, 2, 6) == 4, "count(2,6)");
+    CHECK(mcering_count(&layout, 3, 3) == 0, "count(3,3)");
+    CHECK(mcering_count(&layout, 2, 3) == 7, "count(2,3)");
+
+    /* Walk from tail=6 around to head=2: frames 6, 7, 0, 1. */
+    n = mcering_walk(&layout, 2, 6, offsets, DSP_FRAME_BATCH_MAX);
+    CHECK(n == 4, "walk wrap returned %i", n);
+    CHECK(n == 4 && offsets[0] == expect[6] && offsets[1] == expect[7] &&
+            offsets[2] == expect[0] && offsets[3] == expect[1],
+            "walk wrap offsets wrong");
+
+    /* max limits the batch. */
+    n = mcering_walk(&layout, 2, 6, offsets, 3);
+    CHECK(n == 3, "walk max=3 returned %i", n);
+    n = mcering_walk(&layout, 2, 6, offsets, 0);
+    CHECK(n == 0, "walk max=0 returned %i", n);
+
+    /* Empty ring; full ring (head one behind tail). */
+    n = mcering_walk(&layout, 4, 4, offsets, DSP_FRAME_BATCH_MAX);
+    CHECK(n == 0, "walk empty returned %i", n);
+    n = mcering_walk(&layout, 3, 4, offsets, DSP_FRAME_BATCH_MAX);
+    CHECK(n == 7, "walk full returned %i", n);
+    for (i=0; i<n; i++)
+        CHECK(offsets[i] == expect[(4+i)%8], "walk full offset %i", i);
+
+    /* Layout being rewritten: no consistent copy. */
+    ctrl.generation++;
+    CHECK(mcering_load_layout(&layout, &ctrl) != 0, "load odd generation");
+    CHECK(mcering_poll(&layout, &ctrl, offsets, 8) < 0, "poll odd generation");
+    ctrl.generation++;
+
+    /* poll picks up a new layout (e.g. after SET_DATASIZE). */
+    CHECK(mcering_load_layout(&layout, &ctrl) == 0, "reload failed");
+    fake_layout(&ctrl, 4096, 3, sizes);
+    ctrl.tail_index = 4;
+    ctrl.head_index = 1;
+    n = mcering_poll(&layout, &ctrl, offsets, DSP_FRAME_BATCH_MAX);
+    CHECK(layout.frame_size == 4096, "poll did not reload layout");
+    /* 2 + 2 + 2 frames of 4096: indices 4, 5, 0 */
+    CHECK(n == 3 && offsets[0] == 18432 && offsets[1] == 22528 &&
+            offsets[2] == 0, "poll after relayout: n=%i", n);
+
+    /* Through the library: mcedata_poll_batch reads the control page
+     * and issues no ioctl (the data fd is invalid). */
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.data.connected = 1;
+    ctx.data.fd = -1;
+    ctx.data.ctrl = &ctrl;
+    mcering_load_layout(&ctx.data.ring, &ctrl);
+    n = mcedata_poll_batch(&ctx, offsets, 2);
+    CHECK(n == 2 && offsets[0] == 18432 && offsets[1] == 22528,
+            "poll_batch returned %i", n);
+    ctrl.tail_index = ctrl.head_index;
+    n = mcedata_poll_batch(&ctx, offsets, 2);
+    CHECK(n == 0, "poll_batch empty returned %i", n);
+
+    /* A kill request goes to the driver (and fails here). */
+    ctrl.force_exit = 1;
+    n = mcedata_poll_batch(&ctx, offsets, 2);
+    CHECK(n < 0, "poll_batch with force_exit returned %i", n);
+
+    printf("ring: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
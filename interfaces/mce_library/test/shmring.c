@@ -0,0 +1,217 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Publish synthetic frames to a shared-memory ring while readers
+ * follow it: one that keeps up sees every frame, in order; a slow one
+ * sees whole frames only, in order, and counts what it missed.  Then
+ * replace the writer, as a new acquisition would, and check that a
+ * reader moves on to the new ring. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "check.h"
+
+#define FRAME_SIZE 300
+#define DEPTH 16
+
+struct follower {
+    const char *name;
+    int n_frames;       /* stop after the writer's last frame */
+    int delay_us;       /* per frame read */
+    int read;
+    int bad_order;
+    int torn;
+    int bad_time;
+    long long lost;
+};
+
+static void fake_frame(uint32_t *data, int frame_size, int frame)
+{
+    int i;
+    for (i=0; i<frame_size; i++)
+        data[i] = frame * 1000 + i;
+}
+
+static int check_frame(const uint32_t *data, int frame_size, int frame)
+{
+    int i;
+    for (i=0; i<frame_size; i++)
+        if (data[i] != frame * 1000 + i)
+            return 0;
+    return 1;
+}
+
+static void *follow(void *arg)
+{
+    struct follower *f = arg;
+    mcedata_shmring_t *ring = mcedata_shmring_open(f->name);
+    uint32_t data[FRAME_SIZE];
+    mce_shmring_frame_t info;
+    int last = -1;
+
+    if (ring == NULL)
+        return NULL;
+    while (last < f->n_frames - 1) {
+        int n = mcedata_shmring_read(ring, data, FRAME_SIZE, &info);
+        if (n <= 0) {
+            usleep(10);
+            continue;
+        }
+        if (info.frame_index <= last)
+            f->bad_order++;
+        if (!check_frame(data, n, info.frame_index))
+            f->torn++;
+        if (info.frame_time.mono_ns != info.frame_index ||
+                info.seq != info.frame_index)
+            f->bad_time++;
+        last = info.frame_index;
+        f->read++;
+        if (f->delay_us > 0)
+            usleep(f->delay_us);
+    }
+    f->lost = mcedata_shmring_lost(ring);
+    mcedata_shmring_close(ring);
+    return NULL;
+}
+
+static int writer_start(mce_acq_t *acq, mce_context_t *ctx, const char *name,
+        int frame_size)
+{
+    memset(acq, 0, sizeof(*acq));
+    acq->context = ctx;
+    acq->frame_size = frame_size;
+    acq->cards = MCEDATA_RC2;
+    acq->rows = 1;
+    acq->cols = frame_size - MCEDATA_HEADER - 1;
+    acq->storage = mcedata_shmring_create(name, DEPTH);
+    return acq->storage->init(acq);
+}
+
+static void writer_post(mce_acq_t *acq, int k)
+{
+    uint32_t frame[FRAME_SIZE];
+    fake_frame(frame, acq->frame_size, k);
+    acq->frame_time.mono_ns = k;
+    acq->storage->post_frame(acq, k, frame);
+}
+
+static void writer_stop(mce_acq_t *acq)
+{
+    acq->storage->cleanup(acq);
+    mcedata_storage_destroy(acq->storage);
+}
+
+static void run(const char *name, int n_frames, int writer_delay_us)
+{
+    mce_context_t ctx;
+    mce_acq_t acq;
+    struct follower fast, slow;
+    pthread_t t_fast, t_slow;
+    int k;
+
+    memset(&ctx, 0, sizeof(ctx));
+    memset(&fast, 0, sizeof(fast));
+    memset(&slow, 0, sizeof(slow));
+    fast.name = slow.name = name;
+    fast.n_frames = slow.n_frames = n_frames;
+    slow.delay_us = 500;
+
+    CHECK(writer_start(&acq, &ctx, name, FRAME_SIZE) == 0, "init failed");
+    pthread_create(&t_fast, NULL, follow, &fast);
+    pthread_create(&t_slow, NULL, follow, &slow);
+    usleep(20000);      // let them open the ring
+
+    for (k=0; k<n_frames; k++) {
+        writer_post(&acq, k);
+        if (writer_delay_us > 0)
+            usleep(writer_delay_us);
+    }
+    pthread_join(t_fast, NULL);
+    pthread_join(t_slow, NULL);
+    writer_stop(&acq);
+
+    if (writer_delay_us > 0)
+        CHECK(fast.read == n_frames && fast.lost == 0,
+                "fast reader read %i, lost %lli", fast.read, fast.lost);
+    CHECK(fast.read + fast.lost == n_frames, "fast reader read %i + lost %lli",
+            fast.read, fast.lost);
+    CHECK(slow.read + slow.lost == n_frames, "slow reader read %i + lost %lli",
+            slow.read, slow.lost);
+    CHECK(slow.lost > 0, "slow reader was never overrun");
+    CHECK(fast.bad_order == 0 && slow.bad_order == 0, "frames out of order");
+    CHECK(fast.torn == 0 && slow.torn == 0, "torn frames: %i, %i",
+            fast.torn, slow.torn);
+    CHECK(fast.bad_time == 0 && slow.bad_time == 0, "bad frame info");
+
+    printf("frames=%-6i writer delay=%-4ius  slow reader read %i, lost %lli\n",
+            n_frames, writer_delay_us, slow.read, slow.lost);
+}
+
+/* A reader moves on when the writer is replaced, and geometry with it. */
+static void replace(const char *name)
+{
+    mce_context_t ctx;
+    mce_acq_t acq;
+    mcedata_shmring_t *ring;
+    uint32_t data[FRAME_SIZE];
+    mce_shmring_frame_t info;
+    int n;
+
+    memset(&ctx, 0, sizeof(ctx));
+    CHECK(mcedata_shmring_open(name) == NULL, "opened a missing ring");
+
+    writer_start(&acq, &ctx, name, FRAME_SIZE);
+    ring = mcedata_shmring_open(name);
+    CHECK(ring != NULL, "open failed");
+    if (ring == NULL)
+        return;
+    CHECK(mcedata_shmring_channel(ring, 0, 8) == MCEDATA_HEADER &&
+            mcedata_shmring_channel(ring, 0, 0) == -1, "channel lookup");
+    writer_post(&acq, 0);
+    CHECK(mcedata_shmring_read(ring, data, FRAME_SIZE, &info) == FRAME_SIZE,
+            "first ring: no frame");
+    CHECK(mcedata_shmring_read(ring, data, FRAME_SIZE, &info) == 0,
+            "first ring: extra frame");
+    writer_stop(&acq);
+
+    writer_start(&acq, &ctx, name, FRAME_SIZE / 2);
+    writer_post(&acq, 0);
+    writer_post(&acq, 1);
+    CHECK(mcedata_shmring_read(ring, data, FRAME_SIZE, &info) == 0,
+            "no pause at the new ring");
+    CHECK(mcedata_shmring_header(ring)->frame_size == FRAME_SIZE / 2,
+            "new ring not found");
+    writer_post(&acq, 2);
+    n = mcedata_shmring_read(ring, data, FRAME_SIZE, &info);
+    CHECK(n == FRAME_SIZE / 2 && info.seq == 2 &&
+            check_frame(data, n, 2), "new ring: read %i, seq %lli", n,
+            (long long)info.seq);
+    CHECK(mcedata_shmring_read(ring, data, FRAME_SIZE, &info) == 0,
+            "new ring: extra frame");
+    writer_post(&acq, 3);
+    CHECK(mcedata_shmring_read(ring, data, 10, &info) == -1,
+            "short buffer accepted");
+    writer_stop(&acq);
+    mcedata_shmring_close(ring);
+}
+
+int main()
+{
+    char name[64];
+    sprintf(name, "/mce_test_shmring.%i", (int)getpid());
+
+    run(name, 2000, 200);
+    run(name, 20000, 0);
+    replace(name);
+
+    printf("shmring: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,63 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Check the latency histogram binning, percentiles, and summary. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "stats.h"
+#include "check.h"
+
+int main()
+{
+    mce_acq_stats_t stats;
+    char line[MCE_LONG];
+    int i;
+
+    acq_stats_reset(&stats);
+    CHECK(stats.last_checksum_error == -1, "reset");
+    CHECK(acq_stats_percentile(&stats, 0.5) == 0, "empty percentile");
+
+    acq_stats_latency(&stats, 0.3);
+    acq_stats_latency(&stats, 1.0);
+    acq_stats_latency(&stats, 3.9);
+    acq_stats_latency(&stats, 4.0);
+    acq_stats_latency(&stats, 1e9);
+    CHECK(stats.latency[0] == 1, "bin 0: %lli", stats.latency[0]);
+    CHECK(stats.latency[1] == 1, "bin 1: %lli", stats.latency[1]);
+    CHECK(stats.latency[2] == 1, "bin 2: %lli", stats.latency[2]);
+    CHECK(stats.latency[3] == 1, "bin 3: %lli", stats.latency[3]);
+    CHECK(stats.latency[MCEDATA_LATENCY_BINS-1] == 1, "last bin");
+    CHECK(stats.latency_max == 1e9, "max");
+
+    // 95 fast frames and 5 slow ones.
+    acq_stats_reset(&stats);
+    for (i=0; i<95; i++)
+        acq_stats_latency(&stats, 5.);
+    for (i=0; i<5; i++)
+        acq_stats_latency(&stats, 300.);
+    CHECK(acq_stats_percentile(&stats, 0.5) == 8, "p50 %f",
+            acq_stats_percentile(&stats, 0.5));
+    CHECK(acq_stats_percentile(&stats, 0.99) == 512, "p99 %f",
+            acq_stats_percentile(&stats, 0.99));
+
+    acq_stats_ring(&stats, 7);
+    acq_stats_ring(&stats, 3);
+    CHECK(stats.ring_high_water == 7, "high water");
+
+    stats.frames = 100;
+    stats.ring_size = 64;
+    acq_stats_summary(&stats, line, sizeof(line));
+    CHECK(strstr(line, "100 frames") != NULL &&
+            strstr(line, "ring high water 7/64") != NULL &&
+            strchr(line, '\n') == NULL, "summary: %s", line);
+
+    if (failures == 0)
+        printf("stats: ok\n");
+    return failures != 0;
+}
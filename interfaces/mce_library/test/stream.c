@@ -0,0 +1,153 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Run a stream through acq_copy_frame, as copy_frames_mmap does: LAST
+ * at each chunk end re-issues the GO (no cards, so nothing is sent),
+ * frame_counter starts over while sync_number carries on.  Check that
+ * storage sees frame numbers in order - across restarts, frames lost at
+ * a chunk start, and the wrap past INT_MAX - and the stream counts. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "data_thread.h"
+#include "frame_manip.h"
+#include "gapcheck.h"
+#include "check.h"
+
+#define ROWS 2
+#define COLS 8
+#define CHUNK 10
+#define CHUNKS 6
+#define SYNC_STEP 47
+
+struct sink {
+    long long frames;
+    int next;           /* expected frame number */
+    int bad_order;
+    int wraps;
+};
+
+static int sink_post(mce_acq_t *acq, int count, uint32_t *data)
+{
+    struct sink *s = acq->storage->action_data;
+
+    if (s->frames > 0 && count != s->next)
+        s->bad_order++;
+    if (count == 0 && s->frames > 0)
+        s->wraps++;
+    s->next = (count == INT_MAX) ? 0 : count + 1;
+    s->frames++;
+    return 0;
+}
+
+static void fake_frame(uint32_t *data, int frame_size, uint32_t counter,
+        uint32_t sync, int last)
+{
+    int i;
+    uint32_t x = 0;
+
+    memset(data, 0, frame_size * sizeof(*data));
+    data[frame_header_v6.frame_counter & FRAME_OFFSET_MASK] = counter;
+    data[frame_header_v6.sync_number & FRAME_OFFSET_MASK] = sync;
+    if (last)
+        data[frame_header_v6.status_v6 & FRAME_OFFSET_MASK] =
+            FRAME_STATUS_V6_LAST;
+    for (i=0; i<frame_size - 1; i++)
+        x ^= data[i];
+    data[frame_size - 1] = x;
+}
+
+int main()
+{
+    mce_context_t ctx;
+    mce_acq_t acq;
+    mcedata_storage_t storage;
+    gapcheck_t gapcheck;
+    struct sink sink;
+    uint32_t frame[MCEDATA_PACKET_MAX];
+    mce_host_time_t t = { 0, 0 };
+    uint32_t sync = 5000;
+    // Start near the top of an int, so that storage's frame number wraps.
+    long long index = INT_MAX - 25LL, first = index;
+    int lost = 0;
+    int c, k, done, stray = 0;
+
+    memset(&ctx, 0, sizeof(ctx));
+    memset(&acq, 0, sizeof(acq));
+    memset(&storage, 0, sizeof(storage));
+    memset(&sink, 0, sizeof(sink));
+    memset(&gapcheck, 0, sizeof(gapcheck));
+    ctx.flags = MCELIB_QUIET;
+
+    storage.post_frame = sink_post;
+    storage.action_data = &sink;
+
+    acq.context = &ctx;
+    acq.storage = &storage;
+    acq.gapcheck = &gapcheck;
+    acq.cards = MCEDATA_RC1;
+    acq.n_cards = 1;
+    acq.rows = ROWS;
+    acq.cols = COLS;
+    acq.frame_size = ROWS*COLS + MCEDATA_HEADER + MCEDATA_FOOTER;
+    acq.reorder = frame_reorder_create(&acq);
+    // As mcedata_acq_stream sets it up; ret_dat is empty, so the re-GO
+    // goes to no cards.
+    acq.n_frames = CHUNK;
+    acq.stream.chunk = CHUNK;
+
+    for (c=0; c<CHUNKS; c++) {
+        // Lose 3 frames mid-chunk, and the first 2 frames of a chunk.
+        int skip_at = (c == 1) ? 4 : (c == 3) ? 0 : -1;
+        int skip = (c == 1) ? 3 : 2;
+        if (c == CHUNKS - 1)
+            acq.stream.stop = 1;
+        for (k=0; k<CHUNK; k++, sync += SYNC_STEP) {
+            int last = (k == CHUNK - 1);
+            if (k == skip_at) {
+                k += skip - 1;
+                sync += (skip - 1) * SYNC_STEP;
+                lost += skip;
+                continue;
+            }
+            fake_frame(frame, acq.frame_size, k, sync, last);
+            done = acq_copy_frame(&acq, index++, frame, &t);
+            if (last && c == CHUNKS - 1)
+                CHECK(done == EXIT_LAST, "stop: done=%i", done);
+            else if (done != 0)
+                stray++;
+        }
+    }
+
+    CHECK(stray == 0, "%i frames ended the stream early", stray);
+    CHECK(sink.frames == index - first, "stored %lli of %lli frames",
+            sink.frames, index - first);
+    CHECK(sink.bad_order == 0, "%i frame numbers out of order",
+            sink.bad_order);
+    CHECK(sink.wraps == 1, "frame number wrapped %i times", sink.wraps);
+    CHECK(acq.stream.frames == index - first, "stream.frames=%lli",
+            acq.stream.frames);
+    CHECK(acq.stream.frames == CHUNKS*CHUNK - lost, "stream.frames=%lli, "
+            "expected %i", acq.stream.frames, CHUNKS*CHUNK - lost);
+    CHECK(acq.stream.restarts == CHUNKS - 1, "stream.restarts=%i",
+            acq.stream.restarts);
+    CHECK(acq.stream.gaps == lost, "stream.gaps=%lli, expected %i",
+            acq.stream.gaps, lost);
+    CHECK(acq.stream.gap_events == 2, "stream.gap_events=%i",
+            acq.stream.gap_events);
+    CHECK(acq.stream.chunk_frames == CHUNK, "stream.chunk_frames=%i",
+            acq.stream.chunk_frames);
+    CHECK(acq.stats.checksum_errors == 0, "%i checksum errors",
+            acq.stats.checksum_errors);
+
+    frame_reorder_destroy(acq.reorder);
+    printf("stream: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
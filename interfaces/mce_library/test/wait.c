@@ -0,0 +1,137 @@
+/* -*- mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*-
+ *      vim: sw=4 ts=4 et tw=80
+ */
+
+/* Exercise mcedata_wait_frame timeout and wakeup logic, using an
+ * eventfd in place of the data device. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/eventfd.h>
+
+#include <mce_library.h>
+#include "context.h"
+#include "check.h"
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+/* Fake data source: "deliver a frame" after a delay. */
+struct source {
+    int fd;
+    int delay_ms;
+    double t_sent;
+};
+
+static void *source_thread(void *arg)
+{
+    struct source *src = arg;
+    uint64_t one = 1;
+    usleep(src->delay_ms * 1000);
+    src->t_sent = now_ms();
+    if (write(src->fd, &one, sizeof(one)) != sizeof(one))
+        perror("write");
+    return NULL;
+}
+
+static void drain(int fd)
+{
+    uint64_t x;
+    if (read(fd, &x, sizeof(x)) != sizeof(x))
+        perror("read");
+}
+
+int main()
+{
+    mce_context_t ctx;
+    struct source src;
+    pthread_t thread;
+    double t0, dt;
+    int err;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.data.fd = eventfd(0, 0);
+    ctx.data.connected = 1;
+    ctx.data.can_poll = 1;
+    if (ctx.data.fd < 0) {
+        perror("eventfd");
+        return 1;
+    }
+
+    /* Nothing arrives: times out after timeout_ms. */
+    t0 = now_ms();
+    err = mcedata_wait_frame(&ctx, 50);
+    dt = now_ms() - t0;
+    CHECK(err == 0, "timeout returned %i", err);
+    CHECK(dt >= 49. && dt < 250., "timeout took %.1f ms", dt);
+
+    /* Zero timeout does not block. */
+    t0 = now_ms();
+    err = mcedata_wait_frame(&ctx, 0);
+    dt = now_ms() - t0;
+    CHECK(err == 0, "zero timeout returned %i", err);
+    CHECK(dt < 20., "zero timeout took %.1f ms", dt);
+
+    /* Frame already waiting: immediate return. */
+    src.fd = ctx.data.fd;
+    src.delay_ms = 0;
+    source_thread(&src);
+    t0 = now_ms();
+    err = mcedata_wait_frame(&ctx, 1000);
+    dt = now_ms() - t0;
+    CHECK(err == 1, "ready returned %i", err);
+    CHECK(dt < 20., "ready took %.1f ms", dt);
+    drain(ctx.data.fd);
+
+    /* Frame arrives while waiting: wake promptly, with or without a
+     * timeout. */
+    src.delay_ms = 30;
+    pthread_create(&thread, NULL, source_thread, &src);
+    err = mcedata_wait_frame(&ctx, 5000);
+    dt = now_ms() - src.t_sent;
+    pthread_join(thread, NULL);
+    CHECK(err == 1, "wakeup returned %i", err);
+    CHECK(dt < 20., "wakeup latency %.1f ms", dt);
+    drain(ctx.data.fd);
+
+    pthread_create(&thread, NULL, source_thread, &src);
+    err = mcedata_wait_frame(&ctx, -1);
+    dt = now_ms() - src.t_sent;
+    pthread_join(thread, NULL);
+    CHECK(err == 1, "untimed wakeup returned %i", err);
+    CHECK(dt < 20., "untimed wakeup latency %.1f ms", dt);
+    drain(ctx.data.fd);
+
+    /* Drivers without poll support: short sleep, then "try again". */
+    ctx.data.can_poll = 0;
+    t0 = now_ms();
+    err = mcedata_wait_frame(&ctx, 1000);
+    dt = now_ms() - t0;
+    CHECK(err == 1, "fallback returned %i", err);
+    CHECK(dt < 100., "fallback took %.1f ms", dt);
+    err = mcedata_wait_frame(&ctx, 0);
+    CHECK(err == 0, "fallback zero timeout returned %i", err);
+
+    /* Bad descriptor is an error, not a timeout. */
+    ctx.data.can_poll = 1;
+    close(ctx.data.fd);
+    err = mcedata_wait_frame(&ctx, 10);
+    CHECK(err < 0, "closed fd returned %i", err);
+
+    /* Not connected. */
+    ctx.data.connected = 0;
+    err = mcedata_wait_frame(&ctx, 10);
+    CHECK(err == -MCE_ERR_NEED_DATA, "disconnected returned %i", err);
+
+    printf("wait: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
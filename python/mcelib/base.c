@@ -23,6 +23,7 @@ typedef struct {
     PyObject_HEAD
     void *p;
     mce_param_t param;
+    mce_acq_stats_t stats;      /* for a context: its latest read_data */
 } ptrobj;
 
 static PyTypeObject
@@ -204,6 +205,7 @@ static PyObject *mce_connect(PyObject *self, PyObject *args, PyObject *kwargs)
 
     ptrobj* p = PyObject_New(ptrobj, &ptrobjType);
     p->p = mce;
+    memset(&p->stats, 0, sizeof(p->stats));
     return (PyObject *) p;
 }
 
@@ -363,15 +365,17 @@ static int frame_callback(unsigned long user_data, int size, u32 *data)
 
 static PyObject *mce_read_data(PyObject *self, PyObject *args)
 {
+    ptrobj *context;
     mce_context_t *mce;
     int cards, count;
     PyArrayObject *array;
 
-    if (!PyArg_ParseTuple(args, "O&iiO!",
-                          ptrobj_decode, &mce,
+    if (!PyArg_ParseTuple(args, "O!iiO!",
+                          &ptrobjType, &context,
                           &cards, &count,
                           &PyArray_Type, &array))
         return NULL;
+    mce = context->p;
 
     // Note how this totally doesn't do any array size checking.
     frame_handler_t f;
@@ -386,20 +390,181 @@ static PyObject *mce_read_data(PyObject *self, PyObject *args)
     if (err != 0)
         goto fail;
     err = mcedata_acq_go(&acq, count);
+    mcedata_acq_stats(&acq, &context->stats);
+    if (err != 0)
+        goto fail;
+    err = mcedata_acq_destroy(&acq);
+    if (err != 0)
+        goto fail;
+
+    Py_RETURN_TRUE;
+
+fail:
+    Py_RETURN_FALSE;
+}
+
+
+
+/*
+  mce_read_channels(context, cards, count, channels, dest)
+
+  Reads count frames of data from cards, but keeps only the channels
+  listed in channels, an (n, 2) int32 numpy array of MCE (row, column)
+  coordinates.  Stores them in dest, an int32 numpy array of (at
+  least) count*n elements; channels that are not in the frames read
+  as 0.  Frames are not reordered; see mce/frame_view.h.
+
+  Returns True on success, False on failure.
+*/
+
+typedef struct {
+    int index;
+    u32 *buf;
+    int n_channels;
+    const int *channels;        /* (row, col) pairs */
+    int *offsets;               /* into the frame, or -1 */
+} channel_handler_t;
+
+static int channel_callback(unsigned long user_data,
+                            const mce_frame_view_t *view)
+{
+    channel_handler_t *f = (channel_handler_t*)user_data;
+    u32 *dest = f->buf + f->index * f->n_channels;
+    int i;
+
+    /* The geometry is the same for every frame, so look up once. */
+    if (f->index == 0) {
+        for (i=0; i<f->n_channels; i++) {
+            const u32 *p = mce_frame_view_find(view, f->channels[2*i],
+                                               f->channels[2*i+1]);
+            f->offsets[i] = (p == NULL) ? -1 : p - view->data;
+        }
+    }
+    for (i=0; i<f->n_channels; i++)
+        dest[i] = (f->offsets[i] < 0) ? 0 : view->data[f->offsets[i]];
+    f->index++;
+    return 0;
+}
+
+static PyObject *mce_read_channels(PyObject *self, PyObject *args)
+{
+    ptrobj *context;
+    mce_context_t *mce;
+    int cards, count;
+    PyArrayObject *channels, *array;
+
+    if (!PyArg_ParseTuple(args, "O!iiO!O!",
+                          &ptrobjType, &context,
+                          &cards, &count,
+                          &PyArray_Type, &channels,
+                          &PyArray_Type, &array))
+        return NULL;
+    mce = context->p;
+
+    if (channels->nd != 2 || channels->dimensions[1] != 2 ||
+        channels->descr->type_num != NPY_INT32 ||
+        !PyArray_ISCARRAY(channels) ||
+        !PyArray_ISCARRAY(array) ||
+        PyArray_NBYTES(array) <
+            (npy_intp)count * channels->dimensions[0] * sizeof(u32)) {
+        PyErr_SetString(PyExc_ValueError,
+                        "channels must be (n,2) int32; dest count*n int32.");
+        return NULL;
+    }
+
+    channel_handler_t f;
+    f.buf = (void*)array->data;
+    f.index = 0;
+    f.n_channels = channels->dimensions[0];
+    f.channels = (const int*)channels->data;
+    f.offsets = malloc((f.n_channels + 1) * sizeof(int));
+    if (f.offsets == NULL)
+        return PyErr_NoMemory();
+    mcedata_storage_t *ramb = mcedata_rambuff_view_create(channel_callback,
+                                                          (unsigned long)&f);
+
+    int err = 0;
+    mce_acq_t acq;
+    err = mcedata_acq_create(&acq, mce, 0, cards, -1, ramb);
+    if (err != 0)
+        goto fail;
+    err = mcedata_acq_go(&acq, count);
+    mcedata_acq_stats(&acq, &context->stats);
     if (err != 0)
         goto fail;
     err = mcedata_acq_destroy(&acq);
     if (err != 0)
         goto fail;
 
+    free(f.offsets);
     Py_RETURN_TRUE;
 
 fail:
+    free(f.offsets);
     Py_RETURN_FALSE;
 }
 
 
 
+/*
+  mce_acq_stats(context)
+
+  Returns a dict of acquisition statistics (see mce_acq_stats_t in
+  mce/acq.h) for the most recent read_data or read_channels call on
+  context.  Times are in microseconds; "latency" is the histogram of
+  per-frame handling time, in power-of-two bins, and "summary" is the
+  line that was sent to maslog.  "sync_time" has an entry for each of
+  the first MCEDATA_STATS_SYNCS syncs; "n_syncs" may be larger, and
+  the rest are added up in "sync_time_rest".
+*/
+
+static PyObject *mce_acq_stats(PyObject *self, PyObject *args)
+{
+    ptrobj *context;
+    const mce_acq_stats_t *s;
+    PyObject *latency, *sync_time, *d;
+    char summary[MCE_LONG];
+    int i, n_timed;
+
+    if (!PyArg_ParseTuple(args, "O!", &ptrobjType, &context))
+        return NULL;
+    s = &context->stats;
+
+    latency = PyList_New(MCEDATA_LATENCY_BINS);
+    for (i=0; i<MCEDATA_LATENCY_BINS; i++)
+        PyList_SetItem(latency, i, PyLong_FromLongLong(s->latency[i]));
+    n_timed = (s->n_syncs < MCEDATA_STATS_SYNCS) ? s->n_syncs :
+        MCEDATA_STATS_SYNCS;
+    sync_time = PyList_New(n_timed);
+    for (i=0; i<n_timed; i++)
+        PyList_SetItem(sync_time, i, PyFloat_FromDouble(s->sync_time[i]));
+    mcedata_acq_stats_summary(s, summary, sizeof(summary));
+
+    d = Py_BuildValue("{s:L,s:i,s:i,s:L,s:i,s:i,s:i,s:L,s:L,s:i,s:i,"
+                      "s:N,s:d,s:d,s:i,s:N,s:d,s:s}",
+                      "frames", s->frames,
+                      "checksum_errors", s->checksum_errors,
+                      "last_checksum_error", s->last_checksum_error,
+                      "gaps", s->gaps,
+                      "gap_events", s->gap_events,
+                      "repeats", s->repeats,
+                      "sync_events", s->sync_events,
+                      "polls", s->polls,
+                      "empty_polls", s->empty_polls,
+                      "ring_size", s->ring_size,
+                      "ring_high_water", s->ring_high_water,
+                      "latency", latency,
+                      "latency_max", s->latency_max,
+                      "storage_time", s->storage_time,
+                      "n_syncs", s->n_syncs,
+                      "sync_time", sync_time,
+                      "sync_time_rest", s->sync_time_rest,
+                      "summary", summary);
+    return d;
+}
+
+
+
 /*
  * Get / set / reset the driver data lock.
  *
@@ -443,6 +608,267 @@ static PyObject *lock_op(PyObject *self, PyObject *args)
 }
 
 
+/*
+  Compressed frame archives (see mce/archive.h).
+
+  archive_open returns a handle on the archive, or None; archive_close
+  releases it.  archive_info returns a dict of the frame size, frame
+  count and readout geometry.  archive_read and archive_read_channels
+  fill a C-contiguous int32 array with count rows of whole frames or of
+  the listed channels (offsets in the frame; -1 reads as 0), and return
+  the number of frames read, or -1 on error.
+*/
+
+static int archive_decode(PyObject *o, mcedata_archive_t **dest)
+{
+    if (!PyObject_TypeCheck(o, &ptrobjType) || ((ptrobj*)o)->p == NULL) {
+        PyErr_SetString(PyExc_ValueError, "Not an open archive.");
+        return 0;
+    }
+    *dest = ((ptrobj*)o)->p;
+    return 1;
+}
+
+static PyObject *archive_open(PyObject *self, PyObject *args)
+{
+    const char *filename;
+    mcedata_archive_t *a;
+
+    if (!PyArg_ParseTuple(args, "s", &filename))
+        return NULL;
+    a = mcedata_archive_open(filename);
+    if (a == NULL)
+        Py_RETURN_NONE;
+    return (PyObject*)ptrobj_new(a);
+}
+
+static PyObject *archive_close(PyObject *self, PyObject *args)
+{
+    ptrobj *po;
+
+    if (!PyArg_ParseTuple(args, "O!", &ptrobjType, &po))
+        return NULL;
+    mcedata_archive_close(po->p);
+    po->p = NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject *archive_info(PyObject *self, PyObject *args)
+{
+    mcedata_archive_t *a;
+    const mce_archive_header_t *h;
+    PyObject *row0, *col0;
+    int i;
+
+    if (!PyArg_ParseTuple(args, "O&", archive_decode, &a))
+        return NULL;
+    h = mcedata_archive_header(a);
+    row0 = PyList_New(MCEDATA_CARDS);
+    col0 = PyList_New(MCEDATA_CARDS);
+    for (i=0; i<MCEDATA_CARDS; i++) {
+        PyList_SetItem(row0, i, PyInt_FromLong(h->row0[i]));
+        PyList_SetItem(col0, i, PyInt_FromLong(h->col0[i]));
+    }
+    return Py_BuildValue("{s:i,s:i,s:l,s:i,s:i,s:i,s:i,s:N,s:N}",
+                         "frame_size", h->frame_size,
+                         "header_size", h->header_size,
+                         "frames", mcedata_archive_frame_count(a),
+                         "block_frames", h->block_frames,
+                         "cards", h->cards,
+                         "rows", h->rows,
+                         "cols", h->cols,
+                         "row0", row0,
+                         "col0", col0);
+}
+
+static PyObject *archive_channel(PyObject *self, PyObject *args)
+{
+    mcedata_archive_t *a;
+    int row, col;
+
+    if (!PyArg_ParseTuple(args, "O&ii", archive_decode, &a, &row, &col))
+        return NULL;
+    return PyInt_FromLong(mcedata_archive_channel(a, row, col));
+}
+
+static PyObject *archive_read(PyObject *self, PyObject *args)
+{
+    mcedata_archive_t *a;
+    long first, count;
+    PyArrayObject *array;
+
+    if (!PyArg_ParseTuple(args, "O&llO!",
+                          archive_decode, &a,
+                          &first, &count,
+                          &PyArray_Type, &array))
+        return NULL;
+
+    if (!PyArray_ISCARRAY(array) || count < 0 ||
+        PyArray_NBYTES(array) < (npy_intp)count *
+            mcedata_archive_frame_size(a) * sizeof(u32)) {
+        PyErr_SetString(PyExc_ValueError,
+                        "dest must be count*frame_size int32.");
+        return NULL;
+    }
+    return PyInt_FromLong(mcedata_archive_read(a, first, count,
+                                               (u32*)array->data));
+}
+
+static PyObject *archive_read_channels(PyObject *self, PyObject *args)
+{
+    mcedata_archive_t *a;
+    long first, count;
+    PyArrayObject *channels, *array;
+
+    if (!PyArg_ParseTuple(args, "O&llO!O!",
+                          archive_decode, &a,
+                          &first, &count,
+                          &PyArray_Type, &channels,
+                          &PyArray_Type, &array))
+        return NULL;
+
+    if (channels->nd != 1 || channels->descr->type_num != NPY_INT32 ||
+        !PyArray_ISCARRAY(channels) ||
+        !PyArray_ISCARRAY(array) || count < 0 ||
+        PyArray_NBYTES(array) <
+            (npy_intp)count * channels->dimensions[0] * sizeof(u32)) {
+        PyErr_SetString(PyExc_ValueError,
+                        "channels must be (n,) int32; dest count*n int32.");
+        return NULL;
+    }
+    return PyInt_FromLong(mcedata_archive_read_channels(a, first, count,
+                              (const int*)channels->data,
+                              channels->dimensions[0], (u32*)array->data));
+}
+
+
+/*
+  Shared-memory frame rings (see mce/shmring.h).
+
+  shm_open returns a handle on the ring, following it from its newest
+  frame, or None if there is no such ring; shm_close releases it.
+  shm_info returns a dict of the frame size, geometry, frames published
+  and frames missed by this reader.  shm_read copies the frames that
+  have arrived since the last read (at most n, and stopping if the
+  frame size changes) into data, C-contiguous int32 of shape
+  (n, frame_size), and the stream position, frame index and arrival
+  times (mono_ns, real_ns) of each into info, int64 of shape (n, 4).
+  It returns the number of frames copied.
+*/
+
+static int shm_decode(PyObject *o, mcedata_shmring_t **dest)
+{
+    if (!PyObject_TypeCheck(o, &ptrobjType) || ((ptrobj*)o)->p == NULL) {
+        PyErr_SetString(PyExc_ValueError, "Not an open ring.");
+        return 0;
+    }
+    *dest = ((ptrobj*)o)->p;
+    return 1;
+}
+
+static PyObject *shm_open_ring(PyObject *self, PyObject *args)
+{
+    const char *name;
+    mcedata_shmring_t *r;
+
+    if (!PyArg_ParseTuple(args, "s", &name))
+        return NULL;
+    r = mcedata_shmring_open(name);
+    if (r == NULL)
+        Py_RETURN_NONE;
+    return (PyObject*)ptrobj_new(r);
+}
+
+static PyObject *shm_close_ring(PyObject *self, PyObject *args)
+{
+    ptrobj *po;
+
+    if (!PyArg_ParseTuple(args, "O!", &ptrobjType, &po))
+        return NULL;
+    mcedata_shmring_close(po->p);
+    po->p = NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject *shm_info(PyObject *self, PyObject *args)
+{
+    mcedata_shmring_t *r;
+    const mce_shmring_header_t *h;
+    PyObject *row0, *col0;
+    int i;
+
+    if (!PyArg_ParseTuple(args, "O&", shm_decode, &r))
+        return NULL;
+    h = mcedata_shmring_header(r);
+    row0 = PyList_New(MCEDATA_CARDS);
+    col0 = PyList_New(MCEDATA_CARDS);
+    for (i=0; i<MCEDATA_CARDS; i++) {
+        PyList_SetItem(row0, i, PyInt_FromLong(h->row0[i]));
+        PyList_SetItem(col0, i, PyInt_FromLong(h->col0[i]));
+    }
+    return Py_BuildValue("{s:i,s:i,s:i,s:K,s:L,s:i,s:i,s:i,s:N,s:N}",
+                         "frame_size", h->frame_size,
+                         "header_size", h->header_size,
+                         "depth", h->depth,
+                         "head", (unsigned long long)h->head,
+                         "lost", mcedata_shmring_lost(r),
+                         "cards", h->cards,
+                         "rows", h->rows,
+                         "cols", h->cols,
+                         "row0", row0,
+                         "col0", col0);
+}
+
+static PyObject *shm_channel(PyObject *self, PyObject *args)
+{
+    mcedata_shmring_t *r;
+    int row, col;
+
+    if (!PyArg_ParseTuple(args, "O&ii", shm_decode, &r, &row, &col))
+        return NULL;
+    return PyInt_FromLong(mcedata_shmring_channel(r, row, col));
+}
+
+static PyObject *shm_read(PyObject *self, PyObject *args)
+{
+    mcedata_shmring_t *r;
+    PyArrayObject *array, *info;
+    mce_shmring_frame_t frame;
+    npy_intp n, width, i;
+
+    if (!PyArg_ParseTuple(args, "O&O!O!",
+                          shm_decode, &r,
+                          &PyArray_Type, &array,
+                          &PyArray_Type, &info))
+        return NULL;
+
+    if (array->nd != 2 || array->descr->type_num != NPY_INT32 ||
+        !PyArray_ISCARRAY(array) ||
+        info->nd != 2 || info->descr->type_num != NPY_INT64 ||
+        !PyArray_ISCARRAY(info) || info->dimensions[1] != 4 ||
+        info->dimensions[0] < array->dimensions[0]) {
+        PyErr_SetString(PyExc_ValueError,
+                        "data must be (n, frame_size) int32; info (n, 4) int64.");
+        return NULL;
+    }
+    n = array->dimensions[0];
+    width = array->dimensions[1];
+
+    for (i=0; i<n; i++) {
+        int64_t *out = (int64_t*)info->data + 4*i;
+        if (mcedata_shmring_header(r)->frame_size != width ||
+            mcedata_shmring_read(r, (u32*)array->data + i*width, width,
+                                 &frame) <= 0)
+            break;
+        out[0] = frame.seq;
+        out[1] = frame.frame_index;
+        out[2] = frame.frame_time.mono_ns;
+        out[3] = frame.frame_time.real_ns;
+    }
+    return PyInt_FromLong(i);
+}
+
+
 static PyMethodDef mceMethods[] = {
     {"trace",  trace, METH_VARARGS,
      "Return the trace of a matrix."},
@@ -456,8 +882,34 @@ static PyMethodDef mceMethods[] = {
      "Read."},
     {"read_data",  mce_read_data, METH_VARARGS,
      "Read data."},
+    {"read_channels",  mce_read_channels, METH_VARARGS,
+     "Read selected channels."},
+    {"acq_stats",  mce_acq_stats, METH_VARARGS,
+     "Statistics of the last data read on a context."},
     {"lock_op", lock_op, METH_VARARGS,
      "Driver data lock operations."},
+    {"archive_open", archive_open, METH_VARARGS,
+     "Open a frame archive."},
+    {"archive_close", archive_close, METH_VARARGS,
+     "Close a frame archive."},
+    {"archive_info", archive_info, METH_VARARGS,
+     "Frame size, frame count and geometry of an archive."},
+    {"archive_channel", archive_channel, METH_VARARGS,
+     "Offset in the frame of an MCE row and column."},
+    {"archive_read", archive_read, METH_VARARGS,
+     "Read whole frames from an archive."},
+    {"archive_read_channels", archive_read_channels, METH_VARARGS,
+     "Read selected channels from an archive."},
+    {"shm_open", shm_open_ring, METH_VARARGS,
+     "Open a shared-memory frame ring."},
+    {"shm_close", shm_close_ring, METH_VARARGS,
+     "Close a shared-memory frame ring."},
+    {"shm_info", shm_info, METH_VARARGS,
+     "Frame size, geometry and progress of a shared-memory ring."},
+    {"shm_channel", shm_channel, METH_VARARGS,
+     "Offset in the frame of an MCE row and column."},
+    {"shm_read", shm_read, METH_VARARGS,
+     "Read the newly arrived frames from a shared-memory ring."},
     {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
@@ -1,5 +1,7 @@
 import mcelib
 from basic import BasicMCE
+from archive import MCEArchive
+from shmring import MCEShmRing
 import compat
 import const
 
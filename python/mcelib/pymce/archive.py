@@ -0,0 +1,84 @@
+import mcelib
+
+import numpy
+
+class MCEArchive:
+    """
+    Reader for compressed frame archives, as written by
+    ACQ_CONFIG_ARCHIVE in mce_cmd.  The archive is stored channel by
+    channel, so reading a few channels over a long span is cheap.
+
+    Attributes: frame_size, header_size, n_frames, and the readout
+    geometry: cards (bit mask), rows, cols, row0 and col0 (by RC).
+    """
+    def __init__(self, filename):
+        self.archive = mcelib.archive_open(filename)
+        if self.archive == None:
+            raise IOError, "Could not open archive %s" % filename
+        info = mcelib.archive_info(self.archive)
+        self.frame_size = info['frame_size']
+        self.header_size = info['header_size']
+        self.n_frames = info['frames']
+        self.cards = info['cards']
+        self.rows = info['rows']
+        self.cols = info['cols']
+        self.row0 = info['row0']
+        self.col0 = info['col0']
+
+    def close(self):
+        if self.archive != None:
+            mcelib.archive_close(self.archive)
+            self.archive = None
+
+    def __len__(self):
+        return self.n_frames
+
+    def _count(self, first, count):
+        if count == None or first + count > self.n_frames:
+            count = self.n_frames - first
+        return max(count, 0)
+
+    def channel(self, row, col):
+        """
+        Offset in the frame of MCE (row, column), or -1 if that channel
+        was not read out.
+        """
+        return mcelib.archive_channel(self.archive, row, col)
+
+    def read_frames(self, first=0, count=None):
+        """
+        Read count whole frames (default: to the end) from frame
+        first.  Returns an int32 array of shape (count, frame_size).
+        """
+        count = self._count(first, count)
+        data = numpy.empty((count, self.frame_size), 'int32')
+        n = mcelib.archive_read(self.archive, first, count, data)
+        if n < 0:
+            return None
+        return data[:n]
+
+    def read_words(self, words, first=0, count=None):
+        """
+        Read count frames (default: to the end) from frame first,
+        keeping only the listed words (offsets in the frame; header
+        words included).  Returns an int32 array of shape (count,
+        len(words)).  Only those words are decoded.
+        """
+        count = self._count(first, count)
+        words = numpy.array(words, 'int32').reshape(-1)
+        data = numpy.empty((count, len(words)), 'int32')
+        n = mcelib.archive_read_channels(self.archive, first, count,
+                                         words, data)
+        if n < 0:
+            return None
+        return data[:n]
+
+    def read_channels(self, channels, first=0, count=None):
+        """
+        Like read_words, for a sequence of MCE (row, column) pairs, as
+        in BasicMCE.read_channels.  Channels not in the readout read
+        as 0.
+        """
+        channels = numpy.array(channels, 'int32').reshape(-1, 2)
+        words = [self.channel(r, c) for r, c in channels]
+        return self.read_words(words, first, count)
@@ -101,6 +101,25 @@ class BasicMCE:
             return None
         return data
 
+    def read_channels(self, count, channels, cards=None):
+        """
+        Read count frames, keeping only the listed channels, a
+        sequence of MCE (row, column) pairs.  Returns an int32 array of
+        shape (count, len(channels)).  Channels not in the readout
+        read as 0.
+        """
+        cards = self.card_list(cards)
+        if cards == None:
+            raise ValueError, "Invalid card list %s" % str(cards)
+        card_code = sum([1<<(c-1) for c in cards])
+        channels = numpy.array(channels, 'int32').reshape(-1, 2)
+        data = numpy.empty((count, len(channels)), 'int32')
+        ok = mcelib.read_channels(self.context, card_code, count,
+                                  channels, data)
+        if not ok:
+            return None
+        return data
+
     def read_data(self, count=1, cards=None, fields=None, extract=False,
                   row_col=False, raw_frames=False, unfilter=False):
         d = MCEBinaryData(mce=self)
@@ -143,6 +162,14 @@ class BasicMCE:
             d.data = dict(zip(fields, d.extract(fields, unfilter=unfilter)))
         return d
 
+    def acq_stats(self):
+        """
+        Returns a dict of statistics (frames, checksum_errors, gaps,
+        empty_polls, ring_high_water, latency histogram, ...) for the
+        most recent read_data or read_channels on this MCE.
+        """
+        return mcelib.acq_stats(self.context)
+
     def lock_query(self):
         return mcelib.lock_op(self.context, 0)
     def lock_down(self):
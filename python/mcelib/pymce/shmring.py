@@ -0,0 +1,73 @@
+import mcelib
+
+import numpy
+import time
+
+class MCEShmRing:
+    """
+    Follower of a shared-memory frame ring, as published by
+    ACQ_CONFIG_SHM in mce_cmd.  Any number of processes can follow the
+    same ring; none of them needs the driver, or holds up the
+    acquisition.  A follower that falls too far behind misses frames;
+    they are counted in lost().
+
+    Attributes: frame_size, header_size, depth, and the readout
+    geometry: cards (bit mask), rows, cols, row0 and col0 (by RC).
+    These are updated when a new acquisition replaces the ring.
+    """
+    def __init__(self, name='/mce_frames'):
+        self.ring = mcelib.shm_open(name)
+        if self.ring == None:
+            raise IOError, "No shared memory ring %s" % name
+        self._update()
+
+    def _update(self):
+        info = mcelib.shm_info(self.ring)
+        self.frame_size = info['frame_size']
+        self.header_size = info['header_size']
+        self.depth = info['depth']
+        self.cards = info['cards']
+        self.rows = info['rows']
+        self.cols = info['cols']
+        self.row0 = info['row0']
+        self.col0 = info['col0']
+        return info
+
+    def close(self):
+        if self.ring != None:
+            mcelib.shm_close(self.ring)
+            self.ring = None
+
+    def lost(self):
+        """
+        Frames missed so far by falling more than depth frames behind.
+        """
+        return mcelib.shm_info(self.ring)['lost']
+
+    def channel(self, row, col):
+        """
+        Offset in the frame of MCE (row, column), or -1 if that channel
+        is not read out.
+        """
+        return mcelib.shm_channel(self.ring, row, col)
+
+    def read(self, max_frames=None, timeout=0., poll=0.01):
+        """
+        Read the frames that arrived since the last read (at most
+        max_frames; default, the ring depth), waiting up to timeout
+        seconds for the first.  Returns (data, info): an int32 array of
+        shape (n, frame_size), and an int64 array of shape (n, 4) with
+        the stream position, frame index and arrival time (monotonic
+        and real, in ns) of each frame.
+        """
+        if max_frames == None:
+            max_frames = self.depth
+        t_end = time.time() + timeout
+        while True:
+            self._update()
+            data = numpy.empty((max_frames, self.frame_size), 'int32')
+            info = numpy.empty((max_frames, 4), 'int64')
+            n = mcelib.shm_read(self.ring, data, info)
+            if n > 0 or time.time() >= t_end:
+                return data[:n], info[:n]
+            time.sleep(poll)